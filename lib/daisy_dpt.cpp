@@ -3,11 +3,13 @@
 #include "dev/DAC7554.h"
 
 #include "util/hal_map.h"
+#include "util/scopedirqblocker.h"
 #include "sys/system.h"
 #include "per/gpio.h"
 #include "per/tim.h"
 
 #include <vector>
+#include <atomic>
 
 #define DSY_MIN(in, mn) (in < mn ? in : mn)
 #define DSY_MAX(in, mx) (in > mx ? in : mx)
@@ -132,9 +134,22 @@ namespace dpt
     const dsy_gpio_pin DPT::D9  = kPinMap[3][8];
     const dsy_gpio_pin DPT::D10 = kPinMap[3][9];
 
+    /** CV calibration block, last 64kB block of the 8MB QSPI */
+    static constexpr uint32_t kCvCalibrationQspiOffset = 0x7F0000;
+
     /** outside of class static buffer(s) for DMA access */
     uint16_t DMA_BUFFER_MEM_SECTION dsy_patch_sm_dac_buffer[2][48];
 
+    /** One batch of running status encoded MIDI output */
+    static constexpr size_t kMidiTxBufferSize = 192;
+    uint8_t DMA_BUFFER_MEM_SECTION dsy_dpt_midi_tx_buffer[kMidiTxBufferSize];
+
+    /** Circular DMA buffer for MIDI input, the UART hands it over on idle line */
+    static constexpr size_t kMidiRxBufferSize = 256;
+    uint8_t DMA_BUFFER_MEM_SECTION dsy_dpt_midi_rx_buffer[kMidiRxBufferSize];
+
+    TraceBuffer<DPT_TRACE_SIZE> dsy_dpt_trace;
+
     class DPT::Impl
     {
       public:
@@ -146,8 +161,186 @@ namespace dpt
             dac_output_[1]          = 0;
             internal_dac_buffer_[0] = dsy_patch_sm_dac_buffer[0];
             internal_dac_buffer_[1] = dsy_patch_sm_dac_buffer[1];
+            hw_                     = nullptr;
+            dac_cb_                 = nullptr;
+            trace_stop_on_xrun_     = false;
+            audio_cb_               = nullptr;
+            interleaving_audio_cb_  = nullptr;
+            dac_samplerate_         = 48000.f;
+            qspi_ready_             = false;
+            midi_rx_running_        = false;
+            midi_tx_busy_           = false;
+            usb_midi_running_       = false;
+            clock_div_[0]           = 0;
+            clock_div_[1]           = 0;
+            clock_width_            = 0.5f;
+            clock_task_             = -1;
+            task_tim_running_[0]    = false;
+            task_tim_running_[1]    = false;
+            gate_edges_.Init();
+            gate_in_state_[0]       = false;
+            gate_in_state_[1]       = false;
+            gate_capture_running_   = false;
+            cv_cal_.SetDefaults();
+            for(int i = 0; i < CV_CAL_LAST; i++)
+                cv_cal_live_[i] = -1;
+            for(int i = 0; i < 2; i++)
+            {
+                cv_mode_[i]          = CvOutMode::HOLD;
+                cv_level_[i]         = 0.f;
+                cv_slew_coef_[i]     = 1.f;
+                cv_stream_write_[i]  = 0;
+                cv_stream_read_[i]   = 0;
+                cv_stream_primed_[i] = false;
+            }
         }
 
+        /** Wrap the app's audio callback, so the board can run its own 
+         *  per-block work (control scheduler) first */
+        static void AudioCallbackWrapper(AudioHandle::InputBuffer  in,
+                                         AudioHandle::OutputBuffer out,
+                                         size_t                    size);
+
+        static void
+        InterleavingAudioCallbackWrapper(AudioHandle::InterleavingInputBuffer  in,
+                                         AudioHandle::InterleavingOutputBuffer out,
+                                         size_t size);
+
+        /** Ends the audio_load_ measurement, and marks overruns in the trace */
+        inline void EndAudioLoad()
+        {
+            uint32_t xruns = audio_load_.Xruns();
+            audio_load_.End();
+            if(audio_load_.Xruns() == xruns)
+                return;
+            DPT_TRACE_MARK(TRACE_XRUN, 0);
+            if(trace_stop_on_xrun_)
+                dsy_dpt_trace.Stop();
+        }
+
+        DPT                                   *hw_;
+        AudioHandle::AudioCallback             audio_cb_;
+        AudioHandle::InterleavingAudioCallback interleaving_audio_cb_;
+
+        void StartMidiRx();
+
+        /** UART receive (DMA idle line) interrupt, parses and stamps the bytes */
+        static void MidiRxCallback(uint8_t            *data,
+                                   size_t              size,
+                                   void               *context,
+                                   UartHandler::Result result);
+
+        static MidiEvent ToMidiEvent(const MidiMessage &msg);
+
+        /** \retval false for messages the router doesn't carry (SysEx) */
+        static bool ToMidiMessage(const MidiEvent &event, MidiMessage *msg);
+
+        /** Runs an incoming message through midi_router. 
+         *  midi_rx_queue_ is single producer, and both inputs push to it: TRS
+         *  from the UART interrupt, USB from DPT::ProcessMidi in the main loop.
+         *  Only call this from the UART interrupt or with interrupts blocked,
+         *  as ProcessMidi does, so the two can never interleave inside Push.
+         */
+        void RouteMidiIn(int port, const MidiMessage &msg, uint32_t time);
+
+        /** midi_router outputs */
+        static void MidiTrsOut(const MidiMessage &msg, void *context);
+        static void MidiUsbOut(const MidiMessage &msg, void *context);
+
+        /** TRS MIDI on USART1, DMA listen for input and DMA batches for output.
+         *  The only handler on the UART, see DPT::InitMidi
+         */
+        UartHandler midi_uart_;
+
+        /** Single producer (UART interrupt, or USB input with interrupts blocked), 
+         *  single consumer (DPT::PopMidiEvent) */
+        MidiByteParser                midi_parser_;
+        SpscQueue<TimedMidiEvent, 64> midi_rx_queue_;
+        bool                          midi_rx_running_;
+
+        /** Encodes queued messages into the DMA buffer and starts sending them.
+         *  Call with interrupts blocked, does nothing while a batch is in flight.
+         */
+        void FlushMidiOut();
+
+        static void MidiTxEndCallback(void *context, UartHandler::Result result);
+
+        /** Stop dsy_dpt_trace when the audio callback overruns, see DPT::StartTrace */
+        bool trace_stop_on_xrun_;
+
+        /** Producers block interrupts around Push, so any context can send */
+        SpscQueue<MidiMessage, 64> midi_out_queue_;
+        MidiRunningStatusEncoder   midi_encoder_;
+        volatile bool              midi_tx_busy_;
+
+        /** Periodic task, drives the gates from midi_clock */
+        static void ClockServiceCallback(void *data);
+
+        /** Rate of the clock gate service, sets the gate edge jitter */
+        static constexpr uint32_t kClockServiceRate = 4000;
+
+        int      clock_task_;
+        uint16_t clock_div_[2];
+        float    clock_width_;
+
+        typedef PeriodicTaskScheduler<kMaxTasks> TaskScheduler;
+
+        /** Timer interrupt, data is the TaskScheduler it ticks */
+        static void TaskTimerCallback(void *data);
+
+        /** Starts, retunes or stops the timer for one priority to match its tasks */
+        void UpdateTaskTimer(int level);
+
+        /** One per TaskPriority: TIM5, TIM4 */
+        TaskScheduler tasks_[2];
+        TimerHandle   task_tim_[2];
+        bool          task_tim_running_[2];
+
+        /** Sets up TIM3 as a 1us one-shot for the gate edges */
+        void InitGateTimer();
+
+        /** Restarts TIM3 to fire at the earliest pending edge.
+         *  Call with interrupts blocked.
+         */
+        void ArmGateTimer();
+
+        /** Sample time to the microsecond timer, one block later. 
+         *  Call with interrupts blocked, or from the audio callback.
+         */
+        uint32_t GateEdgeTime(uint32_t time);
+
+        /** TIM3 interrupt, sets the gates that are due */
+        static void GateTimerCallback(void *data);
+
+        static void ApplyGateEdge(uint8_t gate, bool state, void *context);
+
+        /** Longest TIM3 one-shot at 1us per tick, later edges take a few re-arms */
+        static constexpr uint32_t kGateTimerMaxUs = 0xffff;
+
+        TimerHandle           gate_tim_;
+        GateEdgeScheduler<32> gate_edges_;
+
+        /** One gate input edge, in System::GetTick() ticks */
+        struct GateInEdge
+        {
+            uint32_t tick;
+            uint8_t  gate;
+            bool     rising;
+        };
+
+        /** EXTI interrupt for PG13/PG14 (gate_in_1/gate_in_2) */
+        void GateCaptureCallback(uint32_t tick);
+
+        /** Single producer (EXTI interrupt), single consumer (audio callback) */
+        SpscQueue<GateInEdge, 64> gate_in_queue_;
+        GatePeriodEstimator       gate_in_period_[2];
+        bool                      gate_in_state_[2];
+        bool                      gate_capture_running_;
+
+        /** Sent from DPT::ProcessMidi, USB transmit isn't interrupt safe */
+        SpscQueue<MidiMessage, 64> usb_out_queue_;
+        bool                       usb_midi_running_;
+
         void InitDac();
 
         void StartDac(DacHandle::DacCallback callback);
@@ -156,30 +349,83 @@ namespace dpt
 
         static void InternalDacCallback(uint16_t **output, size_t size);
 
+        /** Times the app's DAC callback, or InternalDacCallback */
+        static void DacCallbackWrapper(uint16_t **output, size_t size);
+
+        DacHandle::DacCallback dac_cb_;
+
+        CpuLoadMeter audio_load_;
+        CpuLoadMeter dac_load_;
+
         /** Based on a 0-5V output with a 0-4095 12-bit DAC */
         static inline uint16_t VoltageToCode(float input)
         {
-            float pre = (input + 5.0f) * 273.f;
-            if(pre > 4095.f)
-                pre = 4095.f;
-            else if(pre < 0.f)
-                pre = 0.f;
-            return (uint16_t)pre;
+            return CvVoltageToCode(input);
+        }
+
+        /** Volts to code for any of the CV_CAL_LAST outputs, calibrated if available */
+        inline uint16_t CvCode(int output, float voltage)
+        {
+            int live = cv_cal_live_[output].load(std::memory_order_acquire);
+            if(live >= 0)
+                return cv_cal_table_[output][live].Convert(voltage);
+            return output < CV_CAL_EXP_1 ? VoltageToCode(voltage)
+                                         : CvExpVoltageToCode(voltage);
         }
 
         inline void WriteCvOut(int channel, float voltage, bool raw)
         {
             if(channel == 0 || channel == 1)
-                dac_output_[0] = raw ? (uint16_t) voltage : VoltageToCode(voltage);
+                dac_output_[0] = raw ? (uint16_t) voltage : CvCode(CV_CAL_OUT_1, voltage);
             if(channel == 0 || channel == 2)
-                dac_output_[1] = raw ? (uint16_t) voltage : VoltageToCode(voltage);
+                dac_output_[1] = raw ? (uint16_t) voltage : CvCode(CV_CAL_OUT_2, voltage);
         }
 
+        bool SetCvCalibration(int output, const CvCalibrationPoints &points);
+
+        void LoadCvCalibration(QSPIHandle &qspi);
+
+        bool SaveCvCalibration(QSPIHandle &qspi);
+
+        void WriteCvOutBlock(int channel, const float *voltage, size_t size, bool raw);
+
+        void SetCvOutMode(int channel, CvOutMode mode, float slew_time);
+
+        /** Moves one channel towards dac_output_ according to its CvOutMode */
+        void RenderCvOut(int chn, uint16_t *out, size_t size);
+
+        /** Copies up to size queued samples for one channel, holds the last value after that */
+        void ReadCvStream(int chn, uint16_t *out, size_t size);
+
+        /** Per-sample codes queued by WriteCvOutBlock, must be a power of 2 */
+        static constexpr size_t kCvStreamSize = 512;
+
         size_t    dac_buffer_size_;
+        float     dac_samplerate_;
         uint16_t *internal_dac_buffer_[2];
         uint16_t  dac_output_[2];
         DacHandle dac_;
 
+        bool               qspi_ready_;
+        CvCalibrationData  cv_cal_;
+        /** Two tables per output, SetCvCalibration() builds the one not in use */
+        CvCalibrationTable cv_cal_table_[CV_CAL_LAST][2];
+        /** The table in use per output, -1 for the nominal scaling.
+         *  Writers publish a new table with one store, readers (audio 
+         *  callback) finish with a table before the main loop runs again.
+         */
+        std::atomic<int8_t> cv_cal_live_[CV_CAL_LAST];
+
+        CvOutMode cv_mode_[2];
+        float     cv_level_[2];
+        float     cv_slew_coef_[2];
+
+        /** Single producer (audio callback), single consumer (DAC callback) */
+        uint16_t        cv_stream_[2][kCvStreamSize];
+        volatile size_t cv_stream_write_[2];
+        volatile size_t cv_stream_read_[2];
+        bool            cv_stream_primed_[2];
+
       private:
         bool dac_running_;
     };
@@ -189,6 +435,352 @@ namespace dpt
 
     /** Impl function definintions */
 
+    void DPT::Impl::AudioCallbackWrapper(AudioHandle::InputBuffer  in,
+                                         AudioHandle::OutputBuffer out,
+                                         size_t                    size)
+    {
+        DPT_TRACE_ENTER(TRACE_AUDIO, size);
+        patch_sm_hw.audio_load_.Begin();
+        patch_sm_hw.hw_->BeginBlock(size);
+        patch_sm_hw.hw_->TickControls(size);
+        if(patch_sm_hw.audio_cb_)
+            patch_sm_hw.audio_cb_(in, out, size);
+        patch_sm_hw.EndAudioLoad();
+        DPT_TRACE_EXIT(TRACE_AUDIO, size);
+    }
+
+    void DPT::Impl::InterleavingAudioCallbackWrapper(
+        AudioHandle::InterleavingInputBuffer  in,
+        AudioHandle::InterleavingOutputBuffer out,
+        size_t                                size)
+    {
+        // size is in samples across both channels here
+        DPT_TRACE_ENTER(TRACE_AUDIO, size / 2);
+        patch_sm_hw.audio_load_.Begin();
+        patch_sm_hw.hw_->BeginBlock(size / 2);
+        patch_sm_hw.hw_->TickControls(size / 2);
+        if(patch_sm_hw.interleaving_audio_cb_)
+            patch_sm_hw.interleaving_audio_cb_(in, out, size);
+        patch_sm_hw.EndAudioLoad();
+        DPT_TRACE_EXIT(TRACE_AUDIO, size / 2);
+    }
+
+    void DPT::Impl::StartMidiRx()
+    {
+        midi_parser_.Reset();
+        midi_uart_.DmaListenStart(
+            dsy_dpt_midi_rx_buffer, kMidiRxBufferSize, MidiRxCallback, this);
+    }
+
+    void DPT::Impl::MidiRxCallback(uint8_t            *data,
+                                   size_t              size,
+                                   void               *context,
+                                   UartHandler::Result result)
+    {
+        Impl *impl = static_cast<Impl *>(context);
+        if(result != UartHandler::Result::OK)
+            return;
+        DPT_TRACE_ENTER(TRACE_MIDI_RX, size);
+
+        /** Bytes arrive in bursts on the idle line, so they share one stamp */
+        uint32_t    time = impl->hw_->SampleClock();
+        MidiMessage msg;
+        for(size_t i = 0; i < size; i++)
+        {
+            if(impl->midi_parser_.Parse(data[i], &msg))
+                impl->RouteMidiIn(MIDI_PORT_TRS, msg, time);
+        }
+        DPT_TRACE_EXIT(TRACE_MIDI_RX, size);
+    }
+
+    void DPT::Impl::RouteMidiIn(int port, const MidiMessage &msg, uint32_t time)
+    {
+        if(!hw_->midi_router.Process(port, msg))
+            return;
+        if(msg.status >= 0xf8)
+            hw_->midi_clock.Message(msg.status, System::GetUs());
+        TimedMidiEvent timed;
+        timed.time  = time;
+        timed.port  = port;
+        timed.event = ToMidiEvent(msg);
+        midi_rx_queue_.Push(timed);
+    }
+
+    void DPT::Impl::ClockServiceCallback(void *data)
+    {
+        Impl *impl = static_cast<Impl *>(data);
+        DPT  *hw   = impl->hw_;
+        float pos  = hw->midi_clock.Process(System::GetUs());
+        bool  run  = hw->midi_clock.IsRunning() && pos >= 0.f;
+
+        dsy_gpio *gates[2] = {&hw->gate_out_1, &hw->gate_out_2};
+        for(int i = 0; i < 2; i++)
+        {
+            float div = impl->clock_div_[i];
+            if(div == 0.f)
+                continue;
+            dsy_gpio_write(gates[i], run && fmodf(pos, div) < impl->clock_width_ * div);
+        }
+    }
+
+    void DPT::Impl::TaskTimerCallback(void *data)
+    {
+        uint16_t level = data == &patch_sm_hw.tasks_[0] ? 0 : 1;
+        DPT_TRACE_ENTER(TRACE_TASKS, level);
+        static_cast<TaskScheduler *>(data)->Tick();
+        DPT_TRACE_EXIT(TRACE_TASKS, level);
+    }
+
+    void DPT::Impl::UpdateTaskTimer(int level)
+    {
+        TimerHandle &tim  = task_tim_[level];
+        float        rate = tasks_[level].TickRate();
+        if(rate <= 0.f)
+        {
+            if(task_tim_running_[level])
+                tim.Stop();
+            task_tim_running_[level] = false;
+            return;
+        }
+
+        /** TIM2-7 run from APB1 at twice PCLK1. TIM5 is 32 bit, TIM4 only 16,
+         *  so slow LOW priority ticks (e.g. 60Hz) need the prescaler */
+        uint32_t prescaler, period;
+        uint32_t max_period = level == 0 ? 0xffffffff : 0xffff;
+        float    clock      = (float)System::GetPClk1Freq() * 2.f;
+        if(TimerDivision(clock, rate, max_period, &prescaler, &period) <= 0.f)
+            return; /** under 0.05Hz, out of the prescaler's reach */
+        if(task_tim_running_[level])
+        {
+            tim.SetPrescaler(prescaler);
+            tim.SetPeriod(period);
+            return;
+        }
+        TimerHandle::Config timcfg;
+        timcfg.periph     = level == 0 ? TimerHandle::Config::Peripheral::TIM_5
+                                       : TimerHandle::Config::Peripheral::TIM_4;
+        timcfg.dir        = TimerHandle::Config::CounterDir::UP;
+        timcfg.period     = period;
+        timcfg.enable_irq = true;
+        tim.Init(timcfg);
+        tim.SetPrescaler(prescaler);
+        tim.SetCallback(TaskTimerCallback, &tasks_[level]);
+        /** HIGH keeps the level 0 InitTimer() always had, above the 
+         *  level 1 gate one-shot (TIM3) and gate capture */
+        if(level == 0)
+            HAL_NVIC_SetPriority(TIM5_IRQn, 0, 0);
+        else
+            HAL_NVIC_SetPriority(TIM4_IRQn, 14, 0);
+        tim.Start();
+        task_tim_running_[level] = true;
+    }
+
+    void DPT::Impl::InitGateTimer()
+    {
+        TimerHandle::Config timcfg;
+        timcfg.periph     = TimerHandle::Config::Peripheral::TIM_3;
+        timcfg.dir        = TimerHandle::Config::CounterDir::UP;
+        timcfg.period     = kGateTimerMaxUs;
+        timcfg.enable_irq = true;
+        gate_tim_.Init(timcfg);
+        gate_tim_.SetCallback(GateTimerCallback, this);
+        HAL_NVIC_SetPriority(TIM3_IRQn, 1, 0);
+
+        /** 1us ticks, TIM2-7 run from APB1 at twice PCLK1 */
+        gate_tim_.SetPrescaler(System::GetPClk1Freq() * 2 / 1000000 - 1);
+        /** One pulse mode stops the counter at the update, and with URS only 
+         *  the overflow raises it, so UG can reload PSC/ARR without an interrupt */
+        TIM3->CR1 |= TIM_CR1_OPM | TIM_CR1_URS;
+        TIM3->EGR  = TIM_EGR_UG;
+        TIM3->SR   = ~TIM_SR_UIF;
+        TIM3->DIER |= TIM_DIER_UIE;
+    }
+
+    void DPT::Impl::ArmGateTimer()
+    {
+        uint32_t next;
+        TIM3->CR1 &= ~TIM_CR1_CEN;
+        if(!gate_edges_.Next(&next))
+            return;
+        int32_t delay = (int32_t)(next - System::GetUs());
+        delay         = delay < 2 ? 2 : delay;
+        delay         = delay > (int32_t)kGateTimerMaxUs ? kGateTimerMaxUs : delay;
+        TIM3->ARR     = delay - 1;
+        TIM3->EGR     = TIM_EGR_UG;
+        TIM3->CR1 |= TIM_CR1_CEN;
+    }
+
+    uint32_t DPT::Impl::GateEdgeTime(uint32_t time)
+    {
+        int32_t samples = (int32_t)(time - hw_->block_start_) + (int32_t)hw_->block_size_;
+        return hw_->block_start_us_ + (int32_t)(samples / hw_->samples_per_us_);
+    }
+
+    void DPT::Impl::GateTimerCallback(void *data)
+    {
+        Impl            *impl = static_cast<Impl *>(data);
+        ScopedIrqBlocker lock;
+        DPT_TRACE_ENTER(TRACE_GATE_OUT, 0);
+        impl->gate_edges_.Process(System::GetUs(), ApplyGateEdge, impl);
+        impl->ArmGateTimer();
+        DPT_TRACE_EXIT(TRACE_GATE_OUT, 0);
+    }
+
+    void DPT::Impl::ApplyGateEdge(uint8_t gate, bool state, void *context)
+    {
+        DPT *hw = static_cast<Impl *>(context)->hw_;
+        dsy_gpio_write(gate == GATE_OUT_1 ? &hw->gate_out_1 : &hw->gate_out_2, state);
+    }
+
+    /** gate_in_1 is B10 (PG13), gate_in_2 is B9 (PG14) */
+    static constexpr uint16_t kGateInPins[2] = {GPIO_PIN_13, GPIO_PIN_14};
+
+    void DPT::Impl::GateCaptureCallback(uint32_t tick)
+    {
+        for(int i = 0; i < 2; i++)
+        {
+            if(!__HAL_GPIO_EXTI_GET_IT(kGateInPins[i]))
+                continue;
+            __HAL_GPIO_EXTI_CLEAR_IT(kGateInPins[i]);
+
+            /** The input stage inverts, the pin is low while the gate is high */
+            bool       state = !(GPIOG->IDR & kGateInPins[i]);
+            GateInEdge edge  = {tick, (uint8_t)i, state};
+            if(state == gate_in_state_[i])
+            {
+                /** A trigger shorter than the interrupt latency, 
+                 *  both edges happened, and both get this stamp */
+                edge.rising = !state;
+                gate_in_queue_.Push(edge);
+                DPT_TRACE_MARK(TRACE_GATE_IN, i | edge.rising << 1);
+                if(!state)
+                    gate_in_period_[i].Edge(tick);
+                edge.rising = state;
+            }
+            gate_in_queue_.Push(edge);
+            DPT_TRACE_MARK(TRACE_GATE_IN, i | edge.rising << 1);
+            if(state)
+                gate_in_period_[i].Edge(tick);
+            gate_in_state_[i] = state;
+        }
+    }
+
+    void DPT::Impl::MidiTrsOut(const MidiMessage &msg, void *context)
+    {
+        static_cast<Impl *>(context)->hw_->MIDISend(msg);
+    }
+
+    void DPT::Impl::MidiUsbOut(const MidiMessage &msg, void *context)
+    {
+        ScopedIrqBlocker lock;
+        static_cast<Impl *>(context)->usb_out_queue_.Push(msg);
+    }
+
+    bool DPT::Impl::ToMidiMessage(const MidiEvent &event, MidiMessage *msg)
+    {
+        msg->data[0] = event.data[0];
+        msg->data[1] = event.data[1];
+        switch(event.type)
+        {
+            case MidiMessageType::SystemRealTime:
+                msg->status = 0xf8 + event.srt_type;
+                msg->size   = 0;
+                return true;
+            case MidiMessageType::SystemCommon:
+                switch(event.sc_type)
+                {
+                    case MTCQuarterFrame:
+                    case SongSelect: msg->size = 1; break;
+                    case SongPositionPointer: msg->size = 2; break;
+                    case TuneRequest: msg->size = 0; break;
+                    default: return false;
+                }
+                msg->status = 0xf0 + event.sc_type;
+                return true;
+            case MidiMessageType::ChannelMode:
+                msg->status  = 0xb0 | event.channel;
+                msg->data[0] = 120 + event.cm_type;
+                msg->size    = 2;
+                return true;
+            case MidiMessageType::ProgramChange:
+            case MidiMessageType::ChannelPressure:
+                msg->status = ((event.type + 0x8) << 4) | event.channel;
+                msg->size   = 1;
+                return true;
+            case MidiMessageType::NoteOff:
+            case MidiMessageType::NoteOn:
+            case MidiMessageType::PolyphonicKeyPressure:
+            case MidiMessageType::ControlChange:
+            case MidiMessageType::PitchBend:
+                msg->status = ((event.type + 0x8) << 4) | event.channel;
+                msg->size   = 2;
+                return true;
+            default: return false;
+        }
+    }
+
+    void DPT::Impl::FlushMidiOut()
+    {
+        if(midi_tx_busy_)
+            return;
+
+        uint8_t *buf = dsy_dpt_midi_tx_buffer;
+        size_t   n   = midi_encoder_.EncodeBatch(
+            midi_out_queue_, buf, kMidiTxBufferSize);
+        if(n == 0)
+            return;
+
+        midi_tx_busy_ = true;
+        if(midi_uart_.DmaTransmit(buf, n, nullptr, MidiTxEndCallback, this)
+           != UartHandler::Result::OK)
+        {
+            /** The batch is lost, make sure the next one starts with a status byte */
+            midi_tx_busy_ = false;
+            midi_encoder_.Reset();
+        }
+    }
+
+    void DPT::Impl::MidiTxEndCallback(void *context, UartHandler::Result result)
+    {
+        Impl            *impl = static_cast<Impl *>(context);
+        ScopedIrqBlocker lock;
+        if(result != UartHandler::Result::OK)
+            impl->midi_encoder_.Reset();
+        impl->midi_tx_busy_ = false;
+        impl->FlushMidiOut();
+    }
+
+    MidiEvent DPT::Impl::ToMidiEvent(const MidiMessage &msg)
+    {
+        MidiEvent event;
+        event.channel = msg.status & 0x0f;
+        event.data[0] = msg.data[0];
+        event.data[1] = msg.data[1];
+        if(msg.status >= 0xf8)
+        {
+            event.type     = MidiMessageType::SystemRealTime;
+            event.srt_type = (SystemRealTimeType)(msg.status - 0xf8);
+        }
+        else if(msg.status >= 0xf0)
+        {
+            event.type    = MidiMessageType::SystemCommon;
+            event.sc_type = (SystemCommonType)(msg.status & 0x07);
+        }
+        else
+        {
+            event.type = (MidiMessageType)((msg.status >> 4) - 0x8);
+            /** Same conventions as MidiHandler's parser */
+            if(event.type == MidiMessageType::NoteOn && msg.data[1] == 0)
+                event.type = MidiMessageType::NoteOff;
+            if(event.type == MidiMessageType::ControlChange && msg.data[0] >= 120)
+            {
+                event.type    = MidiMessageType::ChannelMode;
+                event.cm_type = (ChannelModeType)(msg.data[0] - 120);
+            }
+        }
+        return event;
+    }
+
     void DPT::Impl::InitDac()
     {
         DacHandle::Config dac_config;
@@ -197,7 +789,7 @@ namespace dpt
             BITS_12; /**< Sets the output value to 0-4095 */
         dac_config.chn               = DacHandle::Channel::BOTH;
         dac_config.buff_state        = DacHandle::BufferState::ENABLED;
-        dac_config.target_samplerate = 48000;
+        dac_config.target_samplerate = (uint32_t)dac_samplerate_;
         dac_.Init(dac_config);
     }
 
@@ -205,10 +797,12 @@ namespace dpt
     {
         if(dac_running_)
             dac_.Stop();
+        dac_cb_ = callback == nullptr ? InternalDacCallback : callback;
+        dac_load_.SetPeriod(dac_buffer_size_ / dac_samplerate_);
         dac_.Start(internal_dac_buffer_[0],
                    internal_dac_buffer_[1],
                    dac_buffer_size_,
-                   callback == nullptr ? InternalDacCallback : callback);
+                   DacCallbackWrapper);
         dac_running_ = true;
     }
 
@@ -219,18 +813,185 @@ namespace dpt
     }
 
 
+    void DPT::Impl::DacCallbackWrapper(uint16_t **output, size_t size)
+    {
+        DPT_TRACE_ENTER(TRACE_DAC, size);
+        patch_sm_hw.dac_load_.Begin();
+        patch_sm_hw.dac_cb_(output, size);
+        patch_sm_hw.dac_load_.End();
+        DPT_TRACE_EXIT(TRACE_DAC, size);
+    }
+
     void DPT::Impl::InternalDacCallback(uint16_t **output, size_t size)
     {
-        /** We could add some smoothing, interp, or something to make this a bit less waste-y */
-        // std::fill(&output[0][0], &output[0][size], patch_sm_hw.dac_output_[0]);
-        // std::fill(&output[1][1], &output[1][size], patch_sm_hw.dac_output_[1]);
-        for(size_t i = 0; i < size; i++)
+        /** Samples queued with WriteCvOutBlock play out first, 
+         *  otherwise the last WriteCvOut value is held */
+        patch_sm_hw.ReadCvStream(0, output[0], size);
+        patch_sm_hw.ReadCvStream(1, output[1], size);
+    }
+
+    void DPT::Impl::WriteCvOutBlock(int         channel,
+                                    const float *voltage,
+                                    size_t       size,
+                                    bool         raw)
+    {
+        for(int chn = 0; chn < 2; chn++)
+        {
+            if(channel != 0 && channel != chn + 1)
+                continue;
+            size_t w    = cv_stream_write_[chn];
+            size_t room = kCvStreamSize - (w - cv_stream_read_[chn]);
+            size_t n    = size < room ? size : room;
+            int live = cv_cal_live_[chn].load(std::memory_order_acquire);
+            /** Convert in at most two contiguous spans of the ring */
+            for(size_t done = 0; done < n;)
+            {
+                size_t    pos  = w & (kCvStreamSize - 1);
+                size_t    span = kCvStreamSize - pos;
+                uint16_t *dst  = &cv_stream_[chn][pos];
+                span           = span < n - done ? span : n - done;
+                if(raw)
+                    for(size_t i = 0; i < span; i++)
+                        dst[i] = (uint16_t)voltage[done + i];
+                else if(live >= 0)
+                    cv_cal_table_[chn][live].ConvertBlock(voltage + done, dst, span);
+                else
+                    CvVoltageToCodeBlock(voltage + done, dst, span);
+                done += span;
+                w += span;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            cv_stream_write_[chn] = w;
+        }
+    }
+
+    void DPT::Impl::ReadCvStream(int chn, uint16_t *out, size_t size)
+    {
+        size_t r     = cv_stream_read_[chn];
+        size_t avail = cv_stream_write_[chn] - r;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        /** Wait for a full DAC block before starting, so the stream keeps 
+         *  a fixed offset from the audio block that wrote it. */
+        if(!cv_stream_primed_[chn])
+        {
+            if(avail < size)
+                avail = 0;
+            else
+                cv_stream_primed_[chn] = true;
+        }
+
+        size_t n = avail < size ? avail : size;
+        for(size_t i = 0; i < n; i++, r++)
+            out[i] = cv_stream_[chn][r & (kCvStreamSize - 1)];
+        cv_stream_read_[chn] = r;
+
+        if(n > 0)
+        {
+            dac_output_[chn] = out[n - 1];
+            cv_level_[chn]   = out[n - 1];
+        }
+        /** Underrun (or no stream), hold and re-prime */
+        if(n < size)
+        {
+            cv_stream_primed_[chn] = false;
+            RenderCvOut(chn, out + n, size - n);
+        }
+    }
+
+    void DPT::Impl::RenderCvOut(int chn, uint16_t *out, size_t size)
+    {
+        const float target = dac_output_[chn];
+        float       level  = cv_level_[chn];
+        switch(cv_mode_[chn])
+        {
+            case CvOutMode::RAMP:
+            {
+                /** One divide per block, lands on the target at the last sample */
+                const float step = (target - level) / size;
+                for(size_t i = 0; i < size - 1; i++)
+                {
+                    level += step;
+                    out[i] = (uint16_t)(level + 0.5f);
+                }
+                level         = target;
+                out[size - 1] = dac_output_[chn];
+                break;
+            }
+            case CvOutMode::SLEW:
+            {
+                const float coef = cv_slew_coef_[chn];
+                for(size_t i = 0; i < size; i++)
+                {
+                    level += coef * (target - level);
+                    out[i] = (uint16_t)(level + 0.5f);
+                }
+                break;
+            }
+            case CvOutMode::HOLD:
+            default:
+                level = target;
+                for(size_t i = 0; i < size; i++)
+                    out[i] = dac_output_[chn];
+                break;
+        }
+        cv_level_[chn] = level;
+    }
+
+    void DPT::Impl::SetCvOutMode(int channel, CvOutMode mode, float slew_time)
+    {
+        const float coef = slew_time > 0.f
+                               ? 1.f - expf(-1.f / (slew_time * dac_samplerate_))
+                               : 1.f;
+        for(int chn = 0; chn < 2; chn++)
         {
-            output[0][i] = patch_sm_hw.dac_output_[0];
-            output[1][i] = patch_sm_hw.dac_output_[1];
+            if(channel != 0 && channel != chn + 1)
+                continue;
+            cv_slew_coef_[chn] = coef;
+            cv_mode_[chn]      = mode;
         }
     }
 
+    bool DPT::Impl::SetCvCalibration(int output, const CvCalibrationPoints &points)
+    {
+        if(output < 0 || output >= CV_CAL_LAST)
+            return false;
+        /** Build into the spare table, the live one is used until the swap */
+        int                 live  = cv_cal_live_[output].load(std::memory_order_relaxed);
+        int                 spare = live == 0 ? 1 : 0;
+        CvCalibrationTable &table = cv_cal_table_[output][spare];
+        if(!table.Build(points))
+            return false;
+        cv_cal_live_[output].store(spare, std::memory_order_release);
+        cv_cal_.outputs[output] = points;
+        cv_cal_.UpdateChecksum();
+        return true;
+    }
+
+    void DPT::Impl::LoadCvCalibration(QSPIHandle &qspi)
+    {
+        const CvCalibrationData *stored
+            = (const CvCalibrationData *)qspi.GetData(kCvCalibrationQspiOffset);
+        if(!stored->IsValid())
+            return;
+        for(int i = 0; i < CV_CAL_LAST; i++)
+            SetCvCalibration(i, stored->outputs[i]);
+    }
+
+    bool DPT::Impl::SaveCvCalibration(QSPIHandle &qspi)
+    {
+        if(!qspi_ready_)
+            return false;
+        cv_cal_.UpdateChecksum();
+        qspi.Erase(kCvCalibrationQspiOffset,
+                   kCvCalibrationQspiOffset + sizeof(CvCalibrationData));
+        qspi.Write(kCvCalibrationQspiOffset,
+                   sizeof(CvCalibrationData),
+                   (uint8_t *)&cv_cal_);
+        return ((const CvCalibrationData *)qspi.GetData(kCvCalibrationQspiOffset))
+            ->IsValid();
+    }
+
 /** Actual DPT implementation 
  *  With the pimpl model in place, we can/should probably
  *  move the rest of the implementation to the Impl class
@@ -240,6 +1001,7 @@ namespace dpt
     {
         /** Assign pimpl pointer */
         pimpl_ = &patch_sm_hw;
+        pimpl_->hw_ = this;
         /** Initialize the MCU and clock tree */
         System::Config syscfg;
         syscfg.Boost();
@@ -249,6 +1011,15 @@ namespace dpt
             syscfg.skip_clocks = true;
 
         system.Init(syscfg);
+        CycleCounter::Init();
+        const float cycles_per_second
+            = CycleCounter::TicksPerSecond(System::GetSysClkFreq());
+        dsy_dpt_trace.Init(cycles_per_second);
+        for(int i = 0; i < 2; i++)
+            pimpl_->tasks_[i].Init(CycleCounter::Now, cycles_per_second);
+        /** Periods are set once the audio and DAC are configured */
+        pimpl_->audio_load_.Init(cycles_per_second, 0.f);
+        pimpl_->dac_load_.Init(cycles_per_second, 0.f);
         /** Memories */
         if(memory == System::MemoryRegion::INTERNAL_FLASH)
         {
@@ -268,7 +1039,10 @@ namespace dpt
             qspi_config.pin_config.clk = {DSY_GPIOF, 10};
             qspi_config.pin_config.ncs = {DSY_GPIOG, 6};
             qspi.Init(qspi_config);
+            pimpl_->qspi_ready_ = true;
         }
+        /** Memory mapped either way, by us or by the bootloader */
+        pimpl_->LoadCvCalibration(qspi);
         /** Audio */
         // Audio Init
         SaiHandle::Config sai_config;
@@ -301,7 +1075,9 @@ namespace dpt
         audio_config.samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
         audio_config.postgain   = 1.f;
         audio.Init(audio_config, sai_1_handle);
-        callback_rate_ = AudioSampleRate() / AudioBlockSize();
+        callback_rate_    = AudioSampleRate() / AudioBlockSize();
+        samples_per_tick_ = AudioSampleRate() / System::GetTickFreq();
+        pimpl_->audio_load_.SetPeriod(1.f / callback_rate_);
 
         /** ADC Init */
         AdcChannelConfig adc_config[ADC_LAST];
@@ -327,13 +1103,22 @@ namespace dpt
         }
         adc.Init(adc_config, ADC_LAST);
         /** Control Init */
+        uint16_t *adc_ptrs[ADC_LAST];
         for(size_t i = 0; i < ADC_LAST; i++)
         {
+            adc_ptrs[i] = adc.GetPtr(i);
             if(i < ADC_9)
+            {
                 controls[i].InitBipolarCv(adc.GetPtr(i), callback_rate_);
+                control_bank.InitBipolarCv(i, callback_rate_);
+            }
             else
+            {
                 controls[i].Init(adc.GetPtr(i), callback_rate_);
+                control_bank.InitUnipolar(i, callback_rate_);
+            }
         }
+        control_bank.Init(adc_ptrs);
 
         /** Fixed-function Digital I/O */
         user_led.mode = DSY_GPIO_MODE_OUTPUT_PP;
@@ -353,6 +1138,7 @@ namespace dpt
         gate_out_2.pull = DSY_GPIO_NOPULL;
         gate_out_2.pin  = B5;
         dsy_gpio_init(&gate_out_2);
+        pimpl_->InitGateTimer();
 
 
         // Init MIDI i/o
@@ -376,9 +1162,6 @@ namespace dpt
 
         dac_exp.Init();
 
-        /** Init MIDI i/o */
-        InitMidi();
-
         /** DAC init */
 
         /** Start any background stuff */
@@ -388,67 +1171,301 @@ namespace dpt
         /** Init Timer */
     }
 
-    void DPT::InitTimer(daisy::TimerHandle::PeriodElapsedCallback cb, void *data) {
-        daisy::TimerHandle tim5_;
-        daisy::TimerHandle::Config timcfg;
-        uint32_t target_freq;
-        target_freq = 48000; //this->AudioSampleRate() 32000;
-        timcfg.periph = daisy::TimerHandle::Config::Peripheral::TIM_5;
-        timcfg.dir = daisy::TimerHandle::Config::CounterDir::UP;
-        auto tim_base_freq = daisy::System::GetPClk2Freq();
-        auto tim_target_freq = target_freq;
-        auto tim_period = tim_base_freq / tim_target_freq;
-        timcfg.period = tim_period;
-        timcfg.enable_irq = true;
-        tim5_.Init(timcfg);
-        HAL_NVIC_SetPriority(TIM5_IRQn, 0x0, 0x0);
-        tim5_.SetCallback(cb, data);
+    void DPT::InitTimer(daisy::TimerHandle::PeriodElapsedCallback cb, void *data)
+    {
+        AddTask(cb, data, AudioSampleRate(), TaskPriority::HIGH);
+    }
+
+    int DPT::AddTask(daisy::TimerHandle::PeriodElapsedCallback cb,
+                     void                                     *data,
+                     float                                     rate,
+                     TaskPriority                              priority)
+    {
+        int level = priority == TaskPriority::HIGH ? 0 : 1;
+        int slot;
+        {
+            ScopedIrqBlocker lock;
+            slot = pimpl_->tasks_[level].Add(cb, data, rate);
+        }
+        if(slot < 0)
+            return -1;
+        pimpl_->UpdateTaskTimer(level);
+        return level * kMaxTasks + slot;
+    }
 
-        tim5_.Start();
+    void DPT::RemoveTask(int task)
+    {
+        if(task < 0 || task >= 2 * kMaxTasks)
+            return;
+        int level = task / kMaxTasks;
+        {
+            ScopedIrqBlocker lock;
+            pimpl_->tasks_[level].Remove(task % kMaxTasks);
+        }
+        pimpl_->UpdateTaskTimer(level);
+    }
 
-        //TIM5->PSC = 1;
-        //TIM5->DIER = TIM_DIER_UIE;
-        //tim5.Instance = ((TIM_TypeDef *)TIM5_BASE);
-        //tim5.Init.CounterMode = TIM_COUNTERMODE_UP;
-        //tim5.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
-        //tim5.Init.Prescaler = 1;
+    bool DPT::GetTaskTiming(int task, TaskTiming *timing)
+    {
+        if(task < 0 || task >= 2 * kMaxTasks)
+            return false;
+        const Impl::TaskScheduler &sched = pimpl_->tasks_[task / kMaxTasks];
+        int                        slot  = task % kMaxTasks;
+        if(!sched.Valid(slot))
+            return false;
+
+        Impl::TaskScheduler::Stats stats;
+        {
+            ScopedIrqBlocker lock;
+            stats = sched.GetStats(slot);
+        }
+        const float us         = 1e6f / sched.ClockRate();
+        timing->rate           = sched.Rate(slot);
+        timing->runs           = stats.runs;
+        timing->average_us     = stats.average * us;
+        timing->peak_us        = stats.peak * us;
+        timing->jitter_us      = stats.jitter_average * us;
+        timing->jitter_peak_us = stats.jitter_peak * us;
+        return true;
+    }
 
-        //HAL_TIM_Base_Init(&tim5);
+    void DPT::ResetTaskTiming(int task)
+    {
+        if(task < 0 || task >= 2 * kMaxTasks)
+            return;
+        ScopedIrqBlocker lock;
+        pimpl_->tasks_[task / kMaxTasks].ResetStats(task % kMaxTasks);
     }
 
     void DPT::InitMidi() {
-        /*
-        MidiUsbHandler::Config midi_cfg;
-        midi_cfg.transport_config.periph = MidiUsbTransport::Config::EXTERNAL;
-        usb_midi.Init(midi_cfg);
-        */
+        // usb_midi is started by StartMidiRouter()
+
+        // This is using USART1 here, for both directions.
+        UartHandler::Config uart_config;
+        uart_config.periph        = UartHandler::Config::Peripheral::USART_1;
+        uart_config.mode          = UartHandler::Config::Mode::TX_RX;
+        uart_config.baudrate      = 31250;
+        uart_config.stopbits      = UartHandler::Config::StopBits::BITS_1;
+        uart_config.parity        = UartHandler::Config::Parity::NONE;
+        uart_config.wordlength    = UartHandler::Config::WordLength::BITS_8;
+        uart_config.pin_config.rx = DPT::A9;
+        uart_config.pin_config.tx = DPT::A8;
+        pimpl_->midi_uart_.Init(uart_config);
+    }
+
+    bool DPT::MIDISend(const MidiMessage &msg)
+    {
+        if(!use_midi_out_queue_)
+        {
+            uint8_t data[3] = {msg.status, msg.data[0], msg.data[1]};
+            return pimpl_->midi_uart_.BlockingTransmit(data, msg.size + 1)
+                   == UartHandler::Result::OK;
+        }
+
+        ScopedIrqBlocker lock;
+        bool             queued = pimpl_->midi_out_queue_.Push(msg);
+        pimpl_->FlushMidiOut();
+        return queued;
+    }
+
+    void DPT::SetMidiOutQueue(bool enable)
+    {
+        ScopedIrqBlocker lock;
+        use_midi_out_queue_ = enable;
+        pimpl_->midi_encoder_.Reset();
+    }
+
+    uint32_t DPT::MidiOutDropped()
+    {
+        return pimpl_->midi_out_queue_.Dropped();
+    }
+
+    void DPT::StartMidiInterrupt()
+    {
+        pimpl_->StartMidiRx();
+        pimpl_->midi_rx_running_ = true;
+    }
+
+    bool DPT::PopMidiEvent(TimedMidiEvent *event)
+    {
+        /** The UART stops itself on errors (e.g. overrun), restart it */
+        if(pimpl_->midi_rx_running_ && !pimpl_->midi_uart_.IsListening())
+            pimpl_->StartMidiRx();
+        return pimpl_->midi_rx_queue_.Pop(event);
+    }
+
+    void DPT::StartMidiRouter(MidiUsbTransport::Config::Periph usb_periph)
+    {
+        MidiUsbHandler::Config usb_config;
+        usb_config.transport_config.periph = usb_periph;
+        usb_midi.Init(usb_config);
+        usb_midi.StartReceive();
+
+        /** Outputs get called from the UART interrupt, so TRS has to be queued */
+        SetMidiOutQueue(true);
+        midi_router.SetOutput(MIDI_PORT_TRS, Impl::MidiTrsOut, pimpl_);
+        midi_router.SetOutput(MIDI_PORT_USB, Impl::MidiUsbOut, pimpl_);
+
+        if(!pimpl_->midi_rx_running_)
+            StartMidiInterrupt();
+        pimpl_->usb_midi_running_ = true;
+    }
+
+    void DPT::StartClockGates(uint16_t div_1, uint16_t div_2, float width)
+    {
+        pimpl_->clock_div_[0] = div_1;
+        pimpl_->clock_div_[1] = div_2;
+        pimpl_->clock_width_  = width;
+        if(pimpl_->clock_task_ < 0)
+            pimpl_->clock_task_ = AddTask(
+                Impl::ClockServiceCallback, pimpl_, Impl::kClockServiceRate);
+    }
+
+    void DPT::StopClockGates()
+    {
+        RemoveTask(pimpl_->clock_task_);
+        pimpl_->clock_task_ = -1;
+        if(pimpl_->clock_div_[0])
+            dsy_gpio_write(&gate_out_1, 0);
+        if(pimpl_->clock_div_[1])
+            dsy_gpio_write(&gate_out_2, 0);
+    }
+
+    bool DPT::ScheduleGate(int gate, uint32_t time, bool state)
+    {
+        if(gate < GATE_OUT_1 || gate >= GATE_OUT_LAST)
+            return false;
+        ScopedIrqBlocker lock;
+        bool queued = pimpl_->gate_edges_.Schedule(pimpl_->GateEdgeTime(time), gate, state);
+        pimpl_->ArmGateTimer();
+        return queued;
+    }
+
+    bool DPT::TriggerGate(int gate, uint32_t time, uint32_t width_us)
+    {
+        if(gate < GATE_OUT_1 || gate >= GATE_OUT_LAST)
+            return false;
+        ScopedIrqBlocker lock;
+        bool queued = pimpl_->gate_edges_.Pulse(pimpl_->GateEdgeTime(time), gate, width_us);
+        pimpl_->ArmGateTimer();
+        return queued;
+    }
+
+    void DPT::CancelGate(int gate)
+    {
+        ScopedIrqBlocker lock;
+        pimpl_->gate_edges_.Cancel(gate);
+        pimpl_->ArmGateTimer();
+    }
+
+    uint32_t DPT::GateEdgesDropped() { return pimpl_->gate_edges_.Dropped(); }
+
+    void DPT::StartGateCapture()
+    {
+        if(!ENABLE_GATE_CAPTURE)
+            return;
+        for(int i = 0; i < 2; i++)
+        {
+            pimpl_->gate_in_period_[i].Init(System::GetTickFreq());
+            pimpl_->gate_in_state_[i] = !(GPIOG->IDR & kGateInPins[i]);
+        }
+
+        /** Same pins GateIn set up, now with an interrupt on both edges */
+        GPIO_InitTypeDef init = {};
+        init.Pin              = kGateInPins[0] | kGateInPins[1];
+        init.Mode             = GPIO_MODE_IT_RISING_FALLING;
+        init.Pull             = GPIO_NOPULL;
+        init.Speed            = GPIO_SPEED_FREQ_LOW;
+        HAL_GPIO_Init(GPIOG, &init);
+        __HAL_GPIO_EXTI_CLEAR_IT(init.Pin);
+
+        pimpl_->gate_capture_running_ = true;
+        HAL_NVIC_SetPriority(EXTI15_10_IRQn, 1, 0);
+        HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+    }
+
+    bool DPT::NextGateEdge(int *gate, bool *rising, size_t *offset)
+    {
+        const Impl::GateInEdge *next = pimpl_->gate_in_queue_.Peek();
+        if(!next)
+            return false;
+        /** Still coming in during this block, it plays in the next one */
+        if((int32_t)(next->tick - block_start_tick_) >= 0)
+            return false;
+        int32_t since = (int32_t)(next->tick - prev_block_start_tick_);
+        int32_t pos   = since < 0 ? 0 : (int32_t)(since * samples_per_tick_);
+        *offset       = pos < (int32_t)block_size_ ? pos : block_size_ - 1;
+        *gate         = next->gate;
+        *rising       = next->rising;
+        pimpl_->gate_in_queue_.Pop();
+        return true;
+    }
+
+    float DPT::GateInPeriod(int gate)
+    {
+        if(gate < 0 || gate > 1 || !pimpl_->gate_capture_running_)
+            return 0.f;
+        const GatePeriodEstimator &est = pimpl_->gate_in_period_[gate];
+        return est.IsRunning(System::GetTick()) ? est.Period() : 0.f;
+    }
+
+    float DPT::GateInBpm(int gate, int ppqn)
+    {
+        float period = GateInPeriod(gate);
+        return period > 0.f ? 60.f / (period * ppqn) : 0.f;
+    }
+
+    void DPT::ProcessMidi()
+    {
+        if(pimpl_->midi_rx_running_ && !pimpl_->midi_uart_.IsListening())
+            pimpl_->StartMidiRx();
+        if(!pimpl_->usb_midi_running_)
+            return;
+
+        /** USB input is parsed by usb_midi, stamp it as it is picked up */
+        usb_midi.Listen();
+        while(usb_midi.HasEvents())
+        {
+            MidiEvent   event = usb_midi.PopEvent();
+            MidiMessage msg;
+            if(!Impl::ToMidiMessage(event, &msg))
+                continue;
+            /** The UART interrupt is the other producer, see RouteMidiIn */
+            ScopedIrqBlocker lock;
+            pimpl_->RouteMidiIn(MIDI_PORT_USB, msg, SampleClock());
+        }
 
-        // This is using USART1 here
-        MidiUartHandler::Config midi_config;
-        midi_config.transport_config.rx = DPT::A9;
-        midi_config.transport_config.tx = DPT::A8;
-        midi.Init(midi_config);
+        MidiMessage msg;
+        while(pimpl_->usb_out_queue_.Pop(&msg))
+        {
+            uint8_t data[3] = {msg.status, msg.data[0], msg.data[1]};
+            usb_midi.SendMessage(data, msg.size + 1);
+        }
     }
 
     void DPT::StartAudio(AudioHandle::AudioCallback cb)
     {
-        audio.Start(cb);
+        pimpl_->audio_cb_ = cb;
+        audio.Start(Impl::AudioCallbackWrapper);
     }
 
     void DPT::StartAudio(AudioHandle::InterleavingAudioCallback cb)
     {
-        audio.Start(cb);
+        pimpl_->interleaving_audio_cb_ = cb;
+        audio.Start(Impl::InterleavingAudioCallbackWrapper);
     }
 
     void DPT::ChangeAudioCallback(AudioHandle::AudioCallback cb)
     {
-        audio.ChangeCallback(cb);
+        pimpl_->audio_cb_ = cb;
+        audio.ChangeCallback(Impl::AudioCallbackWrapper);
     }
 
     void
     DPT::ChangeAudioCallback(AudioHandle::InterleavingAudioCallback cb)
     {
-        audio.ChangeCallback(cb);
+        pimpl_->interleaving_audio_cb_ = cb;
+        audio.ChangeCallback(Impl::InterleavingAudioCallbackWrapper);
     }
 
     void DPT::StopAudio() { audio.Stop(); }
@@ -456,7 +1473,110 @@ namespace dpt
     void DPT::SetAudioBlockSize(size_t size)
     {
         audio.SetBlockSize(size);
-        callback_rate_ = AudioSampleRate() / AudioBlockSize();
+        UpdateCallbackRate();
+    }
+
+    void DPT::UpdateCallbackRate()
+    {
+        callback_rate_    = AudioSampleRate() / AudioBlockSize();
+        samples_per_us_   = AudioSampleRate() * 1e-6f;
+        pimpl_->audio_load_.SetPeriod(1.f / callback_rate_);
+        samples_per_tick_ = AudioSampleRate() / System::GetTickFreq();
+
+        /** Filters run at the scheduler's effective rate, or once per callback */
+        float rate = callback_rate_;
+        if(control_rate_ > 0.f)
+        {
+            float period    = AudioSampleRate() / control_rate_;
+            control_period_ = period < 1.f ? 1 : (int32_t)(period + 0.5f);
+            if(control_period_ > (int32_t)AudioBlockSize())
+                rate = AudioSampleRate() / control_period_;
+            control_countdown_ = 0;
+        }
+        for(size_t i = 0; i < ADC_LAST; i++)
+        {
+            if(i < ADC_9)
+            {
+                controls[i].InitBipolarCv(adc.GetPtr(i), rate);
+                control_bank.InitBipolarCv(i, rate);
+            }
+            else
+            {
+                controls[i].Init(adc.GetPtr(i), rate);
+                control_bank.InitUnipolar(i, rate);
+            }
+        }
+    }
+
+    void DPT::SetControlRate(float rate)
+    {
+        control_rate_ = rate > 0.f ? rate : 0.f;
+        UpdateCallbackRate();
+    }
+
+    void DPT::TickControls(size_t size)
+    {
+        if(control_rate_ <= 0.f)
+            return;
+        control_countdown_ -= size;
+        if(control_countdown_ > 0)
+            return;
+        control_countdown_ += control_period_;
+        /** Fell behind (block longer than the period), don't try to catch up */
+        if(control_countdown_ <= 0)
+            control_countdown_ = control_period_;
+
+        ProcessAllControls();
+        for(int i = 0; i < ADC_LAST; i++)
+            control_snapshot_.values[i] = GetAdcValue(i);
+        control_snapshot_.gate_in[0] = gate_in_1.State();
+        control_snapshot_.gate_in[1] = gate_in_2.State();
+        control_snapshot_.sequence++;
+    }
+
+    void DPT::BeginBlock(size_t size)
+    {
+        prev_block_start_tick_ = block_start_tick_;
+        block_start_tick_      = System::GetTick();
+        block_start_us_        = System::GetUs();
+        block_start_           = block_start_ + block_size_;
+        block_size_            = size;
+    }
+
+    uint32_t DPT::SampleClock()
+    {
+        /** The audio interrupt may update these between the two reads */
+        uint32_t start, start_us;
+        do
+        {
+            start    = block_start_;
+            start_us = block_start_us_;
+        } while(start != block_start_);
+
+        return start + (uint32_t)((System::GetUs() - start_us) * samples_per_us_);
+    }
+
+    bool DPT::QueueMidiEvent(const MidiEvent &event)
+    {
+        return QueueMidiEvent(event, SampleClock());
+    }
+
+    bool DPT::QueueMidiEvent(const MidiEvent &event, uint32_t time)
+    {
+        TimedMidiEvent timed;
+        timed.time  = time + block_size_;
+        timed.port  = MIDI_PORT_LAST;
+        timed.event = event;
+        return midi_queue_.Push(timed);
+    }
+
+    bool DPT::NextMidiEvent(MidiEvent *event, size_t *offset)
+    {
+        TimedMidiEvent next;
+        if(!PopDue(midi_queue_, block_start_, block_size_, &next, offset))
+            return false;
+        *event = next.event;
+        return true;
     }
 
     void DPT::SetAudioSampleRate(float sr)
@@ -480,14 +1600,94 @@ namespace dpt
             default: sai_sr = SaiHandle::Config::SampleRate::SAI_48KHZ; break;
         }
         audio.SetSampleRate(sai_sr);
-        callback_rate_ = AudioSampleRate() / AudioBlockSize();
+        UpdateCallbackRate();
     }
 
     void
     DPT::SetAudioSampleRate(SaiHandle::Config::SampleRate sample_rate)
     {
         audio.SetSampleRate(sample_rate);
-        callback_rate_ = AudioSampleRate() / AudioBlockSize();
+        UpdateCallbackRate();
+    }
+
+    const CpuLoadMeter &DPT::AudioLoad() const { return pimpl_->audio_load_; }
+
+    const CpuLoadMeter &DPT::DacLoad() const { return pimpl_->dac_load_; }
+
+    void DPT::ResetLoad()
+    {
+        ScopedIrqBlocker lock;
+        pimpl_->audio_load_.Reset();
+        pimpl_->dac_load_.Reset();
+        for(int i = 0; i < 2; i++)
+            for(int slot = 0; slot < kMaxTasks; slot++)
+                if(pimpl_->tasks_[i].Valid(slot))
+                    pimpl_->tasks_[i].ResetStats(slot);
+    }
+
+    void DPT::PrintLoad()
+    {
+        const char         *names[2]  = {"audio", "dac"};
+        const CpuLoadMeter *meters[2] = {&pimpl_->audio_load_, &pimpl_->dac_load_};
+        for(int i = 0; i < 2; i++)
+        {
+            const CpuLoadMeter &m = *meters[i];
+            PrintLine("%s: avg " FLT_FMT3 "%% peak " FLT_FMT3 "%% min " FLT_FMT3
+                      "%% p99 " FLT_FMT3 "%% xruns %u/%u",
+                      names[i],
+                      FLT_VAR3(m.Average() * 100.f),
+                      FLT_VAR3(m.Peak() * 100.f),
+                      FLT_VAR3(m.Min() * 100.f),
+                      FLT_VAR3(m.Percentile(0.99f) * 100.f),
+                      (unsigned)m.Xruns(),
+                      (unsigned)m.Runs());
+        }
+        for(int task = 0; task < 2 * kMaxTasks; task++)
+        {
+            TaskTiming t;
+            if(!GetTaskTiming(task, &t))
+                continue;
+            PrintLine("task %d: " FLT_FMT3 "Hz avg " FLT_FMT3 "us peak " FLT_FMT3
+                      "us jitter " FLT_FMT3 "us peak " FLT_FMT3 "us",
+                      task,
+                      FLT_VAR3(t.rate),
+                      FLT_VAR3(t.average_us),
+                      FLT_VAR3(t.peak_us),
+                      FLT_VAR3(t.jitter_us),
+                      FLT_VAR3(t.jitter_peak_us));
+        }
+    }
+
+    void DPT::StartTrace(bool one_shot, bool stop_on_xrun)
+    {
+        pimpl_->trace_stop_on_xrun_ = stop_on_xrun;
+        dsy_dpt_trace.Start(one_shot);
+    }
+
+    void DPT::StopTrace() { dsy_dpt_trace.Stop(); }
+
+    void DPT::PrintTrace()
+    {
+        dsy_dpt_trace.Stop();
+        size_t count = dsy_dpt_trace.Count();
+        PrintLine("DPTTRACE %u %u",
+                  (unsigned)dsy_dpt_trace.TicksPerSecond(),
+                  (unsigned)count);
+        for(size_t i = 0; i < count; i++)
+        {
+            const TraceEvent &e = dsy_dpt_trace.Get(i);
+            PrintLine("%08x%02x%02x%04x",
+                      (unsigned)e.time,
+                      (unsigned)e.type,
+                      (unsigned)e.id,
+                      (unsigned)e.arg);
+        }
+        PrintLine("DPTTRACE END");
+    }
+
+    void DPT::DumpTrace(TraceBuffer<DPT_TRACE_SIZE>::Writer write, void *context)
+    {
+        dsy_dpt_trace.Dump(write, context);
     }
 
     size_t DPT::AudioBlockSize()
@@ -505,15 +1705,28 @@ namespace dpt
 
     void DPT::ProcessAnalogControls()
     {
+        if(use_control_bank_)
+        {
+            control_bank.Process();
+            if(use_control_changes_)
+                control_changes.Process(control_bank.Values());
+            return;
+        }
+        float values[ADC_LAST];
         for(int i = 0; i < ADC_LAST; i++)
         {
-            controls[i].Process();
+            values[i] = controls[i].Process();
         }
+        if(use_control_changes_)
+            control_changes.Process(values);
     }
 
     void DPT::ProcessDigitalControls() {}
 
-    float DPT::GetAdcValue(int idx) { return controls[idx].Value(); }
+    float DPT::GetAdcValue(int idx)
+    {
+        return use_control_bank_ ? control_bank.Value(idx) : controls[idx].Value();
+    }
 
     dsy_gpio_pin DPT::GetPin(const PinBank bank, const int idx)
     {
@@ -530,23 +1743,36 @@ namespace dpt
 
     void DPT::StopDac() { pimpl_->StopDac(); }
 
+    void DPT::StartDacExp(Dac7554::StreamCallback callback)
+    {
+        dac_exp.StartStream(callback, AudioSampleRate());
+    }
+
+    void DPT::StopDacExp() { dac_exp.StopStream(); }
+
     void DPT::WriteCvOut(const int channel, float voltage, bool raw)
     {
         pimpl_->WriteCvOut(channel, voltage, raw);
     }
 
+    void DPT::SetCvOutMode(const int channel, CvOutMode mode, float slew_time)
+    {
+        pimpl_->SetCvOutMode(channel, mode, slew_time);
+    }
+
+    void DPT::WriteCvOutBlock(const int    channel,
+                              const float *voltage,
+                              size_t       size,
+                              bool         raw)
+    {
+        pimpl_->WriteCvOutBlock(channel, voltage, size, raw);
+    }
+
     // Scale -7v to 7v
     uint16_t DPT::VoltageToCodeExp(float input)
     {
         // Outputs are inverted, so have to flip the literal voltage
-        float pre = DSY_CLAMP(4095.f - ((input + 7.f) / 14.f * 4095.f), 0, 4095);
-
-        if (pre > 4095.f)
-            pre = 4095.f;
-        else if (pre < 0.f)
-            pre = 0.f;
-
-        return (uint16_t)pre;
+        return CvExpVoltageToCode(input);
     }
 
     void DPT::WriteCvOutExp(float a, float b, float c, float d, bool raw)
@@ -554,15 +1780,40 @@ namespace dpt
         uint16_t gogo[4];
 
         // Outputs are inverted, so have to flip the inputs
-        gogo[0] = raw ? 4095 - (uint16_t)a : VoltageToCodeExp(a);
-        gogo[1] = raw ? 4095 - (uint16_t)b : VoltageToCodeExp(b);
-        gogo[2] = raw ? 4095 - (uint16_t)c : VoltageToCodeExp(c);
-        gogo[3] = raw ? 4095 - (uint16_t)d : VoltageToCodeExp(d);
+        gogo[0] = raw ? 4095 - (uint16_t)a : pimpl_->CvCode(CV_CAL_EXP_1, a);
+        gogo[1] = raw ? 4095 - (uint16_t)b : pimpl_->CvCode(CV_CAL_EXP_2, b);
+        gogo[2] = raw ? 4095 - (uint16_t)c : pimpl_->CvCode(CV_CAL_EXP_3, c);
+        gogo[3] = raw ? 4095 - (uint16_t)d : pimpl_->CvCode(CV_CAL_EXP_4, d);
 
         dac_exp.Write(gogo);
         dac_exp.WriteDac7554();
     }
 
+    bool DPT::SetCvCalibration(int          output,
+                               const float *codes,
+                               const float *volts,
+                               int          num_points)
+    {
+        CvCalibrationPoints points;
+        points.Set(codes, volts, num_points);
+        return pimpl_->SetCvCalibration(output, points);
+    }
+
+    void DPT::ClearCvCalibration(int output)
+    {
+        if(output < 0 || output >= CV_CAL_LAST)
+            return;
+        CvCalibrationPoints nominal;
+        if(output < CV_CAL_EXP_1)
+            nominal.SetNominal(kCvCodesPerVolt, kCvCodeOffset);
+        else
+            nominal.SetNominal(kCvExpCodesPerVolt, kCvExpCodeOffset);
+        pimpl_->SetCvCalibration(output, nominal);
+        pimpl_->cv_cal_live_[output].store(-1, std::memory_order_release);
+    }
+
+    bool DPT::SaveCvCalibration() { return pimpl_->SaveCvCalibration(qspi); }
+
     void DPT::SetLed(bool state) { dsy_gpio_write(&user_led, state); }
 
     bool DPT::ValidateSDRAM()
@@ -636,3 +1887,11 @@ namespace dpt
 
 } // namespace dpt
 } // namespace daisy
+
+#if ENABLE_GATE_CAPTURE
+/** Lines 10-15 share one vector, only the gate inputs are enabled on it */
+extern "C" void EXTI15_10_IRQHandler(void)
+{
+    daisy::dpt::patch_sm_hw.GateCaptureCallback(daisy::System::GetTick());
+}
+#endif
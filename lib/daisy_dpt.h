@@ -5,10 +5,31 @@
 #ifndef DSY_DEV_DAC_7554_H
 #include "dev/DAC7554.h"
 #endif
+#include "util/cv_code.h"
+#include "util/cv_calibration.h"
+#include "util/control_bank.h"
+#include "util/change_detector.h"
+#include "util/spsc_queue.h"
+#include "util/midi_parser.h"
+#include "util/midi_encoder.h"
+#include "util/midi_router.h"
+#include "util/clock_follower.h"
+#include "util/edge_scheduler.h"
+#include "util/gate_period.h"
+#include "util/task_scheduler.h"
+#include "util/cpu_load.h"
+#include "util/trace.h"
 
 #define ENABLE_MIDI 1
 #define ENABLE_E4 0 // Expander w/ LED controller and 4 buttons
 
+/** StartGateCapture() owns the EXTI15_10 vector (EXTI lines 10-15). 
+ *  Define as 0 to keep the vector for the app, StartGateCapture() then does nothing.
+ */
+#ifndef ENABLE_GATE_CAPTURE
+#define ENABLE_GATE_CAPTURE 1
+#endif
+
 namespace daisy
 {
 namespace dpt
@@ -55,6 +76,56 @@ namespace dpt
         CV_OUT_2,
     };
 
+    /** Gate outputs, for DPT::ScheduleGate */
+    enum
+    {
+        GATE_OUT_1 = 0,
+        GATE_OUT_2,
+        GATE_OUT_LAST,
+    };
+
+    /** Latest processed control values, see DPT::SetControlRate */
+    struct ControlSnapshot
+    {
+        float    values[ADC_LAST]; /**< Same as DPT::GetAdcValue */
+        bool     gate_in[2];       /**< gate_in_1/gate_in_2 State() */
+        uint32_t sequence;         /**< Increments on every update */
+    };
+
+    /** MIDI event stamped with the audio sample clock, see DPT::QueueMidiEvent */
+    struct TimedMidiEvent
+    {
+        uint32_t  time; /**< in samples, see DPT::SampleClock */
+        uint8_t   port; /**< MidiPort it came in on, MIDI_PORT_LAST if queued by the app */
+        MidiEvent event;
+    };
+
+    /** Which timer interrupt a periodic task runs in, see DPT::AddTask */
+    enum class TaskPriority
+    {
+        HIGH, /**< TIM5 at NVIC priority 0, preempts LOW tasks and the gate interrupts */
+        LOW,  /**< TIM4, below the audio and DMA interrupts */
+    };
+
+    /** Timing of a periodic task, see DPT::GetTaskTiming */
+    struct TaskTiming
+    {
+        float    rate;           /**< average rate in Hz, to 1mHz */
+        uint32_t runs;           /**< since it was added or reset */
+        float    average_us;     /**< smoothed execution time */
+        float    peak_us;        /**< longest execution time */
+        float    jitter_us;      /**< smoothed error of the time between runs */
+        float    jitter_peak_us; /**< largest error of the time between runs */
+    };
+
+    /** How the internal DAC moves between WriteCvOut values, see DPT::SetCvOutMode */
+    enum class CvOutMode
+    {
+        HOLD, /**< Steps to the new value (default) */
+        RAMP, /**< Linear ramp to the new value across one DAC block */
+        SLEW, /**< One-pole slew towards the new value */
+    };
+
     inline float fmin(float a, float b)
     {
         float r;
@@ -99,6 +170,84 @@ namespace dpt
         }
     }
 
+    /** 2^x, 4th order polynomial on the fractional part.
+     *  Relative error < 3e-6 against exp2f for -126 <= x <= 127. 
+     */
+    inline float fexp2(float x)
+    {
+        x = fclamp(x, -126.f, 127.f);
+        int   i = (int)x;
+        i -= x < (float)i;
+        float f = x - (float)i;
+        float p = 1.f
+                  + f
+                        * (0.693044843f
+                           + f
+                                 * (0.241280213f
+                                    + f * (0.052242463f + f * 0.0134266892f)));
+        union
+        {
+            float    f;
+            uint32_t u;
+        } bits;
+        bits.f = p;
+        bits.u += (uint32_t)i << 23;
+        return bits.f;
+    }
+
+    /** @brief fmap with the per-call math done up front
+     * 
+     *  Init() precomputes the range, and for LOG the log2 of max / min,
+     *  so Process() is a multiply-add for LINEAR and EXP, and one fexp2
+     *  instead of log10f + powf for LOG (within 4e-6 relative of fmap).
+     * 
+     *  Usage: 
+     *  \code
+     *  CurveMapper damp;
+     *  damp.Init(1000.f, 19000.f, MappingFmap::LOG);
+     *  reverb.SetLpFreq(damp.Process(patch.GetAdcValue(CV_2)));
+     *  \endcode
+     */
+    class CurveMapper
+    {
+      public:
+        CurveMapper() {}
+        ~CurveMapper() {}
+
+        /** \param min output for in = 0, must be > 0 for LOG
+         *  \param max output for in = 1
+         *  \param curve mapping curve, LINEAR_INVERTED maps 0 to max
+         */
+        void Init(float min, float max, MappingFmap curve = MappingFmap::LINEAR)
+        {
+            min_   = min;
+            max_   = max;
+            range_ = max - min;
+            curve_ = curve;
+            log2_ratio_
+                = curve == MappingFmap::LOG ? log2f(max / min) : 0.f;
+        }
+
+        inline float Process(float in) const
+        {
+            switch(curve_)
+            {
+                case MappingFmap::EXP:
+                    return fclamp(min_ + (in * in) * range_, min_, max_);
+                case MappingFmap::LOG:
+                    return fclamp(min_ * fexp2(in * log2_ratio_), min_, max_);
+                case MappingFmap::LINEAR_INVERTED:
+                    return fclamp(max_ - in * range_, min_, max_);
+                case MappingFmap::LINEAR:
+                default: return fclamp(min_ + in * range_, min_, max_);
+            }
+        }
+
+      private:
+        float       min_ = 0.f, max_ = 1.f, range_ = 1.f, log2_ratio_ = 0.f;
+        MappingFmap curve_ = MappingFmap::LINEAR;
+    };
+
 
     /** @brief Board support file for DPT hardware
      *  @author shensley
@@ -126,10 +275,115 @@ namespace dpt
         /** Initializes the memories, and core peripherals for the Daisy Patch SM */
         void Init();
 
+        /** Sets up TRS MIDI on USART1, called by Init(). One UartHandler 
+         *  carries both directions, input through StartMidiInterrupt() and
+         *  output through MIDISend(). Don't init another handler on USART1,
+         *  the last one to init the UART would take it over.
+         */
         void InitMidi();
+
+        /** Parses MIDI input (USART1) in the UART receive interrupt as it arrives,
+         *  and stamps every event with SampleClock(), so latency doesn't depend
+         *  on how often the main loop polls. Read events with PopMidiEvent().
+         */
+        void StartMidiInterrupt();
+
+        /** Next event parsed by StartMidiInterrupt(), with its capture time.
+         *  Call from one context only (e.g. the main loop).
+         */
+        bool PopMidiEvent(TimedMidiEvent *event);
+
+        /** Starts USB MIDI (usb_midi) and TRS input in interrupt mode, and runs
+         *  both through midi_router into the PopMidiEvent() stream.
+         *  By default both inputs are merged into the app's stream and nothing
+         *  is sent on, set up thru and filters on midi_router, e.g.
+         *  \code
+         *  // USB to TRS interface
+         *  hw.midi_router.Thru(MIDI_PORT_USB, MIDI_PORT_TRS, true);
+         *  hw.midi_router.Thru(MIDI_PORT_TRS, MIDI_PORT_USB, true);
+         *  \endcode
+         *  TRS output goes through the MIDISend() queue, so this turns it on
+         *  if SetMidiOutQueue(false) turned it off.
+         */
+        void StartMidiRouter(MidiUsbTransport::Config::Periph usb_periph
+                             = MidiUsbTransport::Config::EXTERNAL);
+
+        /** Services the router from the main loop: picks up USB input, sends
+         *  USB output, and restarts the UART after errors. 
+         */
+        void ProcessMidi();
+
+        /** Drives gate_out_1/gate_out_2 from midi_clock, in a 4kHz task (see AddTask).
+         *  midi_clock follows the clock messages that midi_router passes to the app,
+         *  from StartMidiInterrupt() or StartMidiRouter().
+         *  \param div_1 clock ticks per gate cycle on gate_out_1 (24 = quarter notes, 6 = 16ths), 
+         *         0 leaves the gate to the app
+         *  \param div_2 same for gate_out_2
+         *  \param width high time, as a fraction of the cycle
+         */
+        void StartClockGates(uint16_t div_1 = 6, uint16_t div_2 = 24, float width = 0.5f);
+
+        void StopClockGates();
+
+        /** Sets gate_out_1/gate_out_2 at an audio sample time, see SampleClock().
+         *  Edges are queued and set by a TIM3 one-shot interrupt, with 
+         *  microsecond resolution, so they don't depend on when the main loop 
+         *  or the audio callback gets around to it. Like QueueMidiEvent(), 
+         *  edges land one block after their sample time, which lines them up 
+         *  with the audio rendered for that sample.
+         *  Safe from any context, including the audio callback.
+         *  An edge for the same gate at the same time replaces the earlier one.
+         *  Don't use on a gate that StartClockGates() is driving.
+         *  \param gate GATE_OUT_1 or GATE_OUT_2
+         *  \retval false if the edge queue is full
+         */
+        bool ScheduleGate(int gate, uint32_t time, bool state);
+
+        /** Schedules a trigger: high at time, low again width_us later */
+        bool TriggerGate(int gate, uint32_t time, uint32_t width_us = 1000);
+
+        /** Drops every pending edge for a gate, it keeps its current state */
+        void CancelGate(int gate);
+
+        /** Edges ScheduleGate()/TriggerGate() couldn't fit in the queue */
+        uint32_t GateEdgesDropped();
     
+        /** Runs cb at the audio samplerate in the TIM5 interrupt, e.g. to 
+         *  write the DAC7554. Same as AddTask(cb, data, AudioSampleRate()).
+         *  TIM5 stays at NVIC priority 0, so cb still preempts the gate 
+         *  one-shot (TIM3) and gate capture (EXTI), which run at 1.
+         */
         void InitTimer(daisy::TimerHandle::PeriodElapsedCallback cb, void *data);
 
+        /** Runs cb periodically from a timer interrupt, e.g. CV or LED refresh.
+         *  Tasks of one priority share a timer, which ticks at the fastest 
+         *  task's rate. Slower tasks run on the ticks that keep their average
+         *  rate exact, every n ticks when the rate divides the fastest one,
+         *  otherwise with up to a tick of jitter. Each task is timed, see 
+         *  GetTaskTiming().
+         *  \param rate in Hz
+         *  \param priority HIGH tasks (TIM5) preempt LOW ones (TIM4)
+         *  \retval an id for RemoveTask(), or -1 if all kMaxTasks of that 
+         *          priority are taken
+         */
+        int AddTask(daisy::TimerHandle::PeriodElapsedCallback cb,
+                    void                                     *data,
+                    float                                     rate,
+                    TaskPriority priority = TaskPriority::HIGH);
+
+        /** Stops a task, its timer stops with the last one */
+        void RemoveTask(int task);
+
+        /** Execution time and jitter of a task, measured with the cycle counter
+         *  \retval false if there is no such task
+         */
+        bool GetTaskTiming(int task, TaskTiming *timing);
+
+        void ResetTaskTiming(int task);
+
+        /** Tasks per priority */
+        static constexpr int kMaxTasks = 8;
+
         /** Starts a non-interleaving audio callback */
         void StartAudio(AudioHandle::AudioCallback cb);
 
@@ -162,6 +416,103 @@ namespace dpt
 
         void SetAudioSampleRate(SaiHandle::Config::SampleRate sample_rate);
 
+        /** Audio sample clock: samples rendered since StartAudio(), 
+         *  interpolated between callbacks with the microsecond timer.
+         *  Wraps every ~24 hours at 48kHz, compare with signed differences.
+         */
+        uint32_t SampleClock();
+
+        /** Timestamps an event with SampleClock() and queues it for the audio callback.
+         *  The event is played one block later at the same position in the block,
+         *  so all events get the same latency and no jitter.
+         *  Call from one context only (e.g. the main loop).
+         *  \retval false if the queue is full
+         */
+        bool QueueMidiEvent(const MidiEvent &event);
+
+        /** Same, for an event that was captured at time, e.g. by PopMidiEvent() */
+        bool QueueMidiEvent(const MidiEvent &event, uint32_t time);
+
+        /** From the audio callback: pops the next queued event that is due in
+         *  this block. Apply it at offset samples into the block. 
+         *  Events come out in order, so offsets never go backwards.
+         *  \retval false when there are no more events for this block
+         */
+        bool NextMidiEvent(MidiEvent *event, size_t *offset);
+
+        /** Timestamps gate_in_1/gate_in_2 edges in an EXTI interrupt as they 
+         *  happen, instead of sampling State() once per block, so edges keep
+         *  their position within the block and triggers shorter than a block
+         *  aren't missed. Also keeps GateInPeriod() up to date.
+         *  gate_in_1/gate_in_2 keep working as before.
+         *  Takes the EXTI15_10 vector, which only serves the gate lines, so
+         *  the other EXTI lines 10-15 can't interrupt next to it,
+         *  see ENABLE_GATE_CAPTURE.
+         */
+        void StartGateCapture();
+
+        /** From the audio callback: pops the next gate input edge captured 
+         *  during the previous block. Apply it at offset samples into this 
+         *  block, so every edge gets one block of latency and no jitter.
+         *  \param gate 0 for gate_in_1, 1 for gate_in_2
+         *  \param rising true when the gate went high
+         *  \retval false when there are no more edges for this block
+         */
+        bool NextGateEdge(int *gate, bool *rising, size_t *offset);
+
+        /** Period of a clock on a gate input in seconds, from its rising edges.
+         *  0 until StartGateCapture() saw two edges, or after edges stop 
+         *  coming for two periods.
+         *  \param gate 0 for gate_in_1, 1 for gate_in_2
+         */
+        float GateInPeriod(int gate);
+
+        /** Tempo of a clock on a gate input, 0 when there is none
+         *  \param ppqn edges per quarter note
+         */
+        float GateInBpm(int gate, int ppqn = 1);
+
+        /** Time spent in every audio callback (including the board's per-block 
+         *  work) against the block period, measured with the DWT cycle counter.
+         *  Xruns() counts callbacks that overran the block.
+         */
+        const CpuLoadMeter &AudioLoad() const;
+
+        /** Same for the internal DAC callback, against the DAC block period */
+        const CpuLoadMeter &DacLoad() const;
+
+        /** Clears the load meters and the task timings */
+        void ResetLoad();
+
+        /** Prints the load meters and task timings with PrintLine(), see StartLog() */
+        void PrintLoad();
+
+        /** Starts recording the board's interrupts (audio, DAC, DAC7554, MIDI,
+         *  timers, gate inputs) into dsy_dpt_trace, a few cycles per event.
+         *  Apps can add their own with DPT_TRACE_ENTER/EXIT/MARK(TRACE_USER + n, arg).
+         *  \param one_shot keep the first DPT_TRACE_SIZE events instead of the last
+         *  \param stop_on_xrun stop when the audio callback overruns, so the
+         *         buffer ends with what led up to it
+         */
+        void StartTrace(bool one_shot = false, bool stop_on_xrun = false);
+
+        void StopTrace();
+
+        /** Stops the trace and prints it with PrintLine(), see StartLog().
+         *  Save the log and convert it with lib/util/trace_to_chrome.py.
+         */
+        void PrintTrace();
+
+        /** Stops the trace and writes it in binary, e.g. to a file on the SD card:
+         *  \code
+         *  hw.DumpTrace([](const void *data, size_t size, void *f) {
+         *      UINT bw;
+         *      f_write((FIL *)f, data, size, &bw);
+         *  }, &file);
+         *  \endcode
+         */
+        void DumpTrace(TraceBuffer<DPT_TRACE_SIZE>::Writer write, void *context);
+
         /** Returns the number of samples processed in an audio callback */
         size_t AudioBlockSize();
 
@@ -183,6 +534,12 @@ namespace dpt
         /** Reads and filters all of the analog control inputs */
         void ProcessAnalogControls();
 
+        /** Switches ProcessAnalogControls() and GetAdcValue() over to control_bank,
+         *  which filters all 12 channels in one pass instead of 12 AnalogControls.
+         *  controls[] stops updating while this is enabled.
+         */
+        void SetControlBank(bool enable) { use_control_bank_ = enable; }
+
         /** Reads and debounces any of the digital control inputs 
          *  This does nothing on this board at this time.
          */
@@ -195,9 +552,70 @@ namespace dpt
             ProcessDigitalControls();
         }
 
+        /** Runs ProcessAllControls() from the audio interrupt at a fixed rate, 
+         *  independent of the audio block size, and retunes the control 
+         *  filters to match. Apps then skip ProcessAllControls(), and read 
+         *  GetAdcValue() or GetControlSnapshot() as usual.
+         * 
+         *  Control processing happens at most once per audio callback, so 
+         *  rates above AudioCallbackRate() run at the callback rate.
+         * 
+         *  \param rate in Hz, e.g. 1000. 0 leaves control processing to the app (default)
+         */
+        void SetControlRate(float rate);
+
+        /** Returns the rate the control filters are tuned for in Hz */
+        float ControlRate() { return control_rate_ > 0.f ? control_rate_ : callback_rate_; }
+
+        /** Latest values from the control scheduler. 
+         *  Updated in the audio interrupt, so read it from the audio callback
+         *  (or check sequence) to get a consistent set.
+         */
+        const ControlSnapshot &GetControlSnapshot() const
+        {
+            return control_snapshot_;
+        }
+
         /** Returns the current value for one of the ADCs */
         float GetAdcValue(int idx);
 
+        /** Runs change detection on the ADCs in ProcessAnalogControls().
+         *  Off by default, so apps that don't use it don't pay for it.
+         *  SetControlChangeCallback() turns it on as well.
+         */
+        void SetControlChangeDetection(bool enable)
+        {
+            use_control_changes_ = enable;
+        }
+
+        /** True if the ADC moved past its change threshold since the last call.
+         *  Clears the flag, so check each control once per pass.
+         *  Needs SetControlChangeDetection(true), it is always false otherwise.
+         */
+        bool ControlChanged(int idx) { return control_changes.Changed(idx); }
+
+        /** Sets how far one ADC has to move before it counts as changed.
+         *  \param deadband movement ignored while moving in the same direction
+         *  \param hysteresis extra movement needed to change direction
+         */
+        void SetControlChangeThreshold(int idx, float deadband, float hysteresis)
+        {
+            control_changes.SetThreshold(idx, deadband, hysteresis);
+        }
+
+        /** Called from ProcessAnalogControls() for every ADC that changed.
+         *  With SetControlRate() this runs in the audio interrupt.
+         *  Turns change detection on, unless callback is nullptr.
+         */
+        void SetControlChangeCallback(
+            ControlChangeDetector<ADC_LAST>::ChangeCallback callback,
+            void *context = nullptr)
+        {
+            control_changes.SetCallback(callback, context);
+            if(callback)
+                use_control_changes_ = true;
+        }
+
         /** Returns the STM32 port/pin combo for the desired pin (or an invalid pin for HW only pins)
          *
          *  Macros at top of file can be used in place of separate arguments (i.e. GetPin(A4), etc.)
@@ -216,8 +634,6 @@ namespace dpt
          * 
          *  This is started automatically when Init() is called.
          */
-        void StartDacExp(DacHandle::DacCallback callback = nullptr);
-
         void StartDac(DacHandle::DacCallback callback = nullptr);
 
         /** Stop the DAC from updating. 
@@ -225,10 +641,20 @@ namespace dpt
          */
         void StopDac();
 
+        /** Starts streaming the DAC7554 expander outputs at the audio samplerate
+         * 
+         *  The callback fills half-buffers of 4-channel frames (raw codes),
+         *  and a timer-triggered DMA clocks them out, so there is no
+         *  per-sample interrupt. Without a callback, the last values from
+         *  WriteCvOutExp are held, and WriteCvOutExp stops touching the SPI.
+         */
+        void StartDacExp(Dac7554::StreamCallback callback = nullptr);
+
+        /** Stops the DAC7554 stream, WriteCvOutExp transmits directly again */
+        void StopDacExp();
+
         /** Sets specified DAC channel to the target voltage. 
-         *  This may not be 100% accurate without calibration. 
-         *  
-         *  \todo Add Calibration to CV Outputs
+         *  This may not be 100% accurate without calibration, see SetCvCalibration.
          * 
          *  \param channel desired channel to update. 0 is both, otherwise 1 or 2 are valid.
          *  \param volage value in Volts that you'd like to write to the DAC. The valid range is -5-10V.
@@ -236,10 +662,35 @@ namespace dpt
          */
         void WriteCvOut(const int channel, float voltage, bool raw);
 
+        /** Sets how a CV Output moves between values written with WriteCvOut.
+         *  The DAC callback fills each 48 sample block incrementally, 
+         *  so this costs no extra interrupts. Samples queued with 
+         *  WriteCvOutBlock are played as-is.
+         * 
+         *  \param channel desired channel to update. 0 is both, otherwise 1 or 2 are valid.
+         *  \param mode HOLD, RAMP or SLEW
+         *  \param slew_time time constant in seconds for CvOutMode::SLEW
+         */
+        void SetCvOutMode(const int channel, CvOutMode mode, float slew_time = 0.005f);
+
+        /** Queues one value per sample for the CV Outputs.
+         *  Call once per audio callback with the block size, and the 
+         *  internal DAC plays the block out at the samplerate, a fixed 
+         *  offset behind the audio. When the queue runs dry, the last 
+         *  value is held, and WriteCvOut works as usual.
+         * 
+         *  \param channel desired channel to update. 0 is both, otherwise 1 or 2 are valid.
+         *  \param voltage size values in Volts (-5-10V), or raw [0-4095]
+         *  \param size number of samples
+         *  \param raw if true, voltage values are passed directly to the dac [0-4095]
+         */
+        void WriteCvOutBlock(const int    channel,
+                             const float *voltage,
+                             size_t       size,
+                             bool         raw = false);
+
         /** Sets expander channels to the target voltage + write. 
-         *  This may not be 100% accurate without calibration. 
-         *  
-         *  \todo Add Calibration to CV Outputs
+         *  This may not be 100% accurate without calibration, see SetCvCalibration.
          * 
          *  \param a v for output 1 
          *  \param b v for output 2
@@ -250,7 +701,34 @@ namespace dpt
         void WriteCvOutExp(float a, float b, float c, float d, bool raw);
 
         
-        /** Convert -8 to 8 range to 4096 */
+        /** Sets the measured calibration for one CV output.
+         *  The points are indexed into a lookup table, so calibrated 
+         *  writes cost about the same as uncalibrated ones. Measured
+         *  voltages give their codes exactly, and the outermost segments
+         *  carry on past the end points up to the DAC's limits.
+         * 
+         *  \param output CV_CAL_OUT_1, CV_CAL_OUT_2, or CV_CAL_EXP_1 - CV_CAL_EXP_4
+         *  \param codes raw DAC codes that were written [0-4095]
+         *  \param volts voltage measured at the jack for each code
+         *  \param num_points 2 for gain and offset, up to 9 for a piecewise correction
+         *  \retval false if the points can't be used, the output keeps its previous calibration
+         */
+        bool SetCvCalibration(int          output,
+                              const float *codes,
+                              const float *volts,
+                              int          num_points);
+
+        /** Returns an output to the nominal scaling */
+        void ClearCvCalibration(int output);
+
+        /** Stores the current calibration in QSPI, it is loaded again by Init().
+         *  Erases one sector, so don't call this while audio is critical.
+         *  \retval false if the QSPI isn't available (e.g. running from QSPI)
+         */
+        bool SaveCvCalibration();
+
+        /** Convert -7 to 7 range to 4096, inverted for the expander outputs.
+         *  See CvExpVoltageToCodeBlock for whole buffers. */
         uint16_t VoltageToCodeExp(float input);
 
         /** Here are some wrappers around libDaisy Static functions 
@@ -299,26 +777,52 @@ namespace dpt
         // midi helping stuff yoinked from makingsoundmachines @ electrosmith forum
         void MIDISendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity)
         {
-            uint8_t data[3] = {0};
-
-            data[0] = (channel & 0x0F) + 0x90; // limit channel byte, add status byte
-            data[1] = note & 0x7F;             // remove MSB on data
-            data[2] = velocity & 0x7F;
-
-            midi.SendMessage(data, 3);
+            MidiMessage msg;
+            msg.status  = (channel & 0x0F) + 0x90; // limit channel byte, add status byte
+            msg.data[0] = note & 0x7F;             // remove MSB on data
+            msg.data[1] = velocity & 0x7F;
+            msg.size    = 2;
+            MIDISend(msg);
         }
 
         void MIDISendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity)
         {
-            uint8_t data[3] = {0};
-
-            data[0] = (channel & 0x0F) + 0x80; // limit channel byte, add status byte
-            data[1] = note & 0x7F;             // remove MSB on data
-            data[2] = velocity & 0x7F;
+            MidiMessage msg;
+            msg.status  = (channel & 0x0F) + 0x80; // limit channel byte, add status byte
+            msg.data[0] = note & 0x7F;             // remove MSB on data
+            msg.data[1] = velocity & 0x7F;
+            msg.size    = 2;
+            MIDISend(msg);
+        }
 
-            midi.SendMessage(data, 3);
+        void MIDISendControlChange(uint8_t channel, uint8_t cc, uint8_t value)
+        {
+            MidiMessage msg;
+            msg.status  = (channel & 0x0F) + 0xB0;
+            msg.data[0] = cc & 0x7F;
+            msg.data[1] = value & 0x7F;
+            msg.size    = 2;
+            MIDISend(msg);
         }
 
+        /** Sends a message on the TRS MIDI output.
+         *  By default this only queues it and returns, so it is safe from the
+         *  audio callback, and so are the MIDISendNoteOn/NoteOff/ControlChange
+         *  helpers. After SetMidiOutQueue(false) it blocks until the UART has sent it.
+         *  \retval false if the queue was full, or the UART failed to send
+         */
+        bool MIDISend(const MidiMessage &msg);
+
+        /** Routes MIDISend() through an output queue, on by default. Messages 
+         *  are running status encoded and go out in batches over UART DMA, the
+         *  next batch starts as soon as the previous one finishes. 
+         *  false sends every message with a blocking transmit instead.
+         */
+        void SetMidiOutQueue(bool enable);
+
+        /** Messages MIDISend() couldn't fit in the output queue */
+        uint32_t MidiOutDropped();
+
         /** @brief Tests entirety of SDRAM for validity 
          *         This will wipe contents of SDRAM when testing. 
          * 
@@ -334,7 +838,9 @@ namespace dpt
         /** @brief Tests the QSPI for validity 
          *         This will wipe contents of QSPI when testing. 
          * 
-         *  @note  If called with quick = false, this will erase all memory
+         *  @note  If called with quick = false, this will erase all memory,
+         *         the CV calibration stored at 0x7F0000 included, so call
+         *         SaveCvCalibration() again after it.
          *         the "quick" test starts 0x400000 bytes into the memory and
          *         test 16kB of data
          * 
@@ -354,7 +860,6 @@ namespace dpt
         UsbHandle   usb;
         Pcm3060     codec;
         DacHandle   dac;
-        MidiUartHandler midi;
         MidiUsbHandler usb_midi;
 
         Dac7554     dac_exp;
@@ -362,6 +867,10 @@ namespace dpt
         /** Dedicated Function Pins */
         dsy_gpio      user_led;
         AnalogControl controls[ADC_LAST];
+        AnalogControlBank<ADC_LAST> control_bank;
+        ControlChangeDetector<ADC_LAST> control_changes;
+        MidiRouter    midi_router;
+        MidiClockFollower midi_clock;
         GateIn        gate_in_1, gate_in_2;
         dsy_gpio      gate_out_1, gate_out_2;
         dsy_gpio      clicker1, clicker2;
@@ -380,12 +889,42 @@ namespace dpt
         class Impl;
 
         TIM_HandleTypeDef tim5;
-        TimerHandle tim5_;
 
       private:
         using Log = Logger<LOGGER_INTERNAL>;
 
+        /** Recomputes callback_rate_ and retunes the control filters */
+        void UpdateCallbackRate();
+
+        /** Control scheduler, called before every audio callback */
+        void TickControls(size_t size);
+
+        /** Advances the sample clock, called before every audio callback */
+        void BeginBlock(size_t size);
+
         float callback_rate_;
+        bool  use_control_bank_    = false;
+        bool  use_control_changes_ = false;
+
+        float           control_rate_      = 0.f;
+        int32_t         control_period_    = 0;
+        int32_t         control_countdown_ = 0;
+        ControlSnapshot control_snapshot_  = {};
+
+        /** Sample clock at the start of the block being rendered */
+        volatile uint32_t block_start_    = 0;
+        volatile uint32_t block_start_us_ = 0;
+        volatile uint32_t block_size_     = 0;
+        float             samples_per_us_ = 0.048f;
+
+        /** System::GetTick() at the start of this block and the previous one */
+        uint32_t block_start_tick_      = 0;
+        uint32_t prev_block_start_tick_ = 0;
+        float    samples_per_tick_      = 0.f;
+
+        SpscQueue<TimedMidiEvent, 64> midi_queue_;
+
+        bool use_midi_out_queue_ = true;
 
         /** Background callback for updating the DACs. */
         Impl* pimpl_;
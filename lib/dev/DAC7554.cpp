@@ -6,6 +6,7 @@
 #include "../per/qspi.h"
 #include "../per/gpio.h"
 #include "../sys/system.h"
+#include "../util/trace.h"
 
 // Driver for DAC7554 based on code from Making Sound Machines 
 // Based on Code from Westlicht Performer   - https://westlicht.github.io/performer/
@@ -50,6 +51,9 @@ using namespace std;
 #define MAX_DAC7554_BUF_SIZE 256
 uint8_t DMA_BUFFER_MEM_SECTION dac7554buf[MAX_DAC7554_BUF_SIZE];
 uint8_t DMA_BUFFER_MEM_SECTION dac7554buf_count = 0;
+uint16_t DMA_BUFFER_MEM_SECTION dac7554frame[Dac7554::Channels];
+uint16_t DMA_BUFFER_MEM_SECTION
+    dac7554stream[2][Dac7554::StreamFrames * Dac7554::Channels];
 
 typedef struct
 {
@@ -61,13 +65,21 @@ static dsy_gpio          pin_sync;
 static Dac7554_t         Dac7554_;
 static SpiHandle::Config spi_config;
 
+static DMA_HandleTypeDef       hdma_spi2_tx;
+static TIM_HandleTypeDef       htim_stream;
+static Dac7554::StreamCallback stream_callback = nullptr;
+static Dac7554*                stream_dac      = nullptr;
+
 void TxCpltCallback(void* context, daisy::SpiHandle::Result result) {
-    if(dac7554buf_count < 3) {
+    DPT_TRACE_MARK(daisy::dpt::TRACE_DAC_EXP_SPI, dac7554buf_count);
+    Dac7554* dac = static_cast<Dac7554*>(context);
+    if(dac7554buf_count < 3 && !dac->IsStreaming()) {
         dac7554buf_count++;
-        h_spi.DmaTransmit(dac7554buf + (2 * dac7554buf_count), 2, nullptr, TxCpltCallback, nullptr);
-    } else {
-        dac7554buf_count = 0;
+        h_spi.DmaTransmit(dac7554buf + (2 * dac7554buf_count), 2, nullptr, TxCpltCallback, context);
+        return;
     }
+    dac7554buf_count = 0;
+    dac->TransferComplete();
 }
 
 
@@ -75,19 +87,52 @@ void TxStartCallback(void* context) {
     return;
 }
 
-void Dac7554::Init()
+static void StreamFill(size_t half)
 {
-    // Initialize PIO - possibly not needed?
-    pin_sync.mode = DSY_GPIO_MODE_OUTPUT_PP;
-    pin_sync.pin  = DaisyPatchSM::D1;
-    dsy_gpio_init(&pin_sync);
+    DPT_TRACE_ENTER(daisy::dpt::TRACE_DAC_EXP, half);
+    uint16_t* buf = dac7554stream[half];
+    if(stream_callback)
+        stream_callback(buf, Dac7554::StreamFrames);
+    else
+        stream_dac->FillFrames(buf, Dac7554::StreamFrames);
 
-    // Initialize SPI
+    // Turn the codes into command words in place
+    for(size_t i = 0; i < Dac7554::StreamFrames * Dac7554::Channels; i++)
+        buf[i] = Dac7554::Command(i & (Dac7554::Channels - 1), buf[i]);
+    DPT_TRACE_EXIT(daisy::dpt::TRACE_DAC_EXP, half);
+}
+
+static void FrameCpltCallback(DMA_HandleTypeDef* hdma)
+{
+    DPT_TRACE_MARK(daisy::dpt::TRACE_DAC_EXP_SPI, Dac7554::Channels);
+    static_cast<Dac7554*>(hdma->Parent)->TransferComplete();
+}
+
+static void StreamHalfCpltCallback(DMA_HandleTypeDef* hdma)
+{
+    StreamFill(0);
+}
 
+static void StreamCpltCallback(DMA_HandleTypeDef* hdma)
+{
+    StreamFill(1);
+}
+
+#if ENABLE_DAC7554_DMA
+extern "C" void DMA2_Stream7_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_spi2_tx);
+}
+#endif
+
+/** 8-bit frames for CHAINED, 16-bit frames with SYNC pulsed between them
+ *  for FRAME and streaming */
+static void InitSpi(unsigned long datasize)
+{
     spi_config.periph         = SpiHandle::Config::Peripheral::SPI_2;
     spi_config.mode           = SpiHandle::Config::Mode::MASTER;
     spi_config.direction      = SpiHandle::Config::Direction::TWO_LINES_TX_ONLY;
-    spi_config.datasize       = 8;
+    spi_config.datasize       = datasize;
     spi_config.clock_polarity = SpiHandle::Config::ClockPolarity::HIGH;
     spi_config.clock_phase    = SpiHandle::Config::ClockPhase::ONE_EDGE;
     spi_config.nss            = SpiHandle::Config::NSS::HARD_OUTPUT;
@@ -100,6 +145,79 @@ void Dac7554::Init()
 
     h_spi.Init(spi_config);
 
+    if(datasize == 16)
+    {
+        // SSOM drives NSS (SYNC) inactive between data frames, for the MIDI
+        // idle cycles the master inserts between them, so every 16-bit word
+        // is latched without ending the transfer.
+        // Only valid with CPHA = 0 (ClockPhase::ONE_EDGE), and SPE must be clear.
+        SPI2->CFG2 |= SPI_CFG2_SSOM;
+        MODIFY_REG(SPI2->CFG2, SPI_CFG2_MIDI, 2 << SPI_CFG2_MIDI_Pos);
+    }
+}
+
+/** FRAME drives SPI2 from its own halfword DMA rather than SpiHandle's,
+ *  which only moves bytes: one request per data frame from the SPI */
+static void InitFrameDma(Dac7554* dac)
+{
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    hdma_spi2_tx.Instance                 = DMA2_Stream7;
+    hdma_spi2_tx.Init.Request             = DMA_REQUEST_SPI2_TX;
+    hdma_spi2_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    hdma_spi2_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
+    hdma_spi2_tx.Init.MemInc              = DMA_MINC_ENABLE;
+    hdma_spi2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_spi2_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+    hdma_spi2_tx.Init.Mode                = DMA_NORMAL;
+    hdma_spi2_tx.Init.Priority            = DMA_PRIORITY_HIGH;
+    hdma_spi2_tx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_spi2_tx);
+
+    hdma_spi2_tx.Parent               = dac;
+    hdma_spi2_tx.XferHalfCpltCallback = nullptr;
+    hdma_spi2_tx.XferCpltCallback     = FrameCpltCallback;
+    HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+}
+
+/** Sends Channels words from dac7554frame as one SPI transaction */
+static bool StartFrame()
+{
+    // The DMA completes as the last word enters the tx FIFO, so the previous
+    // frame may still be shifting out; that is at most a few words, ~1.5us.
+    if(SPI2->CR1 & SPI_CR1_SPE)
+        while(!(SPI2->SR & SPI_SR_EOT)) {}
+    SPI2->CR1 &= ~SPI_CR1_SPE;
+    SPI2->CFG1 &= ~SPI_CFG1_TXDMAEN;
+    SPI2->IFCR = SPI_IFCR_EOTC | SPI_IFCR_TXTFC;
+
+    MODIFY_REG(SPI2->CR2, SPI_CR2_TSIZE, Dac7554::Channels);
+    if(HAL_DMA_Start_IT(&hdma_spi2_tx,
+                        (uintptr_t)dac7554frame,
+                        (uintptr_t)&SPI2->TXDR,
+                        Dac7554::Channels)
+       != HAL_OK)
+        return false;
+    SPI2->CFG1 |= SPI_CFG1_TXDMAEN;
+    SPI2->CR1 |= SPI_CR1_SPE;
+    SPI2->CR1 |= SPI_CR1_CSTART;
+    return true;
+}
+
+void Dac7554::Init(TransferMode mode)
+{
+    _mode = ENABLE_DAC7554_DMA ? mode : TransferMode::CHAINED;
+
+    // Initialize PIO - possibly not needed?
+    pin_sync.mode = DSY_GPIO_MODE_OUTPUT_PP;
+    pin_sync.pin  = DaisyPatchSM::D1;
+    dsy_gpio_init(&pin_sync);
+
+    // Initialize SPI
+    InitSpi(_mode == TransferMode::FRAME ? 16 : 8);
+    if(_mode == TransferMode::FRAME)
+        InitFrameDma(this);
+
     Dac7554_.Initialized = 1;
 }
 
@@ -109,24 +227,157 @@ void Dac7554::Write(uint16_t gogo[4])
 
     for(int i = 0; i < 4; i++)
         _values[i] = gogo[i];
-    dac_ready = true;
 }
 
 void Dac7554::WriteDac7554()
 {
-    for(int i=0; i<4; i++) {
-        uint8_t chan = i;
-        uint16_t cmd = (2 << 14) | (chan << 12) | _values[chan];
+    // The stream DMA picks up _values on its own
+    if(_streaming)
+        return;
+
+    Value* frame = _frames.WriteFrame();
+    for(int i = 0; i < Channels; i++)
+        frame[i] = _values[i];
+
+    // nullptr when a running transfer will pick this frame up on completion
+    const Value* tx = _frames.Publish();
+    if(tx)
+        StartTransfer(tx);
+}
+
+void Dac7554::TransferComplete()
+{
+    const Value* tx = _frames.Complete();
+    if(tx)
+        StartTransfer(tx);
+}
 
-        dac7554buf[2*i] = (cmd >> 8) & 0xff;
-        dac7554buf[2*i+1] = cmd & 0xff;
+void Dac7554::StartTransfer(const Value* frame)
+{
+    // The stream owns SPI2 now, a frame completing after it started is dropped
+    if(_streaming)
+    {
+        _frames.Abort();
+        return;
+    }
+
+    bool started;
+    if(_mode == TransferMode::FRAME)
+    {
+        PackWords(frame, dac7554frame);
+        started = StartFrame();
+    }
+    else
+    {
+        PackBytes(frame, dac7554buf);
+        dac7554buf_count = 0;
+        started          = h_spi.DmaTransmit(
+                      dac7554buf, 2, TxStartCallback, TxCpltCallback, this)
+                  == SpiHandle::Result::OK;
     }
-    h_spi.DmaTransmit(dac7554buf, 2, TxStartCallback, TxCpltCallback, nullptr);
 
     // older blocking method, for reference
     // h_spi.BlockingTransmit(dac7554buf, 2, 100);
 
-    //lock = false;
+    if(!started)
+        _frames.Abort();
+}
+
+void Dac7554::FillFrames(Value* out, size_t size) const
+{
+    for(size_t i = 0; i < size; i++)
+        for(int j = 0; j < Channels; j++)
+            out[i * Channels + j] = _values[j];
+}
+
+void Dac7554::StartStream(StreamCallback callback, float rate)
+{
+    if(!ENABLE_DAC7554_DMA)
+        return;
+    if(_streaming)
+        StopStream();
+    if(_mode != TransferMode::FRAME)
+        InitSpi(16);
+
+    stream_callback = callback;
+    stream_dac      = this;
+    StreamFill(0);
+    StreamFill(1);
+
+    // SPI2 in endless mode: it clocks out whatever lands in TXDR,
+    // so the DMA (not TXP) paces the transfer.
+    SPI2->CR1 &= ~SPI_CR1_SPE;
+    SPI2->CFG1 &= ~SPI_CFG1_TXDMAEN;
+    MODIFY_REG(SPI2->CR2, SPI_CR2_TSIZE, 0);
+    SPI2->CR1 |= SPI_CR1_SPE;
+    SPI2->CR1 |= SPI_CR1_CSTART;
+
+    // DMAMUX request generator turns each TIM12 TRGO into 4 DMA requests,
+    // one per channel word.
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    hdma_spi2_tx.Instance                 = DMA2_Stream7;
+    hdma_spi2_tx.Init.Request             = DMA_REQUEST_GENERATOR0;
+    hdma_spi2_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    hdma_spi2_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
+    hdma_spi2_tx.Init.MemInc              = DMA_MINC_ENABLE;
+    hdma_spi2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_spi2_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+    hdma_spi2_tx.Init.Mode                = DMA_CIRCULAR;
+    hdma_spi2_tx.Init.Priority            = DMA_PRIORITY_HIGH;
+    hdma_spi2_tx.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_spi2_tx);
+
+    HAL_DMA_MuxRequestGeneratorConfigTypeDef gen;
+    gen.SignalID      = HAL_DMAMUX1_REQ_GEN_TIM12_TRGO;
+    gen.Polarity      = HAL_DMAMUX_REQ_GEN_RISING;
+    gen.RequestNumber = Channels;
+    HAL_DMAEx_ConfigMuxRequestGenerator(&hdma_spi2_tx, &gen);
+    HAL_DMAEx_EnableMuxRequestGenerator(&hdma_spi2_tx);
+
+    hdma_spi2_tx.XferHalfCpltCallback = StreamHalfCpltCallback;
+    hdma_spi2_tx.XferCpltCallback     = StreamCpltCallback;
+    HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+    HAL_DMA_Start_IT(&hdma_spi2_tx,
+                     (uintptr_t)dac7554stream,
+                     (uintptr_t)&SPI2->TXDR,
+                     2 * StreamFrames * Channels);
+
+    // TIM12 sits on APB1, timer clock is 2x PCLK1
+    __HAL_RCC_TIM12_CLK_ENABLE();
+    htim_stream.Instance               = TIM12;
+    htim_stream.Init.Prescaler         = 0;
+    htim_stream.Init.CounterMode       = TIM_COUNTERMODE_UP;
+    htim_stream.Init.Period            = (System::GetPClk1Freq() * 2) / rate - 1;
+    htim_stream.Init.ClockDivision     = TIM_CLOCKDIVISION_DIV1;
+    htim_stream.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+    HAL_TIM_Base_Init(&htim_stream);
+
+    TIM_MasterConfigTypeDef master;
+    master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    master.MasterSlaveMode     = TIM_MASTERSLAVEMODE_DISABLE;
+    HAL_TIMEx_MasterConfigSynchronization(&htim_stream, &master);
+
+    _streaming = true;
+    HAL_TIM_Base_Start(&htim_stream);
+}
+
+void Dac7554::StopStream()
+{
+    if(!_streaming)
+        return;
+    HAL_TIM_Base_Stop(&htim_stream);
+    HAL_DMAEx_DisableMuxRequestGenerator(&hdma_spi2_tx);
+    HAL_DMA_Abort(&hdma_spi2_tx);
+
+    // Back to a fixed transfer size per frame
+    SPI2->CR1 |= SPI_CR1_CSUSP;
+    SPI2->CR1 &= ~SPI_CR1_SPE;
+    if(_mode != TransferMode::FRAME)
+        InitSpi(8);
+    else
+        InitFrameDma(this);
+    _streaming = false;
 }
 
 void Dac7554::Clear(void* context, int result) {
@@ -5,9 +5,18 @@
 #include <stdint.h>
 #include <vector>
 #include "daisy_core.h"
+#include "../util/frame_exchange.h"
 
 using namespace std;
 
+/** DMA2_Stream7 and its interrupt vector belong to the driver, for FRAME
+ *  and StartStream(). Define as 0 to keep them for the app: FRAME then
+ *  falls back to CHAINED, and StartStream() does nothing.
+ */
+#ifndef ENABLE_DAC7554_DMA
+#define ENABLE_DAC7554_DMA 1
+#endif
+
 
 namespace daisy
 {
@@ -26,6 +35,10 @@ namespace daisy
     hspi1.Init.CLKPolarity       = SPI_POLARITY_HIGH; // was SPI_POLARITY_LOW;
     hspi1.Init.NSS               = SPI_NSS_SOFT; // was SPI_NSS_HARD_OUTPUT;
     hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_2; // was SPI_BAUDRATEPRESCALER_8;
+
+    TransferMode::FRAME runs SPI2 with 16-bit data frames from its own
+    halfword DMA on DMA2_Stream7, so it needs no change to libDaisy's
+    SpiHandle, whose DMA only moves bytes.
 */
 
 
@@ -53,12 +66,70 @@ class Dac7554
         DAC7554,
     };
 
+    /** How a 4-channel update is clocked out over SPI.
+     *
+     *  CHAINED sends one 2-byte DMA per channel, and relies on the
+     *  end of each transfer to raise SYNC. The completion callback
+     *  starts the next word, so an update costs 4 DMA setups and 4 IRQs.
+     *
+     *  FRAME sends all 4 words in a single 16-bit DMA transaction.
+     *  The SPI pulses SYNC (hardware NSS) between data frames, so the
+     *  DAC still latches every word, for a single completion IRQ.
+     *  Uses DMA2_Stream7, shared with StartStream(), see ENABLE_DAC7554_DMA.
+     */
+    enum class TransferMode
+    {
+        CHAINED,
+        FRAME,
+    };
 
 
     static constexpr int Channels = 4; // #define CONFIG_DAC_CHANNELS 8
 
     typedef uint16_t Value;
 
+    /** Frames per half of the streaming buffer */
+    static constexpr size_t StreamFrames = 48;
+
+    /** Fills one half of the streaming buffer.
+     *  \param out interleaved frames, out[frame * Channels + channel],
+     *         raw DAC codes [0-4095]. The expander outputs are inverted.
+     *  \param size number of frames to fill
+     */
+    typedef void (*StreamCallback)(Value* out, size_t size);
+
+    /** Builds the 16-bit command word for a channel.
+     *  Control bits 0b10 write the input register and update that channel.
+     */
+    static inline uint16_t Command(int channel, Value value)
+    {
+        return (2 << 14) | ((channel & 0x3) << 12) | (value & 0xfff);
+    }
+
+    /** Packs 4 channel values as big-endian byte pairs, for 8-bit transfers.
+     *  \param values channel values [0-4095]
+     *  \param buf destination, 2 * Channels bytes
+     */
+    static inline void PackBytes(const Value* values, uint8_t* buf)
+    {
+        for(int i = 0; i < Channels; i++)
+        {
+            uint16_t cmd = Command(i, values[i]);
+            buf[2 * i]     = (cmd >> 8) & 0xff;
+            buf[2 * i + 1] = cmd & 0xff;
+        }
+    }
+
+    /** Packs 4 channel values as native command words, for 16-bit transfers.
+     *  \param values channel values [0-4095]
+     *  \param buf destination, Channels words
+     */
+    static inline void PackWords(const Value* values, uint16_t* buf)
+    {
+        for(int i = 0; i < Channels; i++)
+            buf[i] = Command(i, values[i]);
+    }
+
     vector<uint8_t> buf;
 
 
@@ -75,17 +146,57 @@ class Dac7554
     // configuration currently only uses SPI1, w/ soft chip select.
 
     /** 
-    Takes an argument for the pin cfg
-    \param pin_cfg should be a pointer to an array of Dac7554::NUM_PINS dsy_gpio_pins
+    Initializes SPI2 and the SYNC pin
+    \param mode FRAME sends each update as a single DMA transaction
     */
-    void Init();
+    void Init(TransferMode mode = TransferMode::FRAME);
     void Set(int channel, Value value) { _values[channel] = value; }
     void Write(uint16_t gogo[4]);
+
+    /** Publishes the current values as a frame, and transmits it if the SPI is idle.
+     *  If a transfer is still running, the frame is queued instead, replacing
+     *  (coalescing) any frame that has not been sent yet. Never blocks.
+     */
     void WriteDac7554();
 
-    bool dac_ready;
-    bool lock;
+    /** Called from the SPI DMA completion, starts the newest pending frame */
+    void TransferComplete();
+
+    TransferMode GetTransferMode() const { return _mode; }
+
+    /** True while a frame is being transmitted */
+    bool IsBusy() const { return _frames.IsBusy(); }
+
+    uint32_t FramesSent() const { return _frames.Sent(); }
+    uint32_t FramesCoalesced() const { return _frames.Coalesced(); }
+    uint32_t FramesDropped() const { return _frames.Dropped(); }
+
+    /** Starts clocking frames out of a circular DMA buffer.
+     *  A timer triggers a 4-word DMA burst into SPI2 per frame, and the
+     *  callback refills each half of the buffer, like DacHandle.
+     *  While streaming, WriteDac7554() no longer transmits; the values
+     *  from Set()/Write() are repeated when no callback is given.
+     *
+     *  Switches SPI2 to 16-bit frames for the stream whatever the
+     *  TransferMode, and StopStream() switches it back. Start it while no
+     *  WriteDac7554() transfer is running, e.g. at startup.
+     *  Uses TIM12 and DMA2_Stream7, see ENABLE_DAC7554_DMA.
+     *  \param callback fills each half, or nullptr to hold the last Write()
+     *  \param rate frame rate in Hz
+     */
+    void StartStream(StreamCallback callback = nullptr, float rate = 48000.f);
+
+    /** Stops the timer and DMA started by StartStream() */
+    void StopStream();
+
+    bool IsStreaming() const { return _streaming; }
+
+    /** Fills frames with the current channel values */
+    void FillFrames(Value* out, size_t size) const;
+
   private:
+    void StartTransfer(const Value* frame);
+
     void Clear(void* context, int result);
     void Reset();
     void SetInternalRef(bool enabled);
@@ -100,8 +211,12 @@ class Dac7554
 
     void SetClearCode(ClearCode code);
 
-    Value    _values[Channels];
-    uint32_t _dataShift = 0;
+    Value        _values[Channels];
+    uint32_t     _dataShift = 0;
+    TransferMode _mode      = TransferMode::FRAME;
+    bool         _streaming = false;
+
+    dpt::FrameExchange<Value, Channels> _frames;
     };
     /** @} */
 } // namespace daisy
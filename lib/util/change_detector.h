@@ -0,0 +1,117 @@
+#pragma once
+#ifndef DPT_UTIL_CHANGE_DETECTOR_H
+#define DPT_UTIL_CHANGE_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Per-channel "changed since last read" flags for noisy control values
+     *
+     *  A channel reports a change when it moves more than its deadband away
+     *  from the last reported value. Reversing direction costs an extra
+     *  hysteresis on top, so noise that jitters around a resting knob
+     *  never fires, while a knob that is being turned still tracks finely.
+     *  From rest, a channel has to move deadband + hysteresis to report.
+     *
+     *  Process() runs wherever the values are updated (an ISR is fine),
+     *  Changed() can be read from any context.
+     */
+    template <size_t N>
+    class ControlChangeDetector
+    {
+      public:
+        static_assert(N <= 32, "Changed flags are a 32-bit mask");
+
+        /** Called from Process() for each channel that changed */
+        typedef void (*ChangeCallback)(size_t channel, float value, void* context);
+
+        ControlChangeDetector() { Init(); }
+        ~ControlChangeDetector() {}
+
+        void Init(float deadband = 0.002f, float hysteresis = 0.002f)
+        {
+            for(size_t i = 0; i < N; i++)
+            {
+                ref_[i] = 0.f;
+                dir_[i] = 0;
+                SetThreshold(i, deadband, hysteresis);
+            }
+            changed_.store(0);
+            callback_ = nullptr;
+            context_  = nullptr;
+        }
+
+        /** \param deadband movement ignored in the current direction
+         *  \param hysteresis extra movement needed to reverse, or start from rest
+         */
+        void SetThreshold(size_t channel, float deadband, float hysteresis)
+        {
+            deadband_[channel]   = deadband;
+            hysteresis_[channel] = hysteresis;
+        }
+
+        void SetCallback(ChangeCallback callback, void* context = nullptr)
+        {
+            context_  = context;
+            callback_ = callback;
+        }
+
+        /** Compares N new values against the last reported ones */
+        void Process(const float* values)
+        {
+            uint32_t mask = 0;
+            for(size_t i = 0; i < N; i++)
+            {
+                float  delta = values[i] - ref_[i];
+                int8_t dir   = delta > 0.f ? 1 : -1;
+                float  mag   = delta * dir;
+                float  threshold
+                    = deadband_[i] + (dir == dir_[i] ? 0.f : hysteresis_[i]);
+                if(mag > threshold)
+                {
+                    ref_[i] = values[i];
+                    dir_[i] = dir;
+                    mask |= 1u << i;
+                }
+            }
+            if(mask == 0)
+                return;
+            changed_.fetch_or(mask);
+            if(callback_)
+                for(size_t i = 0; i < N; i++)
+                    if(mask & (1u << i))
+                        callback_(i, ref_[i], context_);
+        }
+
+        /** True if the channel changed since the last call, clears the flag */
+        bool Changed(size_t channel)
+        {
+            uint32_t bit = 1u << channel;
+            return changed_.fetch_and(~bit) & bit;
+        }
+
+        /** All changed flags as a bitmask, clears them */
+        uint32_t ChangedMask() { return changed_.exchange(0); }
+
+        /** Last reported value of a channel */
+        float Value(size_t channel) const { return ref_[channel]; }
+
+      private:
+        float                 ref_[N];
+        float                 deadband_[N];
+        float                 hysteresis_[N];
+        int8_t                dir_[N];
+        std::atomic<uint32_t> changed_;
+        ChangeCallback        callback_;
+        void*                 context_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
@@ -0,0 +1,228 @@
+#pragma once
+#ifndef DPT_UTIL_CLOCK_FOLLOWER_H
+#define DPT_UTIL_CLOCK_FOLLOWER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Smooth tempo and position from MIDI clock (24 ticks per quarter)
+     *
+     *  Ticks are stamped in microseconds as they arrive and fed to a second
+     *  order phase-locked loop (an alpha-beta filter): every tick the
+     *  prediction error nudges the estimated tick time by alpha and the
+     *  period by beta. Process() then interpolates between the filtered
+     *  tick times, so the jitter on the incoming ticks is averaged out and
+     *  the position moves smoothly and never backwards.
+     *
+     *  A clock with no transport messages starts running on its own after a
+     *  few ticks. Once a start, continue or stop has been seen the transport
+     *  is explicit: after a stop, ticks keep the tempo estimate up to date
+     *  but the position holds until the next start or continue.
+     *
+     *  Tick()/Message() and Process() may run in different interrupts.
+     *  Process() never waits: if it lands in the middle of a Tick() it keeps
+     *  using the previous estimate for that call.
+     *
+     *  No hardware dependencies, so jittered tick streams can be fed to it on the host.
+     */
+    class MidiClockFollower
+    {
+      public:
+        static constexpr int kPpqn = 24;
+
+        MidiClockFollower() { Init(); }
+        ~MidiClockFollower() {}
+
+        /** \param alpha phase correction per tick, lower is smoother but slower to follow
+         */
+        void Init(float alpha = 0.05f)
+        {
+            alpha_      = alpha;
+            beta_       = alpha * alpha / (2.f - alpha); // critically damped
+            seq_        = 0;
+            count_      = -1;
+            ticks_      = 0;
+            last_tick_  = 0;
+            offset_     = 0.f;
+            period_     = 20833.f; // 120 BPM
+            running_    = false;
+            transport_  = false;
+            locked_     = false;
+            epoch_      = 0;
+            last_pos_   = -1.f;
+            last_epoch_ = 0;
+            snap_ = State{count_, last_tick_, offset_, period_, running_, epoch_};
+        }
+
+        /** Feeds a real-time byte: clock, start, continue and stop */
+        void Message(uint8_t status, uint32_t time_us)
+        {
+            switch(status)
+            {
+                case 0xf8: Tick(time_us); break;
+                case 0xfa: Start(); break;
+                case 0xfb: Continue(); break;
+                case 0xfc: Stop(); break;
+                default: break;
+            }
+        }
+
+        /** MIDI start: the next tick is position 0 */
+        void Start()
+        {
+            Begin();
+            count_     = -1;
+            running_   = true;
+            transport_ = true;
+            epoch_++;
+            End();
+        }
+
+        /** MIDI continue: the position goes on from where it stopped */
+        void Continue() { SetRunning(true); }
+
+        /** MIDI stop: the position holds, until Start() or Continue() */
+        void Stop() { SetRunning(false); }
+
+        /** One clock tick, stamped when it arrived */
+        void Tick(uint32_t time_us)
+        {
+            Begin();
+            float interval = (float)(time_us - last_tick_);
+            if(ticks_ == 1)
+                period_ = Clamp(interval);
+            if(ticks_ >= 1)
+            {
+                /** Prediction error against the filtered time of the last tick */
+                float error = interval - offset_ - period_;
+                if(!locked_ && (error > 0.5f * period_ || error < -0.5f * period_))
+                {
+                    /** Tempo jump, start over from the raw interval */
+                    period_ = Clamp(interval);
+                    offset_ = 0.f;
+                }
+                else
+                {
+                    offset_ = -(1.f - alpha_) * error;
+                    period_ = Clamp(period_ + beta_ * error);
+                }
+                locked_ = error < 0.25f * period_ && error > -0.25f * period_;
+            }
+            last_tick_ = time_us;
+            ticks_++;
+            if(!running_ && !transport_ && ticks_ > 2)
+                running_ = true;
+            if(running_)
+                count_++;
+            End();
+        }
+
+        /** Smoothed position in ticks at now_us, e.g. 24 per quarter note.
+         *  Never goes backwards, and holds at the next tick until it arrives.
+         *  Stops moving when no tick came for 4 periods.
+         */
+        float Process(uint32_t now_us)
+        {
+            uint32_t seq = seq_;
+            if(!(seq & 1))
+            {
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+                State s = {count_, last_tick_, offset_, period_, running_, epoch_};
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+                if(seq == seq_)
+                    snap_ = s;
+            }
+            const State& s = snap_;
+            if(s.epoch != last_epoch_)
+            {
+                /** Restarted, allow going back to 0 */
+                last_epoch_ = s.epoch;
+                last_pos_   = -1.f;
+            }
+            if(!s.running || s.count < 0)
+                return last_pos_;
+
+            float since = (float)(now_us - s.last_tick) - s.offset;
+            if(since > 4.f * s.period)
+                return last_pos_;
+            float pos = s.count + since / s.period;
+            pos       = pos > s.count + 1.f ? s.count + 1.f : pos;
+            if(pos > last_pos_)
+                last_pos_ = pos;
+            return last_pos_;
+        }
+
+        /** Estimated microseconds per tick */
+        float Period() const { return period_; }
+
+        float Bpm() const { return 60e6f / (period_ * kPpqn); }
+
+        bool IsRunning() const { return running_; }
+
+        /** True while ticks land within a quarter period of the prediction */
+        bool IsLocked() const { return locked_; }
+
+      private:
+        /** Everything Process() needs, copied as one */
+        struct State
+        {
+            int32_t  count;
+            uint32_t last_tick;
+            float    offset;
+            float    period;
+            bool     running;
+            uint32_t epoch; /**< counts Start()s */
+        };
+
+        static float Clamp(float period)
+        {
+            /** 20 to 1000 BPM */
+            return period < 2500.f ? 2500.f : period > 125000.f ? 125000.f : period;
+        }
+
+        void SetRunning(bool running)
+        {
+            Begin();
+            running_   = running;
+            transport_ = true;
+            End();
+        }
+
+        /** Odd while the estimate is being updated */
+        void Begin()
+        {
+            seq_ = seq_ + 1;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+
+        void End()
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            seq_ = seq_ + 1;
+        }
+
+        float             alpha_, beta_;
+        volatile uint32_t seq_;
+        int32_t           count_;
+        uint32_t          ticks_;
+        uint32_t          last_tick_;
+        float             offset_; /**< filtered minus raw time of the last tick */
+        float             period_;
+        bool              running_;
+        bool              transport_; /**< a start, continue or stop was seen */
+        bool              locked_;
+        uint32_t          epoch_;
+        float             last_pos_; /**< Process() side from here */
+        uint32_t          last_epoch_;
+        State             snap_; /**< last consistent copy, for Process() */
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
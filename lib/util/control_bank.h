@@ -0,0 +1,118 @@
+#pragma once
+#ifndef DPT_UTIL_CONTROL_BANK_H
+#define DPT_UTIL_CONTROL_BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Structure-of-arrays replacement for an array of AnalogControl
+     *
+     *  Every lane does what AnalogControl::Process() does, folded into one
+     *  multiply-add and a one-pole filter:
+     *
+     *      target = raw * gain + offset
+     *      value += coeff * (target - value)
+     *
+     *  Raw values, gains, offsets, coefficients and state each live in their
+     *  own array, so all lanes are processed in one tight loop over the ADC
+     *  DMA buffer with no per-channel pointer chasing or branches.
+     */
+    template <size_t N>
+    class AnalogControlBank
+    {
+      public:
+        AnalogControlBank() {}
+        ~AnalogControlBank() {}
+
+        /** \param raw pointers to each channel's ADC value, e.g. AdcHandle::GetPtr(i).
+         *         When they are consecutive, Process() reads them as one array.
+         */
+        void Init(uint16_t* const* raw)
+        {
+            contiguous_ = true;
+            for(size_t i = 0; i < N; i++)
+            {
+                raw_[i]   = raw[i];
+                value_[i] = 0.f;
+                if(raw[i] != raw[0] + i)
+                    contiguous_ = false;
+            }
+            base_ = raw[0];
+        }
+
+        /** Same scaling as AnalogControl::Init(), 0 to 1 */
+        void InitUnipolar(size_t lane, float samplerate, float slew_seconds = 0.002f)
+        {
+            gain_[lane]   = kNormFactor;
+            offset_[lane] = 0.f;
+            SetSlew(lane, samplerate, slew_seconds);
+        }
+
+        /** Same scaling as AnalogControl::InitBipolarCv(), -1 to 1 with the inverting input stage */
+        void InitBipolarCv(size_t lane, float samplerate, float slew_seconds = 0.002f)
+        {
+            // ((1 - raw * k) - 0.5) * 2
+            gain_[lane]   = -2.f * kNormFactor;
+            offset_[lane] = 1.f;
+            SetSlew(lane, samplerate, slew_seconds);
+        }
+
+        /** Sets the filter coefficient the same way AnalogControl does */
+        void SetSlew(size_t lane, float samplerate, float slew_seconds)
+        {
+            slew_[lane]  = slew_seconds;
+            float coeff  = 1.f / (slew_seconds * samplerate * 0.5f);
+            coeff_[lane] = coeff > 1.f ? 1.f : coeff;
+        }
+
+        /** Retunes every lane's filter for a new processing rate */
+        void SetSampleRate(float samplerate)
+        {
+            for(size_t i = 0; i < N; i++)
+                SetSlew(i, samplerate, slew_[i]);
+        }
+
+        /** Reads, scales and filters all lanes */
+        void Process()
+        {
+            float raw[N];
+            if(contiguous_)
+                for(size_t i = 0; i < N; i++)
+                    raw[i] = (float)base_[i];
+            else
+                for(size_t i = 0; i < N; i++)
+                    raw[i] = (float)*raw_[i];
+
+            for(size_t i = 0; i < N; i++)
+            {
+                float target = raw[i] * gain_[i] + offset_[i];
+                value_[i] += coeff_[i] * (target - value_[i]);
+            }
+        }
+
+        inline float Value(size_t lane) const { return value_[lane]; }
+
+        /** All lanes, N values */
+        inline const float* Values() const { return value_; }
+
+      private:
+        static constexpr float kNormFactor = 1.f / 65536.f;
+
+        float           gain_[N];
+        float           offset_[N];
+        float           coeff_[N];
+        float           slew_[N];
+        float           value_[N];
+        const uint16_t* base_;
+        const uint16_t* raw_[N];
+        bool            contiguous_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
@@ -0,0 +1,202 @@
+#pragma once
+#ifndef DPT_UTIL_CPU_LOAD_H
+#define DPT_UTIL_CPU_LOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef __arm__
+#include <chrono>
+#endif
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Free running 32 bit cycle count
+     *
+     *  On the Cortex-M7 this is the DWT cycle counter, one tick per core
+     *  clock, read in a single load. On the host it falls back to
+     *  std::chrono::steady_clock in nanoseconds, so code timed with it runs
+     *  unchanged in host benchmarks. Either way it wraps, so only take
+     *  differences (a 480MHz core wraps every ~9s).
+     */
+    struct CycleCounter
+    {
+#ifdef __arm__
+        /** Turns the counter on, it is off out of reset (DWT, ARMv7-M) */
+        static void Init()
+        {
+            volatile uint32_t* demcr    = (volatile uint32_t*)0xE000EDFC;
+            volatile uint32_t* dwt_ctrl = (volatile uint32_t*)0xE0001000;
+            volatile uint32_t* dwt_lar  = (volatile uint32_t*)0xE0001FB0;
+            *demcr |= 1u << 24;     // TRCENA
+            *dwt_lar = 0xC5ACCE55;  // unlock, the M7 ignores writes otherwise
+            *Counter() = 0;
+            *dwt_ctrl |= 1u;        // CYCCNTENA
+        }
+
+        static inline uint32_t Now() { return *Counter(); }
+
+        /** Ticks per second, the core clock */
+        static float TicksPerSecond(float core_clock) { return core_clock; }
+
+      private:
+        static inline volatile uint32_t* Counter()
+        {
+            return (volatile uint32_t*)0xE0001004; // DWT_CYCCNT
+        }
+#else
+        static void Init() {}
+
+        static inline uint32_t Now()
+        {
+            return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        /** Ticks per second, nanoseconds whatever the core clock */
+        static float TicksPerSecond(float core_clock) { return 1e9f; }
+#endif
+    };
+
+    /** @brief Execution time of a periodic callback against its deadline
+     *
+     *  Begin()/End() around the callback, or Add() a measured duration.
+     *  Each run is compared to the period it has to fit in, and kept as:
+     *  a smoothed average load, the peak and the minimum, a histogram of
+     *  the load in kBinWidth steps for percentiles, and a count of runs
+     *  that took longer than the period (xruns, the output glitched).
+     *
+     *  Times are in the ticks of whatever clock measured them, e.g.
+     *  CycleCounter, given to Init() as ticks per second.
+     *
+     *  End()/Add() run in the callback's context, the getters read single
+     *  words, so they can be polled from the main loop. Reset() should not
+     *  race End(), DPT blocks interrupts around it.
+     *  No hardware dependencies besides CycleCounter, so it works the same on the host.
+     */
+    class CpuLoadMeter
+    {
+      public:
+        /** Histogram bins, the last one holds everything from kBins - 1 steps up */
+        static constexpr size_t kBins = 24;
+
+        /** Load per histogram bin */
+        static constexpr float kBinWidth = 0.05f;
+
+        CpuLoadMeter() { Init(1.f, 1.f); }
+        ~CpuLoadMeter() {}
+
+        /** \param ticks_per_second rate of the clock the times are measured with
+         *  \param period deadline of one run in seconds, e.g. block size / samplerate
+         */
+        void Init(float ticks_per_second, float period)
+        {
+            ticks_per_second_ = ticks_per_second;
+            SetPeriod(period);
+            Reset();
+        }
+
+        /** Changes the deadline, e.g. after the block size changed */
+        void SetPeriod(float period)
+        {
+            budget_     = period * ticks_per_second_;
+            inv_budget_ = budget_ > 0.f ? 1.f / budget_ : 0.f;
+        }
+
+        void Reset()
+        {
+            runs_    = 0;
+            xruns_   = 0;
+            average_ = 0.f;
+            peak_    = 0.f;
+            min_     = 0.f;
+            last_    = 0;
+            for(size_t i = 0; i < kBins; i++)
+                histogram_[i] = 0;
+        }
+
+        inline void Begin() { start_ = CycleCounter::Now(); }
+
+        inline void End() { Add(CycleCounter::Now() - start_); }
+
+        /** Adds one run that took ticks */
+        void Add(uint32_t ticks)
+        {
+            float load = ticks * inv_budget_;
+            last_      = ticks;
+            if(runs_ == 0)
+            {
+                average_ = load;
+                peak_    = load;
+                min_     = load;
+            }
+            else
+            {
+                average_ += (load - average_) * kSmoothing;
+                peak_ = load > peak_ ? load : peak_;
+                min_  = load < min_ ? load : min_;
+            }
+            size_t bin = (size_t)(load * (1.f / kBinWidth));
+            histogram_[bin < kBins ? bin : kBins - 1]++;
+            if(load > 1.f)
+                xruns_++;
+            runs_++;
+        }
+
+        /** Smoothed load, 1 is the whole period */
+        float Average() const { return average_; }
+
+        float Peak() const { return peak_; }
+
+        float Min() const { return min_; }
+
+        /** Load that p of the runs stayed under, e.g. 0.99, to kBinWidth */
+        float Percentile(float p) const
+        {
+            uint32_t total = 0;
+            for(size_t i = 0; i < kBins; i++)
+                total += histogram_[i];
+            uint32_t target = (uint32_t)(p * total + 0.5f);
+            uint32_t count  = 0;
+            for(size_t i = 0; i < kBins; i++)
+            {
+                count += histogram_[i];
+                if(count >= target && count > 0)
+                    return (i + 1) * kBinWidth;
+            }
+            return 0.f;
+        }
+
+        /** Runs in histogram bin i, [i, i + 1) * kBinWidth */
+        uint32_t Histogram(size_t i) const { return histogram_[i]; }
+
+        /** Runs that overran the period */
+        uint32_t Xruns() const { return xruns_; }
+
+        uint32_t Runs() const { return runs_; }
+
+        /** Duration of the last run in seconds */
+        float LastSeconds() const { return last_ / ticks_per_second_; }
+
+        /** Average duration of a run in seconds */
+        float AverageSeconds() const { return average_ * budget_ / ticks_per_second_; }
+
+      private:
+        /** Average over roughly the last 100 runs */
+        static constexpr float kSmoothing = 0.01f;
+
+        float             ticks_per_second_;
+        float             budget_, inv_budget_;
+        uint32_t          start_;
+        volatile uint32_t runs_, xruns_;
+        volatile float    average_, peak_, min_;
+        volatile uint32_t last_;
+        uint32_t          histogram_[kBins];
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
@@ -0,0 +1,211 @@
+#pragma once
+#ifndef DPT_UTIL_CV_CALIBRATION_H
+#define DPT_UTIL_CV_CALIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cv_code.h"
+
+namespace daisy
+{
+namespace dpt
+{
+    /** Outputs that carry a calibration */
+    enum
+    {
+        CV_CAL_OUT_1 = 0,
+        CV_CAL_OUT_2,
+        CV_CAL_EXP_1,
+        CV_CAL_EXP_2,
+        CV_CAL_EXP_3,
+        CV_CAL_EXP_4,
+        CV_CAL_LAST,
+    };
+
+    /** Measured voltages for a handful of DAC codes on one output.
+     *  Two points give gain and offset, more points give a piecewise
+     *  correction (e.g. for the inverted DAC7554 stage).
+     */
+    struct CvCalibrationPoints
+    {
+        static constexpr int kMaxPoints = 9;
+
+        uint32_t num_points;
+        float    code[kMaxPoints];
+        float    volts[kMaxPoints];
+
+        /** Copies up to kMaxPoints code/voltage pairs */
+        void Set(const float* codes, const float* measured, int n)
+        {
+            num_points = n < kMaxPoints ? n : kMaxPoints;
+            for(uint32_t i = 0; i < num_points; i++)
+            {
+                code[i]  = codes[i];
+                volts[i] = measured[i];
+            }
+        }
+
+        /** The ideal straight line: code = volts * codes_per_volt + code_offset */
+        void SetNominal(float codes_per_volt, float code_offset)
+        {
+            num_points = 2;
+            code[0]    = 0.f;
+            code[1]    = 4095.f;
+            volts[0]   = (0.f - code_offset) / codes_per_volt;
+            volts[1]   = (4095.f - code_offset) / codes_per_volt;
+        }
+    };
+
+    /** Calibration block as stored in QSPI */
+    struct CvCalibrationData
+    {
+        static constexpr uint32_t kMagic   = 0x43545044; // "DPTC"
+        static constexpr uint32_t kVersion = 1;
+
+        uint32_t            magic;
+        uint32_t            version;
+        CvCalibrationPoints outputs[CV_CAL_LAST];
+        uint32_t            checksum;
+
+        void SetDefaults()
+        {
+            magic   = kMagic;
+            version = kVersion;
+            outputs[CV_CAL_OUT_1].SetNominal(kCvCodesPerVolt, kCvCodeOffset);
+            outputs[CV_CAL_OUT_2].SetNominal(kCvCodesPerVolt, kCvCodeOffset);
+            for(int i = CV_CAL_EXP_1; i < CV_CAL_LAST; i++)
+                outputs[i].SetNominal(kCvExpCodesPerVolt, kCvExpCodeOffset);
+            UpdateChecksum();
+        }
+
+        uint32_t Checksum() const
+        {
+            const uint8_t* p    = (const uint8_t*)this;
+            uint32_t       hash = 2166136261u; // FNV-1a
+            for(size_t i = 0; i < offsetof(CvCalibrationData, checksum); i++)
+                hash = (hash ^ p[i]) * 16777619u;
+            return hash;
+        }
+
+        void UpdateChecksum() { checksum = Checksum(); }
+
+        bool IsValid() const
+        {
+            return magic == kMagic && version == kVersion
+                   && checksum == Checksum();
+        }
+    };
+
+    /** @brief Calibration as a piecewise linear voltage to code function
+     *
+     *  Each measured point anchors a segment that runs to the next one, and
+     *  the end segments carry on with their slope past the outermost points,
+     *  so voltages outside the measured span still reach every code up to
+     *  the DAC's 0/4095 limits. The breakpoints are kept exactly: a measured
+     *  voltage converts to its measured code.
+     *
+     *  Finding the segment is an index into kCells equal voltage steps over
+     *  the measured span, which gives the segment the step starts in, then
+     *  a compare per breakpoint inside that step (usually one at most). Converting
+     *  is then one multiply-add and the same clamp as the uncalibrated path,
+     *  regardless of the number of points.
+     */
+    class CvCalibrationTable
+    {
+      public:
+        static constexpr int kCells = 32;
+
+        CvCalibrationTable() {}
+        ~CvCalibrationTable() {}
+
+        /** Builds the table from measured points.
+         *  \retval false if there are fewer than 2 points, or the voltages
+         *          are not strictly monotonic in code.
+         */
+        bool Build(const CvCalibrationPoints& points)
+        {
+            int n = points.num_points;
+            if(n < 2 || n > CvCalibrationPoints::kMaxPoints)
+                return false;
+
+            /** Sort by voltage, so inverted outputs work the same way */
+            float code[CvCalibrationPoints::kMaxPoints];
+            float volts[CvCalibrationPoints::kMaxPoints];
+            for(int i = 0; i < n; i++)
+            {
+                int j = i;
+                for(; j > 0 && volts[j - 1] > points.volts[i]; j--)
+                {
+                    volts[j] = volts[j - 1];
+                    code[j]  = code[j - 1];
+                }
+                volts[j] = points.volts[i];
+                code[j]  = points.code[i];
+            }
+            for(int i = 1; i < n; i++)
+            {
+                if(volts[i] <= volts[i - 1])
+                    return false;
+                /** Code has to move the same way across all points */
+                if((code[i] - code[i - 1]) * (code[1] - code[0]) <= 0.f)
+                    return false;
+            }
+
+            /** Segment i starts at point i, the last one extends the one before */
+            for(int i = 0; i < n; i++)
+            {
+                int k     = i < n - 1 ? i : n - 2;
+                volts_[i] = volts[i];
+                code_[i]  = code[i];
+                slope_[i] = (code[k + 1] - code[k]) / (volts[k + 1] - volts[k]);
+            }
+            last_ = n - 1;
+
+            const float step = (volts[n - 1] - volts[0]) / kCells;
+            inv_step_        = 1.f / step;
+            int k            = 0;
+            for(int c = 0; c < kCells; c++)
+            {
+                /** Half a step back, so rounding in Convert() can't land
+                 *  past a breakpoint that sits on a step boundary */
+                float v = volts[0] + (c - 0.5f) * step;
+                while(k < last_ && v >= volts[k + 1])
+                    k++;
+                cell_[c] = k;
+            }
+            return true;
+        }
+
+        /** Volts to 12-bit code */
+        inline uint16_t Convert(float v) const
+        {
+            float x = (v - volts_[0]) * inv_step_;
+            x       = x < 0.f ? 0.f : x;
+            x       = x < (float)(kCells - 1) ? x : (float)(kCells - 1);
+            int i   = cell_[(int)x];
+            while(i < last_ && v >= volts_[i + 1])
+                i++;
+            return LinearToCode(v - volts_[i], slope_[i], code_[i]);
+        }
+
+        void ConvertBlock(const float* in, uint16_t* out, size_t size) const
+        {
+            for(size_t i = 0; i < size; i++)
+                out[i] = Convert(in[i]);
+        }
+
+      private:
+        static constexpr int kMaxPoints = CvCalibrationPoints::kMaxPoints;
+
+        float   inv_step_ = 0.f;
+        int     last_     = 0;
+        float   volts_[kMaxPoints] = {};
+        float   code_[kMaxPoints]  = {};
+        float   slope_[kMaxPoints] = {};
+        uint8_t cell_[kCells]      = {};
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
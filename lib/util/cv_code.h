@@ -0,0 +1,168 @@
+#pragma once
+#ifndef DPT_UTIL_CV_CODE_H
+#define DPT_UTIL_CV_CODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** Internal DAC: -5V to 10V over 0-4095 */
+    static constexpr float kCvCodesPerVolt = 273.f;
+    static constexpr float kCvCodeOffset   = 5.f * kCvCodesPerVolt;
+
+    /** DAC7554 expander: -7V to 7V over 0-4095, the output stage is inverted */
+    static constexpr float kCvExpCodesPerVolt = -4095.f / 14.f;
+    static constexpr float kCvExpCodeOffset   = 4095.f / 2.f;
+
+    /** (int32_t)x, saturating at the int32 limits and 0 for NaN.
+     *  That's what vcvt does on the Cortex-M7, where this is a plain cast.
+     *  Elsewhere an out of range cast is undefined (x86 gives INT32_MIN).
+     */
+    inline int32_t TruncateToInt(float x)
+    {
+#ifdef __arm__
+        return (int32_t)x;
+#else
+        if(x != x)
+            return 0;
+        if(x >= 2147483648.f)
+            return INT32_MAX;
+        if(x <= -2147483648.f)
+            return INT32_MIN;
+        return (int32_t)x;
+#endif // __arm__
+    }
+
+    /** Clamps to 0-4095, usat on the Cortex-M7 */
+    inline int32_t Saturate12(int32_t x)
+    {
+#if defined(__arm__) && defined(__ARM_FEATURE_DSP)
+        asm("usat %0, #12, %1" : "=r"(x) : "r"(x));
+        return x;
+#else
+        return x < 0 ? 0 : (x > 4095 ? 4095 : x);
+#endif // __arm__
+    }
+
+    /** Two 16-bit codes in one word, lo first in memory, pkhbt on the Cortex-M7 */
+    inline uint32_t PackCodes(int32_t lo, int32_t hi)
+    {
+#if defined(__arm__) && defined(__ARM_FEATURE_DSP)
+        uint32_t out;
+        asm("pkhbt %0, %1, %2, lsl #16" : "=r"(out) : "r"(lo), "r"(hi));
+        return out;
+#else
+        return ((uint32_t)lo & 0xffff) | ((uint32_t)hi << 16);
+#endif // __arm__
+    }
+
+    /** code = clamp(in * scale + offset, 0, 4095), truncated like a (uint16_t) cast.
+     *  Clamps in float, NaN gives 0. The portable reference for LinearToCodeSat.
+     */
+    inline uint16_t LinearToCodeFloat(float in, float scale, float offset)
+    {
+        float pre = in * scale + offset;
+        pre       = pre > 0.f ? pre : 0.f;
+        pre       = pre < 4095.f ? pre : 4095.f;
+        return (uint16_t)pre;
+    }
+
+    /** Same codes as LinearToCodeFloat, by truncating first and saturating the
+     *  integer: vcvt and usat, no compares or branches on the Cortex-M7.
+     */
+    inline uint16_t LinearToCodeSat(float in, float scale, float offset)
+    {
+        return Saturate12(TruncateToInt(in * scale + offset));
+    }
+
+    /** code = clamp(in * scale + offset, 0, 4095), truncated like a (uint16_t) cast */
+    inline uint16_t LinearToCode(float in, float scale, float offset)
+    {
+#if defined(__arm__) && defined(__ARM_FEATURE_DSP)
+        return LinearToCodeSat(in, scale, offset);
+#else
+        return LinearToCodeFloat(in, scale, offset);
+#endif // __arm__
+    }
+
+    /** LinearToCodeBlock on the Cortex-M7: four at a time through
+     *  LinearToCodeSat, storing two codes per 32-bit write. There it is
+     *  branchless: vcvt to int, usat to 12 bits, and pkhbt to pack.
+     *  The host builds the same loop in C, so it can be checked against
+     *  LinearToCodeFloat there, but it is slower than the plain loop.
+     *  Assumes a little-endian target, like both of them.
+     */
+    inline void LinearToCodeBlockSat(const float* in,
+                                     uint16_t*    out,
+                                     size_t       size,
+                                     float        scale,
+                                     float        offset)
+    {
+        size_t i = 0;
+        /** Align out to a word for the paired stores */
+        if(size > 0 && ((uintptr_t)out & 2))
+        {
+            out[0] = LinearToCodeSat(in[0], scale, offset);
+            i      = 1;
+        }
+        for(; i + 4 <= size; i += 4)
+        {
+            int32_t  a = Saturate12(TruncateToInt(in[i] * scale + offset));
+            int32_t  b = Saturate12(TruncateToInt(in[i + 1] * scale + offset));
+            int32_t  c = Saturate12(TruncateToInt(in[i + 2] * scale + offset));
+            int32_t  d = Saturate12(TruncateToInt(in[i + 3] * scale + offset));
+            uint32_t words[2] = {PackCodes(a, b), PackCodes(c, d)};
+            // One 64-bit or two 32-bit stores, memcpy keeps it legal C++
+            memcpy(out + i, words, sizeof(words));
+        }
+        for(; i < size; i++)
+            out[i] = LinearToCodeSat(in[i], scale, offset);
+    }
+
+    /** Converts a buffer of values to 12-bit codes, see LinearToCode.
+     *  LinearToCodeBlockSat with the DSP extension, a plain
+     *  LinearToCodeFloat loop everywhere else.
+     */
+    inline void
+    LinearToCodeBlock(const float* in, uint16_t* out, size_t size, float scale, float offset)
+    {
+#if defined(__arm__) && defined(__ARM_FEATURE_DSP)
+        LinearToCodeBlockSat(in, out, size, scale, offset);
+#else
+        for(size_t i = 0; i < size; i++)
+            out[i] = LinearToCodeFloat(in[i], scale, offset);
+#endif // __arm__
+    }
+
+    /** Volts (-5 to 10) to internal DAC codes */
+    inline uint16_t CvVoltageToCode(float in)
+    {
+        return LinearToCode(in, kCvCodesPerVolt, kCvCodeOffset);
+    }
+
+    /** Volts (-5 to 10) to internal DAC codes, size values at a time */
+    inline void CvVoltageToCodeBlock(const float* in, uint16_t* out, size_t size)
+    {
+        LinearToCodeBlock(in, out, size, kCvCodesPerVolt, kCvCodeOffset);
+    }
+
+    /** Volts (-7 to 7) to DAC7554 codes, inverted for the output stage */
+    inline uint16_t CvExpVoltageToCode(float in)
+    {
+        return LinearToCode(in, kCvExpCodesPerVolt, kCvExpCodeOffset);
+    }
+
+    /** Volts (-7 to 7) to DAC7554 codes, size values at a time */
+    inline void CvExpVoltageToCodeBlock(const float* in, uint16_t* out, size_t size)
+    {
+        LinearToCodeBlock(in, out, size, kCvExpCodesPerVolt, kCvExpCodeOffset);
+    }
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
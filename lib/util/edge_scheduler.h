@@ -0,0 +1,169 @@
+#pragma once
+#ifndef DPT_UTIL_EDGE_SCHEDULER_H
+#define DPT_UTIL_EDGE_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Pending gate edges, ordered by time
+     *
+     *  A binary min-heap in a fixed array, so scheduling and popping an edge
+     *  is O(log N) with no allocation. Scheduling an edge for a gate at a time
+     *  that already has one for that gate replaces its state instead of
+     *  adding a second edge (the last one scheduled wins), so back to back
+     *  pulses that meet end to end simply stay high.
+     *
+     *  Times are any free-running 32 bit clock (e.g. microseconds), compared
+     *  with signed differences so they can wrap.
+     *
+     *  Not thread safe, callers serialize access (DPT blocks interrupts).
+     *  No hardware dependencies, so ordering can be checked on the host.
+     */
+    template <size_t N>
+    class GateEdgeScheduler
+    {
+      public:
+        struct Edge
+        {
+            uint32_t time;
+            uint8_t  gate;
+            uint8_t  state;
+        };
+
+        /** Sets a gate, called from Process() for every edge that is due */
+        typedef void (*ApplyCallback)(uint8_t gate, bool state, void* context);
+
+        GateEdgeScheduler() { Init(); }
+        ~GateEdgeScheduler() {}
+
+        void Init()
+        {
+            size_    = 0;
+            dropped_ = 0;
+        }
+
+        /** Adds an edge, or replaces the state of gate's edge at the same time.
+         *  \retval false if the heap is full, the edge is dropped
+         */
+        bool Schedule(uint32_t time, uint8_t gate, bool state)
+        {
+            for(size_t i = 0; i < size_; i++)
+            {
+                if(heap_[i].time == time && heap_[i].gate == gate)
+                {
+                    heap_[i].state = state;
+                    return true;
+                }
+            }
+            if(size_ >= N)
+            {
+                dropped_++;
+                return false;
+            }
+            Edge edge  = {time, gate, (uint8_t)state};
+            size_t pos = size_++;
+            while(pos > 0)
+            {
+                size_t parent = (pos - 1) / 2;
+                if(!Before(edge.time, heap_[parent].time))
+                    break;
+                heap_[pos] = heap_[parent];
+                pos        = parent;
+            }
+            heap_[pos] = edge;
+            return true;
+        }
+
+        /** Rising edge at time, falling edge width later */
+        bool Pulse(uint32_t time, uint8_t gate, uint32_t width)
+        {
+            /** No point in the rising edge without its falling edge */
+            if(size_ + 2 > N)
+            {
+                dropped_ += 2;
+                return false;
+            }
+            return Schedule(time, gate, true) && Schedule(time + width, gate, false);
+        }
+
+        /** Removes every pending edge for gate */
+        void Cancel(uint8_t gate)
+        {
+            size_t n = 0;
+            for(size_t i = 0; i < size_; i++)
+                if(heap_[i].gate != gate)
+                    heap_[n++] = heap_[i];
+            size_ = n;
+            for(size_t i = size_ / 2; i-- > 0;)
+                SiftDown(i);
+        }
+
+        void Clear() { size_ = 0; }
+
+        /** Applies every edge due at or before now, oldest first.
+         *  \retval the number of edges applied
+         */
+        size_t Process(uint32_t now, ApplyCallback apply, void* context)
+        {
+            size_t n = 0;
+            while(size_ > 0 && !Before(now, heap_[0].time))
+            {
+                Edge edge = heap_[0];
+                heap_[0]  = heap_[--size_];
+                SiftDown(0);
+                apply(edge.gate, edge.state, context);
+                n++;
+            }
+            return n;
+        }
+
+        /** Time of the earliest pending edge.
+         *  \retval false if nothing is scheduled
+         */
+        bool Next(uint32_t* time) const
+        {
+            if(size_ == 0)
+                return false;
+            *time = heap_[0].time;
+            return true;
+        }
+
+        size_t Size() const { return size_; }
+
+        /** Edges that didn't fit */
+        uint32_t Dropped() const { return dropped_; }
+
+      private:
+        static bool Before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+        void SiftDown(size_t pos)
+        {
+            Edge edge = heap_[pos];
+            for(;;)
+            {
+                size_t child = 2 * pos + 1;
+                if(child >= size_)
+                    break;
+                if(child + 1 < size_ && Before(heap_[child + 1].time, heap_[child].time))
+                    child++;
+                if(!Before(heap_[child].time, edge.time))
+                    break;
+                heap_[pos] = heap_[child];
+                pos        = child;
+            }
+            heap_[pos] = edge;
+        }
+
+        Edge     heap_[N];
+        size_t   size_;
+        uint32_t dropped_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
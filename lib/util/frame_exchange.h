@@ -0,0 +1,141 @@
+#pragma once
+#ifndef DPT_UTIL_FRAME_EXCHANGE_H
+#define DPT_UTIL_FRAME_EXCHANGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Lock-free handoff of fixed-size frames to a DMA consumer
+     *
+     *  Triple buffer: the producer writes its own slot, the transfer in
+     *  flight reads another, and the third holds the newest published frame.
+     *  Publishing swaps the producer slot with the ready slot, so a frame is
+     *  never written while it is being sent, and nobody ever waits.
+     *
+     *  The "bus" is owned by whoever wins the busy flag. When a frame is
+     *  published while a transfer is running, it is coalesced with any frame
+     *  still waiting, and the completion picks up the newest one.
+     *
+     *  No hardware dependencies, so it can be driven on the host with a
+     *  mocked transfer completion.
+     *
+     *  Usage:
+     *  \code
+     *  T* f = ex.WriteFrame();     // fill f[0..N-1]
+     *  if(const T* tx = ex.Publish())
+     *      StartTransfer(tx);      // call ex.Abort() if that fails
+     *  // in the transfer complete ISR
+     *  if(const T* tx = ex.Complete())
+     *      StartTransfer(tx);
+     *  \endcode
+     */
+    template <typename T, size_t N>
+    class FrameExchange
+    {
+      public:
+        FrameExchange() { Reset(); }
+
+        void Reset()
+        {
+            write_idx_ = 0;
+            send_idx_  = 1;
+            state_.store(2);
+            busy_.store(false);
+            sent_      = 0;
+            coalesced_ = 0;
+            dropped_   = 0;
+        }
+
+        /** Producer's private frame, safe to write at any time */
+        T* WriteFrame() { return frames_[write_idx_]; }
+
+        /** Publishes the producer frame.
+         *  \retval the frame to transmit if the caller now owns the bus,
+         *          nullptr if a running transfer will pick it up.
+         */
+        const T* Publish()
+        {
+            uint8_t old = state_.exchange(write_idx_ | kDirty);
+            write_idx_  = old & kIndexMask;
+            if(old & kDirty)
+                coalesced_++;
+            return Claim();
+        }
+
+        /** Called when a transfer finishes.
+         *  \retval the next frame to transmit, or nullptr if the bus is now free.
+         */
+        const T* Complete()
+        {
+            sent_++;
+            const T* next = Take();
+            if(next)
+                return next;
+            busy_.store(false);
+            // A publish may have lost the race for the busy flag just now
+            return Claim();
+        }
+
+        /** Releases the bus after a transfer could not be started */
+        void Abort()
+        {
+            dropped_++;
+            busy_.store(false);
+        }
+
+        bool IsBusy() const { return busy_.load(); }
+
+        /** Frames that finished transmitting */
+        uint32_t Sent() const { return sent_; }
+
+        /** Frames replaced by a newer one before they were sent */
+        uint32_t Coalesced() const { return coalesced_; }
+
+        /** Frames whose transfer failed to start */
+        uint32_t Dropped() const { return dropped_; }
+
+      private:
+        static constexpr uint8_t kIndexMask = 0x3;
+        static constexpr uint8_t kDirty     = 0x4;
+
+        /** Takes the bus if it is free and there is something to send */
+        const T* Claim()
+        {
+            if(!(state_.load() & kDirty))
+                return nullptr;
+            bool expected = false;
+            if(!busy_.compare_exchange_strong(expected, true))
+                return nullptr;
+            const T* next = Take();
+            if(!next)
+                busy_.store(false);
+            return next;
+        }
+
+        /** Only called by the bus owner */
+        const T* Take()
+        {
+            if(!(state_.load() & kDirty))
+                return nullptr;
+            uint8_t old = state_.exchange(send_idx_);
+            send_idx_   = old & kIndexMask;
+            return frames_[send_idx_];
+        }
+
+        T                    frames_[3][N];
+        uint8_t              write_idx_;
+        uint8_t              send_idx_;
+        std::atomic<uint8_t> state_;
+        std::atomic<bool>    busy_;
+        volatile uint32_t    sent_, coalesced_, dropped_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
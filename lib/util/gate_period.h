@@ -0,0 +1,138 @@
+#pragma once
+#ifndef DPT_UTIL_GATE_PERIOD_H
+#define DPT_UTIL_GATE_PERIOD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Running period estimate of a clock on a gate input
+     *
+     *  Fed the timestamps of rising edges. Takes the median of the last few
+     *  intervals, so a single late or early edge (or a missed one) doesn't
+     *  move the estimate, and smooths that further while the tempo is
+     *  steady. A jump of more than 10% is taken at once, after it has held
+     *  for a majority of the intervals in the window.
+     *
+     *  Edges closer than the minimum period are ignored as contact bounce,
+     *  and a gap longer than the maximum starts over.
+     *
+     *  Edge() and the getters may run in different contexts, each value is
+     *  read in one access, so at worst a reader sees the previous estimate.
+     *  No hardware dependencies, so jittered edge streams can be fed to it on the host.
+     */
+    class GatePeriodEstimator
+    {
+      public:
+        /** Intervals the median is taken over */
+        static constexpr size_t kWindow = 5;
+
+        GatePeriodEstimator() { Init(1e6f); }
+        ~GatePeriodEstimator() {}
+
+        /** \param ticks_per_second rate of the timestamps passed to Edge()
+         *  \param min_period shortest period in seconds, faster edges are bounce
+         *  \param max_period longest period in seconds, e.g. 4s is 15 BPM at one edge per beat
+         */
+        void Init(float ticks_per_second, float min_period = 0.002f, float max_period = 4.f)
+        {
+            ticks_per_second_ = ticks_per_second;
+            min_ticks_        = (uint32_t)(min_period * ticks_per_second);
+            max_ticks_        = (uint32_t)(max_period * ticks_per_second);
+            Reset();
+        }
+
+        /** Forgets the tempo, e.g. after the clock was unplugged */
+        void Reset()
+        {
+            edges_     = 0;
+            intervals_ = 0;
+            last_      = 0;
+            period_    = 0.f;
+        }
+
+        /** One rising edge, stamped when it arrived */
+        void Edge(uint32_t time)
+        {
+            uint32_t interval = time - last_;
+            if(edges_ > 0 && interval < min_ticks_)
+                return;
+            last_ = time;
+            if(edges_ == 0 || interval > max_ticks_)
+            {
+                /** First edge, or after a long gap: a new clock */
+                edges_     = 1;
+                intervals_ = 0;
+                return;
+            }
+            edges_++;
+            window_[intervals_ % kWindow] = interval;
+            intervals_++;
+
+            float median = Median();
+            float period = period_;
+            if(period <= 0.f || median > 1.1f * period || median < 0.9f * period)
+                period = median;
+            else
+                period += 0.25f * (median - period);
+            period_ = period;
+        }
+
+        /** Estimated period in timestamp ticks, 0 until two edges came in */
+        float PeriodTicks() const { return period_; }
+
+        /** Estimated period in seconds, 0 until two edges came in */
+        float Period() const { return period_ / ticks_per_second_; }
+
+        /** \param ppqn edges per quarter note, e.g. 1, 4 for 16ths, 24 for DIN sync */
+        float Bpm(int ppqn = 1) const
+        {
+            float period = Period();
+            return period > 0.f ? 60.f / (period * ppqn) : 0.f;
+        }
+
+        /** True while edges keep coming, no more than 2 periods apart */
+        bool IsRunning(uint32_t now) const
+        {
+            float period = period_;
+            return period > 0.f && (float)(now - last_) < 2.f * period;
+        }
+
+        /** Time of the last accepted edge */
+        uint32_t Last() const { return last_; }
+
+      private:
+        float Median() const
+        {
+            size_t   n = intervals_ < kWindow ? intervals_ : kWindow;
+            uint32_t sorted[kWindow];
+            for(size_t i = 0; i < n; i++)
+            {
+                /** Insertion sort, the window is tiny */
+                uint32_t v = window_[i];
+                size_t   j = i;
+                for(; j > 0 && sorted[j - 1] > v; j--)
+                    sorted[j] = sorted[j - 1];
+                sorted[j] = v;
+            }
+            if(n & 1)
+                return (float)sorted[n / 2];
+            return 0.5f * ((float)sorted[n / 2 - 1] + (float)sorted[n / 2]);
+        }
+
+        float             ticks_per_second_;
+        uint32_t          min_ticks_, max_ticks_;
+        uint32_t          window_[kWindow];
+        uint32_t          edges_;
+        uint32_t          intervals_;
+        volatile uint32_t last_;
+        volatile float    period_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef DPT_UTIL_MIDI_ENCODER_H
+#define DPT_UTIL_MIDI_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "midi_parser.h"
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Serializes MIDI messages with running status
+     *
+     *  A channel message with the same status byte as the previous one is
+     *  sent as its data bytes only, so a run of notes or CCs on one channel
+     *  costs 2 bytes per message instead of 3. Real-time bytes go out as-is
+     *  and leave running status alone, system common messages cancel it,
+     *  the same rules MidiByteParser decodes with.
+     *
+     *  No hardware dependencies, so it can be checked against the parser on the host.
+     */
+    class MidiRunningStatusEncoder
+    {
+      public:
+        /** Longest encoding of one message */
+        static constexpr size_t kMaxMessageBytes = 3;
+
+        MidiRunningStatusEncoder() { Reset(); }
+        ~MidiRunningStatusEncoder() {}
+
+        /** Sends the status byte with the next message, e.g. after the line was idle */
+        void Reset() { status_ = 0; }
+
+        /** Appends msg to out.
+         *  \retval the number of bytes written, at most kMaxMessageBytes
+         */
+        size_t Encode(const MidiMessage& msg, uint8_t* out)
+        {
+            size_t n = 0;
+            if(msg.status >= 0xf8)
+            {
+                out[n++] = msg.status;
+                return n;
+            }
+            if(msg.status >= 0xf0)
+            {
+                status_  = 0;
+                out[n++] = msg.status;
+            }
+            else if(msg.status != status_)
+            {
+                status_  = msg.status;
+                out[n++] = msg.status;
+            }
+            for(size_t i = 0; i < msg.size && i < 2; i++)
+                out[n++] = msg.data[i] & 0x7f;
+            return n;
+        }
+
+        /** Pops messages from queue and encodes them into out, until the queue
+         *  is empty or the next message might not fit. Messages that don't fit
+         *  stay queued for the next batch.
+         *  \param queue anything with bool Pop(MidiMessage*), e.g. SpscQueue
+         *  \param size of out, at least kMaxMessageBytes
+         *  \retval the number of bytes written
+         */
+        template <typename Queue>
+        size_t EncodeBatch(Queue& queue, uint8_t* out, size_t size)
+        {
+            size_t      n = 0;
+            MidiMessage msg;
+            while(n + kMaxMessageBytes <= size && queue.Pop(&msg))
+                n += Encode(msg, out + n);
+            return n;
+        }
+
+      private:
+        uint8_t status_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
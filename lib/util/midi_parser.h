@@ -0,0 +1,136 @@
+#pragma once
+#ifndef DPT_UTIL_MIDI_PARSER_H
+#define DPT_UTIL_MIDI_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** One complete MIDI message, as it came off the wire */
+    struct MidiMessage
+    {
+        uint8_t status;  /**< including the channel for channel messages */
+        uint8_t data[2]; /**< only size bytes are valid */
+        uint8_t size;    /**< number of data bytes, 0-2 */
+    };
+
+    /** @brief Turns a MIDI byte stream into messages, one byte at a time
+     *
+     *  Handles running status, real-time bytes interleaved anywhere (even
+     *  inside another message, without disturbing it), and system common
+     *  messages, which cancel running status. SysEx is skipped up to the
+     *  next status byte, data bytes with no status are counted as errors.
+     *
+     *  Small enough to run from the UART interrupt, and has no hardware
+     *  dependencies, so byte streams can be fed to it on the host.
+     */
+    class MidiByteParser
+    {
+      public:
+        MidiByteParser() { Reset(); }
+        ~MidiByteParser() {}
+
+        void Reset()
+        {
+            status_   = 0;
+            count_    = 0;
+            expected_ = 0;
+            sysex_    = false;
+            errors_   = 0;
+        }
+
+        /** Feeds one byte.
+         *  \retval true when msg now holds a complete message
+         */
+        bool Parse(uint8_t byte, MidiMessage* msg)
+        {
+            if(byte >= 0xf8)
+            {
+                /** Real-time, always a single byte */
+                msg->status = byte;
+                msg->size   = 0;
+                return true;
+            }
+            if(byte & 0x80)
+            {
+                sysex_ = byte == 0xf0;
+                count_ = 0;
+                if(byte >= 0xf0)
+                {
+                    /** System common and SysEx cancel running status */
+                    status_   = 0;
+                    expected_ = SystemDataBytes(byte);
+                    if(expected_ < 0)
+                        return false;
+                    if(expected_ == 0)
+                    {
+                        msg->status = byte;
+                        msg->size   = 0;
+                        return true;
+                    }
+                }
+                else
+                {
+                    uint8_t kind = byte >> 4;
+                    expected_    = kind == 0xc || kind == 0xd ? 1 : 2;
+                }
+                status_ = byte;
+                return false;
+            }
+
+            if(sysex_)
+                return false;
+            if(status_ == 0)
+            {
+                errors_++;
+                return false;
+            }
+            data_[count_++] = byte;
+            if(count_ < expected_)
+                return false;
+
+            msg->status  = status_;
+            msg->data[0] = data_[0];
+            msg->data[1] = data_[1];
+            msg->size    = expected_;
+            count_       = 0;
+            if(status_ >= 0xf0)
+                status_ = 0;
+            return true;
+        }
+
+        /** Data bytes that arrived with no status to go with them */
+        uint32_t Errors() const { return errors_; }
+
+      private:
+        /** -1 for bytes that are not messages (SysEx start/end, undefined) */
+        static int SystemDataBytes(uint8_t status)
+        {
+            switch(status)
+            {
+                case 0xf1: // MTC quarter frame
+                case 0xf3: // song select
+                    return 1;
+                case 0xf2: // song position
+                    return 2;
+                case 0xf6: // tune request
+                    return 0;
+                default: return -1;
+            }
+        }
+
+        uint8_t  status_;
+        uint8_t  data_[2];
+        uint8_t  count_;
+        int8_t   expected_;
+        bool     sysex_;
+        uint32_t errors_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
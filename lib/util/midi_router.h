@@ -0,0 +1,132 @@
+#pragma once
+#ifndef DPT_UTIL_MIDI_ROUTER_H
+#define DPT_UTIL_MIDI_ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "midi_parser.h"
+
+namespace daisy
+{
+namespace dpt
+{
+    /** MIDI ports the router knows about */
+    enum MidiPort
+    {
+        MIDI_PORT_TRS = 0,
+        MIDI_PORT_USB,
+        MIDI_PORT_LAST,
+    };
+
+    /** Destinations, or'ed together in a route */
+    enum
+    {
+        MIDI_ROUTE_NONE = 0,
+        MIDI_ROUTE_APP  = 1 << 0,                   /**< the app's event stream */
+        MIDI_ROUTE_TRS  = 1 << (MIDI_PORT_TRS + 1), /**< TRS output */
+        MIDI_ROUTE_USB  = 1 << (MIDI_PORT_USB + 1), /**< USB output */
+        MIDI_ROUTE_ALL  = MIDI_ROUTE_APP | MIDI_ROUTE_TRS | MIDI_ROUTE_USB,
+    };
+
+    /** @brief Thru/merge/filter rules between MIDI ports
+     *
+     *  Every input port has a table with one entry per status byte
+     *  (0x80-0xff), holding where messages with that status go. Since
+     *  channel messages carry the channel in the status byte, rules can be
+     *  per message type, per channel, or both, and routing a message is one
+     *  table lookup however many rules were set up.
+     *
+     *  Outputs are plain callbacks, so on the host they can be mock
+     *  transports that record what they were sent.
+     */
+    class MidiRouter
+    {
+      public:
+        /** Sends msg out of a port */
+        typedef void (*OutputCallback)(const MidiMessage& msg, void* context);
+
+        MidiRouter() { Init(); }
+        ~MidiRouter() {}
+
+        /** Everything goes to the app only, no outputs */
+        void Init()
+        {
+            for(int p = 0; p < MIDI_PORT_LAST; p++)
+            {
+                output_[p]  = nullptr;
+                context_[p] = nullptr;
+                SetRoute(p, 0x80, 0xff, MIDI_ROUTE_APP);
+            }
+        }
+
+        void SetOutput(int port, OutputCallback output, void* context = nullptr)
+        {
+            output_[port]  = output;
+            context_[port] = context;
+        }
+
+        /** Replaces the destinations for status bytes first to last on an input */
+        void SetRoute(int in, uint8_t first, uint8_t last, uint8_t dests)
+        {
+            for(int s = first; s <= last; s++)
+                table_[in][s & 0x7f] = dests;
+        }
+
+        /** Adds destinations for status bytes first to last on an input */
+        void AddRoute(int in, uint8_t first, uint8_t last, uint8_t dests)
+        {
+            for(int s = first; s <= last; s++)
+                table_[in][s & 0x7f] |= dests;
+        }
+
+        /** Removes destinations for status bytes first to last on an input */
+        void RemoveRoute(int in, uint8_t first, uint8_t last, uint8_t dests)
+        {
+            for(int s = first; s <= last; s++)
+                table_[in][s & 0x7f] &= ~dests;
+        }
+
+        /** Copies everything from one port to another's output */
+        void Thru(int in, int out, bool enable)
+        {
+            uint8_t dest = 1 << (out + 1);
+            if(enable)
+                AddRoute(in, 0x80, 0xff, dest);
+            else
+                RemoveRoute(in, 0x80, 0xff, dest);
+        }
+
+        /** Drops status bytes first to last from an input entirely */
+        void Filter(int in, uint8_t first, uint8_t last)
+        {
+            SetRoute(in, first, last, MIDI_ROUTE_NONE);
+        }
+
+        /** Destinations for a message arriving on an input */
+        uint8_t Route(int in, uint8_t status) const
+        {
+            return table_[in][status & 0x7f];
+        }
+
+        /** Sends msg to every output its route includes.
+         *  \retval true if the app should get it too
+         */
+        bool Process(int in, const MidiMessage& msg)
+        {
+            uint8_t dests = Route(in, msg.status);
+            for(int p = 0; p < MIDI_PORT_LAST; p++)
+                if((dests & (1 << (p + 1))) && output_[p])
+                    output_[p](msg, context_[p]);
+            return dests & MIDI_ROUTE_APP;
+        }
+
+      private:
+        uint8_t        table_[MIDI_PORT_LAST][128];
+        OutputCallback output_[MIDI_PORT_LAST];
+        void*          context_[MIDI_PORT_LAST];
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
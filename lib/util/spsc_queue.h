@@ -0,0 +1,133 @@
+#pragma once
+#ifndef DPT_UTIL_SPSC_QUEUE_H
+#define DPT_UTIL_SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Lock-free single producer, single consumer queue
+     *
+     *  One side may be an interrupt and the other the main loop (or another
+     *  interrupt), as long as each side only has one caller. N must be a
+     *  power of two, and N - 1 items fit.
+     *
+     *  No hardware dependencies, so it can be driven from two threads on the host.
+     */
+    template <typename T, size_t N>
+    class SpscQueue
+    {
+      public:
+        static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+        SpscQueue() { Reset(); }
+
+        /** Only safe while neither side is running */
+        void Reset()
+        {
+            head_.store(0);
+            tail_.store(0);
+            dropped_ = 0;
+        }
+
+        /** Producer side.
+         *  \retval false if the queue was full and the item was dropped
+         */
+        bool Push(const T& item)
+        {
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            if(head - tail_.load(std::memory_order_acquire) >= N - 1)
+            {
+                dropped_++;
+                return false;
+            }
+            items_[head & (N - 1)] = item;
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Consumer side: the oldest item, or nullptr. Stays valid until Pop() */
+        const T* Peek() const
+        {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if(tail == head_.load(std::memory_order_acquire))
+                return nullptr;
+            return &items_[tail & (N - 1)];
+        }
+
+        /** Consumer side: drops the oldest item */
+        void Pop()
+        {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if(tail != head_.load(std::memory_order_acquire))
+                tail_.store(tail + 1, std::memory_order_release);
+        }
+
+        /** Consumer side: copies out and drops the oldest item */
+        bool Pop(T* item)
+        {
+            const T* next = Peek();
+            if(!next)
+                return false;
+            *item = *next;
+            Pop();
+            return true;
+        }
+
+        bool IsEmpty() const
+        {
+            return head_.load(std::memory_order_acquire)
+                   == tail_.load(std::memory_order_acquire);
+        }
+
+        size_t Size() const
+        {
+            return head_.load(std::memory_order_acquire)
+                   - tail_.load(std::memory_order_acquire);
+        }
+
+        /** Items the producer could not fit */
+        uint32_t Dropped() const { return dropped_; }
+
+      private:
+        T                     items_[N];
+        std::atomic<uint32_t> head_;
+        std::atomic<uint32_t> tail_;
+        volatile uint32_t     dropped_;
+    };
+
+    /** Consumer side, for items with a uint32_t time member in samples:
+     *  pops the oldest item if it is due before the end of the block that
+     *  starts at block_start. Push items in time order, a later item never
+     *  jumps ahead of an earlier one. Times wrap, they are compared as
+     *  signed differences.
+     *  \param offset samples into the block, 0 for an item that is already late
+     *  \retval false if the queue is empty or the oldest item is for a later block
+     */
+    template <typename T, size_t N>
+    bool PopDue(SpscQueue<T, N>& queue,
+                uint32_t         block_start,
+                size_t           block_size,
+                T*               item,
+                size_t*          offset)
+    {
+        const T* next = queue.Peek();
+        if(!next)
+            return false;
+        int32_t delta = (int32_t)(next->time - block_start);
+        if(delta >= (int32_t)block_size)
+            return false;
+        *offset = delta < 0 ? 0 : delta;
+        *item   = *next;
+        queue.Pop();
+        return true;
+    }
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
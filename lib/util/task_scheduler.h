@@ -0,0 +1,306 @@
+#pragma once
+#ifndef DPT_UTIL_TASK_SCHEDULER_H
+#define DPT_UTIL_TASK_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** Prescaler and auto-reload register values for a timer to update at rate.
+     *  Uses the smallest prescaler that keeps the auto-reload within max_period,
+     *  for the finest period resolution.
+     *  \param clock timer input clock in Hz
+     *  \param max_period largest auto-reload value, 0xffff on a 16 bit timer
+     *  \param prescaler PSC, the clock is divided by prescaler + 1 (16 bits)
+     *  \param period ARR, the timer updates every period + 1 prescaled ticks
+     *  \retval the rate the timer actually updates at, 0 if rate is out of reach
+     */
+    inline float TimerDivision(float     clock,
+                               float     rate,
+                               uint32_t  max_period,
+                               uint32_t* prescaler,
+                               uint32_t* period)
+    {
+        if(rate <= 0.f || rate > clock)
+            return 0.f;
+        float    ticks = clock / rate;
+        float    range = (float)max_period + 1.f;
+        uint32_t div   = (uint32_t)(ticks / range);
+        div            = (float)div * range < ticks ? div + 1 : div;
+        div            = div < 1 ? 1 : div;
+        if(div > 0x10000)
+            return 0.f;
+        uint64_t count = (uint64_t)(ticks / div + 0.5f);
+        count          = count > (uint64_t)max_period + 1 ? (uint64_t)max_period + 1 : count;
+        count          = count < 1 ? 1 : count;
+        *prescaler     = div - 1;
+        *period        = (uint32_t)(count - 1);
+        return clock / ((float)div * (float)count);
+    }
+
+    /** @brief Several periodic tasks multiplexed onto one timer tick
+     *
+     *  The tick runs at the rate of the fastest task. Every task has a phase
+     *  accumulator that adds its rate each tick and runs the task when it
+     *  passes the tick rate, so its average rate is exact (to 1mHz) even
+     *  when it doesn't divide the tick rate: a 700Hz task next to a 1kHz one
+     *  runs 7 times in 10 ticks. Runs still land on ticks, so such a task's
+     *  interval varies by one tick. When the rate divides the tick rate it
+     *  runs every divider ticks exactly, and tasks with the same divider are
+     *  given different phases where possible, so e.g. two 1kHz tasks on a
+     *  48kHz tick don't both land on the same tick. Due tasks run in id order.
+     *
+     *  Each run is timed with an optional clock, for execution time, and
+     *  the interval between runs against the nominal one, for jitter.
+     *
+     *  Add/Remove and Tick() must not overlap (DPT blocks interrupts).
+     *  No hardware dependencies, so the rate division can be checked on the host.
+     */
+    template <size_t N>
+    class PeriodicTaskScheduler
+    {
+      public:
+        typedef void (*TaskCallback)(void* context);
+
+        /** Free running clock for the statistics, e.g. a cycle counter */
+        typedef uint32_t (*Clock)();
+
+        /** Fastest task rate in Hz, the accumulators count in mHz */
+        static constexpr float kMaxRate = 1e6f;
+
+        /** Timing of one task, in clock ticks */
+        struct Stats
+        {
+            uint32_t runs;
+            uint32_t last;           /**< execution time of the last run */
+            uint32_t peak;           /**< longest execution time */
+            float    average;        /**< smoothed execution time */
+            uint32_t jitter_peak;    /**< largest start interval error */
+            float    jitter_average; /**< smoothed start interval error */
+        };
+
+        PeriodicTaskScheduler() { Init(nullptr, 1.f); }
+        ~PeriodicTaskScheduler() {}
+
+        /** \param clock times the tasks, nullptr for no statistics
+         *  \param clock_rate clock ticks per second
+         */
+        void Init(Clock clock, float clock_rate)
+        {
+            clock_      = clock;
+            clock_rate_ = clock_rate;
+            tick_rate_  = 0.f;
+            tick_step_  = 0;
+            tick_       = 0;
+            for(size_t i = 0; i < N; i++)
+                tasks_[i].callback = nullptr;
+        }
+
+        /** Registers a task.
+         *  \param rate in Hz, up to kMaxRate
+         *  \retval its id, or -1 if all N slots are taken or the rate is out of range
+         */
+        int Add(TaskCallback callback, void* context, float rate)
+        {
+            if(!callback || !(rate >= 0.001f && rate <= kMaxRate))
+                return -1;
+            for(size_t i = 0; i < N; i++)
+            {
+                Task& t = tasks_[i];
+                if(t.callback)
+                    continue;
+                t.context    = context;
+                t.step       = (uint32_t)(rate * 1000.f + 0.5f);
+                t.divider    = 0; /**< picked by Retune() */
+                t.phase      = 0;
+                t.acc        = 0;
+                t.last_start = 0;
+                ResetStats(i);
+                t.callback = callback;
+                Retune();
+                return (int)i;
+            }
+            return -1;
+        }
+
+        void Remove(int id)
+        {
+            if(!Valid(id))
+                return;
+            tasks_[id].callback = nullptr;
+            Retune();
+        }
+
+        /** Rate the tick has to run at, the fastest task's. 0 without tasks */
+        float TickRate() const { return tick_rate_; }
+
+        /** Average rate a task runs at, its rate rounded to 1mHz */
+        float Rate(int id) const { return Valid(id) ? tasks_[id].step * 0.001f : 0.f; }
+
+        /** Ticks between runs of a task, rounded when its rate doesn't divide the tick rate */
+        uint32_t Divider(int id) const { return Valid(id) ? tasks_[id].divider : 0; }
+
+        /** Tick count (mod Divider()) the task runs on, if its rate divides the tick rate */
+        uint32_t Phase(int id) const { return Valid(id) ? tasks_[id].phase : 0; }
+
+        bool Valid(int id) const
+        {
+            return id >= 0 && id < (int)N && tasks_[id].callback;
+        }
+
+        /** Call at TickRate(), runs the tasks that are due
+         *  \retval the number of tasks that ran
+         */
+        size_t Tick()
+        {
+            size_t n = 0;
+            tick_++;
+            for(size_t i = 0; i < N; i++)
+            {
+                Task& t = tasks_[i];
+                if(!t.callback)
+                    continue;
+                t.acc += t.step;
+                if(t.acc < tick_step_)
+                    continue;
+                t.acc -= tick_step_;
+                n++;
+                if(!clock_)
+                {
+                    t.callback(t.context);
+                    continue;
+                }
+                uint32_t start = clock_();
+                t.callback(t.context);
+                Measure(t, start, clock_() - start);
+            }
+            return n;
+        }
+
+        const Stats& GetStats(int id) const { return tasks_[id].stats; }
+
+        void ResetStats(int id)
+        {
+            Stats& s = tasks_[id].stats;
+            s.runs           = 0;
+            s.last           = 0;
+            s.peak           = 0;
+            s.average        = 0.f;
+            s.jitter_peak    = 0;
+            s.jitter_average = 0.f;
+        }
+
+        /** Clock ticks per second, to convert Stats */
+        float ClockRate() const { return clock_rate_; }
+
+      private:
+        struct Task
+        {
+            TaskCallback callback;
+            void*        context;
+            uint32_t     step; /**< rate in mHz, added to acc every tick */
+            uint32_t     acc;  /**< runs the task when it reaches tick_step_ */
+            uint32_t     divider;
+            uint32_t     phase;
+            uint32_t     last_start;
+            Stats        stats;
+        };
+
+        void Measure(Task& t, uint32_t start, uint32_t elapsed)
+        {
+            Stats& s = t.stats;
+            s.last   = elapsed;
+            s.peak   = elapsed > s.peak ? elapsed : s.peak;
+            s.average += (elapsed - s.average) * (s.runs ? 1.f / 64.f : 1.f);
+            if(s.runs > 0)
+            {
+                float nominal = clock_rate_ * 1000.f / t.step;
+                float error   = (float)(start - t.last_start) - nominal;
+                error         = error < 0.f ? -error : error;
+                if(error > s.jitter_peak)
+                    s.jitter_peak = (uint32_t)error;
+                s.jitter_average += (error - s.jitter_average) * (1.f / 64.f);
+            }
+            t.last_start = start;
+            s.runs++;
+        }
+
+        /** Picks the tick rate, and the dividers and phases again.
+         *  Tasks whose divider stays the same keep their phase, so adding
+         *  or removing a task doesn't disturb the others.
+         */
+        void Retune()
+        {
+            uint32_t old_step = tick_step_;
+            tick_step_        = 0;
+            for(size_t i = 0; i < N; i++)
+                if(tasks_[i].callback && tasks_[i].step > tick_step_)
+                    tick_step_ = tasks_[i].step;
+            tick_rate_ = tick_step_ * 0.001f;
+
+            bool moved[N];
+            for(size_t i = 0; i < N; i++)
+            {
+                Task& t  = tasks_[i];
+                moved[i] = false;
+                if(!t.callback)
+                    continue;
+                uint32_t divider = (tick_step_ + t.step / 2) / t.step;
+                divider          = divider < 1 ? 1 : divider;
+                moved[i]         = divider != t.divider;
+                t.divider        = divider;
+                /** Same place in its cycle on the new tick */
+                if(old_step > 0 && old_step != tick_step_)
+                    t.acc = (uint32_t)((uint64_t)t.acc * tick_step_ / old_step);
+            }
+
+            for(size_t i = 0; i < N; i++)
+            {
+                Task& t = tasks_[i];
+                if(!moved[i])
+                    continue;
+                /** The phase the fewest placed tasks with the same divider use */
+                uint32_t best = 0, best_count = ~0u;
+                for(uint32_t p = 0; p < t.divider && best_count > 0; p++)
+                {
+                    uint32_t count = 0;
+                    for(size_t j = 0; j < N; j++)
+                        if(j != i && !moved[j] && tasks_[j].callback
+                           && tasks_[j].divider == t.divider && tasks_[j].phase == p)
+                            count++;
+                    if(count < best_count)
+                    {
+                        best       = p;
+                        best_count = count;
+                    }
+                }
+                /** First run Countdown() ticks from now, then every divider */
+                uint64_t ahead = (uint64_t)Countdown(best, t.divider) * t.step;
+                t.phase        = best;
+                t.acc          = ahead < tick_step_ ? (uint32_t)(tick_step_ - ahead) : 0;
+                moved[i]       = false;
+                ResetStats(i);
+            }
+        }
+
+        /** Ticks from the next one until the next that is phase mod divider */
+        uint32_t Countdown(uint32_t phase, uint32_t divider) const
+        {
+            return (phase + divider - (tick_ + 1) % divider) % divider + 1;
+        }
+
+        Clock    clock_;
+        float    clock_rate_;
+        float    tick_rate_;
+        uint32_t tick_step_; /**< the fastest task's step */
+        uint32_t tick_; /**< Tick() calls so far, places new phases */
+        Task     tasks_[N];
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
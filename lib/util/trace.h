@@ -0,0 +1,183 @@
+#pragma once
+#ifndef DPT_UTIL_TRACE_H
+#define DPT_UTIL_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "cpu_load.h"
+
+/** Set to 0 to compile the DPT_TRACE_* macros out entirely */
+#ifndef DPT_TRACE
+#define DPT_TRACE 1
+#endif
+
+/** Events kept, must be a power of 2 (8 bytes each) */
+#ifndef DPT_TRACE_SIZE
+#define DPT_TRACE_SIZE 1024
+#endif
+
+namespace daisy
+{
+namespace dpt
+{
+    enum TraceType
+    {
+        TRACE_ENTER = 0,
+        TRACE_EXIT,
+        TRACE_MARK,
+    };
+
+    /** Where an event came from, trace_to_chrome.py names them */
+    enum TraceId
+    {
+        TRACE_AUDIO = 0,   /**< audio callback, arg is the block size */
+        TRACE_DAC,         /**< internal DAC callback */
+        TRACE_DAC_EXP,     /**< DAC7554 stream refill, arg is the half */
+        TRACE_DAC_EXP_SPI, /**< DAC7554 SPI DMA complete (TxCpltCallback) */
+        TRACE_MIDI_RX,     /**< MIDI UART receive, arg is the byte count */
+        TRACE_TASKS,       /**< periodic task timer, arg is the priority */
+        TRACE_GATE_OUT,    /**< gate edge timer */
+        TRACE_GATE_IN,     /**< gate input edge, arg is gate | rising << 1 */
+        TRACE_XRUN,        /**< the audio callback overran its block */
+        TRACE_USER = 32,   /**< first id for the app's own events */
+    };
+
+    /** One event as it is stored and dumped, 8 bytes little endian */
+    struct TraceEvent
+    {
+        uint32_t time; /**< CycleCounter::Now() */
+        uint8_t  type; /**< TraceType */
+        uint8_t  id;   /**< TraceId */
+        uint16_t arg;
+    };
+
+    /** @brief Fixed size ring of timestamped enter/exit/marker events
+     *
+     *  Recording an event is an atomic increment (LDREX/STREX, so any
+     *  interrupt may record) and one 8 byte store, and a single branch
+     *  while recording is stopped. Continuous mode keeps the last N events,
+     *  so recording can be stopped right after a glitch and the lead-up
+     *  looked at; one-shot mode keeps the first N after Start().
+     *
+     *  Dump() writes a small header and the events, oldest first, for
+     *  trace_to_chrome.py to turn into a Chrome trace (chrome://tracing,
+     *  or ui.perfetto.dev).
+     */
+    template <size_t N>
+    class TraceBuffer
+    {
+      public:
+        static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+
+        /** Receives the dump, e.g. wraps f_write or a USB transmit */
+        typedef void (*Writer)(const void* data, size_t size, void* context);
+
+        /** Starts the binary dump */
+        struct Header
+        {
+            char     magic[4]; /**< "DPTT" */
+            uint32_t version;
+            uint32_t ticks_per_second;
+            uint32_t count;
+        };
+
+        TraceBuffer() : head_(0), recording_(false), one_shot_(false) {}
+        ~TraceBuffer() {}
+
+        /** \param ticks_per_second rate of CycleCounter, stored in the dump */
+        void Init(uint32_t ticks_per_second)
+        {
+            ticks_per_second_ = ticks_per_second;
+            recording_        = false;
+            head_             = 0;
+        }
+
+        /** Clears the buffer and starts recording */
+        void Start(bool one_shot = false)
+        {
+            recording_ = false;
+            head_      = 0;
+            one_shot_  = one_shot;
+            recording_ = true;
+        }
+
+        void Stop() { recording_ = false; }
+
+        bool IsRecording() const { return recording_; }
+
+        inline void Record(uint8_t type, uint8_t id, uint16_t arg = 0)
+        {
+            if(!recording_)
+                return;
+            uint32_t i = head_.fetch_add(1, std::memory_order_relaxed);
+            if(one_shot_ && i >= N)
+            {
+                recording_ = false;
+                return;
+            }
+            TraceEvent& e = events_[i & (N - 1)];
+            e.time        = CycleCounter::Now();
+            e.type        = type;
+            e.id          = id;
+            e.arg         = arg;
+        }
+
+        /** Events held, at most N */
+        size_t Count() const
+        {
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            return head < N ? head : N;
+        }
+
+        /** Event i, oldest first. Stop() first, or it may change under you */
+        const TraceEvent& Get(size_t i) const
+        {
+            uint32_t head  = head_.load(std::memory_order_relaxed);
+            uint32_t first = head > N && !one_shot_ ? head - N : 0;
+            return events_[(first + i) & (N - 1)];
+        }
+
+        /** Stops recording and writes the header and the events */
+        void Dump(Writer write, void* context)
+        {
+            Stop();
+            Header header = {{'D', 'P', 'T', 'T'}, 1, ticks_per_second_, (uint32_t)Count()};
+            write(&header, sizeof(header), context);
+            for(size_t i = 0; i < header.count; i++)
+                write(&Get(i), sizeof(TraceEvent), context);
+        }
+
+        uint32_t TicksPerSecond() const { return ticks_per_second_; }
+
+      private:
+        TraceEvent            events_[N];
+        std::atomic<uint32_t> head_;
+        volatile bool         recording_;
+        bool                  one_shot_;
+        uint32_t              ticks_per_second_;
+    };
+
+    /** The board's trace, defined in daisy_dpt.cpp */
+    extern TraceBuffer<DPT_TRACE_SIZE> dsy_dpt_trace;
+
+} // namespace dpt
+} // namespace daisy
+
+#if DPT_TRACE
+#define DPT_TRACE_ENTER(id, arg) \
+    ::daisy::dpt::dsy_dpt_trace.Record(::daisy::dpt::TRACE_ENTER, (id), (arg))
+#define DPT_TRACE_EXIT(id, arg) \
+    ::daisy::dpt::dsy_dpt_trace.Record(::daisy::dpt::TRACE_EXIT, (id), (arg))
+#define DPT_TRACE_MARK(id, arg) \
+    ::daisy::dpt::dsy_dpt_trace.Record(::daisy::dpt::TRACE_MARK, (id), (arg))
+#else
+#define DPT_TRACE_ENTER(id, arg) \
+    do                           \
+    {                            \
+    } while(0)
+#define DPT_TRACE_EXIT(id, arg) DPT_TRACE_ENTER(id, arg)
+#define DPT_TRACE_MARK(id, arg) DPT_TRACE_ENTER(id, arg)
+#endif
+
+#endif
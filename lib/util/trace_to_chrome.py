@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Turns a DPT trace dump into Chrome trace JSON.
+
+Takes either the binary dump from DPT::DumpTrace() (e.g. a file copied off
+the SD card), or a saved serial log with the output of DPT::PrintTrace().
+Open the result in chrome://tracing or https://ui.perfetto.dev.
+
+    python3 trace_to_chrome.py trace.bin trace.json
+    python3 trace_to_chrome.py serial.log trace.json
+
+Every TraceId gets its own row, enter/exit pairs become slices, markers
+become instant events. Event layout and ids match lib/util/trace.h.
+"""
+
+import json
+import struct
+import sys
+
+ENTER, EXIT, MARK = 0, 1, 2
+
+NAMES = {
+    0: "audio",
+    1: "dac",
+    2: "dac7554 stream",
+    3: "dac7554 spi",
+    4: "midi rx",
+    5: "tasks",
+    6: "gate out",
+    7: "gate in",
+    8: "xrun",
+}
+TRACE_USER = 32
+
+HEADER = struct.Struct("<4sIII")
+EVENT = struct.Struct("<IBBH")
+
+
+def name(event_id):
+    if event_id >= TRACE_USER:
+        return "user %d" % (event_id - TRACE_USER)
+    return NAMES.get(event_id, "id %d" % event_id)
+
+
+def read_binary(data):
+    magic, version, rate, count = HEADER.unpack_from(data, 0)
+    if magic != b"DPTT" or version != 1:
+        raise ValueError("not a DPT trace dump")
+    events = [EVENT.unpack_from(data, HEADER.size + i * EVENT.size) for i in range(count)]
+    return rate, events
+
+
+def read_log(text):
+    """The last DPTTRACE block in the log"""
+    rate, events, block = None, [], None
+    for line in text.splitlines():
+        line = line.strip()
+        if line.startswith("DPTTRACE END"):
+            if block is not None:
+                events = block
+            block = None
+        elif line.startswith("DPTTRACE"):
+            rate = int(line.split()[1])
+            block = []
+        elif block is not None and len(line) == 16:
+            block.append((int(line[0:8], 16), int(line[8:10], 16), int(line[10:12], 16), int(line[12:16], 16)))
+    if rate is None:
+        raise ValueError("no DPTTRACE block in the log")
+    return rate, events
+
+
+def unwrap(events):
+    """32 bit cycle stamps to a continuous count, in the order they were stored.
+    Interrupts can store slightly out of order, so deltas are signed."""
+    out, now, last = [], 0, None
+    for time, kind, event_id, arg in events:
+        if last is not None:
+            delta = (time - last) & 0xFFFFFFFF
+            now += delta - (1 << 32) if delta & 0x80000000 else delta
+        last = time
+        out.append((now, kind, event_id, arg))
+    out.sort(key=lambda e: e[0])
+    return out
+
+
+def to_chrome(rate, events):
+    events = unwrap(events)
+    start = events[0][0] if events else 0
+    trace, depth = [], {}
+    for event_id in sorted({e[2] for e in events}):
+        trace.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": event_id,
+                      "args": {"name": name(event_id)}})
+    for now, kind, event_id, arg in events:
+        entry = {"name": name(event_id), "pid": 0, "tid": event_id,
+                 "ts": (now - start) * 1e6 / rate, "args": {"arg": arg}}
+        if kind == ENTER:
+            depth[event_id] = depth.get(event_id, 0) + 1
+            entry["ph"] = "B"
+        elif kind == EXIT:
+            if depth.get(event_id, 0) == 0:
+                continue  # entered before the buffer starts
+            depth[event_id] -= 1
+            entry["ph"] = "E"
+        else:
+            entry["ph"] = "i"
+            entry["s"] = "t"
+        trace.append(entry)
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    with open(argv[1], "rb") as f:
+        data = f.read()
+    if data[:4] == b"DPTT":
+        rate, events = read_binary(data)
+    else:
+        rate, events = read_log(data.decode("utf-8", "replace"))
+    with open(argv[2], "w") as f:
+        json.dump(to_chrome(rate, events), f)
+    times = unwrap(events)
+    span = (times[-1][0] - times[0][0]) * 1e3 / rate if times else 0.0
+    print("%d events over %.3f ms" % (len(events), span))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,219 @@
+#pragma once
+#ifndef DPT_UTIL_VOICE_ALLOCATOR_H
+#define DPT_UTIL_VOICE_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+namespace dpt
+{
+    /** @brief Assigns MIDI notes to N voices
+     *
+     *  Voices are either free, held (note on) or released (note off, still
+     *  sounding until the app calls Free()). A note-on picks, in order:
+     *    1. the voice already playing the same note on the same channel
+     *    2. a free voice, popped off a free list in O(1)
+     *    3. the oldest released voice
+     *    4. a held voice, chosen by the stealing policy
+     *
+     *  Every voice that is not free sits in a compact active table, so the
+     *  audio callback loops over NumActive() entries and never touches or
+     *  branches on silent voices.
+     *
+     *  No hardware dependencies, so it can be driven on the host.
+     *  Not reentrant: NoteOn()/NoteOff()/Free() must not interrupt the
+     *  audio callback's walk over the active table (block IRQs around them,
+     *  or call them from the audio callback).
+     */
+    template <size_t N>
+    class VoiceAllocator
+    {
+      public:
+        static_assert(N > 0 && N < 255, "Voice indices are stored as uint8_t");
+
+        /** Which held voice to take when all are busy */
+        enum class Steal
+        {
+            OLDEST,   /**< longest held note */
+            QUIETEST, /**< lowest Level() */
+            NONE,     /**< drop the new note */
+        };
+
+        enum class State : uint8_t
+        {
+            FREE,
+            HELD,
+            RELEASED,
+        };
+
+        struct Voice
+        {
+            State    state;
+            uint8_t  channel;
+            uint8_t  note;
+            uint8_t  velocity;
+            uint32_t age;   /**< note-on order, lower is older */
+            float    level; /**< for Steal::QUIETEST, defaults to velocity */
+        };
+
+        VoiceAllocator() { Init(); }
+        ~VoiceAllocator() {}
+
+        void Init(Steal policy = Steal::OLDEST)
+        {
+            policy_     = policy;
+            clock_      = 0;
+            num_active_ = 0;
+            num_free_   = N;
+            for(size_t i = 0; i < N; i++)
+            {
+                voices_[i]     = Voice{State::FREE, 0, 0, 0, 0, 0.f};
+                free_[i]       = N - 1 - i; // voice 0 is handed out first
+                active_pos_[i] = kNone;
+                active_[i]     = 0;
+            }
+        }
+
+        void SetPolicy(Steal policy) { policy_ = policy; }
+
+        /** Assigns a voice to the note.
+         *  \retval the voice index, or -1 if nothing could be taken
+         */
+        int NoteOn(uint8_t channel, uint8_t note, uint8_t velocity)
+        {
+            int v = Find(channel, note);
+            if(v < 0 && num_free_ > 0)
+            {
+                v = free_[--num_free_];
+                Activate(v);
+            }
+            if(v < 0)
+                v = Oldest(State::RELEASED);
+            if(v < 0 && policy_ == Steal::OLDEST)
+                v = Oldest(State::HELD);
+            if(v < 0 && policy_ == Steal::QUIETEST)
+                v = Quietest();
+            if(v < 0)
+                return -1;
+
+            Voice& voice   = voices_[v];
+            voice.state    = State::HELD;
+            voice.channel  = channel;
+            voice.note     = note;
+            voice.velocity = velocity;
+            voice.age      = clock_++;
+            voice.level    = velocity / 127.f;
+            return v;
+        }
+
+        /** Releases the voice holding the note. It stays active until Free().
+         *  \retval the voice index, or -1 if the note is not held
+         */
+        int NoteOff(uint8_t channel, uint8_t note)
+        {
+            int v = Find(channel, note);
+            if(v < 0 || voices_[v].state != State::HELD)
+                return -1;
+            voices_[v].state = State::RELEASED;
+            return v;
+        }
+
+        /** Returns a voice to the free list, e.g. when its envelope finished */
+        void Free(int v)
+        {
+            if(voices_[v].state == State::FREE)
+                return;
+            voices_[v].state = State::FREE;
+
+            /** Swap the last active entry into the hole */
+            uint8_t pos        = active_pos_[v];
+            uint8_t last       = active_[--num_active_];
+            active_[pos]       = last;
+            active_pos_[last]  = pos;
+            active_pos_[v]     = kNone;
+            free_[num_free_++] = v;
+        }
+
+        /** Releases every held voice */
+        void AllNotesOff()
+        {
+            for(size_t i = 0; i < num_active_; i++)
+                if(voices_[active_[i]].state == State::HELD)
+                    voices_[active_[i]].state = State::RELEASED;
+        }
+
+        /** Reports a voice's current loudness for Steal::QUIETEST */
+        void SetLevel(int v, float level) { voices_[v].level = level; }
+
+        /** Number of held or released voices */
+        size_t NumActive() const { return num_active_; }
+
+        /** Voice index of active entry i, 0 <= i < NumActive() */
+        uint8_t Active(size_t i) const { return active_[i]; }
+
+        /** The whole active table, NumActive() entries */
+        const uint8_t* ActiveVoices() const { return active_; }
+
+        const Voice& GetVoice(int v) const { return voices_[v]; }
+
+      private:
+        static constexpr uint8_t kNone = 0xff;
+
+        void Activate(int v)
+        {
+            active_pos_[v]         = num_active_;
+            active_[num_active_++] = v;
+        }
+
+        int Find(uint8_t channel, uint8_t note) const
+        {
+            for(size_t i = 0; i < num_active_; i++)
+            {
+                const Voice& voice = voices_[active_[i]];
+                if(voice.note == note && voice.channel == channel)
+                    return active_[i];
+            }
+            return -1;
+        }
+
+        int Oldest(State state) const
+        {
+            int best = -1;
+            for(size_t i = 0; i < num_active_; i++)
+            {
+                const Voice& voice = voices_[active_[i]];
+                if(voice.state == state
+                   && (best < 0 || (int32_t)(voice.age - voices_[best].age) < 0))
+                    best = active_[i];
+            }
+            return best;
+        }
+
+        int Quietest() const
+        {
+            int best = -1;
+            for(size_t i = 0; i < num_active_; i++)
+            {
+                const Voice& voice = voices_[active_[i]];
+                if(best < 0 || voice.level < voices_[best].level)
+                    best = active_[i];
+            }
+            return best;
+        }
+
+        Voice    voices_[N];
+        uint8_t  active_[N];
+        uint8_t  active_pos_[N];
+        uint8_t  free_[N];
+        size_t   num_active_;
+        size_t   num_free_;
+        uint32_t clock_;
+        Steal    policy_;
+    };
+
+} // namespace dpt
+} // namespace daisy
+
+#endif
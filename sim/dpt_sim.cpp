@@ -0,0 +1,82 @@
+/** Host simulation of a DPT app, see README.md */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_engine.h"
+
+/** The app's main(), renamed by the Makefile */
+int dpt_sim_app_main();
+
+static void Usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -t SECONDS        length of the render (10)\n"
+            "  -i FILE.wav       audio input, silence without\n"
+            "  -o PREFIX         output files PREFIX.wav, PREFIX_cv.csv,\n"
+            "                    PREFIX_events.csv (dpt_sim)\n"
+            "  -c FILE.csv       controls: time, cv_1..cv_8, adc_9..adc_12,\n"
+            "                    gate_in_1, gate_in_2\n"
+            "  -m FILE.txt       MIDI input, lines of: time [trs|usb] hex bytes\n"
+            "  -r HZ             rate of the CV output rows (1000)\n"
+            "  --trace FILE      start dsy_dpt_trace and dump it to FILE\n"
+            "  --sync-timeout S  wall clock seconds to wait for the main loop\n"
+            "                    to come back to System::Delay() (0.5)\n",
+            name);
+}
+
+int main(int argc, char* argv[])
+{
+    sim::Options opts;
+    for(int i = 1; i < argc; i++)
+    {
+        const char* arg   = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool        known = true;
+        if(!strcmp(arg, "-h") || !strcmp(arg, "--help"))
+        {
+            Usage(argv[0]);
+            return 0;
+        }
+        if(!value)
+            known = false;
+        else if(!strcmp(arg, "-t"))
+            opts.seconds = atof(value);
+        else if(!strcmp(arg, "-i"))
+            opts.input_wav = value;
+        else if(!strcmp(arg, "-o"))
+            opts.output_prefix = value;
+        else if(!strcmp(arg, "-c"))
+            opts.controls_csv = value;
+        else if(!strcmp(arg, "-m"))
+            opts.midi_file = value;
+        else if(!strcmp(arg, "-r"))
+            opts.csv_rate = atof(value);
+        else if(!strcmp(arg, "--trace"))
+            opts.trace_file = value;
+        else if(!strcmp(arg, "--sync-timeout"))
+            opts.sync_timeout = atof(value);
+        else
+            known = false;
+        if(!known)
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if(opts.seconds <= 0.0 || opts.csv_rate <= 0.f)
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    int status = sim::Engine::Get().Run(opts, dpt_sim_app_main);
+
+    /** The app's thread is still in its main loop, leave without unwinding it */
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
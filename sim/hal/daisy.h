@@ -0,0 +1,37 @@
+#pragma once
+#ifndef DPT_SIM_DAISY_H
+#define DPT_SIM_DAISY_H
+
+/** Stand-in for libDaisy's daisy.h: the subset of libDaisy that lib/ and 
+ *  the sw/ apps use, on the host. Layout and names follow libDaisy's src/
+ *  so lib/ compiles unchanged; see sim/README.md for what each peripheral
+ *  does in the simulation.
+ */
+
+/** libDaisy brings these in through its own headers */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daisy_core.h"
+#include "sys/system.h"
+#include "per/gpio.h"
+#include "per/tim.h"
+#include "per/spi.h"
+#include "per/uart.h"
+#include "per/qspi.h"
+#include "per/sai.h"
+#include "per/i2c.h"
+#include "per/adc.h"
+#include "per/dac.h"
+#include "per/rng.h"
+#include "hid/audio.h"
+#include "hid/ctrl.h"
+#include "hid/gatein.h"
+#include "hid/midi.h"
+#include "hid/logger.h"
+#include "hid/usb.h"
+#include "dev/codec_pcm3060.h"
+#include "dev/sdram.h"
+#include "util/scopedirqblocker.h"
+
+#endif
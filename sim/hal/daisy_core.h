@@ -0,0 +1,46 @@
+#pragma once
+#ifndef DPT_SIM_DAISY_CORE_H
+#define DPT_SIM_DAISY_CORE_H
+
+/** Stand-in for libDaisy's daisy_core.h, see sim/README.md */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stm32h7xx_hal.h"
+
+/** No memory sections on the host */
+#define DMA_BUFFER_MEM_SECTION
+#define DSY_SDRAM_BSS
+#define DTCM_MEM_SECTION
+#define FORCE_INLINE inline
+
+/** GPIO ports, same order as GPIOA..GPIOK */
+typedef enum
+{
+    DSY_GPIOA,
+    DSY_GPIOB,
+    DSY_GPIOC,
+    DSY_GPIOD,
+    DSY_GPIOE,
+    DSY_GPIOF,
+    DSY_GPIOG,
+    DSY_GPIOH,
+    DSY_GPIOI,
+    DSY_GPIOJ,
+    DSY_GPIOK,
+    DSY_GPIOX, /**< not connected */
+    DSY_GPIO_LAST,
+} dsy_gpio_port;
+
+typedef struct
+{
+    dsy_gpio_port port;
+    uint8_t       pin;
+} dsy_gpio_pin;
+
+inline bool dsy_pin_cmp(const dsy_gpio_pin* a, const dsy_gpio_pin* b)
+{
+    return a->port == b->port && a->pin == b->pin;
+}
+
+#endif
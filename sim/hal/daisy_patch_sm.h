@@ -0,0 +1,26 @@
+#pragma once
+#ifndef DPT_SIM_DAISY_PATCH_SM_H
+#define DPT_SIM_DAISY_PATCH_SM_H
+
+#include "daisy.h"
+
+namespace daisy
+{
+namespace patch_sm
+{
+    /** The Patch SM header pins that lib/dev uses, same mapping as DPT's */
+    class DaisyPatchSM
+    {
+      public:
+        static constexpr dsy_gpio_pin A8  = {DSY_GPIOB, 14};
+        static constexpr dsy_gpio_pin A9  = {DSY_GPIOB, 15};
+        static constexpr dsy_gpio_pin D1  = {DSY_GPIOB, 4};
+        static constexpr dsy_gpio_pin D8  = {DSY_GPIOC, 2};
+        static constexpr dsy_gpio_pin D9  = {DSY_GPIOC, 3};
+        static constexpr dsy_gpio_pin D10 = {DSY_GPIOD, 3};
+    };
+
+} // namespace patch_sm
+} // namespace daisy
+
+#endif
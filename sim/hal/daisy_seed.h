@@ -0,0 +1,7 @@
+#pragma once
+#ifndef DPT_SIM_DAISY_SEED_H
+#define DPT_SIM_DAISY_SEED_H
+
+#include "daisy.h"
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef DPT_SIM_DEV_CODEC_PCM3060_H
+#define DPT_SIM_DEV_CODEC_PCM3060_H
+
+#include "per/i2c.h"
+
+namespace daisy
+{
+/** The audio codec, nothing to set up on the host */
+class Pcm3060
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    Pcm3060() {}
+    ~Pcm3060() {}
+
+    Result Init(I2CHandle i2c) { return Result::OK; }
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#ifndef DPT_SIM_DEV_SDRAM_H
+#define DPT_SIM_DEV_SDRAM_H
+
+namespace daisy
+{
+/** External SDRAM, DSY_SDRAM_BSS is ordinary memory on the host */
+class SdramHandle
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    SdramHandle() {}
+    ~SdramHandle() {}
+
+    Result Init() { return Result::OK; }
+    Result DeInit() { return Result::OK; }
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef DPT_SIM_HID_AUDIO_H
+#define DPT_SIM_HID_AUDIO_H
+
+#include "daisy_core.h"
+#include "per/sai.h"
+
+/** Shorthand for the non-interleaved buffers */
+#define IN_L in[0]
+#define IN_R in[1]
+#define OUT_L out[0]
+#define OUT_R out[1]
+
+namespace sim
+{
+class Engine;
+}
+
+namespace daisy
+{
+/** libDaisy's AudioHandle, stereo. The engine calls back every block 
+ *  of virtual time, with the input file (or silence) in and the output
+ *  collected for the output file.
+ */
+class AudioHandle
+{
+  public:
+    struct Config
+    {
+        size_t                        blocksize  = 48;
+        SaiHandle::Config::SampleRate samplerate = SaiHandle::Config::SampleRate::SAI_48KHZ;
+        float                         postgain   = 1.f;
+        float                         output_compensation = 1.f;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    typedef const float* const* InputBuffer;
+    typedef float**             OutputBuffer;
+    typedef void (*AudioCallback)(InputBuffer in, OutputBuffer out, size_t size);
+
+    typedef const float* InterleavingInputBuffer;
+    typedef float*       InterleavingOutputBuffer;
+    typedef void (*InterleavingAudioCallback)(InterleavingInputBuffer  in,
+                                              InterleavingOutputBuffer out,
+                                              size_t                   size);
+
+    /** Largest block the sim's buffers take */
+    static constexpr size_t kMaxBlockSize = 256;
+
+    AudioHandle()
+    : running_(false), callback_(nullptr), interleaving_callback_(nullptr)
+    {
+    }
+    ~AudioHandle() {}
+
+    Result Init(const Config& config, SaiHandle sai);
+    Result Init(const Config& config, SaiHandle sai1, SaiHandle sai2)
+    {
+        return Init(config, sai1);
+    }
+    Result DeInit() { return Stop(); }
+
+    const Config& GetConfig() const { return config_; }
+    size_t        GetChannels() const { return 2; }
+    float         GetSampleRate();
+
+    Result SetSampleRate(SaiHandle::Config::SampleRate samplerate);
+    Result SetBlockSize(size_t size);
+    Result SetPostGain(float val);
+    Result SetOutputCompensation(float val);
+
+    Result Start(AudioCallback callback);
+    Result Start(InterleavingAudioCallback callback);
+    Result Stop();
+    Result ChangeCallback(AudioCallback callback);
+    Result ChangeCallback(InterleavingAudioCallback callback);
+
+  private:
+    friend class ::sim::Engine;
+
+    Config                             config_;
+    volatile bool                      running_;
+    volatile AudioCallback             callback_;
+    volatile InterleavingAudioCallback interleaving_callback_;
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef DPT_SIM_HID_CTRL_H
+#define DPT_SIM_HID_CTRL_H
+
+#include <stdint.h>
+
+namespace daisy
+{
+/** libDaisy's AnalogControl, same scaling and one-pole slew */
+class AnalogControl
+{
+  public:
+    AnalogControl() {}
+    ~AnalogControl() {}
+
+    void Init(uint16_t* adcptr,
+              float     sr,
+              bool      flip         = false,
+              bool      invert       = false,
+              float     slew_seconds = 0.002f);
+
+    /** -1 to 1, for the inverting CV input stages */
+    void InitBipolarCv(uint16_t* adcptr, float sr);
+
+    float Process();
+
+    float Value() const { return val_; }
+
+    void SetCoeff(float val) { coeff_ = val; }
+
+    uint16_t GetRawValue() { return *raw_; }
+    float    GetRawFloat() { return *raw_ / 65536.f; }
+
+    void SetSampleRate(float sample_rate);
+
+  private:
+    uint16_t* raw_          = nullptr;
+    float     coeff_        = 1.f;
+    float     samplerate_   = 1000.f;
+    float     slew_seconds_ = 0.002f;
+    float     val_          = 0.f;
+    float     scale_        = 1.f;
+    float     offset_       = 0.f;
+    bool      flip_         = false;
+    bool      invert_       = false;
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef DPT_SIM_HID_GATEIN_H
+#define DPT_SIM_HID_GATEIN_H
+
+#include "per/gpio.h"
+
+namespace daisy
+{
+/** libDaisy's GateIn, reads the pin the engine drives */
+class GateIn
+{
+  public:
+    GateIn() {}
+    ~GateIn() {}
+
+    /** \param invert the input stage inverts, so a high gate reads low */
+    void Init(dsy_gpio_pin* pin_cfg, bool invert = true);
+
+    /** True once per rising edge, checked at each call */
+    bool Trig();
+
+    bool State();
+
+  private:
+    dsy_gpio pin_;
+    uint8_t  prev_state_ = 0, state_ = 0;
+    bool     invert_     = true;
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef DPT_SIM_HID_LOGGER_H
+#define DPT_SIM_HID_LOGGER_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+/** The host printf handles floats, so these are plain %f */
+#define FLT_FMT(_n) "%." #_n "f"
+#define FLT_VAR(_n, _x) ((double)(_x))
+#define FLT_FMT3 FLT_FMT(3)
+#define FLT_VAR3(_x) FLT_VAR(3, _x)
+
+namespace daisy
+{
+enum LoggerDestination
+{
+    LOGGER_NONE,
+    LOGGER_INTERNAL,
+    LOGGER_EXTERNAL,
+    LOGGER_SEMIHOST,
+};
+
+/** libDaisy's Logger, every destination prints to stdout */
+template <LoggerDestination dest>
+class Logger
+{
+  public:
+    static void Print(const char* format, ...)
+    {
+        va_list va;
+        va_start(va, format);
+        vprintf(format, va);
+        va_end(va);
+    }
+
+    static void PrintLine(const char* format, ...)
+    {
+        va_list va;
+        va_start(va, format);
+        vprintf(format, va);
+        va_end(va);
+        putchar('\n');
+    }
+
+    static void StartLog(bool wait_for_pc = false) {}
+};
+
+} // namespace daisy
+
+#endif
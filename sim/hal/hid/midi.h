@@ -0,0 +1,292 @@
+#pragma once
+#ifndef DPT_SIM_HID_MIDI_H
+#define DPT_SIM_HID_MIDI_H
+
+#include "daisy_core.h"
+#include "per/uart.h"
+
+namespace daisy
+{
+/** libDaisy's MIDI event types, same values (lib/ computes status bytes from them) */
+enum MidiMessageType
+{
+    NoteOff,
+    NoteOn,
+    PolyphonicKeyPressure,
+    ControlChange,
+    ProgramChange,
+    ChannelPressure,
+    PitchBend,
+    SystemCommon,
+    SystemRealTime,
+    ChannelMode,
+    MessageLast,
+};
+
+enum SystemCommonType
+{
+    SystemExclusive,
+    MTCQuarterFrame,
+    SongPositionPointer,
+    SongSelect,
+    SCUndefined0,
+    SCUndefined1,
+    TuneRequest,
+    SysExEnd,
+    SystemCommonLast,
+};
+
+enum SystemRealTimeType
+{
+    TimingClock,
+    SRTUndefined0,
+    Start,
+    Continue,
+    Stop,
+    SRTUndefined1,
+    ActiveSensing,
+    Reset,
+    SystemRealTimeLast,
+};
+
+enum ChannelModeType
+{
+    AllSoundOff,
+    ResetAllControllers,
+    LocalControl,
+    AllNotesOff,
+    OmniModeOff,
+    OmniModeOn,
+    MonoModeOn,
+    PolyModeOn,
+    ChannelModeLast,
+};
+
+struct NoteOffEvent
+{
+    int     channel;
+    uint8_t note;
+    uint8_t velocity;
+};
+
+struct NoteOnEvent
+{
+    int     channel;
+    uint8_t note;
+    uint8_t velocity;
+};
+
+struct PolyphonicKeyPressureEvent
+{
+    int     channel;
+    uint8_t note;
+    uint8_t pressure;
+};
+
+struct ControlChangeEvent
+{
+    int     channel;
+    uint8_t control_number;
+    uint8_t value;
+};
+
+struct ProgramChangeEvent
+{
+    int     channel;
+    uint8_t program;
+};
+
+struct ChannelPressureEvent
+{
+    int     channel;
+    uint8_t pressure;
+};
+
+struct PitchBendEvent
+{
+    int     channel;
+    int16_t value;
+};
+
+struct MidiEvent
+{
+    MidiMessageType    type;
+    int                channel;
+    uint8_t            data[2];
+    SystemCommonType   sc_type;
+    SystemRealTimeType srt_type;
+    ChannelModeType    cm_type;
+
+    NoteOffEvent AsNoteOff() const
+    {
+        return {channel, data[0], data[1]};
+    }
+    NoteOnEvent AsNoteOn() const { return {channel, data[0], data[1]}; }
+    PolyphonicKeyPressureEvent AsPolyphonicKeyPressure() const
+    {
+        return {channel, data[0], data[1]};
+    }
+    ControlChangeEvent AsControlChange() const
+    {
+        return {channel, data[0], data[1]};
+    }
+    ProgramChangeEvent   AsProgramChange() const { return {channel, data[0]}; }
+    ChannelPressureEvent AsChannelPressure() const { return {channel, data[0]}; }
+    PitchBendEvent       AsPitchBend() const
+    {
+        return {channel, (int16_t)(((uint16_t)data[1] << 7 | data[0]) - 8192)};
+    }
+};
+
+/** Bytes to MidiEvents, running status, SysEx is skipped */
+class MidiEventParser
+{
+  public:
+    MidiEventParser() { Reset(); }
+
+    bool Parse(uint8_t byte, MidiEvent* event);
+    void Reset();
+
+  private:
+    uint8_t status_;
+    uint8_t data_[2];
+    uint8_t count_, needed_;
+    bool    sysex_;
+};
+
+/** TRS MIDI, on a UartHandler like libDaisy's, which gets the engine's input */
+class MidiUartTransport
+{
+  public:
+    typedef void (*MidiRxParseCallback)(uint8_t* data, size_t size, void* context);
+
+    struct Config
+    {
+        UartHandler::Config::Peripheral periph = UartHandler::Config::Peripheral::USART_1;
+        dsy_gpio_pin                    rx;
+        dsy_gpio_pin                    tx;
+        uint8_t*                        rx_buffer      = nullptr;
+        size_t                          rx_buffer_size = 0;
+    };
+
+    MidiUartTransport() : callback_(nullptr), context_(nullptr) {}
+    ~MidiUartTransport() {}
+
+    void Init(Config config);
+    void StartRx(MidiRxParseCallback callback, void* context);
+    bool RxActive() { return uart_.IsListening(); }
+    void FlushRx() {}
+    void Tx(uint8_t* buff, size_t size);
+
+  private:
+    static void RxCallback(uint8_t*            data,
+                           size_t              size,
+                           void*               context,
+                           UartHandler::Result result);
+
+    UartHandler         uart_;
+    MidiRxParseCallback callback_;
+    void*               context_;
+    uint8_t             rx_buffer_[256];
+};
+
+/** USB MIDI, input fed by the engine like MidiUartTransport */
+class MidiUsbTransport
+{
+  public:
+    typedef void (*MidiRxParseCallback)(uint8_t* data, size_t size, void* context);
+
+    struct Config
+    {
+        enum Periph
+        {
+            INTERNAL = 0,
+            EXTERNAL,
+            HOST,
+        };
+
+        Periph  periph         = INTERNAL;
+        uint8_t tx_retry_count = 3;
+    };
+
+    MidiUsbTransport() : callback_(nullptr), context_(nullptr), rx_active_(false) {}
+    ~MidiUsbTransport();
+
+    void Init(Config config);
+    void StartRx(MidiRxParseCallback callback, void* context);
+    bool RxActive() { return rx_active_; }
+    void FlushRx() {}
+    void Tx(uint8_t* buff, size_t size);
+
+    /** Sim: delivers received bytes, in interrupt context */
+    void Receive(uint8_t* data, size_t size);
+
+  private:
+    MidiRxParseCallback callback_;
+    void*               context_;
+    bool                rx_active_;
+};
+
+/** libDaisy's MidiHandler. Bytes are parsed into the event queue as they
+ *  arrive, Listen() has nothing left to do.
+ */
+template <typename Transport>
+class MidiHandler
+{
+  public:
+    struct Config
+    {
+        typename Transport::Config transport_config;
+    };
+
+    MidiHandler() : head_(0), tail_(0) {}
+    ~MidiHandler() {}
+
+    void Init(Config config) { transport_.Init(config.transport_config); }
+
+    void StartReceive() { transport_.StartRx(ParseCallback, this); }
+
+    void Listen() {}
+
+    bool HasEvents() const { return head_ != tail_; }
+
+    MidiEvent PopEvent()
+    {
+        MidiEvent event = events_[tail_ % kQueueSize];
+        tail_           = tail_ + 1;
+        return event;
+    }
+
+    void SendMessage(uint8_t* bytes, size_t size) { transport_.Tx(bytes, size); }
+
+  private:
+    static constexpr uint32_t kQueueSize = 256;
+
+    static void ParseCallback(uint8_t* data, size_t size, void* context)
+    {
+        MidiHandler* self = static_cast<MidiHandler*>(context);
+        MidiEvent    event;
+        for(size_t i = 0; i < size; i++)
+        {
+            if(!self->parser_.Parse(data[i], &event))
+                continue;
+            if(self->head_ - self->tail_ < kQueueSize)
+            {
+                self->events_[self->head_ % kQueueSize] = event;
+                self->head_                             = self->head_ + 1;
+            }
+        }
+    }
+
+    Transport         transport_;
+    MidiEventParser   parser_;
+    MidiEvent         events_[kQueueSize];
+    volatile uint32_t head_, tail_;
+};
+
+typedef MidiHandler<MidiUartTransport> MidiUartHandler;
+typedef MidiHandler<MidiUsbTransport>  MidiUsbHandler;
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef DPT_SIM_HID_USB_H
+#define DPT_SIM_HID_USB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+/** libDaisy's UsbHandle, there is no USB device on the host */
+class UsbHandle
+{
+  public:
+    enum Result
+    {
+        OK,
+        ERR,
+    };
+
+    enum UsbPeriph
+    {
+        FS_INTERNAL,
+        FS_EXTERNAL,
+        FS_BOTH,
+    };
+
+    UsbHandle() {}
+    ~UsbHandle() {}
+
+    void   Init(UsbPeriph dev) {}
+    void   DeInit(UsbPeriph dev) {}
+    Result TransmitInternal(uint8_t* buff, size_t size) { return OK; }
+    Result TransmitExternal(uint8_t* buff, size_t size) { return OK; }
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef DPT_SIM_PER_ADC_H
+#define DPT_SIM_PER_ADC_H
+
+#include "daisy_core.h"
+
+namespace sim
+{
+class Engine;
+}
+
+namespace daisy
+{
+/** One ADC input, only the pin is kept */
+struct AdcChannelConfig
+{
+    enum MuxPin
+    {
+        MUX_SEL_0,
+        MUX_SEL_1,
+        MUX_SEL_2,
+        MUX_SEL_LAST,
+    };
+
+    enum class ConversionSpeed
+    {
+        CYCLES_1_5,
+        CYCLES_2_5,
+        CYCLES_8_5,
+        CYCLES_16_5,
+        CYCLES_32_5,
+        CYCLES_64_5,
+        CYCLES_387_5,
+        CYCLES_810_5,
+    };
+
+    void InitSingle(dsy_gpio_pin    pin,
+                    ConversionSpeed speed = ConversionSpeed::CYCLES_8_5)
+    {
+        pin_ = pin;
+    }
+
+    dsy_gpio_pin pin_;
+};
+
+/** libDaisy's AdcHandle. The engine writes the 16 bit conversions 
+ *  (the controls file, or mid-scale) before every audio block.
+ */
+class AdcHandle
+{
+  public:
+    enum OverSampling
+    {
+        OVS_NONE,
+        OVS_4,
+        OVS_8,
+        OVS_16,
+        OVS_32,
+        OVS_64,
+        OVS_128,
+        OVS_256,
+        OVS_512,
+        OVS_1024,
+        OVS_LAST,
+    };
+
+    /** Inputs the sim keeps, DPT uses 12 */
+    static constexpr size_t kMaxChannels = 16;
+
+    AdcHandle() : channels_(0) {}
+    ~AdcHandle() {}
+
+    void Init(AdcChannelConfig* cfg, size_t num_channels, OverSampling ovs = OVS_32);
+    void Start();
+    void Stop() {}
+
+    uint16_t  Get(uint8_t chn) const { return values_[chn]; }
+    uint16_t* GetPtr(uint8_t chn) { return &values_[chn]; }
+    float     GetFloat(uint8_t chn) const { return values_[chn] / 65536.f; }
+
+  private:
+    friend class ::sim::Engine;
+
+    size_t   channels_;
+    uint16_t values_[kMaxChannels];
+};
+
+} // namespace daisy
+
+#endif
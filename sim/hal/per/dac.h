@@ -0,0 +1,95 @@
+#pragma once
+#ifndef DPT_SIM_PER_DAC_H
+#define DPT_SIM_PER_DAC_H
+
+#include "daisy_core.h"
+
+namespace sim
+{
+class Engine;
+}
+
+namespace daisy
+{
+/** libDaisy's DacHandle. In DMA mode the engine plays the two circular 
+ *  buffers at target_samplerate and calls back for each half, like the 
+ *  half/complete transfer interrupts do.
+ */
+class DacHandle
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    enum class Channel
+    {
+        ONE,
+        TWO,
+        BOTH,
+    };
+
+    enum class Mode
+    {
+        POLLING,
+        DMA,
+    };
+
+    enum class BitDepth
+    {
+        BITS_8,
+        BITS_12,
+    };
+
+    enum class BufferState
+    {
+        ENABLED,
+        DISABLED,
+    };
+
+    struct Config
+    {
+        uint32_t    target_samplerate = 48000;
+        Channel     chn               = Channel::BOTH;
+        Mode        mode              = Mode::POLLING;
+        BitDepth    bitdepth          = BitDepth::BITS_12;
+        BufferState buff_state        = BufferState::ENABLED;
+    };
+
+    typedef void (*DacCallback)(uint16_t** out, size_t size);
+
+    DacHandle() : running_(false), callback_(nullptr), size_(0)
+    {
+        buffers_[0] = buffers_[1] = nullptr;
+        values_[0] = values_[1] = 0;
+    }
+    ~DacHandle() {}
+
+    Result        Init(const Config& config);
+    const Config& GetConfig() const { return config_; }
+
+    /** Both channels, size samples per channel, called back with size / 2 */
+    Result Start(uint16_t* buffer_1, uint16_t* buffer_2, size_t size, DacCallback cb);
+    /** One channel */
+    Result Start(uint16_t* buffer, size_t size, DacCallback cb);
+    Result Stop();
+
+    /** Polling mode */
+    Result WriteValue(Channel chn, uint16_t val);
+
+  private:
+    friend class ::sim::Engine;
+
+    Config        config_;
+    volatile bool running_;
+    DacCallback   callback_;
+    uint16_t*     buffers_[2];
+    size_t        size_;
+    uint16_t      values_[2];
+};
+
+} // namespace daisy
+
+#endif
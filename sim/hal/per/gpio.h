@@ -0,0 +1,41 @@
+#pragma once
+#ifndef DPT_SIM_PER_GPIO_H
+#define DPT_SIM_PER_GPIO_H
+
+#include "daisy_core.h"
+
+/** libDaisy's C GPIO API over the sim's GPIO_TypeDef ports.
+ *  Writes to an output are reported to the sim engine, reads of an input 
+ *  see the IDR the engine drives (gate inputs).
+ */
+
+typedef enum
+{
+    DSY_GPIO_MODE_INPUT,
+    DSY_GPIO_MODE_OUTPUT_PP,
+    DSY_GPIO_MODE_OUTPUT_OD,
+    DSY_GPIO_MODE_ANALOG,
+    DSY_GPIO_MODE_LAST,
+} dsy_gpio_mode;
+
+typedef enum
+{
+    DSY_GPIO_NOPULL,
+    DSY_GPIO_PULLUP,
+    DSY_GPIO_PULLDOWN,
+} dsy_gpio_pull;
+
+typedef struct
+{
+    dsy_gpio_pin  pin;
+    dsy_gpio_mode mode;
+    dsy_gpio_pull pull;
+} dsy_gpio;
+
+void    dsy_gpio_init(const dsy_gpio* p);
+void    dsy_gpio_deinit(const dsy_gpio* p);
+uint8_t dsy_gpio_read(const dsy_gpio* p);
+void    dsy_gpio_write(const dsy_gpio* p, uint8_t state);
+void    dsy_gpio_toggle(const dsy_gpio* p);
+
+#endif
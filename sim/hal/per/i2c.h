@@ -0,0 +1,70 @@
+#pragma once
+#ifndef DPT_SIM_PER_I2C_H
+#define DPT_SIM_PER_I2C_H
+
+#include "daisy_core.h"
+
+namespace daisy
+{
+/** libDaisy's I2CHandle config, there is nothing on the sim's bus */
+class I2CHandle
+{
+  public:
+    struct Config
+    {
+        enum class Peripheral
+        {
+            I2C_1,
+            I2C_2,
+            I2C_3,
+            I2C_4,
+        };
+
+        enum class Speed
+        {
+            I2C_100KHZ,
+            I2C_400KHZ,
+            I2C_1MHZ,
+        };
+
+        enum class Mode
+        {
+            I2C_MASTER,
+            I2C_SLAVE,
+        };
+
+        struct
+        {
+            dsy_gpio_pin scl, sda;
+        } pin_config;
+
+        Peripheral periph  = Peripheral::I2C_1;
+        Speed      speed   = Speed::I2C_100KHZ;
+        Mode       mode    = Mode::I2C_MASTER;
+        uint8_t    address = 0x10;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    I2CHandle() {}
+    ~I2CHandle() {}
+
+    Result Init(const Config& config)
+    {
+        config_ = config;
+        return Result::OK;
+    }
+
+    const Config& GetConfig() const { return config_; }
+
+  private:
+    Config config_;
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef DPT_SIM_PER_QSPI_H
+#define DPT_SIM_PER_QSPI_H
+
+#include "daisy_core.h"
+
+namespace daisy
+{
+/** libDaisy's QSPIHandle over 8MB of erased (0xff) host memory, so the
+ *  board finds no CV calibration and uses the nominal curves.
+ */
+class QSPIHandle
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    enum class Status
+    {
+        GOOD,
+        E_HAL_ERROR,
+        E_SWITCHING_MODES,
+        E_INVALID_MODE,
+    };
+
+    struct Config
+    {
+        enum class Device
+        {
+            IS25LP080D,
+            IS25LP064A,
+            DEVICE_LAST,
+        };
+
+        enum class Mode
+        {
+            MEMORY_MAPPED,
+            INDIRECT_POLLING,
+            MODE_LAST,
+        };
+
+        struct
+        {
+            dsy_gpio_pin io0, io1, io2, io3, clk, ncs;
+        } pin_config;
+
+        Device device = Device::IS25LP064A;
+        Mode   mode   = Mode::MEMORY_MAPPED;
+    };
+
+    /** Size of the flash */
+    static constexpr uint32_t kSize = 0x800000;
+
+    QSPIHandle() {}
+    ~QSPIHandle() {}
+
+    Result        Init(const Config& config);
+    const Config& GetConfig() const { return config_; }
+    Result        DeInit() { return Result::OK; }
+
+    /** Erases whole 4kB sectors covering [start_addr, end_addr) */
+    Result Erase(uint32_t start_addr, uint32_t end_addr);
+    Result EraseSector(uint32_t address);
+    Result Write(uint32_t address, uint32_t size, uint8_t* buffer);
+
+    void*  GetData(uint32_t offset = 0);
+    Status GetStatus() const { return Status::GOOD; }
+
+  private:
+    Config config_;
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef DPT_SIM_PER_RNG_H
+#define DPT_SIM_PER_RNG_H
+
+#include <stdint.h>
+
+namespace daisy
+{
+/** libDaisy's Random, a fixed seed xorshift so renders repeat */
+class Random
+{
+  public:
+    static void     Init() {}
+    static void     DeInit() {}
+    static uint32_t GetValue();
+    static float    GetFloat(float min = 0.f, float max = 1.f)
+    {
+        return min + (GetValue() / 4294967296.f) * (max - min);
+    }
+    static bool IsReady() { return true; }
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef DPT_SIM_PER_SAI_H
+#define DPT_SIM_PER_SAI_H
+
+#include "daisy_core.h"
+
+namespace daisy
+{
+/** libDaisy's SaiHandle, only holds the config for AudioHandle */
+class SaiHandle
+{
+  public:
+    struct Config
+    {
+        enum class Peripheral
+        {
+            SAI_1,
+            SAI_2,
+        };
+
+        enum class SampleRate
+        {
+            SAI_8KHZ,
+            SAI_16KHZ,
+            SAI_32KHZ,
+            SAI_48KHZ,
+            SAI_96KHZ,
+        };
+
+        enum class BitDepth
+        {
+            SAI_16BIT,
+            SAI_24BIT,
+            SAI_32BIT,
+        };
+
+        enum class Sync
+        {
+            MASTER,
+            SLAVE,
+        };
+
+        enum class Direction
+        {
+            TRANSMIT,
+            RECEIVE,
+        };
+
+        struct
+        {
+            dsy_gpio_pin mclk, fs, sck, sa, sb;
+        } pin_config;
+
+        Peripheral periph    = Peripheral::SAI_1;
+        SampleRate sr        = SampleRate::SAI_48KHZ;
+        BitDepth   bit_depth = BitDepth::SAI_24BIT;
+        Sync       a_sync    = Sync::MASTER;
+        Sync       b_sync    = Sync::SLAVE;
+        Direction  a_dir     = Direction::RECEIVE;
+        Direction  b_dir     = Direction::TRANSMIT;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    SaiHandle() {}
+    ~SaiHandle() {}
+
+    Result Init(const Config& config)
+    {
+        config_ = config;
+        return Result::OK;
+    }
+
+    const Config& GetConfig() const { return config_; }
+
+    float GetSampleRate() const;
+
+  private:
+    Config config_;
+};
+
+} // namespace daisy
+
+#endif
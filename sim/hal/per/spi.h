@@ -0,0 +1,139 @@
+#pragma once
+#ifndef DPT_SIM_PER_SPI_H
+#define DPT_SIM_PER_SPI_H
+
+#include "daisy_core.h"
+
+namespace daisy
+{
+/** libDaisy's SpiHandle, transmit only.
+ *  A DMA transmit takes datasize bits per data frame of virtual time
+ *  (50MHz kernel clock over the prescaler), then the words are handed to
+ *  the engine (SPI2 decodes them as DAC7554 commands) and the end callback
+ *  runs in interrupt context.
+ *  One transfer can be queued behind a running one, as in libDaisy.
+ */
+class SpiHandle
+{
+  public:
+    struct Config
+    {
+        enum class Peripheral
+        {
+            SPI_1,
+            SPI_2,
+            SPI_3,
+            SPI_4,
+            SPI_5,
+            SPI_6,
+        };
+
+        enum class Mode
+        {
+            MASTER,
+            SLAVE,
+        };
+
+        enum class ClockPolarity
+        {
+            LOW,
+            HIGH,
+        };
+
+        enum class ClockPhase
+        {
+            ONE_EDGE,
+            TWO_EDGE,
+        };
+
+        enum class Direction
+        {
+            TWO_LINES,
+            TWO_LINES_TX_ONLY,
+            TWO_LINES_RX_ONLY,
+            ONE_LINE,
+        };
+
+        enum class NSS
+        {
+            SOFT,
+            HARD_INPUT,
+            HARD_OUTPUT,
+        };
+
+        enum class BaudPrescaler
+        {
+            PS_2,
+            PS_4,
+            PS_8,
+            PS_16,
+            PS_32,
+            PS_64,
+            PS_128,
+            PS_256,
+        };
+
+        struct
+        {
+            dsy_gpio_pin sclk, miso, mosi, nss;
+        } pin_config;
+
+        Peripheral    periph         = Peripheral::SPI_1;
+        Mode          mode           = Mode::MASTER;
+        Direction     direction      = Direction::TWO_LINES;
+        unsigned long datasize       = 8;
+        ClockPolarity clock_polarity = ClockPolarity::LOW;
+        ClockPhase    clock_phase    = ClockPhase::ONE_EDGE;
+        NSS           nss            = NSS::HARD_OUTPUT;
+        BaudPrescaler baud_prescaler = BaudPrescaler::PS_8;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    typedef void (*StartCallbackFunctionPtr)(void* context);
+    typedef void (*EndCallbackFunctionPtr)(void* context, Result result);
+
+    SpiHandle() : busy_(false), queued_(false) {}
+    ~SpiHandle() {}
+
+    Result        Init(const Config& config);
+    const Config& GetConfig() const { return config_; }
+
+    /** Sends right away, in zero virtual time */
+    Result BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout = 100);
+
+    /** \param size in data frames, datasize bits each */
+    Result DmaTransmit(uint8_t*                 buff,
+                       size_t                   size,
+                       StartCallbackFunctionPtr start_callback,
+                       EndCallbackFunctionPtr   end_callback,
+                       void*                    callback_context);
+
+    bool IsBusy() const { return busy_; }
+
+  private:
+    struct Job
+    {
+        uint8_t*                 buff;
+        size_t                   size;
+        StartCallbackFunctionPtr start_callback;
+        EndCallbackFunctionPtr   end_callback;
+        void*                    context;
+    };
+
+    void Begin(const Job& job);
+    void End();
+
+    Config        config_;
+    volatile bool busy_;
+    bool          queued_;
+    Job           job_, next_;
+};
+
+} // namespace daisy
+
+#endif
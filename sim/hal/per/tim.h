@@ -0,0 +1,89 @@
+#pragma once
+#ifndef DPT_SIM_PER_TIM_H
+#define DPT_SIM_PER_TIM_H
+
+#include "daisy_core.h"
+
+namespace sim
+{
+class Engine;
+}
+
+namespace daisy
+{
+/** libDaisy's TimerHandle on the sim's TIM registers.
+ *  The engine counts the timer from CR1/PSC/ARR, and calls the callback 
+ *  on each update while UIE and the timer's NVIC line are enabled.
+ */
+class TimerHandle
+{
+  public:
+    struct Config
+    {
+        enum class Peripheral
+        {
+            TIM_2 = 0,
+            TIM_3,
+            TIM_4,
+            TIM_5,
+        };
+
+        enum class CounterDir
+        {
+            UP = 0,
+            DOWN,
+        };
+
+        Config()
+        : periph(Peripheral::TIM_2),
+          dir(CounterDir::UP),
+          period(0xffffffff),
+          enable_irq(false)
+        {
+        }
+
+        Peripheral periph;
+        CounterDir dir;
+        uint32_t   period;
+        bool       enable_irq;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    typedef void (*PeriodElapsedCallback)(void* data);
+
+    TimerHandle() : tim_(nullptr), callback_(nullptr), data_(nullptr) {}
+    ~TimerHandle() {}
+
+    Result        Init(const Config& config);
+    Result        DeInit();
+    const Config& GetConfig() const { return config_; }
+
+    Result SetPeriod(uint32_t ticks);
+    Result SetPrescaler(uint32_t val);
+    Result Start();
+    Result Stop();
+
+    uint32_t GetFreq();
+    uint32_t GetTick();
+    uint32_t GetMs();
+    uint32_t GetUs();
+
+    void SetCallback(PeriodElapsedCallback cb, void* data = nullptr);
+
+  private:
+    friend class ::sim::Engine;
+
+    Config                config_;
+    TIM_TypeDef*          tim_;
+    PeriodElapsedCallback callback_;
+    void*                 data_;
+};
+
+} // namespace daisy
+
+#endif
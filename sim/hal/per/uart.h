@@ -0,0 +1,124 @@
+#pragma once
+#ifndef DPT_SIM_PER_UART_H
+#define DPT_SIM_PER_UART_H
+
+#include "daisy_core.h"
+
+namespace daisy
+{
+/** libDaisy's UartHandler. Transmits are logged as midi_out_trs events, a DMA
+ *  transmit completes after 10 bits per byte at the configured baudrate.
+ *  USART1 is fed the engine's TRS MIDI input, in bursts as the DMA listen
+ *  idle line interrupt would deliver them.
+ */
+class UartHandler
+{
+  public:
+    struct Config
+    {
+        enum class Peripheral
+        {
+            USART_1,
+            USART_2,
+            USART_3,
+            UART_4,
+            UART_5,
+            USART_6,
+            UART_7,
+            UART_8,
+            LPUART_1,
+        };
+
+        enum class StopBits
+        {
+            BITS_0_5,
+            BITS_1,
+            BITS_1_5,
+            BITS_2,
+        };
+
+        enum class Parity
+        {
+            NONE,
+            EVEN,
+            ODD,
+        };
+
+        enum class Mode
+        {
+            RX,
+            TX,
+            TX_RX,
+        };
+
+        enum class WordLength
+        {
+            BITS_7,
+            BITS_8,
+            BITS_9,
+        };
+
+        struct
+        {
+            dsy_gpio_pin tx, rx;
+        } pin_config;
+
+        Peripheral periph     = Peripheral::USART_1;
+        StopBits   stopbits   = StopBits::BITS_1;
+        Parity     parity     = Parity::NONE;
+        Mode       mode       = Mode::TX_RX;
+        WordLength wordlength = WordLength::BITS_8;
+        uint32_t   baudrate   = 4800;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    typedef void (*StartCallbackFunctionPtr)(void* context);
+    typedef void (*EndCallbackFunctionPtr)(void* context, Result result);
+    typedef void (*CircularRxCallbackFunctionPtr)(uint8_t* data,
+                                                  size_t   size,
+                                                  void*    context,
+                                                  Result   result);
+
+    UartHandler()
+    : busy_(false), listening_(false), rx_callback_(nullptr), rx_context_(nullptr)
+    {
+    }
+    ~UartHandler();
+
+    Result        Init(const Config& config);
+    const Config& GetConfig() const { return config_; }
+
+    Result BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout = 100);
+
+    Result DmaTransmit(uint8_t*                 buff,
+                       size_t                   size,
+                       StartCallbackFunctionPtr start_callback,
+                       EndCallbackFunctionPtr   end_callback,
+                       void*                    callback_context);
+
+    Result DmaListenStart(uint8_t*                      buff,
+                          size_t                        size,
+                          CircularRxCallbackFunctionPtr cb,
+                          void*                         callback_context);
+    Result DmaListenStop();
+    bool   IsListening() const { return listening_; }
+
+    /** Sim: delivers received bytes, in interrupt context */
+    void Receive(uint8_t* data, size_t size);
+
+  private:
+    Config                        config_;
+    volatile bool                 busy_;
+    bool                          listening_;
+    CircularRxCallbackFunctionPtr rx_callback_;
+    void*                         rx_context_;
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,855 @@
+/** The stand-in libDaisy and STM32 HAL, on top of the sim engine */
+
+#include <string.h>
+#include <vector>
+#include "daisy.h"
+#include "../sim_engine.h"
+
+using namespace daisy;
+using sim::Engine;
+
+/** Register blocks */
+GPIO_TypeDef       sim_gpio_ports[11];
+EXTI_TypeDef       sim_exti;
+TIM_TypeDef        sim_tim2, sim_tim3, sim_tim4, sim_tim5, sim_tim12;
+SPI_TypeDef        sim_spi2;
+DMA_Stream_TypeDef sim_dma2_stream7;
+
+namespace sim
+{
+std::recursive_mutex& IrqMutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+} // namespace sim
+
+/** Vectors for builds that don't define them */
+extern "C" __attribute__((weak)) void EXTI15_10_IRQHandler(void) {}
+extern "C" __attribute__((weak)) void DMA2_Stream7_IRQHandler(void) {}
+
+/** NVIC */
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub) {}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq)
+{
+    Engine::Get().SetIrqEnabled(irq, true);
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type irq)
+{
+    Engine::Get().SetIrqEnabled(irq, false);
+}
+
+/** GPIO, EXTI */
+void HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init)
+{
+    /** EXTI modes: bit 28 is the interrupt, bits 20/21 the rising/falling edge */
+    if(!(init->Mode & 0x10000000u))
+        return;
+    uint32_t lines = init->Pin & 0xffff;
+    EXTI->IMR1 |= lines;
+    if(init->Mode & 0x00100000u)
+        EXTI->RTSR1 |= lines;
+    else
+        EXTI->RTSR1 &= ~lines;
+    if(init->Mode & 0x00200000u)
+        EXTI->FTSR1 |= lines;
+    else
+        EXTI->FTSR1 &= ~lines;
+}
+
+GPIO_TypeDef* dsy_hal_map_get_port(const dsy_gpio_pin* p)
+{
+    return p->port < DSY_GPIOX ? &sim_gpio_ports[p->port] : nullptr;
+}
+
+uint16_t dsy_hal_map_get_pin(const dsy_gpio_pin* p)
+{
+    return (uint16_t)(1u << p->pin);
+}
+
+void dsy_gpio_init(const dsy_gpio* p) {}
+
+void dsy_gpio_deinit(const dsy_gpio* p) {}
+
+uint8_t dsy_gpio_read(const dsy_gpio* p)
+{
+    GPIO_TypeDef* port = dsy_hal_map_get_port(&p->pin);
+    if(!port)
+        return 0;
+    bool output = p->mode == DSY_GPIO_MODE_OUTPUT_PP
+                  || p->mode == DSY_GPIO_MODE_OUTPUT_OD;
+    return ((output ? port->ODR : port->IDR) & dsy_hal_map_get_pin(&p->pin)) != 0;
+}
+
+void dsy_gpio_write(const dsy_gpio* p, uint8_t state)
+{
+    GPIO_TypeDef* port = dsy_hal_map_get_port(&p->pin);
+    if(!port)
+        return;
+    uint16_t bit = dsy_hal_map_get_pin(&p->pin);
+    bool     was = port->ODR & bit;
+    if(state)
+        port->ODR |= bit;
+    else
+        port->ODR &= ~(uint32_t)bit;
+    if(was != (state != 0))
+        Engine::Get().GpioChanged(p->pin.port, p->pin.pin, state != 0);
+}
+
+void dsy_gpio_toggle(const dsy_gpio* p)
+{
+    GPIO_TypeDef* port = dsy_hal_map_get_port(&p->pin);
+    if(port)
+        dsy_gpio_write(p, !(port->ODR & dsy_hal_map_get_pin(&p->pin)));
+}
+
+/** TIM */
+
+/** ARR width: TIM2 and TIM5 are 32 bit, the rest 16. PSC is 16 bit on all */
+static uint32_t ArrMask(const TIM_TypeDef* tim)
+{
+    return tim == TIM2 || tim == TIM5 ? 0xffffffff : 0xffff;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim)
+{
+    htim->Instance->PSC = htim->Init.Prescaler & 0xffff;
+    htim->Instance->ARR = htim->Init.Period & ArrMask(htim->Instance);
+    MODIFY_REG(htim->Instance->CR1, TIM_CR1_ARPE, htim->Init.AutoReloadPreload);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim)
+{
+    htim->Instance->CR1 |= TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef* htim)
+{
+    htim->Instance->CR1 &= ~TIM_CR1_CEN;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef*       htim,
+                                                        TIM_MasterConfigTypeDef* config)
+{
+    MODIFY_REG(htim->Instance->CR2, TIM_CR2_MMS, config->MasterOutputTrigger);
+    return HAL_OK;
+}
+
+/** DMA, the engine moves the items as the request generator or SPI2 asks */
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma)
+{
+    hdma->Running          = false;
+    hdma->Pending          = 0;
+    hdma->GeneratorEnabled = false;
+    Engine::Get().Attach(hdma);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_DMA_Start_IT(DMA_HandleTypeDef* hdma, uintptr_t src, uintptr_t dst, uint32_t length)
+{
+    std::lock_guard<std::recursive_mutex> lock(sim::IrqMutex());
+    if(hdma->Running)
+        return HAL_BUSY;
+    hdma->SrcAddress = src;
+    hdma->DstAddress = dst;
+    hdma->Length     = length;
+    hdma->Position   = 0;
+    hdma->Pending    = 0;
+    hdma->Running    = length > 0;
+    if(hdma->Running && hdma->Init.Request == DMA_REQUEST_SPI2_TX)
+        Engine::Get().Spi2Dma(hdma);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma)
+{
+    std::lock_guard<std::recursive_mutex> lock(sim::IrqMutex());
+    hdma->Running = false;
+    hdma->Pending = 0;
+    return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef* hdma)
+{
+    uint32_t pending = hdma->Pending;
+    hdma->Pending    = 0;
+    if((pending & DMA_FLAG_HT) && hdma->XferHalfCpltCallback)
+        hdma->XferHalfCpltCallback(hdma);
+    if((pending & DMA_FLAG_TC) && hdma->XferCpltCallback)
+        hdma->XferCpltCallback(hdma);
+}
+
+HAL_StatusTypeDef
+HAL_DMAEx_ConfigMuxRequestGenerator(DMA_HandleTypeDef*                        hdma,
+                                    HAL_DMA_MuxRequestGeneratorConfigTypeDef* config)
+{
+    hdma->GeneratorSignal   = config->SignalID;
+    hdma->GeneratorRequests = config->RequestNumber;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMAEx_EnableMuxRequestGenerator(DMA_HandleTypeDef* hdma)
+{
+    hdma->GeneratorEnabled = true;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMAEx_DisableMuxRequestGenerator(DMA_HandleTypeDef* hdma)
+{
+    hdma->GeneratorEnabled = false;
+    return HAL_OK;
+}
+
+namespace daisy
+{
+/** System, on virtual time */
+uint32_t System::GetNow()
+{
+    return (uint32_t)(Engine::Get().Now() / 1000000);
+}
+
+uint32_t System::GetUs()
+{
+    return (uint32_t)(Engine::Get().Now() / 1000);
+}
+
+uint32_t System::GetTick()
+{
+    return (uint32_t)(Engine::Get().Now() * 6 / 25);
+}
+
+void System::Delay(uint32_t delay_ms)
+{
+    Engine::Get().Sleep(delay_ms * 1000000ull);
+}
+
+void System::DelayUs(uint32_t delay_us)
+{
+    Engine::Get().Sleep(delay_us * 1000ull);
+}
+
+void System::DelayTicks(uint32_t delay_ticks)
+{
+    Engine::Get().Sleep(delay_ticks * 25ull / 6);
+}
+
+/** TimerHandle */
+static IRQn_Type TimerIrq(TIM_TypeDef* tim)
+{
+    return tim == TIM3   ? TIM3_IRQn
+           : tim == TIM4 ? TIM4_IRQn
+           : tim == TIM5 ? TIM5_IRQn
+                         : IRQn_LAST;
+}
+
+TimerHandle::Result TimerHandle::Init(const Config& config)
+{
+    static TIM_TypeDef* const kTimers[] = {TIM2, TIM3, TIM4, TIM5};
+    config_ = config;
+    tim_    = kTimers[(int)config.periph];
+    tim_->CR1 &= ~TIM_CR1_CEN;
+    tim_->PSC = 0;
+    tim_->ARR = config.period & ArrMask(tim_);
+    if(config.enable_irq && TimerIrq(tim_) != IRQn_LAST)
+        HAL_NVIC_EnableIRQ(TimerIrq(tim_));
+    Engine::Get().Attach(this);
+    return Result::OK;
+}
+
+TimerHandle::Result TimerHandle::DeInit()
+{
+    return Stop();
+}
+
+TimerHandle::Result TimerHandle::SetPeriod(uint32_t ticks)
+{
+    tim_->ARR = ticks & ArrMask(tim_);
+    return Result::OK;
+}
+
+TimerHandle::Result TimerHandle::SetPrescaler(uint32_t val)
+{
+    tim_->PSC = val & 0xffff;
+    return Result::OK;
+}
+
+TimerHandle::Result TimerHandle::Start()
+{
+    if(config_.enable_irq)
+        tim_->DIER |= TIM_DIER_UIE;
+    tim_->CR1 |= TIM_CR1_CEN;
+    return Result::OK;
+}
+
+TimerHandle::Result TimerHandle::Stop()
+{
+    tim_->CR1 &= ~TIM_CR1_CEN;
+    tim_->DIER &= ~TIM_DIER_UIE;
+    return Result::OK;
+}
+
+uint32_t TimerHandle::GetFreq()
+{
+    return System::GetPClk1Freq() * 2 / (tim_->PSC + 1);
+}
+
+uint32_t TimerHandle::GetTick()
+{
+    return (uint32_t)(Engine::Get().Now() * 6 / 25 / (tim_->PSC + 1));
+}
+
+uint32_t TimerHandle::GetMs()
+{
+    return System::GetNow();
+}
+
+uint32_t TimerHandle::GetUs()
+{
+    return System::GetUs();
+}
+
+void TimerHandle::SetCallback(PeriodElapsedCallback cb, void* data)
+{
+    callback_ = cb;
+    data_     = data;
+}
+
+/** SpiHandle */
+SpiHandle::Result SpiHandle::Init(const Config& config)
+{
+    config_ = config;
+    busy_   = false;
+    queued_ = false;
+    return Result::OK;
+}
+
+SpiHandle::Result SpiHandle::BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout)
+{
+    if(config_.periph == Config::Peripheral::SPI_2)
+        Engine::Get().Spi2Transmit(buff, size, config_.datasize);
+    return Result::OK;
+}
+
+SpiHandle::Result SpiHandle::DmaTransmit(uint8_t*                 buff,
+                                         size_t                   size,
+                                         StartCallbackFunctionPtr start_callback,
+                                         EndCallbackFunctionPtr   end_callback,
+                                         void*                    callback_context)
+{
+    std::lock_guard<std::recursive_mutex> lock(sim::IrqMutex());
+    Job job = {buff, size, start_callback, end_callback, callback_context};
+    if(busy_)
+    {
+        if(queued_)
+            return Result::ERR;
+        next_   = job;
+        queued_ = true;
+        return Result::OK;
+    }
+    Begin(job);
+    return Result::OK;
+}
+
+void SpiHandle::Begin(const Job& job)
+{
+    job_  = job;
+    busy_ = true;
+    if(job_.start_callback)
+        job_.start_callback(job_.context);
+    /** 50MHz kernel clock, PS_2 upwards, plus the DMA and NSS setup */
+    uint64_t bit_ns = 40ull << (int)config_.baud_prescaler;
+    Engine::Get().Later(job_.size * config_.datasize * bit_ns + 1000, [this] { End(); });
+}
+
+void SpiHandle::End()
+{
+    if(config_.periph == Config::Peripheral::SPI_2)
+        Engine::Get().Spi2Transmit(job_.buff, job_.size, config_.datasize);
+    busy_ = false;
+    if(job_.end_callback)
+        job_.end_callback(job_.context, Result::OK);
+    if(queued_ && !busy_)
+    {
+        queued_ = false;
+        Begin(next_);
+    }
+}
+
+/** UartHandler */
+UartHandler::~UartHandler()
+{
+    Engine::Get().Detach(this);
+}
+
+UartHandler::Result UartHandler::Init(const Config& config)
+{
+    config_    = config;
+    busy_      = false;
+    listening_ = false;
+    if(config.periph == Config::Peripheral::USART_1)
+        Engine::Get().Attach(this);
+    return Result::OK;
+}
+
+UartHandler::Result UartHandler::BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout)
+{
+    Engine::Get().Bytes("midi_out_trs", buff, size);
+    return Result::OK;
+}
+
+UartHandler::Result UartHandler::DmaTransmit(uint8_t*                 buff,
+                                             size_t                   size,
+                                             StartCallbackFunctionPtr start_callback,
+                                             EndCallbackFunctionPtr   end_callback,
+                                             void*                    callback_context)
+{
+    std::lock_guard<std::recursive_mutex> lock(sim::IrqMutex());
+    if(busy_)
+        return Result::ERR;
+    busy_ = true;
+    if(start_callback)
+        start_callback(callback_context);
+    Engine::Get().Bytes("midi_out_trs", buff, size);
+    /** Start, 8 data and a stop bit per byte */
+    uint64_t ns = size * 10 * 1000000000ull / config_.baudrate;
+    Engine::Get().Later(ns, [this, end_callback, callback_context] {
+        busy_ = false;
+        if(end_callback)
+            end_callback(callback_context, Result::OK);
+    });
+    return Result::OK;
+}
+
+/** QSPIHandle */
+static std::vector<uint8_t>& QspiFlash()
+{
+    static std::vector<uint8_t> flash(QSPIHandle::kSize, 0xff);
+    return flash;
+}
+
+QSPIHandle::Result QSPIHandle::Init(const Config& config)
+{
+    config_ = config;
+    QspiFlash();
+    return Result::OK;
+}
+
+QSPIHandle::Result QSPIHandle::Erase(uint32_t start_addr, uint32_t end_addr)
+{
+    for(uint32_t addr = start_addr & ~0xfffu; addr < end_addr; addr += 0x1000)
+        if(EraseSector(addr) != Result::OK)
+            return Result::ERR;
+    return Result::OK;
+}
+
+QSPIHandle::Result QSPIHandle::EraseSector(uint32_t address)
+{
+    address &= ~0xfffu;
+    if(address >= kSize)
+        return Result::ERR;
+    memset(&QspiFlash()[address], 0xff, 0x1000);
+    return Result::OK;
+}
+
+QSPIHandle::Result QSPIHandle::Write(uint32_t address, uint32_t size, uint8_t* buffer)
+{
+    address &= kSize - 1;
+    if(address + size > kSize)
+        return Result::ERR;
+    /** NOR flash, programming only clears bits */
+    for(uint32_t i = 0; i < size; i++)
+        QspiFlash()[address + i] &= buffer[i];
+    return Result::OK;
+}
+
+void* QSPIHandle::GetData(uint32_t offset)
+{
+    return &QspiFlash()[offset & (kSize - 1)];
+}
+
+/** SAI and audio */
+static float SampleRateHz(SaiHandle::Config::SampleRate sr)
+{
+    switch(sr)
+    {
+        case SaiHandle::Config::SampleRate::SAI_8KHZ: return 8000.f;
+        case SaiHandle::Config::SampleRate::SAI_16KHZ: return 16000.f;
+        case SaiHandle::Config::SampleRate::SAI_32KHZ: return 32000.f;
+        case SaiHandle::Config::SampleRate::SAI_96KHZ: return 96000.f;
+        default: return 48000.f;
+    }
+}
+
+float SaiHandle::GetSampleRate() const
+{
+    return SampleRateHz(config_.sr);
+}
+
+AudioHandle::Result AudioHandle::Init(const Config& config, SaiHandle sai)
+{
+    config_            = config;
+    config_.samplerate = sai.GetConfig().sr;
+    return SetBlockSize(config.blocksize);
+}
+
+float AudioHandle::GetSampleRate()
+{
+    return SampleRateHz(config_.samplerate);
+}
+
+AudioHandle::Result AudioHandle::SetSampleRate(SaiHandle::Config::SampleRate samplerate)
+{
+    config_.samplerate = samplerate;
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::SetBlockSize(size_t size)
+{
+    config_.blocksize = size > kMaxBlockSize ? kMaxBlockSize : size;
+    return size > kMaxBlockSize ? Result::ERR : Result::OK;
+}
+
+AudioHandle::Result AudioHandle::SetPostGain(float val)
+{
+    if(val <= 0.f)
+        return Result::ERR;
+    config_.postgain = val;
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::SetOutputCompensation(float val)
+{
+    config_.output_compensation = val;
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::Start(AudioCallback callback)
+{
+    callback_              = callback;
+    interleaving_callback_ = nullptr;
+    running_               = true;
+    Engine::Get().Attach(this);
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::Start(InterleavingAudioCallback callback)
+{
+    callback_              = nullptr;
+    interleaving_callback_ = callback;
+    running_               = true;
+    Engine::Get().Attach(this);
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::Stop()
+{
+    running_ = false;
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::ChangeCallback(AudioCallback callback)
+{
+    callback_              = callback;
+    interleaving_callback_ = nullptr;
+    return Result::OK;
+}
+
+AudioHandle::Result AudioHandle::ChangeCallback(InterleavingAudioCallback callback)
+{
+    callback_              = nullptr;
+    interleaving_callback_ = callback;
+    return Result::OK;
+}
+
+/** ADC */
+void AdcHandle::Init(AdcChannelConfig* cfg, size_t num_channels, OverSampling ovs)
+{
+    channels_ = num_channels < kMaxChannels ? num_channels : kMaxChannels;
+    for(size_t i = 0; i < kMaxChannels; i++)
+        values_[i] = 0;
+}
+
+void AdcHandle::Start()
+{
+    Engine::Get().Attach(this);
+}
+
+/** DAC */
+DacHandle::Result DacHandle::Init(const Config& config)
+{
+    config_ = config;
+    return Result::OK;
+}
+
+DacHandle::Result
+DacHandle::Start(uint16_t* buffer_1, uint16_t* buffer_2, size_t size, DacCallback cb)
+{
+    if(config_.mode != Mode::DMA)
+        return Result::ERR;
+    buffers_[0] = buffer_1;
+    buffers_[1] = buffer_2;
+    size_       = size;
+    callback_   = cb;
+    running_    = true;
+    Engine::Get().Attach(this);
+    return Result::OK;
+}
+
+DacHandle::Result DacHandle::Start(uint16_t* buffer, size_t size, DacCallback cb)
+{
+    return Start(buffer, nullptr, size, cb);
+}
+
+DacHandle::Result DacHandle::Stop()
+{
+    running_ = false;
+    return Result::OK;
+}
+
+DacHandle::Result DacHandle::WriteValue(Channel chn, uint16_t val)
+{
+    if(chn != Channel::TWO)
+        values_[0] = val;
+    if(chn != Channel::ONE)
+        values_[1] = val;
+    return Result::OK;
+}
+
+/** Random */
+uint32_t Random::GetValue()
+{
+    static uint32_t state = 0x2545f491;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/** AnalogControl, as in libDaisy */
+void AnalogControl::Init(uint16_t* adcptr, float sr, bool flip, bool invert, float slew_seconds)
+{
+    val_          = 0.f;
+    raw_          = adcptr;
+    scale_        = 1.f;
+    offset_       = 0.f;
+    flip_         = flip;
+    invert_       = invert;
+    slew_seconds_ = slew_seconds;
+    SetSampleRate(sr);
+}
+
+void AnalogControl::InitBipolarCv(uint16_t* adcptr, float sr)
+{
+    Init(adcptr, sr, true, false);
+    scale_  = 2.f;
+    offset_ = 0.5f;
+}
+
+float AnalogControl::Process()
+{
+    float t = GetRawFloat();
+    if(flip_)
+        t = 1.f - t;
+    if(invert_)
+        t = -t;
+    t = (t - offset_) * scale_;
+    val_ += coeff_ * (t - val_);
+    return val_;
+}
+
+void AnalogControl::SetSampleRate(float sample_rate)
+{
+    samplerate_ = sample_rate;
+    float coeff = 1.f / (slew_seconds_ * samplerate_ * 0.5f);
+    coeff_      = coeff > 1.f ? 1.f : coeff;
+}
+
+/** GateIn */
+void GateIn::Init(dsy_gpio_pin* pin_cfg, bool invert)
+{
+    pin_.pin  = *pin_cfg;
+    pin_.mode = DSY_GPIO_MODE_INPUT;
+    pin_.pull = DSY_GPIO_NOPULL;
+    dsy_gpio_init(&pin_);
+    invert_     = invert;
+    prev_state_ = state_ = 0;
+}
+
+bool GateIn::Trig()
+{
+    prev_state_ = state_;
+    state_      = State();
+    return state_ && !prev_state_;
+}
+
+bool GateIn::State()
+{
+    return invert_ ? !dsy_gpio_read(&pin_) : dsy_gpio_read(&pin_);
+}
+
+/** MidiEventParser */
+void MidiEventParser::Reset()
+{
+    status_ = 0;
+    count_  = 0;
+    needed_ = 0;
+    sysex_  = false;
+}
+
+bool MidiEventParser::Parse(uint8_t byte, MidiEvent* event)
+{
+    /** Real-time bytes can land anywhere, even inside a message */
+    if(byte >= 0xf8)
+    {
+        event->type     = SystemRealTime;
+        event->channel  = 0;
+        event->srt_type = (SystemRealTimeType)(byte - 0xf8);
+        return true;
+    }
+    if(byte & 0x80)
+    {
+        count_ = 0;
+        sysex_ = byte == 0xf0;
+        if(sysex_ || byte == 0xf7)
+        {
+            status_ = 0;
+            return false;
+        }
+        status_ = byte;
+        if(byte >= 0xf0)
+        {
+            needed_ = byte == 0xf2 ? 2 : byte == 0xf1 || byte == 0xf3 ? 1 : 0;
+            if(needed_ > 0)
+                return false;
+            event->type    = SystemCommon;
+            event->channel = 0;
+            event->sc_type = (SystemCommonType)(byte - 0xf0);
+            status_        = 0;
+            return byte == 0xf6;
+        }
+        needed_ = (byte & 0xf0) == 0xc0 || (byte & 0xf0) == 0xd0 ? 1 : 2;
+        return false;
+    }
+    if(sysex_ || !status_)
+        return false;
+
+    data_[count_++] = byte;
+    if(count_ < needed_)
+        return false;
+    count_         = 0;
+    event->data[0] = data_[0];
+    event->data[1] = needed_ > 1 ? data_[1] : 0;
+    if(status_ >= 0xf0)
+    {
+        event->type    = SystemCommon;
+        event->channel = 0;
+        event->sc_type = (SystemCommonType)(status_ - 0xf0);
+        status_        = 0;
+        return true;
+    }
+    event->type    = (MidiMessageType)((status_ >> 4) - 8);
+    event->channel = status_ & 0x0f;
+    if(event->type == NoteOn && event->data[1] == 0)
+        event->type = NoteOff;
+    if(event->type == ControlChange && event->data[0] >= 120)
+    {
+        event->type    = ChannelMode;
+        event->cm_type = (ChannelModeType)(event->data[0] - 120);
+    }
+    return true;
+}
+
+UartHandler::Result UartHandler::DmaListenStart(uint8_t*                      buff,
+                                                size_t                        size,
+                                                CircularRxCallbackFunctionPtr cb,
+                                                void* callback_context)
+{
+    std::lock_guard<std::recursive_mutex> lock(sim::IrqMutex());
+    rx_callback_ = cb;
+    rx_context_  = callback_context;
+    listening_   = true;
+    return Result::OK;
+}
+
+UartHandler::Result UartHandler::DmaListenStop()
+{
+    std::lock_guard<std::recursive_mutex> lock(sim::IrqMutex());
+    listening_ = false;
+    return Result::OK;
+}
+
+void UartHandler::Receive(uint8_t* data, size_t size)
+{
+    if(listening_ && rx_callback_)
+        rx_callback_(data, size, rx_context_, Result::OK);
+}
+
+/** MIDI transports */
+void MidiUartTransport::Init(Config config)
+{
+    UartHandler::Config uart_config;
+    uart_config.periph        = config.periph;
+    uart_config.mode          = UartHandler::Config::Mode::TX_RX;
+    uart_config.baudrate      = 31250;
+    uart_config.pin_config.rx = config.rx;
+    uart_config.pin_config.tx = config.tx;
+    uart_.Init(uart_config);
+}
+
+void MidiUartTransport::StartRx(MidiRxParseCallback callback, void* context)
+{
+    callback_ = callback;
+    context_  = context;
+    uart_.DmaListenStart(rx_buffer_, sizeof(rx_buffer_), RxCallback, this);
+}
+
+void MidiUartTransport::Tx(uint8_t* buff, size_t size)
+{
+    uart_.BlockingTransmit(buff, size);
+}
+
+void MidiUartTransport::RxCallback(uint8_t*            data,
+                                   size_t              size,
+                                   void*               context,
+                                   UartHandler::Result result)
+{
+    MidiUartTransport* self = static_cast<MidiUartTransport*>(context);
+    if(result == UartHandler::Result::OK && self->callback_)
+        self->callback_(data, size, self->context_);
+}
+
+MidiUsbTransport::~MidiUsbTransport()
+{
+    Engine::Get().Detach(this);
+}
+
+void MidiUsbTransport::Init(Config config)
+{
+    Engine::Get().Attach(this);
+}
+
+void MidiUsbTransport::StartRx(MidiRxParseCallback callback, void* context)
+{
+    callback_  = callback;
+    context_   = context;
+    rx_active_ = true;
+}
+
+void MidiUsbTransport::Tx(uint8_t* buff, size_t size)
+{
+    Engine::Get().Bytes("midi_out_usb", buff, size);
+}
+
+void MidiUsbTransport::Receive(uint8_t* data, size_t size)
+{
+    if(rx_active_ && callback_)
+        callback_(data, size, context_);
+}
+
+} // namespace daisy
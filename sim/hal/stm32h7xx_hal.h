@@ -0,0 +1,339 @@
+#pragma once
+#ifndef DPT_SIM_STM32H7XX_HAL_H
+#define DPT_SIM_STM32H7XX_HAL_H
+
+/** The parts of the STM32H7 HAL and CMSIS register map that lib/ uses.
+ *  Registers are plain structs in host memory: code writes them as usual,
+ *  and the sim engine reads them back (timer enables, reloads, EXTI flags)
+ *  at the next event, instead of a peripheral reacting to the write.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define __IO volatile
+
+#define SET_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+#define WRITE_REG(REG, VAL) ((REG) = (VAL))
+#define READ_REG(REG) ((REG))
+#define MODIFY_REG(REG, CLEARMASK, SETMASK) \
+    WRITE_REG((REG), (((READ_REG(REG)) & (~(CLEARMASK))) | (SETMASK)))
+
+typedef enum
+{
+    HAL_OK      = 0x00,
+    HAL_ERROR   = 0x01,
+    HAL_BUSY    = 0x02,
+    HAL_TIMEOUT = 0x03,
+} HAL_StatusTypeDef;
+
+/** NVIC, only the lines lib/ touches */
+typedef enum
+{
+    TIM3_IRQn         = 29,
+    TIM4_IRQn         = 30,
+    EXTI15_10_IRQn    = 40,
+    TIM5_IRQn         = 50,
+    DMA2_Stream7_IRQn = 70,
+    IRQn_LAST         = 160,
+} IRQn_Type;
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub);
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+void HAL_NVIC_DisableIRQ(IRQn_Type irq);
+
+/** RCC, clocks are always on */
+#define __HAL_RCC_DMA2_CLK_ENABLE() \
+    do                              \
+    {                               \
+    } while(0)
+#define __HAL_RCC_TIM12_CLK_ENABLE() __HAL_RCC_DMA2_CLK_ENABLE()
+
+/** GPIO */
+typedef struct
+{
+    __IO uint32_t MODER;
+    __IO uint32_t OTYPER;
+    __IO uint32_t OSPEEDR;
+    __IO uint32_t PUPDR;
+    __IO uint32_t IDR;
+    __IO uint32_t ODR;
+    __IO uint32_t BSRR;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef sim_gpio_ports[11];
+#define GPIOA (&sim_gpio_ports[0])
+#define GPIOB (&sim_gpio_ports[1])
+#define GPIOC (&sim_gpio_ports[2])
+#define GPIOD (&sim_gpio_ports[3])
+#define GPIOE (&sim_gpio_ports[4])
+#define GPIOF (&sim_gpio_ports[5])
+#define GPIOG (&sim_gpio_ports[6])
+#define GPIOH (&sim_gpio_ports[7])
+#define GPIOI (&sim_gpio_ports[8])
+#define GPIOJ (&sim_gpio_ports[9])
+#define GPIOK (&sim_gpio_ports[10])
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT 0x00000000u
+#define GPIO_MODE_OUTPUT_PP 0x00000001u
+#define GPIO_MODE_IT_RISING 0x11110000u
+#define GPIO_MODE_IT_FALLING 0x11210000u
+#define GPIO_MODE_IT_RISING_FALLING 0x11310000u
+
+#define GPIO_NOPULL 0x0u
+#define GPIO_PULLUP 0x1u
+#define GPIO_PULLDOWN 0x2u
+
+#define GPIO_SPEED_FREQ_LOW 0x0u
+#define GPIO_SPEED_FREQ_HIGH 0x2u
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+/** Sets up EXTI edges and the mask for the IT modes, lines 0-15 */
+void HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init);
+
+/** EXTI, line n is pin n of the port selected in SYSCFG (any port here) */
+typedef struct
+{
+    __IO uint32_t RTSR1;
+    __IO uint32_t FTSR1;
+    __IO uint32_t SWIER1;
+    __IO uint32_t IMR1;
+    __IO uint32_t PR1;
+} EXTI_TypeDef;
+
+extern EXTI_TypeDef sim_exti;
+#define EXTI (&sim_exti)
+
+#define __HAL_GPIO_EXTI_GET_IT(__EXTI_LINE__) (EXTI->PR1 & (__EXTI_LINE__))
+/** Write 1 to clear on the chip, a plain store would wipe the other lines here */
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__) (EXTI->PR1 &= ~(uint32_t)(__EXTI_LINE__))
+
+/** TIM */
+typedef struct
+{
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t SMCR;
+    __IO uint32_t DIER;
+    __IO uint32_t SR;
+    __IO uint32_t EGR;
+    __IO uint32_t CNT;
+    __IO uint32_t PSC;
+    __IO uint32_t ARR;
+} TIM_TypeDef;
+
+extern TIM_TypeDef sim_tim2, sim_tim3, sim_tim4, sim_tim5, sim_tim12;
+#define TIM2 (&sim_tim2)
+#define TIM3 (&sim_tim3)
+#define TIM4 (&sim_tim4)
+#define TIM5 (&sim_tim5)
+#define TIM12 (&sim_tim12)
+
+#define TIM_CR1_CEN (1u << 0)
+#define TIM_CR1_URS (1u << 2)
+#define TIM_CR1_OPM (1u << 3)
+#define TIM_CR1_ARPE (1u << 7)
+#define TIM_CR2_MMS (7u << 4)
+#define TIM_DIER_UIE (1u << 0)
+#define TIM_SR_UIF (1u << 0)
+#define TIM_EGR_UG (1u << 0)
+
+#define TIM_COUNTERMODE_UP 0x0u
+#define TIM_COUNTERMODE_DOWN 0x10u
+#define TIM_CLOCKDIVISION_DIV1 0x0u
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0x0u
+#define TIM_AUTORELOAD_PRELOAD_ENABLE TIM_CR1_ARPE
+#define TIM_TRGO_RESET 0x0u
+#define TIM_TRGO_UPDATE (2u << 4)
+#define TIM_MASTERSLAVEMODE_DISABLE 0x0u
+#define TIM_MASTERSLAVEMODE_ENABLE 0x80u
+
+typedef struct
+{
+    uint32_t Prescaler;
+    uint32_t CounterMode;
+    uint32_t Period;
+    uint32_t ClockDivision;
+    uint32_t RepetitionCounter;
+    uint32_t AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef struct
+{
+    TIM_TypeDef*         Instance;
+    TIM_Base_InitTypeDef Init;
+} TIM_HandleTypeDef;
+
+typedef struct
+{
+    uint32_t MasterOutputTrigger;
+    uint32_t MasterOutputTrigger2;
+    uint32_t MasterSlaveMode;
+} TIM_MasterConfigTypeDef;
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef*       htim,
+                                                        TIM_MasterConfigTypeDef* config);
+
+/** SPI (H7 register layout) */
+typedef struct
+{
+    __IO uint32_t CR1;
+    __IO uint32_t CR2;
+    __IO uint32_t CFG1;
+    __IO uint32_t CFG2;
+    __IO uint32_t IER;
+    __IO uint32_t SR;
+    __IO uint32_t IFCR;
+    __IO uint32_t TXDR;
+    __IO uint32_t RXDR;
+} SPI_TypeDef;
+
+extern SPI_TypeDef sim_spi2;
+#define SPI2 (&sim_spi2)
+
+#define SPI_CR1_SPE (1u << 0)
+#define SPI_CR1_CSTART (1u << 9)
+#define SPI_CR1_CSUSP (1u << 10)
+#define SPI_CR2_TSIZE (0xFFFFu)
+#define SPI_CFG1_TXDMAEN (1u << 15)
+#define SPI_SR_EOT (1u << 3)
+#define SPI_SR_TXTF (1u << 4)
+#define SPI_IFCR_EOTC (1u << 3)
+#define SPI_IFCR_TXTFC (1u << 4)
+#define SPI_CFG2_MIDI_Pos (4u)
+#define SPI_CFG2_MIDI (0xFu << SPI_CFG2_MIDI_Pos)
+#define SPI_CFG2_SSOM (1u << 30)
+
+/** DMA */
+typedef struct
+{
+    __IO uint32_t CR;
+    __IO uint32_t NDTR;
+    __IO uint32_t PAR;
+    __IO uint32_t M0AR;
+    __IO uint32_t M1AR;
+    __IO uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+extern DMA_Stream_TypeDef sim_dma2_stream7;
+#define DMA2_Stream7 (&sim_dma2_stream7)
+
+#define DMA_REQUEST_GENERATOR0 1u
+#define DMA_REQUEST_GENERATOR1 2u
+#define DMA_REQUEST_SPI2_TX 40u
+#define DMA_PERIPH_TO_MEMORY 0x00u
+#define DMA_MEMORY_TO_PERIPH 0x40u
+#define DMA_PINC_ENABLE 0x200u
+#define DMA_PINC_DISABLE 0x0u
+#define DMA_MINC_ENABLE 0x400u
+#define DMA_MINC_DISABLE 0x0u
+#define DMA_PDATAALIGN_BYTE 0x0u
+#define DMA_PDATAALIGN_HALFWORD 0x800u
+#define DMA_PDATAALIGN_WORD 0x1000u
+#define DMA_MDATAALIGN_BYTE 0x0u
+#define DMA_MDATAALIGN_HALFWORD 0x2000u
+#define DMA_MDATAALIGN_WORD 0x4000u
+#define DMA_NORMAL 0x0u
+#define DMA_CIRCULAR 0x100u
+#define DMA_PRIORITY_LOW 0x0u
+#define DMA_PRIORITY_HIGH 0x20000u
+#define DMA_FIFOMODE_DISABLE 0x0u
+
+typedef struct
+{
+    uint32_t Request;
+    uint32_t Direction;
+    uint32_t PeriphInc;
+    uint32_t MemInc;
+    uint32_t PeriphDataAlignment;
+    uint32_t MemDataAlignment;
+    uint32_t Mode;
+    uint32_t Priority;
+    uint32_t FIFOMode;
+    uint32_t FIFOThreshold;
+    uint32_t MemBurst;
+    uint32_t PeriphBurst;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef
+{
+    DMA_Stream_TypeDef* Instance;
+    DMA_InitTypeDef     Init;
+    void*               Parent;
+    void (*XferCpltCallback)(struct __DMA_HandleTypeDef* hdma);
+    void (*XferHalfCpltCallback)(struct __DMA_HandleTypeDef* hdma);
+    void (*XferErrorCallback)(struct __DMA_HandleTypeDef* hdma);
+
+    /** Sim only: the transfer set up by HAL_DMA_Start_IT */
+    uintptr_t SrcAddress;
+    uintptr_t DstAddress;
+    uint32_t  Length;
+    uint32_t  Position;
+    uint32_t  Pending; /**< DMA_FLAG_HT / DMA_FLAG_TC, for HAL_DMA_IRQHandler */
+    uint32_t  GeneratorSignal;
+    uint32_t  GeneratorRequests;
+    bool      GeneratorEnabled;
+    bool      Running;
+} DMA_HandleTypeDef;
+
+#define DMA_FLAG_HT (1u << 0)
+#define DMA_FLAG_TC (1u << 1)
+
+/** DMAMUX request generator */
+#define HAL_DMAMUX1_REQ_GEN_TIM12_TRGO 7u
+#define HAL_DMAMUX_REQ_GEN_RISING 0x1u
+
+typedef struct
+{
+    uint32_t SignalID;
+    uint32_t Polarity;
+    uint32_t RequestNumber;
+} HAL_DMA_MuxRequestGeneratorConfigTypeDef;
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma);
+/** Addresses are pointer sized here, so the host can run it on 64 bit */
+HAL_StatusTypeDef
+HAL_DMA_Start_IT(DMA_HandleTypeDef* hdma, uintptr_t src, uintptr_t dst, uint32_t length);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma);
+void              HAL_DMA_IRQHandler(DMA_HandleTypeDef* hdma);
+HAL_StatusTypeDef
+HAL_DMAEx_ConfigMuxRequestGenerator(DMA_HandleTypeDef*                        hdma,
+                                    HAL_DMA_MuxRequestGeneratorConfigTypeDef* config);
+HAL_StatusTypeDef HAL_DMAEx_EnableMuxRequestGenerator(DMA_HandleTypeDef* hdma);
+HAL_StatusTypeDef HAL_DMAEx_DisableMuxRequestGenerator(DMA_HandleTypeDef* hdma);
+
+/** Interrupt vectors the sim raises, defined by lib/ (or weak defaults) */
+extern "C" void EXTI15_10_IRQHandler(void);
+extern "C" void DMA2_Stream7_IRQHandler(void);
+
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+#ifndef DPT_SIM_SYS_SYSTEM_H
+#define DPT_SIM_SYS_SYSTEM_H
+
+#include <stdint.h>
+
+namespace daisy
+{
+/** Clocks and time, on the sim's virtual clock.
+ *  Boosted H750 clock tree: 480MHz core, 120MHz PCLK1, and a 240MHz tick
+ *  (TIM2 on the chip). Delay() from the app's main loop sleeps in virtual 
+ *  time, see sim/README.md.
+ */
+class System
+{
+  public:
+    struct Config
+    {
+        enum class SysClkFreq
+        {
+            FREQ_400MHZ,
+            FREQ_480MHZ,
+        };
+
+        void Defaults()
+        {
+            cpu_freq    = SysClkFreq::FREQ_400MHZ;
+            use_dcache  = true;
+            use_icache  = true;
+            skip_clocks = false;
+        }
+
+        void Boost()
+        {
+            cpu_freq    = SysClkFreq::FREQ_480MHZ;
+            use_dcache  = true;
+            use_icache  = true;
+            skip_clocks = false;
+        }
+
+        SysClkFreq cpu_freq    = SysClkFreq::FREQ_400MHZ;
+        bool       use_dcache  = true;
+        bool       use_icache  = true;
+        bool       skip_clocks = false;
+    };
+
+    enum class MemoryRegion
+    {
+        INTERNAL_FLASH = 0,
+        ITCMRAM,
+        DTCMRAM,
+        SRAM_D1,
+        SRAM_D2,
+        SRAM_D3,
+        SDRAM,
+        QSPI,
+        INVALID_ADDRESS,
+    };
+
+    System() {}
+    ~System() {}
+
+    void Init() {}
+    void Init(const Config& config) { cfg_ = config; }
+
+    /** Milliseconds */
+    static uint32_t GetNow();
+    static uint32_t GetUs();
+    static uint32_t GetTick();
+    static void     Delay(uint32_t delay_ms);
+    static void     DelayUs(uint32_t delay_us);
+    static void     DelayTicks(uint32_t delay_ticks);
+    static void     ResetToBootloader() {}
+
+    static uint32_t GetTickFreq() { return 240000000; }
+    static uint32_t GetSysClkFreq() { return 480000000; }
+    static uint32_t GetHClkFreq() { return 240000000; }
+    static uint32_t GetPClk1Freq() { return 120000000; }
+    static uint32_t GetPClk2Freq() { return 120000000; }
+
+    /** Runs from flash, so the board sets up SDRAM and QSPI itself */
+    static MemoryRegion GetProgramMemoryRegion()
+    {
+        return MemoryRegion::INTERNAL_FLASH;
+    }
+
+    const Config& GetConfig() const { return cfg_; }
+
+  private:
+    Config cfg_;
+};
+
+} // namespace daisy
+
+#endif
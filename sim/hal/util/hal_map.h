@@ -0,0 +1,11 @@
+#pragma once
+#ifndef DPT_SIM_UTIL_HAL_MAP_H
+#define DPT_SIM_UTIL_HAL_MAP_H
+
+#include "daisy_core.h"
+
+/** dsy_gpio_pin to the sim's GPIO ports, nullptr for DSY_GPIOX */
+GPIO_TypeDef* dsy_hal_map_get_port(const dsy_gpio_pin* p);
+uint16_t      dsy_hal_map_get_pin(const dsy_gpio_pin* p);
+
+#endif
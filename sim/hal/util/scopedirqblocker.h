@@ -0,0 +1,31 @@
+#pragma once
+#ifndef DPT_SIM_UTIL_SCOPEDIRQBLOCKER_H
+#define DPT_SIM_UTIL_SCOPEDIRQBLOCKER_H
+
+#include <mutex>
+
+namespace sim
+{
+/** Held by the engine while it runs an interrupt handler */
+std::recursive_mutex& IrqMutex();
+} // namespace sim
+
+namespace daisy
+{
+/** Blocks the sim's "interrupts" for its lifetime.
+ *  The engine takes the same lock around every handler it runs, so this 
+ *  keeps the main loop and the handlers apart like PRIMASK does.
+ */
+class ScopedIrqBlocker
+{
+  public:
+    ScopedIrqBlocker() { sim::IrqMutex().lock(); }
+    ~ScopedIrqBlocker() { sim::IrqMutex().unlock(); }
+
+  private:
+    ScopedIrqBlocker(const ScopedIrqBlocker&)            = delete;
+    ScopedIrqBlocker& operator=(const ScopedIrqBlocker&) = delete;
+};
+} // namespace daisy
+
+#endif
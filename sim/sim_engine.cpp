@@ -0,0 +1,907 @@
+#include "sim_engine.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "../lib/util/cv_code.h"
+#include "../lib/util/trace.h"
+
+using namespace daisy;
+
+namespace sim
+{
+/** TIM2-7 and TIM12 count at twice PCLK1 */
+static constexpr double kTimerClock = 240e6;
+
+/** One byte on the MIDI wire, 10 bits at 31250 baud */
+static constexpr double kMidiByteNs = 320e3;
+
+/** Largest block the engine passes to the audio callback */
+static constexpr size_t kMaxBlock = AudioHandle::kMaxBlockSize;
+
+Engine& Engine::Get()
+{
+    static Engine engine;
+    return engine;
+}
+
+Engine::Engine()
+: now_(0),
+  app_state_(APP_RUNNING),
+  app_wake_(0),
+  app_release_(0),
+  free_running_(false),
+  audio_(nullptr),
+  audio_next_(0.0),
+  audio_blocks_(0),
+  audio_host_ns_(0.0),
+  audio_host_peak_(0.0),
+  audio_over_(0),
+  dac_(nullptr),
+  dac_next_(0.0),
+  dac_half_(0),
+  dac_playing_start_(0.0),
+  adc_(nullptr),
+  midi_in_next_(0),
+  gate_in_next_(0),
+  spi_byte_count_(0),
+  spi_high_byte_(0),
+  exp_words_(0),
+  csv_next_(0.0)
+{
+    for(int i = 0; i < IRQn_LAST; i++)
+        irq_enabled_[i] = false;
+    timers_[0] = {TIM3, TIM3_IRQn, nullptr, false, 0.0};
+    timers_[1] = {TIM4, TIM4_IRQn, nullptr, false, 0.0};
+    timers_[2] = {TIM5, TIM5_IRQn, nullptr, false, 0.0};
+    /** Only drives the DAC7554 stream DMA, no interrupt */
+    timers_[3] = {TIM12, IRQn_LAST, nullptr, false, 0.0};
+    for(size_t i = 0; i < AdcHandle::kMaxChannels; i++)
+        control_column_[i] = -1;
+    for(int i = 0; i < 4; i++)
+        exp_code_[i] = 0;
+    midi_out_bytes_[0] = midi_out_bytes_[1] = 0;
+
+    /** Gates low, the inverting input stage holds the pins high */
+    GPIOG->IDR |= GPIO_PIN_13 | GPIO_PIN_14;
+}
+
+void Engine::Sleep(uint64_t ns)
+{
+    if(std::this_thread::get_id() == engine_thread_)
+        return;
+    std::unique_lock<std::mutex> lock(app_mutex_);
+    uint64_t                     release = app_release_;
+    app_wake_                            = Now() + ns;
+    app_state_                           = APP_SLEEPING;
+    app_cv_.notify_all();
+    app_cv_.wait(lock, [&] { return app_release_ != release; });
+}
+
+bool Engine::WaitForApp()
+{
+    std::unique_lock<std::mutex> lock(app_mutex_);
+    return app_cv_.wait_for(lock,
+                            std::chrono::duration<double>(opts_.sync_timeout),
+                            [&] { return app_state_ != APP_RUNNING; });
+}
+
+void Engine::Later(uint64_t delay_ns, std::function<void()> fn)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    later_.emplace(Now() + delay_ns, std::move(fn));
+}
+
+void Engine::Event(const std::string& source, const std::string& value)
+{
+    std::lock_guard<std::mutex> lock(events_mutex_);
+    events_.push_back({Now(), source, value});
+}
+
+void Engine::Bytes(const std::string& source, const uint8_t* data, size_t size)
+{
+    std::string hex;
+    char        byte[4];
+    for(size_t i = 0; i < size; i++)
+    {
+        snprintf(byte, sizeof(byte), i ? " %02x" : "%02x", data[i]);
+        hex += byte;
+    }
+    if(source == "midi_out_trs")
+        midi_out_bytes_[0] += size;
+    else if(source == "midi_out_usb")
+        midi_out_bytes_[1] += size;
+    Event(source, hex);
+}
+
+void Engine::SetIrqEnabled(IRQn_Type irq, bool enabled)
+{
+    if(irq >= 0 && irq < IRQn_LAST)
+        irq_enabled_[irq] = enabled;
+}
+
+bool Engine::IrqEnabled(IRQn_Type irq) const
+{
+    return irq >= 0 && irq < IRQn_LAST && irq_enabled_[irq];
+}
+
+void Engine::Attach(AudioHandle* audio)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    audio_      = audio;
+    audio_next_ = Now() + audio->config_.blocksize / audio->GetSampleRate() * 1e9;
+}
+
+void Engine::Attach(DacHandle* dac)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    size_t half = dac->size_ / 2;
+    dac_        = dac;
+    dac_half_   = 0;
+    dac_next_   = Now() + half * 1e9 / dac->config_.target_samplerate;
+    /** The DMA starts on the first half, as the app left it */
+    for(int c = 0; c < 2; c++)
+    {
+        dac_playing_[c].assign(half, 0);
+        if(dac->buffers_[c])
+            dac_playing_[c].assign(dac->buffers_[c], dac->buffers_[c] + half);
+    }
+    dac_playing_start_ = Now();
+}
+
+void Engine::Attach(AdcHandle* adc)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    adc_ = adc;
+    WriteAdc(Now());
+}
+
+void Engine::Attach(TimerHandle* tim)
+{
+    for(Timer& t : timers_)
+        if(t.regs == tim->tim_)
+            t.handle = tim;
+}
+
+void Engine::Attach(DMA_HandleTypeDef* dma)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    if(std::find(dmas_.begin(), dmas_.end(), dma) == dmas_.end())
+        dmas_.push_back(dma);
+}
+
+void Engine::Attach(UartHandler* uart)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    if(std::find(midi_trs_.begin(), midi_trs_.end(), uart) == midi_trs_.end())
+        midi_trs_.push_back(uart);
+}
+
+void Engine::Attach(MidiUsbTransport* midi)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    if(std::find(midi_usb_.begin(), midi_usb_.end(), midi) == midi_usb_.end())
+        midi_usb_.push_back(midi);
+}
+
+void Engine::Detach(const void* midi)
+{
+    std::lock_guard<std::recursive_mutex> lock(IrqMutex());
+    midi_trs_.erase(std::remove(midi_trs_.begin(), midi_trs_.end(), midi),
+                    midi_trs_.end());
+    midi_usb_.erase(std::remove(midi_usb_.begin(), midi_usb_.end(), midi),
+                    midi_usb_.end());
+}
+
+void Engine::GpioChanged(int port, int pin, bool state)
+{
+    std::string name;
+    if(port == DSY_GPIOC && pin == 14)
+        name = "gate_out_1";
+    else if(port == DSY_GPIOC && pin == 13)
+        name = "gate_out_2";
+    else if(port == DSY_GPIOC && pin == 7)
+        name = "led";
+    else
+        name = std::string("gpio_P") + (char)('A' + port) + std::to_string(pin);
+    Event(name, state ? "1" : "0");
+}
+
+void Engine::Spi2Transmit(const uint8_t* buff, size_t size, unsigned long datasize)
+{
+    if(datasize > 8)
+    {
+        const uint16_t* words = (const uint16_t*)buff;
+        for(size_t i = 0; i < size; i++)
+            Dac7554Word(words[i]);
+        return;
+    }
+    /** 8 bit frames carry the commands as big-endian byte pairs */
+    for(size_t i = 0; i < size; i++)
+    {
+        if(spi_byte_count_ == 0)
+        {
+            spi_high_byte_  = buff[i];
+            spi_byte_count_ = 1;
+        }
+        else
+        {
+            Dac7554Word((uint16_t)(spi_high_byte_ << 8 | buff[i]));
+            spi_byte_count_ = 0;
+        }
+    }
+}
+
+void Engine::Spi2Dma(DMA_HandleTypeDef* dma)
+{
+    SPI2->SR &= ~SPI_SR_EOT;
+    /** 16 bit frames at PS_2 (40ns a bit), 2 MIDI idle cycles between them */
+    uint32_t length = dma->Length;
+    Later(length * 18 * 40 + 1000, [this, dma, length] {
+        /** EOT first: the completion may wait on it to start the next frame */
+        SPI2->SR |= SPI_SR_EOT;
+        for(uint32_t i = 0;
+            i < length && dma->Running && dma->Init.Request == DMA_REQUEST_SPI2_TX;
+            i++)
+            DmaTransfer(dma);
+    });
+}
+
+void Engine::Dac7554Word(uint16_t word)
+{
+    /** SYNC rises after each 16 bit word, which latches it */
+    exp_code_[(word >> 12) & 0x3] = word & 0xfff;
+    exp_words_++;
+}
+
+double Engine::TimerPeriod(const Timer& t) const
+{
+    return (t.regs->PSC + 1.0) * (t.regs->ARR + 1.0) * 1e9 / kTimerClock;
+}
+
+void Engine::SyncTimers()
+{
+    for(Timer& t : timers_)
+    {
+        TIM_TypeDef* regs    = t.regs;
+        bool         restart = regs->EGR & TIM_EGR_UG;
+        regs->EGR &= ~TIM_EGR_UG;
+        if(!(regs->CR1 & TIM_CR1_CEN))
+        {
+            t.running = false;
+            continue;
+        }
+        if(!t.running || restart)
+            t.start = Now();
+        t.running = true;
+    }
+}
+
+void Engine::TimerUpdate(Timer& t)
+{
+    TIM_TypeDef* regs = t.regs;
+    t.start += TimerPeriod(t);
+    if(regs->CR1 & TIM_CR1_OPM)
+    {
+        regs->CR1 &= ~TIM_CR1_CEN;
+        t.running = false;
+    }
+    if(regs == TIM12 && (regs->CR2 & TIM_CR2_MMS) == TIM_TRGO_UPDATE)
+        DmaRequest(HAL_DMAMUX1_REQ_GEN_TIM12_TRGO);
+    if((regs->DIER & TIM_DIER_UIE) && IrqEnabled(t.irq) && t.handle
+       && t.handle->callback_)
+        t.handle->callback_(t.handle->data_);
+}
+
+void Engine::DmaRequest(uint32_t signal)
+{
+    for(DMA_HandleTypeDef* dma : dmas_)
+    {
+        if(!dma->Running || !dma->GeneratorEnabled || dma->GeneratorSignal != signal)
+            continue;
+        for(uint32_t i = 0; i < dma->GeneratorRequests && dma->Running; i++)
+            DmaTransfer(dma);
+    }
+}
+
+void Engine::DmaTransfer(DMA_HandleTypeDef* dma)
+{
+    size_t item = dma->Init.MemDataAlignment == DMA_MDATAALIGN_WORD       ? 4
+                  : dma->Init.MemDataAlignment == DMA_MDATAALIGN_HALFWORD ? 2
+                                                                          : 1;
+    uintptr_t src = dma->SrcAddress;
+    if(dma->Init.MemInc == DMA_MINC_ENABLE)
+        src += dma->Position * item;
+    uint32_t value = 0;
+    memcpy(&value, (const void*)src, item);
+    if(dma->DstAddress == (uintptr_t)&SPI2->TXDR)
+    {
+        if(SPI2->CR1 & SPI_CR1_SPE)
+            Spi2Transmit((const uint8_t*)&value, 1, item * 8);
+    }
+    else
+        memcpy((void*)dma->DstAddress, &value, item);
+
+    uint32_t flags = 0;
+    dma->Position++;
+    if(dma->Position == dma->Length / 2)
+        flags |= DMA_FLAG_HT;
+    if(dma->Position == dma->Length)
+    {
+        flags |= DMA_FLAG_TC;
+        dma->Position = 0;
+        if(dma->Init.Mode != DMA_CIRCULAR)
+            dma->Running = false;
+    }
+    if(!flags)
+        return;
+    dma->Pending |= flags;
+    if(dma->Instance == DMA2_Stream7 && IrqEnabled(DMA2_Stream7_IRQn))
+        DMA2_Stream7_IRQHandler();
+}
+
+void Engine::AudioBlock()
+{
+    const AudioHandle::Config& cfg  = audio_->config_;
+    const float                sr   = audio_->GetSampleRate();
+    size_t                     size = cfg.blocksize;
+    audio_next_ += size / sr * 1e9;
+    if(size > kMaxBlock)
+        size = kMaxBlock;
+
+    WriteAdc(Now());
+
+    /** Output lines up with the callback's time, input is the block before */
+    size_t frame = (size_t)llround(Now() * 1e-9 * sr);
+    static float in[2][kMaxBlock], out[2][kMaxBlock];
+    static float in_ilv[2 * kMaxBlock], out_ilv[2 * kMaxBlock];
+    for(size_t i = 0; i < size; i++)
+    {
+        size_t src = frame + i;
+        for(int c = 0; c < 2; c++)
+        {
+            float s = 0.f;
+            if(src >= size && src - size < input_.Frames())
+                s = input_.samples[(src - size) * input_.channels
+                                   + (c < input_.channels ? c : 0)];
+            in[c][i]              = s;
+            in_ilv[2 * i + c]     = s;
+            out[c][i]             = 0.f;
+            out_ilv[2 * i + c]    = 0.f;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if(audio_->callback_)
+    {
+        const float* ins[2]  = {in[0], in[1]};
+        float*       outs[2] = {out[0], out[1]};
+        audio_->callback_(ins, outs, size);
+    }
+    else if(audio_->interleaving_callback_)
+    {
+        audio_->interleaving_callback_(in_ilv, out_ilv, size * 2);
+        for(size_t i = 0; i < size; i++)
+        {
+            out[0][i] = out_ilv[2 * i];
+            out[1][i] = out_ilv[2 * i + 1];
+        }
+    }
+    double host = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    audio_blocks_++;
+    audio_host_ns_ += host;
+    audio_host_peak_ = host > audio_host_peak_ ? host : audio_host_peak_;
+    if(host > size / sr * 1e9)
+        audio_over_++;
+
+    float gain = cfg.postgain * cfg.output_compensation;
+    audio_out_.resize(2 * frame, 0.f);
+    for(size_t i = 0; i < size; i++)
+    {
+        audio_out_.push_back(out[0][i] * gain);
+        audio_out_.push_back(out[1][i] * gain);
+    }
+}
+
+void Engine::DacHalf()
+{
+    size_t half = dac_->size_ / 2;
+    int    h    = dac_half_;
+    dac_next_ += half * 1e9 / dac_->config_.target_samplerate;
+    dac_half_ ^= 1;
+
+    /** The DMA moves on to the half the last callback filled */
+    for(int c = 0; c < 2; c++)
+        if(dac_->buffers_[c])
+            dac_playing_[c].assign(dac_->buffers_[c] + (1 - h) * half,
+                                   dac_->buffers_[c] + (2 - h) * half);
+    dac_playing_start_ = Now();
+
+    uint16_t* out[2] = {dac_->buffers_[0] + h * half,
+                        dac_->buffers_[1] ? dac_->buffers_[1] + h * half : nullptr};
+    if(dac_->callback_)
+        dac_->callback_(out, half);
+}
+
+void Engine::GateInEdge(const GateEdge& edge)
+{
+    const uint32_t line = edge.gate == 0 ? GPIO_PIN_13 : GPIO_PIN_14;
+    /** The input stage inverts */
+    const bool pin = !edge.state;
+    if(pin == (bool)(GPIOG->IDR & line))
+        return;
+    if(pin)
+        GPIOG->IDR |= line;
+    else
+        GPIOG->IDR &= ~line;
+    Event(edge.gate == 0 ? "gate_in_1" : "gate_in_2", edge.state ? "1" : "0");
+
+    bool armed = pin ? EXTI->RTSR1 & line : EXTI->FTSR1 & line;
+    if(!armed || !(EXTI->IMR1 & line))
+        return;
+    EXTI->PR1 |= line;
+    if(IrqEnabled(EXTI15_10_IRQn))
+        EXTI15_10_IRQHandler();
+}
+
+void Engine::DeliverMidi(const MidiIn& in)
+{
+    std::vector<uint8_t> bytes = in.bytes;
+    Bytes(in.usb ? "midi_in_usb" : "midi_in_trs", bytes.data(), bytes.size());
+    if(in.usb)
+    {
+        std::vector<MidiUsbTransport*> receivers = midi_usb_;
+        for(MidiUsbTransport* midi : receivers)
+            midi->Receive(bytes.data(), bytes.size());
+    }
+    else
+    {
+        std::vector<UartHandler*> receivers = midi_trs_;
+        for(UartHandler* uart : receivers)
+            uart->Receive(bytes.data(), bytes.size());
+    }
+}
+
+float Engine::ControlAt(int column, double t) const
+{
+    const double seconds = t * 1e-9;
+    auto         next    = std::upper_bound(
+        control_rows_.begin(),
+        control_rows_.end(),
+        seconds,
+        [](double s, const std::vector<double>& row) { return s < row[0]; });
+    if(next == control_rows_.begin())
+        return (*next)[column];
+    if(next == control_rows_.end())
+        return control_rows_.back()[column];
+    const std::vector<double>& a = *(next - 1);
+    const std::vector<double>& b = *next;
+    double                     x = (seconds - a[0]) / (b[0] - a[0]);
+    return a[column] + (b[column] - a[column]) * x;
+}
+
+void Engine::WriteAdc(double t)
+{
+    if(!adc_)
+        return;
+    for(size_t i = 0; i < adc_->channels_; i++)
+    {
+        /** CV 1-8 are bipolar through an inverting stage, 9-12 are 0-1 */
+        bool  bipolar = i < 8;
+        float v       = 0.f;
+        if(control_column_[i] >= 0 && !control_rows_.empty())
+            v = ControlAt(control_column_[i], t);
+        float raw = bipolar ? (0.5f - v * 0.5f) * 65536.f : v * 65536.f;
+        raw       = raw < 0.f ? 0.f : raw > 65535.f ? 65535.f : raw;
+        adc_->values_[i] = (uint16_t)raw;
+    }
+}
+
+void Engine::SampleOutputs()
+{
+    const double t = Now();
+    float        cv[2];
+    for(int c = 0; c < 2; c++)
+    {
+        uint16_t code = 0;
+        if(dac_ && dac_->running_ && dac_->config_.mode == DacHandle::Mode::DMA)
+        {
+            size_t i = (size_t)((t - dac_playing_start_) * 1e-9
+                                * dac_->config_.target_samplerate);
+            if(!dac_playing_[c].empty())
+                code = dac_playing_[c][std::min(i, dac_playing_[c].size() - 1)];
+        }
+        else if(dac_)
+            code = dac_->values_[c];
+        cv[c] = (code - dpt::kCvCodeOffset) / dpt::kCvCodesPerVolt;
+    }
+    float exp[4];
+    for(int i = 0; i < 4; i++)
+        exp[i] = (exp_code_[i] - dpt::kCvExpCodeOffset) / dpt::kCvExpCodesPerVolt;
+
+    char row[256];
+    snprintf(row,
+             sizeof(row),
+             "%.6f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d",
+             t * 1e-9,
+             cv[0],
+             cv[1],
+             exp[0],
+             exp[1],
+             exp[2],
+             exp[3],
+             (int)((GPIOC->ODR >> 14) & 1),
+             (int)((GPIOC->ODR >> 13) & 1));
+    csv_rows_.push_back(row);
+}
+
+static std::vector<std::string> Split(const std::string& line, char sep)
+{
+    std::vector<std::string> out;
+    std::stringstream        ss(line);
+    std::string              item;
+    while(std::getline(ss, item, sep))
+    {
+        item.erase(0, item.find_first_not_of(" \t\r"));
+        item.erase(item.find_last_not_of(" \t\r") + 1);
+        out.push_back(item);
+    }
+    return out;
+}
+
+bool Engine::LoadControls(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        fprintf(stderr, "dpt_sim: can't open %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    control_names_ = Split(line, ',');
+    if(control_names_.empty() || control_names_[0] != "time")
+    {
+        fprintf(stderr, "dpt_sim: %s must start with a time column\n", path.c_str());
+        return false;
+    }
+
+    int gate_column[2] = {-1, -1};
+    for(size_t i = 1; i < control_names_.size(); i++)
+    {
+        const std::string& name = control_names_[i];
+        int                n    = 0;
+        if(sscanf(name.c_str(), "cv_%d", &n) == 1 && n >= 1 && n <= 8)
+            control_column_[n - 1] = i;
+        else if(sscanf(name.c_str(), "adc_%d", &n) == 1 && n >= 9 && n <= 12)
+            control_column_[n - 1] = i;
+        else if(sscanf(name.c_str(), "gate_in_%d", &n) == 1 && n >= 1 && n <= 2)
+            gate_column[n - 1] = i;
+        else
+            fprintf(stderr, "dpt_sim: ignoring column %s\n", name.c_str());
+    }
+
+    while(std::getline(file, line))
+    {
+        std::vector<std::string> cells = Split(line, ',');
+        if(cells.empty() || cells[0].empty() || cells[0][0] == '#')
+            continue;
+        std::vector<double> row(control_names_.size(), 0.0);
+        for(size_t i = 0; i < row.size() && i < cells.size(); i++)
+            row[i] = strtod(cells[i].c_str(), nullptr);
+        if(!control_rows_.empty() && row[0] < control_rows_.back()[0])
+        {
+            fprintf(stderr, "dpt_sim: %s: times must not go back\n", path.c_str());
+            return false;
+        }
+        control_rows_.push_back(row);
+    }
+
+    /** Gates step at the rows where they change */
+    for(int g = 0; g < 2; g++)
+    {
+        if(gate_column[g] < 0)
+            continue;
+        bool state = false;
+        for(const std::vector<double>& row : control_rows_)
+        {
+            bool high = row[gate_column[g]] >= 0.5;
+            if(high != state)
+                gate_in_.push_back({row[0] * 1e9, g, high});
+            state = high;
+        }
+    }
+    std::stable_sort(gate_in_.begin(),
+                     gate_in_.end(),
+                     [](const GateEdge& a, const GateEdge& b) { return a.time < b.time; });
+    return true;
+}
+
+bool Engine::LoadMidi(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        fprintf(stderr, "dpt_sim: can't open %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    int         number = 0;
+    while(std::getline(file, line))
+    {
+        number++;
+        std::vector<std::string> words;
+        std::stringstream        ss(line.substr(0, line.find('#')));
+        std::string              word;
+        while(ss >> word)
+            words.push_back(word);
+        if(words.empty())
+            continue;
+
+        MidiIn in;
+        char*  end;
+        in.time = strtod(words[0].c_str(), &end) * 1e9;
+        in.usb  = false;
+        size_t i = 1;
+        if(i < words.size() && (words[i] == "trs" || words[i] == "usb"))
+            in.usb = words[i++] == "usb";
+        for(; i < words.size(); i++)
+        {
+            unsigned long byte = strtoul(words[i].c_str(), &end, 16);
+            if(*end || byte > 0xff)
+                break;
+            in.bytes.push_back(byte);
+        }
+        if(i < words.size() || in.bytes.empty())
+        {
+            fprintf(stderr, "dpt_sim: %s:%d: expected time [trs|usb] hex bytes\n",
+                    path.c_str(), number);
+            return false;
+        }
+        /** The UART's idle line interrupt hands the burst over once it's all in */
+        if(!in.usb)
+            in.time += in.bytes.size() * kMidiByteNs;
+        midi_in_.push_back(in);
+    }
+    std::stable_sort(midi_in_.begin(),
+                     midi_in_.end(),
+                     [](const MidiIn& a, const MidiIn& b) { return a.time < b.time; });
+    return true;
+}
+
+static void WriteTrace(const void* data, size_t size, void* context)
+{
+    fwrite(data, 1, size, static_cast<FILE*>(context));
+}
+
+bool Engine::WriteOutputs()
+{
+    bool         ok   = true;
+    const float  sr   = audio_ ? audio_->GetSampleRate() : 48000.f;
+    const size_t end  = (size_t)llround(opts_.seconds * sr);
+    audio_out_.resize(2 * end, 0.f);
+    const std::string wav = opts_.output_prefix + ".wav";
+    if(!WriteWav(wav, audio_out_, 2, (uint32_t)sr))
+    {
+        fprintf(stderr, "dpt_sim: can't write %s\n", wav.c_str());
+        ok = false;
+    }
+
+    const std::string cv = opts_.output_prefix + "_cv.csv";
+    if(FILE* f = fopen(cv.c_str(), "w"))
+    {
+        fprintf(f, "time,cv_out_1,cv_out_2,exp_1,exp_2,exp_3,exp_4,gate_out_1,gate_out_2\n");
+        for(const std::string& row : csv_rows_)
+            fprintf(f, "%s\n", row.c_str());
+        fclose(f);
+    }
+    else
+    {
+        fprintf(stderr, "dpt_sim: can't write %s\n", cv.c_str());
+        ok = false;
+    }
+
+    const std::string events = opts_.output_prefix + "_events.csv";
+    if(FILE* f = fopen(events.c_str(), "w"))
+    {
+        std::lock_guard<std::mutex> lock(events_mutex_);
+        std::stable_sort(events_.begin(),
+                         events_.end(),
+                         [](const LoggedEvent& a, const LoggedEvent& b) {
+                             return a.time < b.time;
+                         });
+        fprintf(f, "time,source,value\n");
+        for(const LoggedEvent& e : events_)
+            fprintf(f, "%.9f,%s,%s\n", e.time * 1e-9, e.source.c_str(), e.value.c_str());
+        fclose(f);
+    }
+    else
+    {
+        fprintf(stderr, "dpt_sim: can't write %s\n", events.c_str());
+        ok = false;
+    }
+
+    if(!opts_.trace_file.empty())
+    {
+        if(FILE* f = fopen(opts_.trace_file.c_str(), "wb"))
+        {
+            dpt::dsy_dpt_trace.Dump(WriteTrace, f);
+            fclose(f);
+        }
+        else
+        {
+            fprintf(stderr, "dpt_sim: can't write %s\n", opts_.trace_file.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void Engine::PrintSummary(double wall_seconds)
+{
+    fprintf(stderr,
+            "dpt_sim: %.3f s simulated in %.3f s (%.1fx realtime)\n",
+            opts_.seconds,
+            wall_seconds,
+            wall_seconds > 0.0 ? opts_.seconds / wall_seconds : 0.0);
+    if(audio_ && audio_blocks_)
+    {
+        double period = audio_->config_.blocksize / audio_->GetSampleRate() * 1e9;
+        fprintf(stderr,
+                "dpt_sim: audio %llu blocks of %u, host time avg %.1f%% peak %.1f%% "
+                "of the block, %llu over\n",
+                (unsigned long long)audio_blocks_,
+                (unsigned)audio_->config_.blocksize,
+                100.0 * audio_host_ns_ / audio_blocks_ / period,
+                100.0 * audio_host_peak_ / period,
+                (unsigned long long)audio_over_);
+    }
+    fprintf(stderr,
+            "dpt_sim: %u DAC7554 words, midi out %u bytes trs, %u bytes usb\n",
+            (unsigned)exp_words_,
+            (unsigned)midi_out_bytes_[0],
+            (unsigned)midi_out_bytes_[1]);
+}
+
+int Engine::Run(const Options& opts, int (*app_main)())
+{
+    opts_ = opts;
+    if(!opts_.input_wav.empty())
+    {
+        std::string error;
+        if(!ReadWav(opts_.input_wav, &input_, &error))
+        {
+            fprintf(stderr, "dpt_sim: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    if(!opts_.controls_csv.empty() && !LoadControls(opts_.controls_csv))
+        return 1;
+    if(!opts_.midi_file.empty() && !LoadMidi(opts_.midi_file))
+        return 1;
+
+    auto wall_start = std::chrono::steady_clock::now();
+    engine_thread_  = std::this_thread::get_id();
+    std::thread app([this, app_main] {
+        app_main();
+        std::lock_guard<std::mutex> lock(app_mutex_);
+        app_state_ = APP_EXITED;
+        app_cv_.notify_all();
+    });
+    app.detach();
+
+    /** Init() and the rest of the setup run at time 0 */
+    if(!WaitForApp())
+    {
+        free_running_ = true;
+        fprintf(stderr,
+                "dpt_sim: the main loop doesn't call System::Delay(), "
+                "leaving it to run freely\n");
+    }
+    if(audio_ && input_.rate != (uint32_t)audio_->GetSampleRate())
+        fprintf(stderr,
+                "dpt_sim: %s is %u Hz, the app runs at %.0f Hz, not resampled\n",
+                opts_.input_wav.c_str(),
+                (unsigned)input_.rate,
+                audio_->GetSampleRate());
+    if(!opts_.trace_file.empty())
+        dpt::dsy_dpt_trace.Start();
+
+    const double end = opts_.seconds * 1e9;
+    while(true)
+    {
+        std::unique_lock<std::recursive_mutex> irq(IrqMutex());
+        SyncTimers();
+
+        /** Earliest event, ties go to the first source checked */
+        double t      = end;
+        int    source = -1;
+        auto   next   = [&](double when, int s) {
+            if(when < t)
+            {
+                t      = when;
+                source = s;
+            }
+        };
+        if(!later_.empty())
+            next(later_.begin()->first, 0);
+        if(midi_in_next_ < midi_in_.size())
+            next(midi_in_[midi_in_next_].time, 1);
+        if(gate_in_next_ < gate_in_.size())
+            next(gate_in_[gate_in_next_].time, 2);
+        for(int i = 0; i < 4; i++)
+            if(timers_[i].running)
+                next(timers_[i].start + TimerPeriod(timers_[i]), 3 + i);
+        if(audio_ && audio_->running_)
+            next(audio_next_, 7);
+        if(dac_ && dac_->running_ && dac_->config_.mode == DacHandle::Mode::DMA)
+            next(dac_next_, 8);
+        next(csv_next_, 9);
+
+        /** The app wakes after any interrupts due at the same time */
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(app_mutex_);
+            wake = app_state_ == APP_SLEEPING && app_wake_ < t;
+        }
+        if(wake)
+        {
+            irq.unlock();
+            {
+                std::lock_guard<std::mutex> lock(app_mutex_);
+                now_.store(std::max(app_wake_, Now()));
+                app_state_ = APP_RUNNING;
+                app_release_++;
+            }
+            app_cv_.notify_all();
+            if(!free_running_ && !WaitForApp())
+            {
+                free_running_ = true;
+                fprintf(stderr,
+                        "dpt_sim: the main loop didn't come back to System::Delay() "
+                        "within %.1f s, leaving it to run freely\n",
+                        opts_.sync_timeout);
+            }
+            continue;
+        }
+        if(source < 0)
+            break;
+
+        now_.store(std::max((uint64_t)t, Now()));
+        switch(source)
+        {
+            case 0:
+            {
+                std::function<void()> fn = std::move(later_.begin()->second);
+                later_.erase(later_.begin());
+                fn();
+                break;
+            }
+            case 1: DeliverMidi(midi_in_[midi_in_next_++]); break;
+            case 2: GateInEdge(gate_in_[gate_in_next_++]); break;
+            case 7: AudioBlock(); break;
+            case 8: DacHalf(); break;
+            case 9:
+                SampleOutputs();
+                csv_next_ += 1e9 / opts_.csv_rate;
+                break;
+            default: TimerUpdate(timers_[source - 3]); break;
+        }
+    }
+    now_.store((uint64_t)end);
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                - wall_start)
+                      .count();
+    bool ok = WriteOutputs();
+    PrintSummary(wall);
+    return ok ? 0 : 1;
+}
+
+} // namespace sim
@@ -0,0 +1,229 @@
+#pragma once
+#ifndef DPT_SIM_ENGINE_H
+#define DPT_SIM_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "daisy.h"
+#include "sim_wav.h"
+
+namespace sim
+{
+/** What to simulate and where the results go, see dpt_sim.cpp */
+struct Options
+{
+    double      seconds = 10.0;
+    std::string input_wav;
+    std::string output_prefix = "dpt_sim";
+    std::string controls_csv;
+    std::string midi_file;
+    std::string trace_file;
+    float       csv_rate     = 1000.f;
+    double      sync_timeout = 0.5; /**< wall clock seconds */
+};
+
+/** @brief Runs a DPT app in virtual time
+ *
+ *  The app's main() runs on its own thread. Everything that is an
+ *  interrupt on the chip (audio and DAC blocks, the TIM3/4/5/12 updates,
+ *  the DAC7554 stream DMA, SPI and UART completions, MIDI input, gate input
+ *  edges) runs on the engine's thread in time order, with IrqMutex() held,
+ *  so ScopedIrqBlocker keeps the two apart.
+ *
+ *  System::Delay() from the main loop parks the app until virtual time
+ *  reaches its wake time, and the engine waits for it to park again before
+ *  it moves on, so main loops that Delay() run in lockstep and renders
+ *  repeat exactly. An app that doesn't come back within the sync timeout
+ *  (e.g. while(1) {}) is left running freely next to the engine.
+ *
+ *  Times are virtual nanoseconds since the app started.
+ */
+class Engine
+{
+  public:
+    static Engine& Get();
+
+    /** Virtual time in ns */
+    uint64_t Now() const { return now_.load(std::memory_order_relaxed); }
+
+    /** System::Delay. Returns at once from the engine's thread (an interrupt) */
+    void Sleep(uint64_t ns);
+
+    /** Runs fn in interrupt context, delay_ns from now */
+    void Later(uint64_t delay_ns, std::function<void()> fn);
+
+    /** Adds a line to the events file, at Now() */
+    void Event(const std::string& source, const std::string& value);
+
+    /** Logs bytes as hex to the events file */
+    void Bytes(const std::string& source, const uint8_t* data, size_t size);
+
+    /** NVIC, an interrupt only runs while its line is enabled */
+    void SetIrqEnabled(IRQn_Type irq, bool enabled);
+    bool IrqEnabled(IRQn_Type irq) const;
+
+    /** Peripherals hand themselves over as they are started */
+    void Attach(daisy::AudioHandle* audio);
+    void Attach(daisy::DacHandle* dac);
+    void Attach(daisy::AdcHandle* adc);
+    void Attach(daisy::TimerHandle* tim);
+    void Attach(DMA_HandleTypeDef* dma);
+    void Attach(daisy::UartHandler* uart);
+    void Attach(daisy::MidiUsbTransport* midi);
+    void Detach(const void* midi);
+
+    /** A dsy_gpio output changed */
+    void GpioChanged(int port, int pin, bool state);
+
+    /** Data frames shifted out of SPI2, decoded as DAC7554 commands */
+    void Spi2Transmit(const uint8_t* buff, size_t size, unsigned long datasize);
+
+    /** A DMA started on the SPI2 tx request: shifts its items out as one
+     *  TSIZE transaction, then raises EOT */
+    void Spi2Dma(DMA_HandleTypeDef* dma);
+
+    /** Runs app_main to opts.seconds and writes the outputs.
+     *  \retval exit status for main()
+     */
+    int Run(const Options& opts, int (*app_main)());
+
+  private:
+    Engine();
+
+    enum AppState
+    {
+        APP_RUNNING,
+        APP_SLEEPING,
+        APP_EXITED,
+    };
+
+    struct Timer
+    {
+        TIM_TypeDef*        regs;
+        IRQn_Type           irq;
+        daisy::TimerHandle* handle;
+        bool                running;
+        double              start; /**< ns of the last start, UG or update */
+    };
+
+    struct MidiIn
+    {
+        double               time;
+        bool                 usb;
+        std::vector<uint8_t> bytes;
+    };
+
+    struct GateEdge
+    {
+        double time;
+        int    gate;
+        bool   state;
+    };
+
+    struct LoggedEvent
+    {
+        uint64_t    time;
+        std::string source;
+        std::string value;
+    };
+
+    bool LoadControls(const std::string& path);
+    bool LoadMidi(const std::string& path);
+
+    /** Waits for the app to sleep or exit, false on the sync timeout */
+    bool WaitForApp();
+
+    /** Picks up timer starts, stops and UG writes since the last event */
+    void   SyncTimers();
+    double TimerPeriod(const Timer& t) const;
+    void   TimerUpdate(Timer& t);
+
+    /** One request of the DMAMUX generators fed by signal */
+    void DmaRequest(uint32_t signal);
+    void DmaTransfer(DMA_HandleTypeDef* dma);
+
+    void AudioBlock();
+    void DacHalf();
+    void GateInEdge(const GateEdge& edge);
+    void DeliverMidi(const MidiIn& in);
+    void SampleOutputs();
+
+    /** Controls file value of column at t, linear between rows */
+    float ControlAt(int column, double t) const;
+    void  WriteAdc(double t);
+
+    void Dac7554Word(uint16_t word);
+
+    bool WriteOutputs();
+    void PrintSummary(double wall_seconds);
+
+    Options               opts_;
+    std::atomic<uint64_t> now_;
+    std::thread::id       engine_thread_;
+    bool                  irq_enabled_[IRQn_LAST];
+
+    /** App thread handshake */
+    std::mutex              app_mutex_;
+    std::condition_variable app_cv_;
+    AppState                app_state_;
+    uint64_t                app_wake_;
+    uint64_t                app_release_;
+    bool                    free_running_;
+
+    std::multimap<uint64_t, std::function<void()>> later_;
+
+    Timer                           timers_[4];
+    std::vector<DMA_HandleTypeDef*> dmas_;
+
+    daisy::AudioHandle* audio_;
+    double              audio_next_;
+    std::vector<float>  audio_out_;
+    uint64_t            audio_blocks_;
+    double              audio_host_ns_, audio_host_peak_;
+    uint64_t            audio_over_;
+
+    daisy::DacHandle*     dac_;
+    double                dac_next_;
+    int                   dac_half_;
+    double                dac_playing_start_;
+    std::vector<uint16_t> dac_playing_[2];
+
+    daisy::AdcHandle* adc_;
+
+    std::vector<daisy::UartHandler*> midi_trs_;
+    std::vector<daisy::MidiUsbTransport*>  midi_usb_;
+    std::vector<MidiIn>                    midi_in_;
+    size_t                                 midi_in_next_;
+
+    /** Controls file: column names, then rows of time + values */
+    std::vector<std::string>         control_names_;
+    std::vector<std::vector<double>> control_rows_;
+    int                              control_column_[daisy::AdcHandle::kMaxChannels];
+    std::vector<GateEdge>            gate_in_;
+    size_t                           gate_in_next_;
+
+    Wav input_;
+
+    uint16_t                 exp_code_[4];
+    int                      spi_byte_count_;
+    uint8_t                  spi_high_byte_;
+    uint32_t                 exp_words_;
+    double                   csv_next_;
+    std::vector<std::string> csv_rows_;
+
+    std::mutex               events_mutex_;
+    std::vector<LoggedEvent> events_;
+    uint32_t                 midi_out_bytes_[2];
+};
+
+} // namespace sim
+
+#endif
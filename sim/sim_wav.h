@@ -0,0 +1,140 @@
+#pragma once
+#ifndef DPT_SIM_WAV_H
+#define DPT_SIM_WAV_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+/** Interleaved float samples of a WAV file */
+struct Wav
+{
+    uint32_t           rate     = 48000;
+    uint16_t           channels = 2;
+    std::vector<float> samples;
+
+    size_t Frames() const { return channels ? samples.size() / channels : 0; }
+};
+
+/** Reads 16/24/32 bit PCM or 32 bit float WAV, any channel count.
+ *  \retval false with error set if the file can't be used
+ */
+inline bool ReadWav(const std::string& path, Wav* wav, std::string* error)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f)
+    {
+        *error = "can't open " + path;
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t              chunk[65536];
+    size_t               n;
+    while((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+
+    auto u16 = [&](size_t i) { return (uint32_t)data[i] | (uint32_t)data[i + 1] << 8; };
+    auto u32 = [&](size_t i) { return u16(i) | u16(i + 2) << 16; };
+    if(data.size() < 12 || memcmp(&data[0], "RIFF", 4) || memcmp(&data[8], "WAVE", 4))
+    {
+        *error = path + " is not a WAV file";
+        return false;
+    }
+
+    uint16_t format = 0, bits = 0;
+    size_t   pos    = 12;
+    while(pos + 8 <= data.size())
+    {
+        uint32_t size = u32(pos + 4);
+        size_t   body = pos + 8;
+        if(!memcmp(&data[pos], "fmt ", 4) && body + 16 <= data.size())
+        {
+            format        = u16(body);
+            wav->channels = u16(body + 2);
+            wav->rate     = u32(body + 4);
+            bits          = u16(body + 14);
+            /** WAVE_FORMAT_EXTENSIBLE, the sub format is in the GUID */
+            if(format == 0xfffe && body + 26 <= data.size())
+                format = u16(body + 24);
+        }
+        else if(!memcmp(&data[pos], "data", 4))
+        {
+            size_t end   = body + size < data.size() ? body + size : data.size();
+            size_t bytes = bits / 8;
+            bool pcm = format == 1 && (bits == 16 || bits == 24 || bits == 32);
+            bool fp  = format == 3 && bits == 32;
+            if(!wav->channels || !(pcm || fp))
+            {
+                *error = path + ": only 16/24/32 bit PCM and 32 bit float are supported";
+                return false;
+            }
+            for(size_t i = body; i + bytes <= end; i += bytes)
+            {
+                float s;
+                if(format == 3)
+                {
+                    uint32_t u = u32(i);
+                    memcpy(&s, &u, 4);
+                }
+                else if(bits == 16)
+                    s = (int16_t)u16(i) / 32768.f;
+                else if(bits == 24)
+                    s = ((int32_t)(u16(i) << 8 | (uint32_t)data[i + 2] << 24) >> 8)
+                        / 8388608.f;
+                else
+                    s = (int32_t)u32(i) / 2147483648.f;
+                wav->samples.push_back(s);
+            }
+            return true;
+        }
+        pos = body + size + (size & 1);
+    }
+    *error = path + " has no data chunk";
+    return false;
+}
+
+/** Writes interleaved samples as 32 bit float WAV */
+inline bool WriteWav(const std::string&        path,
+                     const std::vector<float>& samples,
+                     uint16_t                  channels,
+                     uint32_t                  rate)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if(!f)
+        return false;
+    uint32_t data_size = samples.size() * sizeof(float);
+    uint8_t  header[44];
+    auto     put16 = [&](size_t i, uint32_t v) {
+        header[i]     = v & 0xff;
+        header[i + 1] = (v >> 8) & 0xff;
+    };
+    auto put32 = [&](size_t i, uint32_t v) {
+        put16(i, v & 0xffff);
+        put16(i + 2, v >> 16);
+    };
+    memcpy(header, "RIFF", 4);
+    put32(4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, 3); /**< IEEE float */
+    put16(22, channels);
+    put32(24, rate);
+    put32(28, rate * channels * sizeof(float));
+    put16(32, channels * sizeof(float));
+    put16(34, 32);
+    memcpy(header + 36, "data", 4);
+    put32(40, data_size);
+    bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+              && fwrite(samples.data(), sizeof(float), samples.size(), f)
+                     == samples.size();
+    return fclose(f) == 0 && ok;
+}
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,53 @@
+/** Host microbenchmarks for lib/, see ../README.md
+ *
+ *  Each bench_*.cpp is its own binary with its own main(). Times come from
+ *  dpt::CycleCounter, nanoseconds on the host, so they compare one
+ *  implementation against another, not against the Cortex-M7 budget.
+ */
+#pragma once
+#ifndef DPT_SIM_BENCH_H
+#define DPT_SIM_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "../../lib/util/cpu_load.h"
+
+namespace sim_bench
+{
+/** Keeps the compiler from dropping a result nothing reads */
+template <typename T>
+inline void Keep(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** Best of a few runs of fn(), each calling it repetitions times.
+ *  Prints the time per item, e.g. per sample with 48 items per call for
+ *  a block of 48. Keep a run well under 4s, the host counter wraps.
+ *  \return nanoseconds per call
+ */
+template <typename Fn>
+inline double Run(const char* name,
+                  Fn          fn,
+                  uint32_t    repetitions,
+                  double      items_per_call = 1.0,
+                  const char* item           = "call")
+{
+    using daisy::dpt::CycleCounter;
+    double best = 1e30;
+    for(int run = 0; run < 5; run++)
+    {
+        uint32_t start = CycleCounter::Now();
+        for(uint32_t i = 0; i < repetitions; i++)
+            fn();
+        double ns = (double)(uint32_t)(CycleCounter::Now() - start)
+                    / CycleCounter::TicksPerSecond(1.f) * 1e9 / repetitions;
+        best = ns < best ? ns : best;
+    }
+    printf("%-40s %10.2f ns/%s\n", name, best / items_per_call, item);
+    return best;
+}
+
+} // namespace sim_bench
+
+#endif
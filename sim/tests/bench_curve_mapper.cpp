@@ -0,0 +1,53 @@
+/** CurveMapper::Process against fmap, per call
+ *
+ *  x86 has a fast libm, so the LOG gap here is smaller than on the M7,
+ *  where fmap pays for log10f + powf on every call.
+ */
+
+#include "bench.h"
+#include "../../lib/daisy_dpt.h"
+
+using namespace daisy;
+using namespace daisy::dpt;
+
+int main()
+{
+    const int kInputs = 256;
+    float     in[kInputs];
+    for(int i = 0; i < kInputs; i++)
+        in[i] = i / (float)(kInputs - 1);
+
+    const MappingFmap curves[] = {MappingFmap::LINEAR, MappingFmap::EXP, MappingFmap::LOG};
+    const char*       names[]  = {"LINEAR", "EXP", "LOG"};
+    for(int c = 0; c < 3; c++)
+    {
+        MappingFmap curve = curves[c];
+        CurveMapper m;
+        m.Init(20.f, 20000.f, curve);
+        char label[64];
+        float sum = 0.f;
+
+        snprintf(label, sizeof(label), "fmap %s", names[c]);
+        sim_bench::Run(
+            label,
+            [&] {
+                for(int i = 0; i < kInputs; i++)
+                    sum += fmap(in[i], 20.f, 20000.f, curve);
+                sim_bench::Keep(sum);
+            },
+            20000,
+            kInputs);
+
+        snprintf(label, sizeof(label), "CurveMapper %s", names[c]);
+        sim_bench::Run(
+            label,
+            [&] {
+                for(int i = 0; i < kInputs; i++)
+                    sum += m.Process(in[i]);
+                sim_bench::Keep(sum);
+            },
+            20000,
+            kInputs);
+    }
+    return 0;
+}
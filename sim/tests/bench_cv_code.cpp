@@ -0,0 +1,102 @@
+/** Block voltage to code conversion, against the functions it replaced
+ *
+ *  The baseline rows are Impl::VoltageToCode and DPT::VoltageToCodeExp as
+ *  they were in lib/daisy_dpt.cpp, copied verbatim, called once per sample
+ *  like WriteCvOutBlock did. On the host everything is plain C, so the
+ *  saturate/pack row compares the shape of the loops (it truncates,
+ *  saturates and stores in pairs), not vcvt/usat/pkhbt on the M7's FPU.
+ */
+
+#include <vector>
+#include "bench.h"
+#include "../../lib/util/cv_code.h"
+
+using namespace daisy::dpt;
+
+#define DSY_MIN(in, mn) (in < mn ? in : mn)
+#define DSY_MAX(in, mx) (in > mx ? in : mx)
+#define DSY_CLAMP(in, mn, mx) (DSY_MIN(DSY_MAX(in, mn), mx))
+
+/** Impl::VoltageToCode before cv_code.h */
+static inline uint16_t VoltageToCode(float input)
+{
+    float pre = (input + 5.0f) * 273.f;
+    if(pre > 4095.f)
+        pre = 4095.f;
+    else if(pre < 0.f)
+        pre = 0.f;
+    return (uint16_t)pre;
+}
+
+/** DPT::VoltageToCodeExp before cv_code.h, with its double clamp */
+static uint16_t VoltageToCodeExp(float input)
+{
+    // Outputs are inverted, so have to flip the literal voltage
+    float pre = DSY_CLAMP(4095.f - ((input + 7.f) / 14.f * 4095.f), 0, 4095);
+
+    if (pre > 4095.f)
+        pre = 4095.f;
+    else if (pre < 0.f)
+        pre = 0.f;
+
+    return (uint16_t)pre;
+}
+
+int main()
+{
+    const size_t       kBlock = 48;
+    std::vector<float> in(kBlock);
+    uint16_t           out[kBlock];
+    // Half of them in range, the rest clamping on either side
+    for(size_t i = 0; i < kBlock; i++)
+        in[i] = -10.f + 25.f * i / kBlock;
+
+    sim_bench::Run(
+        "old VoltageToCode loop",
+        [&] {
+            for(size_t i = 0; i < kBlock; i++)
+                out[i] = VoltageToCode(in[i]);
+            sim_bench::Keep(out);
+        },
+        200000,
+        kBlock,
+        "sample");
+    sim_bench::Run(
+        "CvVoltageToCodeBlock",
+        [&] {
+            CvVoltageToCodeBlock(in.data(), out, kBlock);
+            sim_bench::Keep(out);
+        },
+        200000,
+        kBlock,
+        "sample");
+    sim_bench::Run(
+        "old VoltageToCodeExp loop",
+        [&] {
+            for(size_t i = 0; i < kBlock; i++)
+                out[i] = VoltageToCodeExp(in[i]);
+            sim_bench::Keep(out);
+        },
+        200000,
+        kBlock,
+        "sample");
+    sim_bench::Run(
+        "CvExpVoltageToCodeBlock",
+        [&] {
+            CvExpVoltageToCodeBlock(in.data(), out, kBlock);
+            sim_bench::Keep(out);
+        },
+        200000,
+        kBlock,
+        "sample");
+    sim_bench::Run(
+        "LinearToCodeBlockSat (saturate/pack)",
+        [&] {
+            LinearToCodeBlockSat(in.data(), out, kBlock, kCvCodesPerVolt, kCvCodeOffset);
+            sim_bench::Keep(out);
+        },
+        200000,
+        kBlock,
+        "sample");
+    return 0;
+}
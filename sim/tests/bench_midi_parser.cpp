@@ -0,0 +1,45 @@
+/** MidiByteParser throughput on typical traffic
+ *
+ *  A 31250 baud UART delivers a byte every 320us, so anything under a
+ *  microsecond per byte is noise in the UART interrupt.
+ */
+
+#include <vector>
+#include "bench.h"
+#include "../../lib/util/midi_parser.h"
+
+using namespace daisy::dpt;
+
+int main()
+{
+    // Notes with running status, CCs, clock ticks inside messages, a short SysEx
+    std::vector<uint8_t> stream;
+    uint32_t             rng = 1;
+    while(stream.size() < 65536)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        switch(rng >> 29)
+        {
+            case 0: stream.insert(stream.end(), {0x90, 60, 100, 64, 100}); break;
+            case 1: stream.insert(stream.end(), {0x80, 60, 0, 0xf8, 64, 0}); break;
+            case 2: stream.insert(stream.end(), {0xb0, 74, (uint8_t)(rng & 0x7f)}); break;
+            case 3: stream.insert(stream.end(), {0xf0, 0x7e, 0x7f, 0x06, 0x01, 0xf7}); break;
+            default: stream.insert(stream.end(), {0xf8}); break;
+        }
+    }
+
+    MidiByteParser parser;
+    MidiMessage    msg;
+    uint32_t       messages = 0;
+    sim_bench::Run(
+        "MidiByteParser::Parse",
+        [&] {
+            for(uint8_t b : stream)
+                messages += parser.Parse(b, &msg);
+            sim_bench::Keep(messages);
+        },
+        200,
+        stream.size(),
+        "byte");
+    return 0;
+}
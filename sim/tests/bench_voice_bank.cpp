@@ -0,0 +1,91 @@
+/** MegaBasic's voices: 8 SaucyVoice objects against one 8-lane SaucyVoiceBank
+ *
+ *  Prints the time per voice and sample, and how many voices that is per
+ *  percent of CPU at 48kHz, on this host. The bank needs nothing else;
+ *  the SaucyVoice rows need DaisySP, like the app, and the Makefile only
+ *  builds them (BENCH_SAUCY_VOICE) when it finds it.
+ */
+
+#include "bench.h"
+#include "../../sw/MegaBasic/SaucyVoiceBank.h"
+#if BENCH_SAUCY_VOICE
+#include "../../sw/MegaBasic/SaucyVoice.h"
+#endif
+
+static const float  kSamplerate = 48000.f;
+static const size_t kVoices     = SaucyVoiceBank::kLanes;
+static const size_t kBlock      = 32;
+
+static void Report(const char* name, double ns_per_voice_sample)
+{
+    double budget = 1e9 / kSamplerate * 0.01; // ns per sample in 1% of the CPU
+    printf("%-40s %10.2f voices per 1%% CPU\n", name, budget / ns_per_voice_sample);
+}
+
+int main()
+{
+    SaucyVoiceBank bank;
+    bank.Init(kSamplerate);
+    // Long decays, so every voice is sounding for the whole run
+    bank.SetDecay(100.f);
+    for(size_t v = 0; v < kVoices; v++)
+        bank.TrigMidi(v, 48 + 5 * v, 100);
+
+    float  out[kVoices][kBlock];
+    float  frame[kVoices];
+    double ns;
+
+#if BENCH_SAUCY_VOICE
+    SaucyVoice voices[kVoices];
+    for(size_t v = 0; v < kVoices; v++)
+    {
+        voices[v].Init(kSamplerate, v);
+        voices[v].envelope.SetTime(ADENV_SEG_DECAY, 100.f);
+        voices[v].TrigMidi(48 + 5 * v, 100);
+    }
+
+    ns = sim_bench::Run(
+        "SaucyVoice::Process, per sample",
+        [&] {
+            for(size_t i = 0; i < kBlock; i++)
+                for(size_t v = 0; v < kVoices; v++)
+                    out[v][i] = voices[v].Process();
+            sim_bench::Keep(out);
+        },
+        20000,
+        kBlock * kVoices,
+        "voice-sample");
+    Report("SaucyVoice::Process", ns / (kBlock * kVoices));
+
+    ns = sim_bench::Run(
+        "SaucyVoice::ProcessBlock, 32 samples",
+        [&] {
+            for(size_t v = 0; v < kVoices; v++)
+                voices[v].ProcessBlock(out[v], kBlock);
+            sim_bench::Keep(out);
+        },
+        20000,
+        kBlock * kVoices,
+        "voice-sample");
+    Report("SaucyVoice::ProcessBlock", ns / (kBlock * kVoices));
+#else
+    printf("SaucyVoice rows need DaisySP, see DAISYSP_DIR\n");
+#endif
+
+    ns = sim_bench::Run(
+        "SaucyVoiceBank::Process, 8 lanes",
+        [&] {
+            for(size_t i = 0; i < kBlock; i++)
+            {
+                bank.Process(frame);
+                for(size_t v = 0; v < kVoices; v++)
+                    out[v][i] = frame[v];
+            }
+            sim_bench::Keep(out);
+        },
+        20000,
+        kBlock * kVoices,
+        "voice-sample");
+    Report("SaucyVoiceBank::Process", ns / (kBlock * kVoices));
+    return 0;
+}
@@ -0,0 +1,21 @@
+/** Runs every TEST() in the binary, see test.h */
+
+#include "test.h"
+
+int main(int argc, char* argv[])
+{
+    int failed = 0;
+    for(const sim_test::Case& c : sim_test::Cases())
+    {
+        sim_test::Failures() = 0;
+        c.function();
+        printf("%-40s %s\n", c.name, sim_test::Failures() ? "FAIL" : "ok");
+        failed += sim_test::Failures() ? 1 : 0;
+    }
+    if(failed)
+        printf("%s: %d of %zu tests failed\n",
+               argv[0],
+               failed,
+               sim_test::Cases().size());
+    return failed ? 1 : 0;
+}
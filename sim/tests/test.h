@@ -0,0 +1,129 @@
+/** Host tests for lib/, see ../README.md
+ *
+ *  Each test_*.cpp is its own binary, linked with main.cpp:
+ *
+ *      TEST(QueueWraps)
+ *      {
+ *          CHECK(q.Push(1));
+ *          CHECK_EQ(q.Size(), 1u);
+ *          CHECK_NEAR(v, 0.5f, 1e-6f);
+ *      }
+ *
+ *  A failed check reports and the test carries on, so one run shows every
+ *  failure. The binary exits non-zero if any check failed.
+ */
+#pragma once
+#ifndef DPT_SIM_TEST_H
+#define DPT_SIM_TEST_H
+
+#include <math.h>
+#include <stdio.h>
+#include <type_traits>
+#include <vector>
+
+namespace sim_test
+{
+typedef void (*TestFunction)();
+
+struct Case
+{
+    const char*  name;
+    TestFunction function;
+};
+
+inline std::vector<Case>& Cases()
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+/** Failed checks in the test that is running */
+inline int& Failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+struct Register
+{
+    Register(const char* name, TestFunction function)
+    {
+        Cases().push_back({name, function});
+    }
+};
+
+/** Prints a checked value, numbers as numbers, anything else as '?' */
+template <typename T>
+inline void Show(const T& value)
+{
+    if constexpr(std::is_enum<T>::value)
+        printf("%lld", (long long)value);
+    else if constexpr(std::is_floating_point<T>::value)
+        printf("%.9g", (double)value);
+    else if constexpr(std::is_signed<T>::value)
+        printf("%lld", (long long)value);
+    else if constexpr(std::is_integral<T>::value)
+        printf("%llu", (unsigned long long)value);
+    else if constexpr(std::is_pointer<T>::value)
+        printf("%p", (const void*)value);
+    else
+        printf("?");
+}
+
+inline void Fail(const char* file, int line, const char* what)
+{
+    printf("  %s:%d: failed: %s\n", file, line, what);
+    Failures()++;
+}
+
+template <typename A, typename B>
+inline void CheckEq(const A&    a,
+                    const B&    b,
+                    const char* what,
+                    const char* file,
+                    int         line)
+{
+    if(a == b)
+        return;
+    Fail(file, line, what);
+    printf("    ");
+    Show(a);
+    printf(" != ");
+    Show(b);
+    printf("\n");
+}
+
+inline void CheckNear(double      a,
+                      double      b,
+                      double      tolerance,
+                      const char* what,
+                      const char* file,
+                      int         line)
+{
+    if(fabs(a - b) <= tolerance)
+        return;
+    Fail(file, line, what);
+    printf("    %.9g and %.9g differ by %.9g\n", a, b, fabs(a - b));
+}
+
+} // namespace sim_test
+
+#define TEST(name)                                                 \
+    static void             name();                                \
+    static sim_test::Register name##_register(#name, name);        \
+    static void             name()
+
+#define CHECK(cond)                                      \
+    do                                                   \
+    {                                                    \
+        if(!(cond))                                      \
+            sim_test::Fail(__FILE__, __LINE__, #cond);   \
+    } while(0)
+
+#define CHECK_EQ(a, b) \
+    sim_test::CheckEq((a), (b), #a " == " #b, __FILE__, __LINE__)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    sim_test::CheckNear((a), (b), (tolerance), #a " ~ " #b, __FILE__, __LINE__)
+
+#endif
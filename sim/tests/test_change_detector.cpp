@@ -0,0 +1,138 @@
+/** ControlChangeDetector on simulated noisy ADC readings */
+
+#include <stdlib.h>
+#include "test.h"
+#include "../../lib/util/change_detector.h"
+
+using daisy::dpt::ControlChangeDetector;
+
+/** Deterministic ADC noise, uniform in +-amplitude */
+struct Noise
+{
+    uint32_t state = 12345;
+    float    operator()(float amplitude)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return amplitude * ((state & 0xffff) / 32767.5f - 1.f);
+    }
+};
+
+static const float kDeadband   = 0.002f;
+static const float kHysteresis = 0.002f;
+
+/** Just inside the deadband. Two readings can differ by nearly twice that,
+ *  which the hysteresis has to absorb when the noise changes direction. */
+static const float kNoise = 0.9f * kDeadband;
+
+TEST(RestingKnobWithNoiseNeverFires)
+{
+    ControlChangeDetector<4> d;
+    d.Init(kDeadband, kHysteresis);
+    Noise       noise;
+    float       values[4];
+    const float rest[4] = {0.05f, 0.25f, 0.5f, 0.75f};
+
+    // Knobs 0 and 1 come to rest turning up, 2 and 3 turning down
+    for(int i = 0; i < 4; i++)
+        values[i] = i < 2 ? 0.f : 1.f;
+    d.Process(values);
+    for(int i = 0; i < 4; i++)
+        values[i] = rest[i];
+    d.Process(values);
+    CHECK_EQ(d.ChangedMask(), 0xfu);
+
+    uint32_t fired = 0;
+    for(int t = 0; t < 100000; t++)
+    {
+        for(int i = 0; i < 4; i++)
+            values[i] = rest[i] + noise(kNoise);
+        d.Process(values);
+        fired |= d.ChangedMask();
+    }
+    CHECK_EQ(fired, 0u);
+}
+
+TEST(TurningKnobTracksThroughNoise)
+{
+    // 0 to 1 over a second of 1kHz control ticks, with the same noise
+    ControlChangeDetector<1> d;
+    d.Init(kDeadband, kHysteresis);
+    Noise    noise;
+    int      reports = 0;
+    float    worst   = 0.f;
+    for(int t = 0; t <= 1000; t++)
+    {
+        float knob = t / 1000.f;
+        float v    = knob + noise(kNoise);
+        d.Process(&v);
+        if(d.Changed(0))
+            reports++;
+        float lag = knob - d.Value(0);
+        worst     = lag > worst ? lag : worst;
+    }
+    // Reports along the way, not just at the end
+    CHECK(reports > 100);
+    // Never further behind than the threshold plus the noise
+    CHECK(worst <= kDeadband + kHysteresis + 2 * kNoise);
+    CHECK_NEAR(d.Value(0), 1.f, kDeadband + kHysteresis + kNoise);
+}
+
+TEST(ReversingCostsTheHysteresis)
+{
+    ControlChangeDetector<1> d;
+    d.Init(0.01f, 0.02f);
+    float v = 0.5f;
+    d.Process(&v);
+    CHECK(d.Changed(0));
+
+    // Same direction: the deadband alone
+    v = 0.515f;
+    d.Process(&v);
+    CHECK(d.Changed(0));
+
+    // Back down by less than deadband + hysteresis: ignored
+    v = 0.49f;
+    d.Process(&v);
+    CHECK(!d.Changed(0));
+
+    // Past it: reported
+    v = 0.48f;
+    d.Process(&v);
+    CHECK(d.Changed(0));
+    CHECK_NEAR(d.Value(0), 0.48f, 1e-6);
+}
+
+TEST(FlagsClearOnReadAndCallbackRuns)
+{
+    ControlChangeDetector<3> d;
+    d.Init(0.01f, 0.f);
+    int      calls    = 0;
+    uint32_t channels = 0;
+    struct Ctx
+    {
+        int*      calls;
+        uint32_t* channels;
+    } ctx = {&calls, &channels};
+    d.SetCallback(
+        [](size_t channel, float value, void* context) {
+            Ctx* c = (Ctx*)context;
+            (*c->calls)++;
+            *c->channels |= 1u << channel;
+        },
+        &ctx);
+
+    float v[3] = {0.f, 0.5f, 0.005f};
+    d.Process(v);
+    CHECK_EQ(calls, 1);
+    CHECK_EQ(channels, 2u);
+    CHECK_EQ(d.ChangedMask(), 2u);
+    CHECK_EQ(d.ChangedMask(), 0u);
+
+    v[2] = 0.02f;
+    d.Process(v);
+    CHECK(d.Changed(2));
+    CHECK(!d.Changed(2));
+    CHECK(!d.Changed(1));
+}
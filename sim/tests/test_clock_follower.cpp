@@ -0,0 +1,191 @@
+/** MidiClockFollower on jittered tick streams, and the transport messages */
+
+#include <math.h>
+#include "test.h"
+#include "../../lib/util/clock_follower.h"
+
+using daisy::dpt::MidiClockFollower;
+
+/** Deterministic arrival jitter, uniform in +-amplitude */
+struct Jitter
+{
+    uint32_t state = 2463534242u;
+    float    operator()(float amplitude)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return amplitude * ((state & 0xffff) / 32767.5f - 1.f);
+    }
+};
+
+/** Ticks at bpm with arrival jitter, the true tick times are i * period */
+struct Clock
+{
+    MidiClockFollower& follower;
+    Jitter             jitter;
+    float              period;
+    float              jitter_us;
+    uint32_t           start_us;
+    int                ticks;
+
+    Clock(MidiClockFollower& f, float bpm, float jitter_us, uint32_t start_us = 1000)
+    : follower(f),
+      period(60e6f / (bpm * MidiClockFollower::kPpqn)),
+      jitter_us(jitter_us),
+      start_us(start_us),
+      ticks(0)
+    {
+    }
+
+    uint32_t TrueTime(int tick) const { return start_us + (uint32_t)(tick * period); }
+
+    void Tick()
+    {
+        follower.Message(0xf8, TrueTime(ticks) + (int32_t)jitter(jitter_us));
+        ticks++;
+    }
+};
+
+TEST(LocksOnJitteredClock)
+{
+    MidiClockFollower f;
+    Clock             clock(f, 120.f, 1000.f); // +-1ms, about 5% of a tick
+    f.Message(0xfa, 0);
+
+    int   locked = 0;
+    float worst  = 0.f;
+    for(int i = 0; i < 960; i++)
+    {
+        clock.Tick();
+        if(i < 240)
+            continue;
+        locked += f.IsLocked();
+        // Half way to the next tick, where the true position is i + 0.5
+        float pos = f.Process(clock.TrueTime(i) + (uint32_t)(0.5f * clock.period));
+        worst     = fmaxf(worst, fabsf(pos - (i + 0.5f)));
+    }
+    CHECK_EQ(locked, 720);
+    CHECK_NEAR(f.Bpm(), 120.f, 0.5f);
+    // The raw ticks are off by up to 0.05, the filtered position much less
+    CHECK(worst < 0.03f);
+    printf("  +-1ms jitter at 120 BPM: worst position error %.4f ticks\n", worst);
+}
+
+TEST(PositionNeverGoesBackwards)
+{
+    MidiClockFollower f;
+    Clock             clock(f, 133.f, 2000.f);
+    f.Message(0xfa, 0);
+
+    float    last      = -1.f;
+    bool     monotonic = true;
+    uint32_t now       = clock.start_us;
+    for(int i = 0; i < 400; i++)
+    {
+        uint32_t next = clock.TrueTime(clock.ticks);
+        for(; now < next; now += 250) // the 4kHz clock service task
+        {
+            float pos = f.Process(now);
+            monotonic = monotonic && pos >= last;
+            last      = pos;
+        }
+        clock.Tick();
+    }
+    CHECK(monotonic);
+    CHECK_NEAR(last, 399.f, 1.f);
+}
+
+TEST(RelocksAfterTempoJump)
+{
+    MidiClockFollower f;
+    Clock             slow(f, 100.f, 500.f);
+    f.Message(0xfa, 0);
+    for(int i = 0; i < 200; i++)
+        slow.Tick();
+    CHECK(f.IsLocked());
+    CHECK_NEAR(f.Bpm(), 100.f, 0.5f);
+
+    Clock fast(f, 150.f, 500.f, slow.TrueTime(slow.ticks));
+    int   relock = -1;
+    for(int i = 0; i < 200; i++)
+    {
+        fast.Tick();
+        if(relock < 0 && f.IsLocked() && fabsf(f.Bpm() - 150.f) < 1.f)
+            relock = i;
+    }
+    // Within a bar, the jump resets to the raw interval and the loop settles from there
+    CHECK(relock >= 0 && relock < 96);
+    CHECK_NEAR(f.Bpm(), 150.f, 0.5f);
+    printf("  100 -> 150 BPM: locked again after %d ticks\n", relock);
+}
+
+TEST(StartsOnItsOwnWithoutTransport)
+{
+    MidiClockFollower f;
+    Clock             clock(f, 120.f, 0.f);
+    clock.Tick();
+    clock.Tick();
+    CHECK(!f.IsRunning());
+    clock.Tick();
+    CHECK(f.IsRunning());
+    // The tick that started it is position 0
+    CHECK_NEAR(f.Process(clock.TrueTime(2)), 0.f, 1e-3f);
+}
+
+TEST(StopHoldsUntilContinue)
+{
+    MidiClockFollower f;
+    Clock             clock(f, 120.f, 0.f);
+    f.Message(0xfa, 0);
+    for(int i = 0; i < 48; i++)
+        clock.Tick();
+    float stopped = f.Process(clock.TrueTime(47));
+    CHECK_NEAR(stopped, 47.f, 1e-3f);
+
+    f.Message(0xfc, 0);
+    CHECK(!f.IsRunning());
+    // A stopped sequencer keeps sending clock, that must not restart it
+    for(int i = 0; i < 48; i++)
+        clock.Tick();
+    CHECK(!f.IsRunning());
+    CHECK_NEAR(f.Process(clock.TrueTime(95)), stopped, 1e-3f);
+    // The tempo still follows
+    CHECK_NEAR(f.Bpm(), 120.f, 0.1f);
+
+    f.Message(0xfb, 0);
+    CHECK(f.IsRunning());
+    clock.Tick();
+    CHECK_NEAR(f.Process(clock.TrueTime(96)), 48.f, 1e-3f);
+}
+
+TEST(StopBeforeStartDisablesAutoStart)
+{
+    MidiClockFollower f;
+    Clock             clock(f, 120.f, 0.f);
+    f.Message(0xfc, 0);
+    for(int i = 0; i < 10; i++)
+        clock.Tick();
+    CHECK(!f.IsRunning());
+    CHECK(f.Process(clock.TrueTime(9)) < 0.f);
+
+    f.Message(0xfa, 0);
+    clock.Tick();
+    CHECK(f.IsRunning());
+    CHECK_NEAR(f.Process(clock.TrueTime(10)), 0.f, 1e-3f);
+}
+
+TEST(StartGoesBackToZero)
+{
+    MidiClockFollower f;
+    Clock             clock(f, 120.f, 0.f);
+    f.Message(0xfa, 0);
+    for(int i = 0; i < 30; i++)
+        clock.Tick();
+    CHECK(f.Process(clock.TrueTime(29)) > 28.f);
+
+    f.Message(0xfc, 0);
+    f.Message(0xfa, 0);
+    clock.Tick();
+    CHECK_NEAR(f.Process(clock.TrueTime(30)), 0.f, 1e-3f);
+}
@@ -0,0 +1,184 @@
+/** CvCalibrationTable against a double precision piecewise linear reference */
+
+#include <math.h>
+#include "test.h"
+#include "../../lib/util/cv_calibration.h"
+
+using namespace daisy::dpt;
+
+static CvCalibrationPoints Points(const float* codes, const float* volts, int n)
+{
+    CvCalibrationPoints p;
+    p.Set(codes, volts, n);
+    return p;
+}
+
+/** Piecewise linear through the points sorted by volts, end segments extended */
+static double Reference(const CvCalibrationPoints& p, double v)
+{
+    int    n = p.num_points;
+    int    order[CvCalibrationPoints::kMaxPoints];
+    for(int i = 0; i < n; i++)
+        order[i] = i;
+    for(int i = 1; i < n; i++)
+        for(int j = i; j > 0 && p.volts[order[j - 1]] > p.volts[order[j]]; j--)
+        {
+            int t        = order[j];
+            order[j]     = order[j - 1];
+            order[j - 1] = t;
+        }
+    int k = 0;
+    while(k < n - 2 && v >= p.volts[order[k + 1]])
+        k++;
+    double v0 = p.volts[order[k]], v1 = p.volts[order[k + 1]];
+    double c0 = p.code[order[k]], c1 = p.code[order[k + 1]];
+    double code = c0 + (v - v0) * (c1 - c0) / (v1 - v0);
+    return code < 0.0 ? 0.0 : (code > 4095.0 ? 4095.0 : code);
+}
+
+/** Largest difference from the reference, in codes, over -12V to 12V */
+static double MaxError(const CvCalibrationTable& t, const CvCalibrationPoints& p)
+{
+    double worst = 0.0;
+    for(int i = -120000; i <= 120000; i++)
+    {
+        float  v   = i * 1e-4f;
+        double err = fabs(t.Convert(v) - floor(Reference(p, v)));
+        worst      = err > worst ? err : worst;
+    }
+    return worst;
+}
+
+TEST(NominalMatchesUncalibrated)
+{
+    CvCalibrationPoints p;
+    p.SetNominal(kCvCodesPerVolt, kCvCodeOffset);
+    CvCalibrationTable t;
+    CHECK(t.Build(p));
+    int worst = 0;
+    for(int i = -80000; i <= 120000; i++)
+    {
+        float v = i * 1e-4f;
+        int   d = abs((int)t.Convert(v) - (int)CvVoltageToCode(v));
+        worst   = d > worst ? d : worst;
+    }
+    // Only where float rounding decides the truncation
+    CHECK(worst <= 1);
+}
+
+TEST(MeasuredPointsConvertExactly)
+{
+    // Uneven spacing and a bend in the middle, like a real output stage
+    const float codes[] = {0, 400, 1100, 2000, 2048, 2900, 3500, 4000, 4095};
+    const float volts[] = {-5.02f, -3.55f, -1.01f, 2.31f, 2.49f, 5.60f, 7.83f, 9.66f, 10.01f};
+    CvCalibrationPoints p = Points(codes, volts, 9);
+    CvCalibrationTable  t;
+    CHECK(t.Build(p));
+    for(int i = 0; i < 9; i++)
+        CHECK_EQ(t.Convert(volts[i]), (uint16_t)codes[i]);
+    CHECK(MaxError(t, p) <= 1.0);
+}
+
+TEST(BreakpointsOnCellBoundaries)
+{
+    // 9 evenly spaced points put every breakpoint on a table step boundary
+    float codes[9], volts[9];
+    for(int i = 0; i < 9; i++)
+    {
+        volts[i] = -4.f + i;
+        codes[i] = 100.f + i * 400.f + (i & 1) * 37.f;
+    }
+    CvCalibrationPoints p = Points(codes, volts, 9);
+    CvCalibrationTable  t;
+    CHECK(t.Build(p));
+    for(int i = 0; i < 9; i++)
+    {
+        CHECK_EQ(t.Convert(volts[i]), (uint16_t)codes[i]);
+        // Just below a breakpoint is still on the segment before it
+        float below = nextafterf(volts[i], -100.f);
+        CHECK_NEAR(t.Convert(below), Reference(p, below), 1.0);
+    }
+    CHECK(MaxError(t, p) <= 1.0);
+}
+
+TEST(ExtrapolatesPastTheMeasuredSpan)
+{
+    // Measured only between codes 1000 and 3000: the rest of the DAC range
+    // has to stay reachable along the end slopes
+    const float codes[] = {1000, 2000, 3000};
+    const float volts[] = {-1.30f, 2.40f, 6.05f};
+    CvCalibrationPoints p = Points(codes, volts, 3);
+    CvCalibrationTable  t;
+    CHECK(t.Build(p));
+
+    CHECK_EQ(t.Convert(-20.f), 0);
+    CHECK_EQ(t.Convert(20.f), 4095);
+    // 500 codes past either end, along that end's slope
+    float below = -1.30f - 500.f * (3.70f / 1000.f);
+    float above = 6.05f + 500.f * (3.65f / 1000.f);
+    CHECK_NEAR(t.Convert(below), 500.0, 1.0);
+    CHECK_NEAR(t.Convert(above), 3500.0, 1.0);
+    CHECK(MaxError(t, p) <= 1.0);
+}
+
+TEST(InvertedOutput)
+{
+    // The DAC7554 stage: code goes down as volts go up
+    const float codes[] = {0, 1024, 2048, 3072, 4095};
+    const float volts[] = {7.04f, 3.49f, -0.02f, -3.52f, -6.97f};
+    CvCalibrationPoints p = Points(codes, volts, 5);
+    CvCalibrationTable  t;
+    CHECK(t.Build(p));
+    for(int i = 0; i < 5; i++)
+        CHECK_EQ(t.Convert(volts[i]), (uint16_t)codes[i]);
+    CHECK_EQ(t.Convert(-10.f), 4095);
+    CHECK_EQ(t.Convert(10.f), 0);
+
+    uint16_t last     = 4095;
+    bool     monotonic = true;
+    for(int i = -100000; i <= 100000; i++)
+    {
+        uint16_t c = t.Convert(i * 1e-4f);
+        monotonic  = monotonic && c <= last;
+        last       = c;
+    }
+    CHECK(monotonic);
+    CHECK(MaxError(t, p) <= 1.0);
+}
+
+TEST(BlockMatchesSingle)
+{
+    const float codes[] = {0, 2000, 4095};
+    const float volts[] = {-5.f, 2.4f, 10.f};
+    CvCalibrationTable t;
+    CHECK(t.Build(Points(codes, volts, 3)));
+    float    in[64];
+    uint16_t out[64];
+    for(int i = 0; i < 64; i++)
+        in[i] = -8.f + i * 0.3f;
+    t.ConvertBlock(in, out, 64);
+    for(int i = 0; i < 64; i++)
+        CHECK_EQ(out[i], t.Convert(in[i]));
+}
+
+TEST(RejectsUnusablePoints)
+{
+    CvCalibrationTable t;
+    const float        codes[] = {0, 2000, 4095};
+    const float        flat[]  = {-5.f, -5.f, 10.f};
+    const float        bent[]  = {-5.f, 6.f, 2.f};
+    CHECK(!t.Build(Points(codes, flat, 1)));
+    CHECK(!t.Build(Points(codes, flat, 3)));
+    CHECK(!t.Build(Points(codes, bent, 3)));
+}
+
+TEST(StoredBlockChecksum)
+{
+    CvCalibrationData d;
+    d.SetDefaults();
+    CHECK(d.IsValid());
+    d.outputs[CV_CAL_EXP_2].volts[0] += 0.01f;
+    CHECK(!d.IsValid());
+    d.UpdateChecksum();
+    CHECK(d.IsValid());
+}
@@ -0,0 +1,125 @@
+/** The saturating block conversion gives the same codes as the float clamp */
+
+#include <float.h>
+#include <vector>
+#include "test.h"
+#include "../../lib/util/cv_code.h"
+
+using namespace daisy::dpt;
+
+struct Scaling
+{
+    const char* name;
+    float       scale, offset;
+};
+
+static const Scaling kScalings[] = {
+    {"internal", kCvCodesPerVolt, kCvCodeOffset},
+    {"expander", kCvExpCodesPerVolt, kCvExpCodeOffset},
+};
+
+/** Converts in with both block paths and counts codes that differ from the float path */
+static uint32_t Mismatches(const std::vector<float>& in, const Scaling& s)
+{
+    // Offset by one halfword, so both the alignment step and the paired stores run
+    std::vector<uint16_t> buf(in.size() + 1), plain(in.size());
+    uint16_t*             out = buf.data() + 1;
+    LinearToCodeBlockSat(in.data(), out, in.size(), s.scale, s.offset);
+    LinearToCodeBlock(in.data(), plain.data(), in.size(), s.scale, s.offset);
+    uint32_t mismatches = 0;
+    for(size_t i = 0; i < in.size(); i++)
+    {
+        uint16_t ref = LinearToCodeFloat(in[i], s.scale, s.offset);
+        if(out[i] != ref || plain[i] != ref
+           || LinearToCodeSat(in[i], s.scale, s.offset) != ref)
+        {
+            if(mismatches++ < 5)
+                printf("    %s: %.9g V -> %u, float path %u\n",
+                       s.name,
+                       in[i],
+                       out[i],
+                       ref);
+        }
+    }
+    return mismatches;
+}
+
+TEST(SweepMatchesFloatPath)
+{
+    // 10uV steps over well past both ranges
+    std::vector<float> in;
+    for(int i = -2000000; i <= 2000000; i++)
+        in.push_back(i * 1e-5f);
+    for(const Scaling& s : kScalings)
+        CHECK_EQ(Mismatches(in, s), 0u);
+}
+
+TEST(CodeBoundariesMatchFloatPath)
+{
+    // The floats either side of every code edge, where truncation decides
+    for(const Scaling& s : kScalings)
+    {
+        std::vector<float> in;
+        for(int code = -2; code <= 4098; code++)
+        {
+            float v = (code - s.offset) / s.scale;
+            in.push_back(nextafterf(v, -FLT_MAX));
+            in.push_back(v);
+            in.push_back(nextafterf(v, FLT_MAX));
+        }
+        CHECK_EQ(Mismatches(in, s), 0u);
+    }
+}
+
+TEST(EveryFloatExponentMatchesFloatPath)
+{
+    // A stride over all 2^32 bit patterns: every exponent, both signs,
+    // denormals, infinities and NaNs
+    std::vector<float> in;
+    for(uint64_t bits = 0; bits < (1ull << 32); bits += 65537)
+    {
+        uint32_t b = (uint32_t)bits;
+        float    f;
+        memcpy(&f, &b, sizeof(f));
+        in.push_back(f);
+    }
+    for(const Scaling& s : kScalings)
+        CHECK_EQ(Mismatches(in, s), 0u);
+}
+
+TEST(OutOfRangeSaturates)
+{
+    const float big[] = {-1e30f, -100.f, -7.5f, 10.5f, 100.f, 1e30f, INFINITY, -INFINITY, NAN};
+    for(float v : big)
+    {
+        uint16_t code = CvVoltageToCode(v);
+        CHECK(code == 0 || code == 4095);
+    }
+    CHECK_EQ(CvVoltageToCode(-5.f), 0);
+    CHECK_EQ(CvVoltageToCode(20.f), 4095);
+    CHECK_EQ(CvVoltageToCode(NAN), 0);
+    // The expander is inverted
+    CHECK_EQ(CvExpVoltageToCode(-7.f), 4095);
+    CHECK_EQ(CvExpVoltageToCode(7.f), 0);
+}
+
+TEST(BlockHandlesEverySizeAndAlignment)
+{
+    float in[16];
+    for(int i = 0; i < 16; i++)
+        in[i] = -6.f + i;
+    for(size_t skew = 0; skew < 2; skew++)
+        for(size_t size = 0; size <= 16; size++)
+        {
+            uint16_t buf[20];
+            for(uint16_t& b : buf)
+                b = 0xbeef;
+            uint16_t* out = buf + 1 + skew;
+            LinearToCodeBlockSat(in, out, size, kCvCodesPerVolt, kCvCodeOffset);
+            for(size_t i = 0; i < size; i++)
+                CHECK_EQ(out[i], CvVoltageToCode(in[i]));
+            // Nothing written past the end or before the start
+            CHECK_EQ(out[size], 0xbeef);
+            CHECK_EQ(out[-1], 0xbeef);
+        }
+}
@@ -0,0 +1,64 @@
+/** Dac7554 command word packing, for both transfer modes */
+
+#include "test.h"
+#include "../../lib/dev/DAC7554.h"
+
+using daisy::Dac7554;
+
+TEST(CommandWordLayout)
+{
+    // 0b10 write-and-update, 2 address bits, 12 data bits
+    CHECK_EQ(Dac7554::Command(0, 0), 0x8000);
+    CHECK_EQ(Dac7554::Command(1, 0x123), 0x9123);
+    CHECK_EQ(Dac7554::Command(2, 0xfff), 0xafff);
+    CHECK_EQ(Dac7554::Command(3, 0x800), 0xb800);
+}
+
+TEST(CommandMasksOutOfRange)
+{
+    // Codes past 12 bits or channels past 3 can't reach the control bits
+    CHECK_EQ(Dac7554::Command(0, 0x1fff), 0x8fff);
+    CHECK_EQ(Dac7554::Command(1, 0xffff), 0x9fff);
+    CHECK_EQ(Dac7554::Command(5, 0x001), 0x9001);
+}
+
+TEST(PackBytesIsBigEndian)
+{
+    Dac7554::Value values[Dac7554::Channels] = {0x001, 0x234, 0xfff, 0x800};
+    uint8_t        buf[2 * Dac7554::Channels + 1];
+    buf[2 * Dac7554::Channels] = 0x5a;
+    Dac7554::PackBytes(values, buf);
+
+    const uint8_t expected[2 * Dac7554::Channels]
+        = {0x80, 0x01, 0x92, 0x34, 0xaf, 0xff, 0xb8, 0x00};
+    for(int i = 0; i < 2 * Dac7554::Channels; i++)
+        CHECK_EQ(buf[i], expected[i]);
+    CHECK_EQ(buf[2 * Dac7554::Channels], 0x5a);
+}
+
+TEST(PackWordsMatchesCommand)
+{
+    Dac7554::Value values[Dac7554::Channels] = {0x001, 0x234, 0xfff, 0x800};
+    uint16_t       buf[Dac7554::Channels];
+    Dac7554::PackWords(values, buf);
+    for(int i = 0; i < Dac7554::Channels; i++)
+        CHECK_EQ(buf[i], Dac7554::Command(i, values[i]));
+}
+
+TEST(BothModesPutTheSameBitsOnTheWire)
+{
+    // 16-bit frames go out MSB first, so a word is its two bytes in order
+    Dac7554::Value values[Dac7554::Channels];
+    uint8_t        bytes[2 * Dac7554::Channels];
+    uint16_t       words[Dac7554::Channels];
+    for(uint32_t code = 0; code < 4096; code += 7)
+    {
+        for(int i = 0; i < Dac7554::Channels; i++)
+            values[i] = (code + 1000 * i) & 0xfff;
+        Dac7554::PackBytes(values, bytes);
+        Dac7554::PackWords(values, words);
+        for(int i = 0; i < Dac7554::Channels; i++)
+            CHECK_EQ((uint16_t)((bytes[2 * i] << 8) | bytes[2 * i + 1]),
+                     words[i]);
+    }
+}
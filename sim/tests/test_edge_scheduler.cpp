@@ -0,0 +1,200 @@
+/** GateEdgeScheduler ordering, same-time coalescing and overflow */
+
+#include <algorithm>
+#include <vector>
+#include "test.h"
+#include "../../lib/util/edge_scheduler.h"
+
+using namespace daisy::dpt;
+
+typedef GateEdgeScheduler<32> Scheduler;
+
+struct Applied
+{
+    uint32_t time;
+    uint8_t  gate;
+    bool     state;
+};
+
+/** Runs the scheduler dry one due time at a time, like the TIM3 one-shot does,
+ *  and records every edge with the time it was applied at */
+struct Recorder
+{
+    std::vector<Applied> edges;
+    uint32_t             now;
+
+    static void Apply(uint8_t gate, bool state, void* context)
+    {
+        Recorder* self = static_cast<Recorder*>(context);
+        self->edges.push_back({self->now, gate, state});
+    }
+
+    void Drain(Scheduler& s)
+    {
+        while(s.Next(&now))
+            s.Process(now, Apply, this);
+    }
+};
+
+/** Deterministic scheduling order */
+static uint32_t Next(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+TEST(AppliesInTimeOrder)
+{
+    Scheduler             s;
+    Recorder              r;
+    std::vector<uint32_t> times;
+    uint32_t              rng = 1;
+    for(int i = 0; i < 32; i++)
+    {
+        uint32_t t = 1000 + Next(rng) % 100000;
+        times.push_back(t);
+        CHECK(s.Schedule(t, i & 1, i & 2));
+    }
+    r.Drain(s);
+    CHECK_EQ(s.Size(), 0u);
+    CHECK_EQ(r.edges.size(), 32u);
+    std::sort(times.begin(), times.end());
+    for(size_t i = 0; i < r.edges.size() && i < times.size(); i++)
+        CHECK_EQ(r.edges[i].time, times[i]);
+}
+
+TEST(OrderSurvivesClockWrap)
+{
+    Scheduler s;
+    Recorder  r;
+    // Scheduled out of order around the 32 bit wrap
+    const uint32_t times[] = {5, 0xfffffff0u, 100, 0xffffff00u, 0, 0xffffffffu};
+    for(size_t i = 0; i < 6; i++)
+        s.Schedule(times[i], 0, i & 1);
+    r.Drain(s);
+    const uint32_t order[] = {0xffffff00u, 0xfffffff0u, 0xffffffffu, 0, 5, 100};
+    CHECK_EQ(r.edges.size(), 6u);
+    for(size_t i = 0; i < r.edges.size() && i < 6; i++)
+        CHECK_EQ(r.edges[i].time, order[i]);
+}
+
+TEST(ProcessOnlyAppliesDueEdges)
+{
+    Scheduler s;
+    Recorder  r;
+    s.Schedule(300, 0, false);
+    s.Schedule(100, 0, true);
+    s.Schedule(200, 1, true);
+
+    uint32_t next = 0;
+    CHECK(s.Next(&next));
+    CHECK_EQ(next, 100u);
+    r.now = 99;
+    CHECK_EQ(s.Process(99, Recorder::Apply, &r), 0u);
+    r.now = 250;
+    CHECK_EQ(s.Process(250, Recorder::Apply, &r), 2u);
+    CHECK(s.Next(&next));
+    CHECK_EQ(next, 300u);
+    // Oldest first within one call
+    CHECK_EQ(r.edges.size(), 2u);
+    if(r.edges.size() == 2)
+    {
+        CHECK(r.edges[0].gate == 0 && r.edges[0].state);
+        CHECK(r.edges[1].gate == 1 && r.edges[1].state);
+    }
+}
+
+TEST(SameTimeSameGateCoalesces)
+{
+    Scheduler s;
+    Recorder  r;
+    CHECK(s.Schedule(100, 0, true));
+    CHECK(s.Schedule(100, 0, false));
+    CHECK(s.Schedule(100, 0, true));
+    CHECK_EQ(s.Size(), 1u);
+    r.Drain(s);
+    CHECK_EQ(r.edges.size(), 1u);
+    if(r.edges.size() == 1)
+        CHECK(r.edges[0].state); // the last one scheduled wins
+}
+
+TEST(SameTimeOtherGateIsKept)
+{
+    Scheduler s;
+    Recorder  r;
+    s.Schedule(100, 0, true);
+    s.Schedule(100, 1, false);
+    CHECK_EQ(s.Size(), 2u);
+    r.Drain(s);
+    CHECK_EQ(r.edges.size(), 2u);
+    bool seen[2] = {false, false};
+    for(const Applied& e : r.edges)
+    {
+        CHECK_EQ(e.time, 100u);
+        seen[e.gate] = true;
+        CHECK_EQ(e.state, e.gate == 0);
+    }
+    CHECK(seen[0] && seen[1]);
+}
+
+TEST(BackToBackPulsesStayHigh)
+{
+    Scheduler s;
+    Recorder  r;
+    // Three 10ms triggers end to end, as a 100Hz clock with 100% width would
+    for(int i = 0; i < 3; i++)
+        CHECK(s.Pulse(1000 + i * 10000, 0, 10000));
+    // The falling edges of the first two landed on the next rising edges
+    CHECK_EQ(s.Size(), 4u);
+    r.Drain(s);
+
+    bool     high  = false;
+    int      falls = 0;
+    uint32_t last  = 0;
+    for(const Applied& e : r.edges)
+    {
+        falls += high && !e.state;
+        high = e.state;
+        last = e.time;
+    }
+    CHECK_EQ(falls, 1);
+    CHECK(!high);
+    CHECK_EQ(last, 31000u);
+}
+
+TEST(FullHeapDropsWholePulses)
+{
+    GateEdgeScheduler<5> s;
+    CHECK(s.Pulse(100, 0, 10));
+    CHECK(s.Pulse(200, 0, 10));
+    // One slot left, a pulse needs two
+    CHECK(!s.Pulse(300, 0, 10));
+    CHECK_EQ(s.Size(), 4u);
+    CHECK_EQ(s.Dropped(), 2u);
+    CHECK(s.Schedule(300, 1, true));
+    CHECK(!s.Schedule(400, 1, false));
+    CHECK_EQ(s.Dropped(), 3u);
+    // Coalescing needs no room
+    CHECK(s.Schedule(300, 1, false));
+}
+
+TEST(CancelKeepsOtherGatesInOrder)
+{
+    Scheduler s;
+    Recorder  r;
+    uint32_t  rng = 7;
+    for(int i = 0; i < 30; i++)
+        s.Schedule(Next(rng) % 5000, i % 3, true);
+    s.Cancel(1);
+    CHECK_EQ(s.Size(), 20u);
+    r.Drain(s);
+    CHECK_EQ(r.edges.size(), 20u);
+    for(size_t i = 0; i < r.edges.size(); i++)
+    {
+        CHECK(r.edges[i].gate != 1);
+        if(i > 0)
+            CHECK(r.edges[i].time >= r.edges[i - 1].time);
+    }
+}
@@ -0,0 +1,134 @@
+/** FrameExchange handoff, with the transfer completion mocked */
+
+#include <atomic>
+#include <thread>
+#include "test.h"
+#include "../../lib/util/frame_exchange.h"
+
+using daisy::dpt::FrameExchange;
+
+typedef FrameExchange<uint32_t, 4> Exchange;
+
+static const uint32_t* Publish(Exchange& ex, uint32_t value)
+{
+    uint32_t* f = ex.WriteFrame();
+    for(int i = 0; i < 4; i++)
+        f[i] = value;
+    return ex.Publish();
+}
+
+TEST(FirstPublishOwnsTheBus)
+{
+    Exchange        ex;
+    const uint32_t* tx = Publish(ex, 1);
+    CHECK(tx != nullptr);
+    CHECK_EQ(tx[0], 1u);
+    CHECK(ex.IsBusy());
+
+    CHECK(ex.Complete() == nullptr);
+    CHECK(!ex.IsBusy());
+    CHECK_EQ(ex.Sent(), 1u);
+    CHECK_EQ(ex.Coalesced(), 0u);
+}
+
+TEST(PublishWhileBusyIsPickedUpOnCompletion)
+{
+    Exchange ex;
+    CHECK(Publish(ex, 1) != nullptr);
+    CHECK(Publish(ex, 2) == nullptr);
+
+    const uint32_t* tx = ex.Complete();
+    CHECK(tx != nullptr);
+    CHECK_EQ(tx[3], 2u);
+    CHECK(ex.IsBusy());
+    CHECK(ex.Complete() == nullptr);
+    CHECK_EQ(ex.Sent(), 2u);
+}
+
+TEST(PendingFramesCoalesceToTheNewest)
+{
+    Exchange ex;
+    CHECK(Publish(ex, 1) != nullptr);
+    for(uint32_t v = 2; v <= 5; v++)
+        CHECK(Publish(ex, v) == nullptr);
+
+    // 2, 3 and 4 were replaced before they went out
+    CHECK_EQ(ex.Coalesced(), 3u);
+    const uint32_t* tx = ex.Complete();
+    CHECK(tx != nullptr);
+    CHECK_EQ(tx[0], 5u);
+    CHECK(ex.Complete() == nullptr);
+    CHECK_EQ(ex.Sent(), 2u);
+}
+
+TEST(TheFrameInFlightIsNeverTheWriteFrame)
+{
+    Exchange        ex;
+    const uint32_t* tx = Publish(ex, 1);
+    for(uint32_t v = 2; v < 10; v++)
+    {
+        CHECK(ex.WriteFrame() != tx);
+        Publish(ex, v);
+        CHECK_EQ(tx[0], v - 1);
+        tx = ex.Complete();
+    }
+}
+
+TEST(AbortDropsTheFrameAndFreesTheBus)
+{
+    Exchange ex;
+    CHECK(Publish(ex, 1) != nullptr);
+    ex.Abort();
+    CHECK(!ex.IsBusy());
+    CHECK_EQ(ex.Dropped(), 1u);
+
+    // The next publish starts a transfer again
+    const uint32_t* tx = Publish(ex, 2);
+    CHECK(tx != nullptr);
+    CHECK_EQ(tx[0], 2u);
+}
+
+TEST(ConcurrentProducerAndCompletion)
+{
+    // The completion thread stands in for the DMA IRQ. Every frame it sees
+    // has to be whole (never torn by the producer) and newer than the last.
+    Exchange              ex;
+    std::atomic<bool>     done(false);
+    std::atomic<uint32_t> torn(0), reordered(0), sent(0);
+    std::atomic<const uint32_t*> in_flight(nullptr);
+    const uint32_t        kFrames = 200000;
+
+    std::thread completion([&] {
+        uint32_t last = 0;
+        while(!done.load() || in_flight.load())
+        {
+            const uint32_t* tx = in_flight.exchange(nullptr);
+            while(tx)
+            {
+                for(int i = 1; i < 4; i++)
+                    if(tx[i] != tx[0])
+                        torn++;
+                if(tx[0] <= last)
+                    reordered++;
+                last = tx[0];
+                sent++;
+                tx = ex.Complete();
+            }
+        }
+    });
+
+    for(uint32_t v = 1; v <= kFrames; v++)
+    {
+        const uint32_t* tx = Publish(ex, v);
+        if(tx)
+            in_flight.store(tx);
+    }
+    done.store(true);
+    completion.join();
+
+    CHECK_EQ(torn.load(), 0u);
+    CHECK_EQ(reordered.load(), 0u);
+    CHECK(!ex.IsBusy());
+    CHECK_EQ(ex.Sent(), sent.load());
+    CHECK_EQ(ex.Sent() + ex.Coalesced(), kFrames);
+}
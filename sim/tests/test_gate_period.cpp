@@ -0,0 +1,149 @@
+/** GatePeriodEstimator on jittered clock edges */
+
+#include <math.h>
+#include "test.h"
+#include "../../lib/util/gate_period.h"
+
+using daisy::dpt::GatePeriodEstimator;
+
+/** Deterministic edge jitter, uniform in +-amplitude */
+struct Jitter
+{
+    uint32_t state = 88172645u;
+    float    operator()(float amplitude)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return amplitude * ((state & 0xffff) / 32767.5f - 1.f);
+    }
+};
+
+/** Clock edges on microsecond timestamps, each one late or early by jitter */
+struct GateClock
+{
+    GatePeriodEstimator& estimator;
+    Jitter               jitter;
+    double               period_us;
+    double               jitter_us;
+    double               time_us;
+
+    GateClock(GatePeriodEstimator& e, float bpm, float jitter_fraction)
+    : estimator(e),
+      period_us(60e6 / bpm),
+      jitter_us(jitter_fraction * period_us),
+      time_us(1000.0)
+    {
+    }
+
+    void Edge(double offset_us = 0.0)
+    {
+        estimator.Edge((uint32_t)(time_us + offset_us + jitter(jitter_us)));
+        time_us += period_us;
+    }
+};
+
+TEST(FirstIntervalGivesThePeriod)
+{
+    GatePeriodEstimator e;
+    CHECK_EQ(e.Period(), 0.f);
+    e.Edge(1000);
+    CHECK_EQ(e.Period(), 0.f);
+    e.Edge(501000);
+    CHECK_NEAR(e.Period(), 0.5f, 1e-6f);
+    CHECK_NEAR(e.Bpm(), 120.f, 1e-3f);
+    CHECK_NEAR(e.Bpm(4), 30.f, 1e-3f);
+}
+
+TEST(SettlesOnJitteredEdges)
+{
+    GatePeriodEstimator e;
+    GateClock           clock(e, 120.f, 0.02f); // edges +-10ms off at 120 BPM
+    float               worst = 0.f;
+    for(int i = 0; i < 200; i++)
+    {
+        clock.Edge();
+        if(i >= 20)
+            worst = fmaxf(worst, fabsf(e.Bpm() - 120.f));
+    }
+    // Intervals are off by up to 4%, the estimate by much less
+    CHECK(worst < 1.2f);
+    printf("  +-2%% edge jitter at 120 BPM: worst error %.2f BPM\n", worst);
+}
+
+TEST(OneLateEdgeDoesNotMoveIt)
+{
+    GatePeriodEstimator e;
+    GateClock           clock(e, 120.f, 0.f);
+    for(int i = 0; i < 10; i++)
+        clock.Edge();
+    // 40% late: one long interval, then one short one
+    clock.Edge(0.4 * clock.period_us);
+    CHECK_NEAR(e.Bpm(), 120.f, 1e-3f);
+    clock.Edge();
+    CHECK_NEAR(e.Bpm(), 120.f, 1e-3f);
+}
+
+TEST(MissedEdgeDoesNotMoveIt)
+{
+    GatePeriodEstimator e;
+    GateClock           clock(e, 120.f, 0.f);
+    for(int i = 0; i < 10; i++)
+        clock.Edge();
+    clock.time_us += clock.period_us;
+    clock.Edge();
+    CHECK_NEAR(e.Bpm(), 120.f, 1e-3f);
+}
+
+TEST(TempoJumpTakesAMajority)
+{
+    GatePeriodEstimator e;
+    GateClock           clock(e, 120.f, 0.01f);
+    for(int i = 0; i < 20; i++)
+        clock.Edge();
+
+    // The next edge is already due a 120 BPM period on, move it to 90
+    clock.time_us += 60e6 / 90.0 - clock.period_us;
+    clock.period_us = 60e6 / 90.0;
+    clock.Edge();
+    clock.Edge();
+    // Two new intervals out of five, the median is still the old tempo
+    CHECK_NEAR(e.Bpm(), 120.f, 2.f);
+    clock.Edge();
+    // Three: taken at once, not smoothed towards
+    CHECK_NEAR(e.Bpm(), 90.f, 2.f);
+}
+
+TEST(BounceIsIgnored)
+{
+    GatePeriodEstimator e;
+    GateClock           clock(e, 120.f, 0.f);
+    for(int i = 0; i < 10; i++)
+    {
+        clock.Edge();
+        // A bouncing contact: two more edges within the 2ms minimum
+        uint32_t last = e.Last();
+        e.Edge(last + 300);
+        e.Edge(last + 1500);
+        CHECK_EQ(e.Last(), last);
+    }
+    CHECK_NEAR(e.Bpm(), 120.f, 1e-3f);
+}
+
+TEST(LongGapStartsOver)
+{
+    GatePeriodEstimator e;
+    GateClock           clock(e, 120.f, 0.f);
+    for(int i = 0; i < 10; i++)
+        clock.Edge();
+    CHECK(e.IsRunning((uint32_t)clock.time_us));
+    CHECK(!e.IsRunning((uint32_t)(clock.time_us + 2 * clock.period_us)));
+
+    // Unplugged for 5s, then a 60 BPM clock
+    clock.time_us += 5e6;
+    clock.period_us = 1e6;
+    clock.Edge();
+    CHECK_NEAR(e.Bpm(), 120.f, 1e-3f);
+    clock.Edge();
+    CHECK_NEAR(e.Bpm(), 60.f, 1e-3f);
+}
@@ -0,0 +1,131 @@
+/** MIDISend() batching: MidiRunningStatusEncoder::EncodeBatch on the output queue */
+
+#include <vector>
+#include "test.h"
+#include "../../lib/util/midi_encoder.h"
+#include "../../lib/util/midi_parser.h"
+#include "../../lib/util/spsc_queue.h"
+
+using namespace daisy::dpt;
+
+static MidiMessage Msg(uint8_t status, int d0 = -1, int d1 = -1)
+{
+    MidiMessage m = {};
+    m.status      = status;
+    m.size        = d1 >= 0 ? 2 : (d0 >= 0 ? 1 : 0);
+    if(d0 >= 0)
+        m.data[0] = d0;
+    if(d1 >= 0)
+        m.data[1] = d1;
+    return m;
+}
+
+static bool Same(const MidiMessage& a, const MidiMessage& b)
+{
+    return a.status == b.status && a.size == b.size
+           && (a.size < 1 || a.data[0] == b.data[0])
+           && (a.size < 2 || a.data[1] == b.data[1]);
+}
+
+/** Sends batches of at most buffer_size bytes until the queue is empty,
+ *  as the DMA completions would, and collects the bytes on the line
+ */
+template <size_t N>
+static std::vector<uint8_t> SendAll(MidiRunningStatusEncoder& encoder,
+                                    SpscQueue<MidiMessage, N>& queue,
+                                    size_t                     buffer_size,
+                                    std::vector<size_t>*       batches)
+{
+    std::vector<uint8_t> line;
+    std::vector<uint8_t> buf(buffer_size);
+    size_t               n;
+    while((n = encoder.EncodeBatch(queue, buf.data(), buf.size())) > 0)
+    {
+        batches->push_back(n);
+        line.insert(line.end(), buf.begin(), buf.begin() + n);
+    }
+    return line;
+}
+
+TEST(BatchStopsBeforeOverflow)
+{
+    MidiRunningStatusEncoder   encoder;
+    SpscQueue<MidiMessage, 64> queue;
+    // Different channels, so every message takes 3 bytes
+    for(int i = 0; i < 10; i++)
+        CHECK(queue.Push(Msg(0x90 | (i & 1), 60 + i, 100)));
+
+    uint8_t buf[10];
+    size_t  n = encoder.EncodeBatch(queue, buf, sizeof(buf));
+    // 3 messages fit, a 4th could need bytes 9..11
+    CHECK_EQ(n, 9u);
+    CHECK_EQ(queue.Size(), 7u);
+    CHECK_EQ(buf[0], 0x90);
+    CHECK_EQ(buf[3], 0x91);
+}
+
+TEST(EmptyQueueSendsNothing)
+{
+    MidiRunningStatusEncoder   encoder;
+    SpscQueue<MidiMessage, 16> queue;
+    uint8_t                    buf[16];
+    CHECK_EQ(encoder.EncodeBatch(queue, buf, sizeof(buf)), 0u);
+}
+
+TEST(BatchesParseBackInOrder)
+{
+    MidiRunningStatusEncoder    encoder;
+    SpscQueue<MidiMessage, 128> queue;
+    std::vector<MidiMessage>    sent;
+    for(int i = 0; i < 100; i++)
+    {
+        MidiMessage m;
+        switch(i % 5)
+        {
+            case 0: m = Msg(0x90, i, 100); break;
+            case 1: m = Msg(0x90, i, 0); break;
+            case 2: m = Msg(0xf8); break;
+            case 3: m = Msg(0xb2, 1, i); break;
+            default: m = Msg(0xc2, i); break;
+        }
+        sent.push_back(m);
+        CHECK(queue.Push(m));
+    }
+
+    std::vector<size_t>  batches;
+    std::vector<uint8_t> line = SendAll(encoder, queue, 16, &batches);
+    CHECK(batches.size() > 1);
+    for(size_t n : batches)
+        CHECK(n <= 16u);
+    CHECK_EQ(queue.Size(), 0u);
+
+    // Running status carries across batches, the line doesn't go idle between them
+    CHECK(line.size() < sent.size() * 3);
+
+    MidiByteParser           parser;
+    std::vector<MidiMessage> got;
+    MidiMessage              msg = {};
+    for(uint8_t b : line)
+        if(parser.Parse(b, &msg))
+            got.push_back(msg);
+    CHECK_EQ(got.size(), sent.size());
+    for(size_t i = 0; i < got.size() && i < sent.size(); i++)
+        CHECK(Same(got[i], sent[i]));
+    CHECK_EQ(parser.Errors(), 0u);
+}
+
+TEST(ResetAfterLostBatchResendsStatus)
+{
+    MidiRunningStatusEncoder   encoder;
+    SpscQueue<MidiMessage, 16> queue;
+    uint8_t                    buf[3];
+    queue.Push(Msg(0x90, 60, 100));
+    queue.Push(Msg(0x90, 62, 100));
+
+    CHECK_EQ(encoder.EncodeBatch(queue, buf, sizeof(buf)), 3u);
+    // The transfer failed, FlushMidiOut resets the encoder
+    encoder.Reset();
+    CHECK_EQ(encoder.EncodeBatch(queue, buf, sizeof(buf)), 3u);
+    CHECK_EQ(buf[0], 0x90);
+    CHECK_EQ(buf[1], 62);
+}
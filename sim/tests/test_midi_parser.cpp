@@ -0,0 +1,203 @@
+/** MidiByteParser on byte streams, and MidiRunningStatusEncoder against it */
+
+#include <vector>
+#include "test.h"
+#include "../../lib/util/midi_encoder.h"
+#include "../../lib/util/midi_parser.h"
+
+using namespace daisy::dpt;
+
+/** Every message the parser completes from bytes */
+static std::vector<MidiMessage> Parse(MidiByteParser&                 parser,
+                                      std::initializer_list<uint8_t> bytes)
+{
+    std::vector<MidiMessage> out;
+    MidiMessage              msg;
+    for(uint8_t b : bytes)
+        if(parser.Parse(b, &msg))
+            out.push_back(msg);
+    return out;
+}
+
+static bool Is(const MidiMessage& m, uint8_t status, int d0 = -1, int d1 = -1)
+{
+    int size = d1 >= 0 ? 2 : (d0 >= 0 ? 1 : 0);
+    return m.status == status && m.size == size && (size < 1 || m.data[0] == d0)
+           && (size < 2 || m.data[1] == d1);
+}
+
+TEST(RunningStatus)
+{
+    MidiByteParser p;
+    auto m = Parse(p, {0x90, 60, 100, 62, 101, 64, 0, 0xc3, 5, 6});
+    CHECK_EQ(m.size(), 5u);
+    CHECK(Is(m[0], 0x90, 60, 100));
+    CHECK(Is(m[1], 0x90, 62, 101));
+    CHECK(Is(m[2], 0x90, 64, 0));
+    // One data byte messages run too
+    CHECK(Is(m[3], 0xc3, 5));
+    CHECK(Is(m[4], 0xc3, 6));
+    CHECK_EQ(p.Errors(), 0u);
+}
+
+TEST(RealTimeInsideAMessage)
+{
+    MidiByteParser p;
+    // Clock between status and data, start between the data bytes
+    auto m = Parse(p, {0x90, 0xf8, 60, 0xfa, 100, 0xfe});
+    CHECK_EQ(m.size(), 4u);
+    CHECK(Is(m[0], 0xf8));
+    CHECK(Is(m[1], 0xfa));
+    CHECK(Is(m[2], 0x90, 60, 100));
+    CHECK(Is(m[3], 0xfe));
+
+    // Running status survives it as well
+    m = Parse(p, {62, 0xf8, 90});
+    CHECK_EQ(m.size(), 2u);
+    CHECK(Is(m[0], 0xf8));
+    CHECK(Is(m[1], 0x90, 62, 90));
+    CHECK_EQ(p.Errors(), 0u);
+}
+
+TEST(SysExIsSkipped)
+{
+    MidiByteParser p;
+    auto m = Parse(p, {0xf0, 0x7e, 0x7f, 0x06, 0x01, 0xf7, 0xb0, 7, 100});
+    CHECK_EQ(m.size(), 1u);
+    CHECK(Is(m[0], 0xb0, 7, 100));
+    CHECK_EQ(p.Errors(), 0u);
+
+    // Real-time still comes through from inside a dump
+    m = Parse(p, {0xf0, 0x43, 0xf8, 0x10, 0xf7});
+    CHECK_EQ(m.size(), 1u);
+    CHECK(Is(m[0], 0xf8));
+}
+
+TEST(TruncatedSysExEndsAtTheNextStatus)
+{
+    MidiByteParser p;
+    // No F7: the note-on ends the dump and parses normally
+    auto m = Parse(p, {0xf0, 0x7e, 0x01, 0x02, 0x90, 60, 100, 61, 100});
+    CHECK_EQ(m.size(), 2u);
+    CHECK(Is(m[0], 0x90, 60, 100));
+    CHECK(Is(m[1], 0x90, 61, 100));
+    CHECK_EQ(p.Errors(), 0u);
+
+    // A dump cut off in the middle of running status doesn't resume it
+    m = Parse(p, {0xf0, 0x01, 0xf7, 62, 100});
+    CHECK_EQ(m.size(), 0u);
+    CHECK_EQ(p.Errors(), 2u);
+}
+
+TEST(SystemCommonCancelsRunningStatus)
+{
+    MidiByteParser p;
+    auto m = Parse(p, {0x90, 60, 100, 0xf6, 61, 100});
+    CHECK_EQ(m.size(), 2u);
+    CHECK(Is(m[1], 0xf6));
+    CHECK_EQ(p.Errors(), 2u);
+
+    m = Parse(p, {0xf2, 0x10, 0x20, 0xf1, 0x35, 0xf3, 4});
+    CHECK_EQ(m.size(), 3u);
+    CHECK(Is(m[0], 0xf2, 0x10, 0x20));
+    CHECK(Is(m[1], 0xf1, 0x35));
+    CHECK(Is(m[2], 0xf3, 4));
+}
+
+TEST(InterruptedMessageIsDropped)
+{
+    MidiByteParser p;
+    // Note-on missing its velocity, replaced by a CC
+    auto m = Parse(p, {0x90, 60, 0xb1, 1, 64});
+    CHECK_EQ(m.size(), 1u);
+    CHECK(Is(m[0], 0xb1, 1, 64));
+    // Undefined system bytes are ignored, stray data counted
+    m = Parse(p, {0xf4, 0xf5, 1});
+    CHECK_EQ(m.size(), 0u);
+    CHECK_EQ(p.Errors(), 1u);
+}
+
+TEST(FuzzedBytesGiveWellFormedMessages)
+{
+    MidiByteParser p;
+    uint32_t       rng = 7, bad = 0, count = 0;
+    MidiMessage    msg;
+    for(int i = 0; i < 1000000; i++)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        if(!p.Parse(rng >> 24, &msg))
+            continue;
+        count++;
+        bool ok = (msg.status & 0x80) && msg.size <= 2 && msg.status != 0xf0
+                  && msg.status != 0xf7;
+        for(int j = 0; j < msg.size; j++)
+            ok = ok && msg.data[j] < 0x80;
+        bad += ok ? 0 : 1;
+    }
+    CHECK(count > 0);
+    CHECK_EQ(bad, 0u);
+}
+
+TEST(EncoderRoundTripsThroughTheParser)
+{
+    MidiRunningStatusEncoder enc;
+    MidiByteParser           p;
+    uint32_t                 rng = 3, mismatches = 0;
+    size_t                   bytes = 0, messages = 0, plain = 0;
+    for(int i = 0; i < 100000; i++)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        MidiMessage in;
+        switch((rng >> 28) & 7)
+        {
+            case 0: in = {0xf8, {0, 0}, 0}; break;
+            case 1: in = {0xf2, {(uint8_t)(rng & 0x7f), 3}, 2}; break;
+            case 2: in = {(uint8_t)(0xc0 | (rng & 1)), {(uint8_t)(rng >> 8 & 0x7f), 0}, 1}; break;
+            default:
+                in = {(uint8_t)(0x90 | ((rng >> 20) & 1)),
+                      {(uint8_t)(rng >> 8 & 0x7f), (uint8_t)(rng & 0x7f)},
+                      2};
+                break;
+        }
+        uint8_t buf[MidiRunningStatusEncoder::kMaxMessageBytes];
+        size_t  n = enc.Encode(in, buf);
+        bytes += n;
+        plain += 1 + in.size;
+        messages++;
+
+        MidiMessage out  = {};
+        bool        done = false;
+        for(size_t j = 0; j < n; j++)
+            done = p.Parse(buf[j], &out);
+        if(!done || out.status != in.status || out.size != in.size
+           || (in.size > 0 && out.data[0] != in.data[0])
+           || (in.size > 1 && out.data[1] != in.data[1]))
+            mismatches++;
+    }
+    CHECK_EQ(mismatches, 0u);
+    CHECK_EQ(p.Errors(), 0u);
+    // Runs on two channels still save something
+    CHECK(bytes < plain);
+}
+
+TEST(EncoderRunningStatusRules)
+{
+    MidiRunningStatusEncoder enc;
+    uint8_t                  buf[3];
+    MidiMessage              on = {0x90, {60, 100}, 2};
+    CHECK_EQ(enc.Encode(on, buf), 3u);
+    CHECK_EQ(enc.Encode(on, buf), 2u);
+    // Real-time leaves it alone
+    MidiMessage clock = {0xf8, {0, 0}, 0};
+    CHECK_EQ(enc.Encode(clock, buf), 1u);
+    CHECK_EQ(enc.Encode(on, buf), 2u);
+    // System common cancels it
+    MidiMessage tune = {0xf6, {0, 0}, 0};
+    CHECK_EQ(enc.Encode(tune, buf), 1u);
+    CHECK_EQ(enc.Encode(on, buf), 3u);
+    // So does Reset(), and data bytes are masked to 7 bits
+    enc.Reset();
+    MidiMessage loud = {0x90, {60, 0xff}, 2};
+    CHECK_EQ(enc.Encode(loud, buf), 3u);
+    CHECK_EQ(buf[2], 0x7f);
+}
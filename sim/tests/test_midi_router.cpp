@@ -0,0 +1,213 @@
+/** MidiRouter rules, with mock outputs, and the TRS + USB merge DPT builds on it */
+
+#include <vector>
+#include "test.h"
+#include "../../lib/util/midi_encoder.h"
+#include "../../lib/util/midi_parser.h"
+#include "../../lib/util/midi_router.h"
+#include "../../lib/util/spsc_queue.h"
+
+using namespace daisy::dpt;
+
+static MidiMessage Msg(uint8_t status, int d0 = -1, int d1 = -1)
+{
+    MidiMessage m = {};
+    m.status      = status;
+    m.size        = d1 >= 0 ? 2 : (d0 >= 0 ? 1 : 0);
+    if(d0 >= 0)
+        m.data[0] = d0;
+    if(d1 >= 0)
+        m.data[1] = d1;
+    return m;
+}
+
+static bool Same(const MidiMessage& a, const MidiMessage& b)
+{
+    return a.status == b.status && a.size == b.size
+           && (a.size < 1 || a.data[0] == b.data[0])
+           && (a.size < 2 || a.data[1] == b.data[1]);
+}
+
+/** What the app stream holds, like TimedMidiEvent */
+struct Received
+{
+    int         port;
+    uint32_t    time;
+    MidiMessage msg;
+};
+
+/** Mock ports and the app queue, wired up like DPT::StartMidiRouter */
+struct Rig
+{
+    MidiRouter               router;
+    std::vector<MidiMessage> out[MIDI_PORT_LAST];
+    SpscQueue<Received, 64>  app;
+
+    Rig()
+    {
+        router.SetOutput(MIDI_PORT_TRS, Output, &out[MIDI_PORT_TRS]);
+        router.SetOutput(MIDI_PORT_USB, Output, &out[MIDI_PORT_USB]);
+    }
+
+    static void Output(const MidiMessage& msg, void* context)
+    {
+        static_cast<std::vector<MidiMessage>*>(context)->push_back(msg);
+    }
+
+    /** DPT::Impl::RouteMidiIn */
+    void In(int port, const MidiMessage& msg, uint32_t time = 0)
+    {
+        if(router.Process(port, msg))
+            app.Push({port, time, msg});
+    }
+
+    std::vector<Received> App()
+    {
+        std::vector<Received> events;
+        Received              r;
+        while(app.Pop(&r))
+            events.push_back(r);
+        return events;
+    }
+};
+
+TEST(DefaultIsAppOnly)
+{
+    Rig rig;
+    rig.In(MIDI_PORT_TRS, Msg(0x90, 60, 100));
+    rig.In(MIDI_PORT_USB, Msg(0xb3, 1, 2));
+    CHECK_EQ(rig.App().size(), 2u);
+    CHECK_EQ(rig.out[MIDI_PORT_TRS].size(), 0u);
+    CHECK_EQ(rig.out[MIDI_PORT_USB].size(), 0u);
+}
+
+TEST(PerPortChannelMapping)
+{
+    Rig rig;
+    // TRS channel 1 goes to USB instead of the app, all note and CC messages
+    for(uint8_t kind = 0x80; kind < 0xf0; kind += 0x10)
+        rig.router.SetRoute(MIDI_PORT_TRS, kind, kind, MIDI_ROUTE_USB);
+    // TRS channel 2 goes to both
+    for(uint8_t kind = 0x81; kind < 0xf0; kind += 0x10)
+        rig.router.AddRoute(MIDI_PORT_TRS, kind, kind, MIDI_ROUTE_USB);
+    // USB channel 10 is dropped, the rest of USB is untouched
+    for(uint8_t kind = 0x89; kind < 0xf0; kind += 0x10)
+        rig.router.Filter(MIDI_PORT_USB, kind, kind);
+
+    rig.In(MIDI_PORT_TRS, Msg(0x90, 60, 100));
+    rig.In(MIDI_PORT_TRS, Msg(0xb0, 7, 127));
+    rig.In(MIDI_PORT_TRS, Msg(0x91, 62, 100));
+    rig.In(MIDI_PORT_TRS, Msg(0x92, 64, 100));
+    rig.In(MIDI_PORT_USB, Msg(0x99, 36, 100));
+    rig.In(MIDI_PORT_USB, Msg(0x90, 48, 100));
+
+    std::vector<MidiMessage>& usb = rig.out[MIDI_PORT_USB];
+    CHECK_EQ(usb.size(), 3u);
+    if(usb.size() == 3)
+    {
+        CHECK(Same(usb[0], Msg(0x90, 60, 100)));
+        CHECK(Same(usb[1], Msg(0xb0, 7, 127)));
+        CHECK(Same(usb[2], Msg(0x91, 62, 100)));
+    }
+    CHECK_EQ(rig.out[MIDI_PORT_TRS].size(), 0u);
+
+    std::vector<Received> app = rig.App();
+    CHECK_EQ(app.size(), 3u);
+    if(app.size() == 3)
+    {
+        CHECK(Same(app[0].msg, Msg(0x91, 62, 100)));
+        CHECK(Same(app[1].msg, Msg(0x92, 64, 100)));
+        CHECK_EQ(app[2].port, (int)MIDI_PORT_USB);
+        CHECK(Same(app[2].msg, Msg(0x90, 48, 100)));
+    }
+
+    // Rules are per port, the same status on the other input is unaffected
+    CHECK_EQ(rig.router.Route(MIDI_PORT_USB, 0x90), MIDI_ROUTE_APP);
+    CHECK_EQ(rig.router.Route(MIDI_PORT_TRS, 0x93), MIDI_ROUTE_APP);
+    CHECK_EQ(rig.router.Route(MIDI_PORT_USB, 0x99), MIDI_ROUTE_NONE);
+}
+
+TEST(ThruBothWaysDoesNotEcho)
+{
+    Rig rig;
+    rig.router.Thru(MIDI_PORT_USB, MIDI_PORT_TRS, true);
+    rig.router.Thru(MIDI_PORT_TRS, MIDI_PORT_USB, true);
+    rig.In(MIDI_PORT_TRS, Msg(0x90, 60, 100));
+    rig.In(MIDI_PORT_USB, Msg(0x80, 60, 0));
+    CHECK_EQ(rig.out[MIDI_PORT_USB].size(), 1u);
+    CHECK_EQ(rig.out[MIDI_PORT_TRS].size(), 1u);
+    CHECK_EQ(rig.App().size(), 2u);
+
+    rig.router.Thru(MIDI_PORT_TRS, MIDI_PORT_USB, false);
+    rig.In(MIDI_PORT_TRS, Msg(0x90, 61, 100));
+    CHECK_EQ(rig.out[MIDI_PORT_USB].size(), 1u);
+    CHECK_EQ(rig.router.Route(MIDI_PORT_TRS, 0x90), MIDI_ROUTE_APP);
+}
+
+TEST(TrsUsbMerge)
+{
+    Rig rig;
+    // Both inputs merge into the TRS output and the app
+    rig.router.Thru(MIDI_PORT_TRS, MIDI_PORT_TRS, true);
+    rig.router.Thru(MIDI_PORT_USB, MIDI_PORT_TRS, true);
+
+    // TRS arrives as bytes (running status, a clock in the middle of a
+    // message), USB as whole messages in between
+    MidiByteParser           parser;
+    MidiMessage              msg   = {};
+    const uint8_t            trs[] = {0x90, 60, 100, 62, 0xf8, 101, 0xb0, 1, 64};
+    uint32_t                 time  = 0;
+    std::vector<MidiMessage> expected;
+    for(uint8_t b : trs)
+    {
+        time += 32;
+        if(parser.Parse(b, &msg))
+        {
+            rig.In(MIDI_PORT_TRS, msg, time);
+            expected.push_back(msg);
+            MidiMessage usb = Msg(0x90, 70 + (int)expected.size(), 90);
+            rig.In(MIDI_PORT_USB, usb, time + 1);
+            expected.push_back(usb);
+        }
+    }
+    rig.In(MIDI_PORT_USB, Msg(0xfc), time + 2);
+    expected.push_back(Msg(0xfc));
+
+    std::vector<MidiMessage>& out = rig.out[MIDI_PORT_TRS];
+    CHECK_EQ(out.size(), expected.size());
+    for(size_t i = 0; i < out.size() && i < expected.size(); i++)
+        CHECK(Same(out[i], expected[i]));
+
+    // The app gets the same merge, tagged by port and in time order
+    std::vector<Received> app = rig.App();
+    CHECK_EQ(app.size(), expected.size());
+    for(size_t i = 0; i < app.size() && i < expected.size(); i++)
+    {
+        CHECK(Same(app[i].msg, expected[i]));
+        CHECK_EQ(app[i].port, (int)(i % 2 == 0 && i + 1 < app.size() ? MIDI_PORT_TRS
+                                                                     : MIDI_PORT_USB));
+        if(i > 0)
+            CHECK(app[i].time >= app[i - 1].time);
+    }
+    // The clock inside the running status note came out first
+    if(app.size() > 2)
+        CHECK(Same(app[2].msg, Msg(0xf8)));
+
+    // Merged into one running status stream, it still parses back as sent
+    MidiRunningStatusEncoder encoder;
+    std::vector<uint8_t>     line;
+    uint8_t                  buf[MidiRunningStatusEncoder::kMaxMessageBytes];
+    for(const MidiMessage& m : out)
+    {
+        size_t n = encoder.Encode(m, buf);
+        line.insert(line.end(), buf, buf + n);
+    }
+    MidiByteParser           back;
+    std::vector<MidiMessage> parsed;
+    for(uint8_t b : line)
+        if(back.Parse(b, &msg))
+            parsed.push_back(msg);
+    CHECK_EQ(parsed.size(), out.size());
+    for(size_t i = 0; i < parsed.size() && i < out.size(); i++)
+        CHECK(Same(parsed[i], out[i]));
+}
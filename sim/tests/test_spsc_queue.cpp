@@ -0,0 +1,99 @@
+/** SpscQueue: capacity, wraparound and two threads */
+
+#include <thread>
+#include "test.h"
+#include "../../lib/util/spsc_queue.h"
+
+using daisy::dpt::SpscQueue;
+
+TEST(HoldsNMinusOneAndCountsDrops)
+{
+    SpscQueue<int, 8> q;
+    CHECK(q.IsEmpty());
+    for(int i = 0; i < 7; i++)
+        CHECK(q.Push(i));
+    CHECK_EQ(q.Size(), 7u);
+    CHECK(!q.Push(7));
+    CHECK(!q.Push(8));
+    CHECK_EQ(q.Dropped(), 2u);
+
+    // The items already in are untouched by the failed pushes
+    int v = -1;
+    for(int i = 0; i < 7; i++)
+    {
+        CHECK(q.Pop(&v));
+        CHECK_EQ(v, i);
+    }
+    CHECK(!q.Pop(&v));
+    CHECK(q.IsEmpty());
+}
+
+TEST(WrapsAroundTheBuffer)
+{
+    // Interleaved pushes and pops walk the indices round many times
+    SpscQueue<int, 4> q;
+    int               next_in = 0, next_out = 0, mismatches = 0;
+    for(int round = 0; round < 1000; round++)
+    {
+        int n = 1 + round % 3;
+        for(int i = 0; i < n; i++)
+            CHECK(q.Push(next_in++));
+        for(int i = 0; i < n; i++)
+        {
+            int v = -1;
+            q.Pop(&v);
+            mismatches += v != next_out++;
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(q.Dropped(), 0u);
+}
+
+TEST(FullAfterWrapping)
+{
+    SpscQueue<int, 4> q;
+    int               v = -1;
+    for(int i = 0; i < 5; i++)
+    {
+        q.Push(i);
+        q.Pop(&v);
+    }
+    CHECK(q.Push(10) && q.Push(11) && q.Push(12));
+    CHECK(!q.Push(13));
+    CHECK_EQ(q.Size(), 3u);
+    const int* peek = q.Peek();
+    CHECK(peek && *peek == 10);
+    q.Pop();
+    CHECK(q.Push(13));
+    for(int i = 11; i <= 13; i++)
+    {
+        CHECK(q.Pop(&v));
+        CHECK_EQ(v, i);
+    }
+}
+
+TEST(ProducerAndConsumerThreads)
+{
+    // Small queue, so both the full and the empty case happen a lot
+    SpscQueue<uint32_t, 16> q;
+    const uint32_t          kItems = 1000000;
+
+    std::thread producer([&] {
+        for(uint32_t i = 0; i < kItems;)
+            if(q.Push(i))
+                i++;
+            else
+                std::this_thread::yield();
+    });
+
+    uint32_t expected = 0, mismatches = 0, v = 0;
+    while(expected < kItems)
+        if(q.Pop(&v))
+            mismatches += v != expected++;
+        else
+            std::this_thread::yield();
+    producer.join();
+
+    CHECK_EQ(mismatches, 0u);
+    CHECK(q.IsEmpty());
+}
@@ -0,0 +1,186 @@
+/** TimerDivision for the task timers, and PeriodicTaskScheduler rates */
+
+#include <math.h>
+#include "test.h"
+#include "../../lib/util/task_scheduler.h"
+
+using namespace daisy::dpt;
+
+/** TIM2-7 input clock at the Patch SM's 100MHz PCLK1 */
+static const float kTimerClock = 200e6f;
+
+TEST(SlowRateOn16BitTimerUsesPrescaler)
+{
+    uint32_t psc = 0, arr = 0;
+    // 60Hz is 3.33M timer clocks, far more than a 16 bit ARR holds
+    float rate = TimerDivision(kTimerClock, 60.f, 0xffff, &psc, &arr);
+    CHECK(arr <= 0xffffu);
+    CHECK(psc <= 0xffffu);
+    CHECK(psc > 0u);
+    CHECK_NEAR(rate, 60.f, 60.f * 1e-4f);
+    CHECK_NEAR(kTimerClock / ((psc + 1.f) * (arr + 1.f)), rate, 1e-3f);
+    // The smallest prescaler that fits, for the finest period steps
+    CHECK((arr + 1) * (uint64_t)psc < 3333333u);
+}
+
+TEST(FastRateNeedsNoPrescaler)
+{
+    uint32_t psc = 1, arr = 0;
+    float    rate = TimerDivision(kTimerClock, 48000.f, 0xffff, &psc, &arr);
+    CHECK_EQ(psc, 0u);
+    CHECK_EQ(arr, 4167u - 1u); // 4166.7 clocks, rounded
+    CHECK_NEAR(rate, 48000.f, 10.f);
+}
+
+TEST(ThirtyTwoBitTimerKeepsFullResolution)
+{
+    uint32_t psc = 1, arr = 0;
+    float    rate = TimerDivision(kTimerClock, 60.f, 0xffffffff, &psc, &arr);
+    CHECK_EQ(psc, 0u);
+    CHECK_NEAR((float)arr, 3333332.f, 2.f);
+    CHECK_NEAR(rate, 60.f, 1e-3f);
+}
+
+TEST(EveryRateFitsA16BitTimer)
+{
+    bool fits = true, nearest = true;
+    for(float hz = 0.1f; hz < 100000.f; hz *= 1.07f)
+    {
+        uint32_t psc = 0, arr = 0;
+        float    rate = TimerDivision(kTimerClock, hz, 0xffff, &psc, &arr);
+        fits          = fits && rate > 0.f && arr <= 0xffffu && psc <= 0xffffu;
+        // Off by no more than half a period step
+        nearest = nearest && fabsf(rate - hz) / hz <= 0.5f / (arr + 1.f) + 1e-6f;
+        // and slow rates keep steps finer than 1 in 30000
+        nearest = nearest && (psc == 0 || arr >= 30000);
+    }
+    CHECK(fits);
+    CHECK(nearest);
+}
+
+TEST(OutOfReachRates)
+{
+    uint32_t psc = 0, arr = 0;
+    CHECK_EQ(TimerDivision(kTimerClock, 0.f, 0xffff, &psc, &arr), 0.f);
+    CHECK_EQ(TimerDivision(kTimerClock, 0.01f, 0xffff, &psc, &arr), 0.f);
+    CHECK_EQ(TimerDivision(kTimerClock, 1e9f, 0xffff, &psc, &arr), 0.f);
+}
+
+typedef PeriodicTaskScheduler<8> Scheduler;
+
+/** Counts runs, and the tick of each run */
+struct Counter
+{
+    static uint32_t now;
+    uint32_t        runs  = 0;
+    uint32_t        first = 0, last = 0;
+    uint32_t        min_gap = ~0u, max_gap = 0;
+
+    static void Run(void* context)
+    {
+        Counter* c = static_cast<Counter*>(context);
+        if(c->runs == 0)
+            c->first = now;
+        else
+        {
+            uint32_t gap = now - c->last;
+            c->min_gap   = gap < c->min_gap ? gap : c->min_gap;
+            c->max_gap   = gap > c->max_gap ? gap : c->max_gap;
+        }
+        c->last = now;
+        c->runs++;
+    }
+};
+uint32_t Counter::now = 0;
+
+static void Run(Scheduler& s, uint32_t ticks)
+{
+    for(uint32_t i = 0; i < ticks; i++)
+    {
+        Counter::now++;
+        s.Tick();
+    }
+}
+
+TEST(RateThatDoesNotDivideIsExactOnAverage)
+{
+    Scheduler s;
+    Counter   fast, slow;
+    Counter::now = 0;
+    s.Add(Counter::Run, &fast, 1000.f);
+    int id = s.Add(Counter::Run, &slow, 700.f);
+    CHECK_NEAR(s.TickRate(), 1000.f, 1e-3f);
+    CHECK_NEAR(s.Rate(id), 700.f, 1e-3f);
+
+    Run(s, 10000); // 10s at 1kHz
+    CHECK_EQ(fast.runs, 10000u);
+    CHECK_EQ(slow.runs, 7000u);
+    // Lands on ticks, one or two apart
+    CHECK_EQ(slow.min_gap, 1u);
+    CHECK_EQ(slow.max_gap, 2u);
+}
+
+TEST(OddRatesKeepTheirAverage)
+{
+    const float rates[] = {48000.f, 1000.f, 733.3f, 60.f, 0.5f, 16000.f, 47999.f};
+    Scheduler   s;
+    Counter     c[7];
+    Counter::now = 0;
+    for(int i = 0; i < 7; i++)
+        CHECK(s.Add(Counter::Run, &c[i], rates[i]) >= 0);
+
+    const uint32_t ticks = 48000 * 20; // 20s
+    Run(s, ticks);
+    for(int i = 0; i < 7; i++)
+    {
+        float expected = rates[i] * 20.f;
+        CHECK_NEAR((float)c[i].runs, expected, 1.f);
+    }
+}
+
+TEST(DividingRatesRunEveryDividerTicks)
+{
+    Scheduler s;
+    Counter   a, b, c;
+    Counter::now = 0;
+    s.Add(Counter::Run, &a, 48000.f);
+    int id_b = s.Add(Counter::Run, &b, 1000.f);
+    int id_c = s.Add(Counter::Run, &c, 1000.f);
+    CHECK_EQ(s.Divider(id_b), 48u);
+    Run(s, 48000);
+    CHECK_EQ(b.runs, 1000u);
+    CHECK_EQ(b.min_gap, 48u);
+    CHECK_EQ(b.max_gap, 48u);
+    CHECK_EQ(c.min_gap, 48u);
+    CHECK_EQ(c.max_gap, 48u);
+    // Staggered, not on the same tick
+    CHECK(s.Phase(id_b) != s.Phase(id_c));
+    CHECK(b.last % 48 != c.last % 48);
+}
+
+TEST(FasterTaskKeepsSlowOnesOnRate)
+{
+    Scheduler s;
+    Counter   slow, fast;
+    Counter::now = 0;
+    int id = s.Add(Counter::Run, &slow, 100.f);
+    Run(s, 50); // half way through a 100Hz tick
+    // Now the tick runs at 1kHz, the 100Hz task must stay at 100Hz
+    s.Add(Counter::Run, &fast, 1000.f);
+    CHECK_EQ(s.Divider(id), 10u);
+    uint32_t before = slow.runs;
+    Run(s, 10000);
+    CHECK_NEAR((float)(slow.runs - before), 1000.f, 1.f);
+    CHECK_EQ(slow.max_gap, 10u);
+}
+
+TEST(RejectsRatesOutOfRange)
+{
+    Scheduler s;
+    Counter   c;
+    CHECK_EQ(s.Add(Counter::Run, &c, 0.f), -1);
+    CHECK_EQ(s.Add(Counter::Run, &c, -5.f), -1);
+    CHECK_EQ(s.Add(Counter::Run, &c, 2e6f), -1);
+    CHECK_EQ(s.Add(nullptr, &c, 100.f), -1);
+    CHECK(s.Add(Counter::Run, &c, Scheduler::kMaxRate) >= 0);
+}
@@ -0,0 +1,123 @@
+/** Timestamped events through SpscQueue and PopDue, like DPT::QueueMidiEvent
+ *  and DPT::NextMidiEvent */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "test.h"
+#include "../../lib/util/spsc_queue.h"
+
+using namespace daisy::dpt;
+
+struct Event
+{
+    uint32_t time;
+    uint32_t id;
+};
+
+TEST(DueEventsComeOutWithTheirOffset)
+{
+    SpscQueue<Event, 8> q;
+    Event               e;
+    size_t              offset;
+    q.Push({100, 1});
+    q.Push({131, 2});
+    q.Push({132, 3});
+
+    // Block 68..99: nothing due yet
+    CHECK(!PopDue(q, 68, 32, &e, &offset));
+    // Block 100..131
+    CHECK(PopDue(q, 100, 32, &e, &offset));
+    CHECK_EQ(e.id, 1u);
+    CHECK_EQ(offset, 0u);
+    CHECK(PopDue(q, 100, 32, &e, &offset));
+    CHECK_EQ(e.id, 2u);
+    CHECK_EQ(offset, 31u);
+    CHECK(!PopDue(q, 100, 32, &e, &offset));
+    CHECK_EQ(q.Size(), 1u);
+}
+
+TEST(LateEventsPlayAtTheStart)
+{
+    SpscQueue<Event, 8> q;
+    Event               e;
+    size_t              offset = 99;
+    q.Push({10, 1});
+    CHECK(PopDue(q, 500, 32, &e, &offset));
+    CHECK_EQ(offset, 0u);
+}
+
+TEST(ClockWrapsAround)
+{
+    SpscQueue<Event, 8> q;
+    Event               e;
+    size_t              offset;
+    q.Push({0xfffffff0u, 1});
+    q.Push({0x00000004u, 2});
+    CHECK(PopDue(q, 0xffffffe8u, 32, &e, &offset));
+    CHECK_EQ(offset, 8u);
+    CHECK(PopDue(q, 0xffffffe8u, 32, &e, &offset));
+    CHECK_EQ(e.id, 2u);
+    CHECK_EQ(offset, 28u);
+}
+
+TEST(ConcurrentProducerAndAudioCallback)
+{
+    // The audio thread advances a sample clock a block at a time and
+    // drains what is due. The producer stamps events with the clock plus
+    // one block, like QueueMidiEvent. Each event has to come out once, in
+    // order, at the offset its time asks for (or 0 if it was late).
+    const size_t          kBlock  = 32;
+    const uint32_t        kEvents = 200000;
+    SpscQueue<Event, 64>  q;
+    std::atomic<uint32_t> clock(0xffff0000u); // wraps during the run
+    std::atomic<bool>     done(false);
+    uint32_t              sent = 0;
+
+    std::thread producer([&] {
+        for(uint32_t id = 0; id < kEvents;)
+        {
+            Event e = {clock.load() + (uint32_t)kBlock, id};
+            if(q.Push(e))
+                id++;
+            else
+                std::this_thread::yield();
+        }
+        sent = kEvents;
+        done.store(true);
+    });
+
+    uint32_t next_id = 0, reordered = 0, wrong_offset = 0, early = 0;
+    uint32_t late = 0;
+    while(!done.load() || !q.IsEmpty())
+    {
+        uint32_t start = clock.load();
+        Event    e;
+        size_t   offset;
+        while(PopDue(q, start, kBlock, &e, &offset))
+        {
+            int32_t delta = (int32_t)(e.time - start);
+            reordered += e.id != next_id;
+            next_id = e.id + 1;
+            if(delta < 0)
+            {
+                late++;
+                wrong_offset += offset != 0;
+            }
+            else
+                wrong_offset += offset != (size_t)delta;
+            early += delta >= (int32_t)kBlock;
+        }
+        clock.store(start + kBlock);
+    }
+    producer.join();
+
+    CHECK_EQ(next_id, sent);
+    CHECK_EQ(reordered, 0u);
+    CHECK_EQ(wrong_offset, 0u);
+    CHECK_EQ(early, 0u);
+    printf("  %u events, %u late, %u pushes found the queue full\n",
+           kEvents,
+           late,
+           (unsigned)q.Dropped());
+}
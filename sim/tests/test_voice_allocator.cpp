@@ -0,0 +1,203 @@
+/** VoiceAllocator driven by scripted MIDI, through MidiByteParser */
+
+#include <set>
+#include <vector>
+#include "test.h"
+#include "../../lib/util/midi_parser.h"
+#include "../../lib/util/voice_allocator.h"
+
+using namespace daisy::dpt;
+
+typedef VoiceAllocator<4> Allocator;
+
+/** Feeds MIDI bytes to the allocator like MegaBasic's HandleNote, and keeps
+ *  the voice each note-on got, -1 if it was dropped */
+struct Player
+{
+    Allocator        voices;
+    MidiByteParser   parser;
+    std::vector<int> assigned;
+
+    void Play(std::initializer_list<uint8_t> bytes)
+    {
+        MidiMessage msg;
+        for(uint8_t b : bytes)
+        {
+            if(!parser.Parse(b, &msg))
+                continue;
+            uint8_t kind = msg.status & 0xf0, channel = msg.status & 0x0f;
+            if(kind == 0x90 && msg.data[1] > 0)
+                assigned.push_back(voices.NoteOn(channel, msg.data[0], msg.data[1]));
+            else if(kind == 0x80 || kind == 0x90)
+                voices.NoteOff(channel, msg.data[0]);
+        }
+    }
+};
+
+/** The active table lists every non-free voice exactly once */
+static bool Consistent(const Allocator& a)
+{
+    std::set<int> seen;
+    for(size_t i = 0; i < a.NumActive(); i++)
+    {
+        int v = a.Active(i);
+        if(a.GetVoice(v).state == Allocator::State::FREE || !seen.insert(v).second)
+            return false;
+    }
+    for(int v = 0; v < 4; v++)
+        if(a.GetVoice(v).state != Allocator::State::FREE && !seen.count(v))
+            return false;
+    return true;
+}
+
+TEST(ChordTakesFreeVoicesInOrder)
+{
+    Player p;
+    // C major triad with running status, then the same notes off as note-on 0
+    p.Play({0x90, 60, 100, 64, 100, 67, 100});
+    CHECK_EQ(p.assigned.size(), 3u);
+    CHECK_EQ(p.assigned[0], 0);
+    CHECK_EQ(p.assigned[1], 1);
+    CHECK_EQ(p.assigned[2], 2);
+    CHECK_EQ(p.voices.NumActive(), 3u);
+    CHECK(Consistent(p.voices));
+
+    p.Play({60, 0, 64, 0, 67, 0});
+    for(int v = 0; v < 3; v++)
+        CHECK(p.voices.GetVoice(v).state == Allocator::State::RELEASED);
+    // Released voices keep sounding until freed
+    CHECK_EQ(p.voices.NumActive(), 3u);
+}
+
+TEST(RepeatedNoteReusesItsVoice)
+{
+    Player p;
+    p.Play({0x90, 60, 100, 0x80, 60, 0, 0x90, 60, 90});
+    CHECK_EQ(p.assigned.size(), 2u);
+    CHECK_EQ(p.assigned[0], p.assigned[1]);
+    CHECK_EQ(p.voices.NumActive(), 1u);
+    CHECK_EQ(p.voices.GetVoice(p.assigned[1]).velocity, 90);
+
+    // The same note on another channel is another voice
+    p.Play({0x91, 60, 100});
+    CHECK(p.assigned[2] != p.assigned[0]);
+}
+
+TEST(ReleasedVoicesAreTakenBeforeHeldOnes)
+{
+    Player p;
+    p.Play({0x90, 60, 100, 61, 100, 62, 100, 63, 100});
+    // 61 then 62 released, 61 first
+    p.Play({0x80, 61, 0, 62, 0});
+    p.Play({0x90, 70, 100});
+    CHECK_EQ(p.assigned.back(), 1);
+    p.Play({0x90, 71, 100});
+    CHECK_EQ(p.assigned.back(), 2);
+    CHECK(Consistent(p.voices));
+}
+
+TEST(StealOldestHeld)
+{
+    Player p;
+    p.voices.Init(Allocator::Steal::OLDEST);
+    p.Play({0x90, 60, 100, 61, 100, 62, 100, 63, 100, 64, 100});
+    CHECK_EQ(p.assigned.back(), 0);
+    CHECK_EQ(p.voices.GetVoice(0).note, 64);
+    // 60 lost its voice, its note-off does nothing
+    p.Play({0x80, 60, 0});
+    CHECK(p.voices.GetVoice(0).state == Allocator::State::HELD);
+    // Next steal is the next oldest
+    p.Play({0x90, 65, 100});
+    CHECK_EQ(p.assigned.back(), 1);
+}
+
+TEST(StealQuietest)
+{
+    Player p;
+    p.voices.Init(Allocator::Steal::QUIETEST);
+    p.Play({0x90, 60, 100, 61, 20, 62, 100, 63, 100});
+    p.Play({0x90, 64, 100});
+    CHECK_EQ(p.assigned.back(), 1);
+
+    // Levels reported by the voices override velocity
+    p.voices.SetLevel(3, 0.01f);
+    p.Play({0x90, 65, 100});
+    CHECK_EQ(p.assigned.back(), 3);
+}
+
+TEST(StealNoneDropsTheNote)
+{
+    Player p;
+    p.voices.Init(Allocator::Steal::NONE);
+    p.Play({0x90, 60, 100, 61, 100, 62, 100, 63, 100, 64, 100});
+    CHECK_EQ(p.assigned.back(), -1);
+    for(int v = 0; v < 4; v++)
+        CHECK_EQ(p.voices.GetVoice(v).note, 60 + v);
+}
+
+TEST(FreeKeepsTheActiveTableCompact)
+{
+    Player p;
+    p.Play({0x90, 60, 100, 61, 100, 62, 100, 63, 100});
+    p.voices.Free(1);
+    CHECK_EQ(p.voices.NumActive(), 3u);
+    CHECK(Consistent(p.voices));
+    // Freeing twice is harmless
+    p.voices.Free(1);
+    CHECK_EQ(p.voices.NumActive(), 3u);
+    // The freed voice is the one handed out next
+    p.Play({0x90, 70, 100});
+    CHECK_EQ(p.assigned.back(), 1);
+    CHECK(Consistent(p.voices));
+}
+
+TEST(AllNotesOffReleasesEverything)
+{
+    Player p;
+    p.Play({0x90, 60, 100, 61, 100, 0x95, 62, 100});
+    p.voices.AllNotesOff();
+    for(size_t i = 0; i < p.voices.NumActive(); i++)
+        CHECK(p.voices.GetVoice(p.voices.Active(i)).state
+              == Allocator::State::RELEASED);
+}
+
+TEST(RandomScriptKeepsInvariants)
+{
+    // Random notes on two channels, with voices finishing their release at
+    // random. Every held voice must be a note the script is holding.
+    Player                        p;
+    std::set<std::pair<int, int>> held;
+    uint32_t                      rng = 1;
+    auto next = [&rng](uint32_t n) {
+        rng = rng * 1664525u + 1013904223u;
+        return (rng >> 8) % n;
+    };
+    bool ok = true;
+    for(int step = 0; step < 20000 && ok; step++)
+    {
+        uint8_t ch = next(2), note = 48 + next(12);
+        switch(next(3))
+        {
+            case 0:
+                p.Play({(uint8_t)(0x90 | ch), note, 100});
+                held.insert({ch, note});
+                break;
+            case 1:
+                p.Play({(uint8_t)(0x80 | ch), note, 0});
+                held.erase({ch, note});
+                break;
+            default:
+                if(p.voices.NumActive() > 0)
+                    p.voices.Free(p.voices.Active(next(p.voices.NumActive())));
+                break;
+        }
+        ok = Consistent(p.voices);
+        for(int v = 0; v < 4 && ok; v++)
+        {
+            const Allocator::Voice& voice = p.voices.GetVoice(v);
+            if(voice.state == Allocator::State::HELD)
+                ok = held.count({voice.channel, voice.note}) > 0;
+        }
+    }
+    CHECK(ok);
+}
@@ -73,28 +73,6 @@ void AudioCallback(AudioHandle::InputBuffer  in,
     hw.WriteCvOut(2, osc[5].Process() + 2048.f, true);
 }
 
-void MIDISendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity)
-{
-    uint8_t data[3] = {0};
-
-    data[0] = (channel & 0x0F) + 0x90; // limit channel byte, add status byte
-    data[1] = note & 0x7F;             // remove MSB on data
-    data[2] = velocity & 0x7F;
-
-    hw.midi.SendMessage(data, 3);
-}
-
-void MIDISendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity)
-{
-    uint8_t data[3] = {0};
-
-    data[0] = (channel & 0x0F) + 0x80; // limit channel byte, add status byte
-    data[1] = note & 0x7F;             // remove MSB on data
-    data[2] = velocity & 0x7F;
-
-    hw.midi.SendMessage(data, 3);
-}
-
 int main(void)
 {
     float samplerate = 48000;
@@ -153,7 +131,10 @@ int main(void)
 
     bool sdmmc_pass = fres == FR_OK;
 
-    //hw.midi.StartReceive();
+    /** No QSPI test here: hw.ValidateQSPI(false) erases the whole chip,
+     *  the CV calibration at 0x7F0000 included, and the quick test erases
+     *  16kB at 0x400000. SaveCvCalibration() again after a full test. */
+
     //hw.StartLog(false);
 
     //hw.usb.Init(UsbHandle::UsbPeriph::FS_EXTERNAL);
@@ -161,7 +142,7 @@ int main(void)
     uint32_t now, dact, usbt;
     now = dact = usbt = System::GetNow();
 
-    hw.midi.StartReceive();
+    hw.StartMidiInterrupt();
 
     hw.StartAudio(AudioCallback);
 
@@ -169,16 +150,13 @@ int main(void)
     {
         /* This loop will listen for MIDI and trigger gates for feedback */
         now = System::GetNow();
-        hw.midi.Listen();
-
-        if(hw.midi.HasEvents()) {
-            auto event = hw.midi.PopEvent();
+        TimedMidiEvent timed;
+        if(hw.PopMidiEvent(&timed)) {
+            auto event = timed.event;
 
+            /* 10ms trigger per note, timed by the gate scheduler rather than the loop */
             if(event.type  == MidiMessageType::NoteOn) {
-                dsy_gpio_write(&hw.gate_out_1, 1);
-            }
-            else if(event.type  == MidiMessageType::NoteOff) {
-                dsy_gpio_write(&hw.gate_out_1, 0);
+                hw.TriggerGate(GATE_OUT_1, hw.SampleClock(), 10000);
             }
             /*
             else if(event.type == MidiMessageType::ControlChange) {
@@ -186,9 +164,6 @@ int main(void)
                 hw.WriteCvOut(CV_OUT_2, ((float)e.value / 127.) * 5.f, false);
             }
             */
-        } else {
-            dsy_gpio_write(&hw.gate_out_1, 0);
-            dsy_gpio_write(&hw.gate_out_2, 0);
         }
         hw.Delay(50);
     }
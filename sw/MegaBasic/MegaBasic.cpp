@@ -9,9 +9,15 @@
 
 #include "daisysp.h"
 #include "../../lib/daisy_dpt.h"
+#include "../../lib/util/voice_allocator.h"
 #include "SaucyVoice.h"
+#include "SaucyVoiceBank.h"
 
 #define MAX_VOICES 8
+#define NOTE_VOICES 4 // each note also plays on voice + 4, for the DAC7554
+#define USE_VOICE_BANK 0 // 1 renders all 8 voices together with SaucyVoiceBank, saw and envelope only
+#define BLOCK_SIZE 32
+#define PRINT_LOAD 0 // CPU load and task timings over the USB log, once a second
 
 using namespace daisy;
 using namespace dpt;
@@ -19,9 +25,14 @@ using namespace daisysp;
 
 DPT patch;
 
+#if USE_VOICE_BANK
+SaucyVoiceBank bank;
+#else
 SaucyVoice oscillators[8];
+float voice_buf[BLOCK_SIZE];
+#endif
 
-int currVoice = 0;
+VoiceAllocator<NOTE_VOICES> voices;
 
 uint16_t map(uint16_t x, uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max)
 {
@@ -42,46 +53,165 @@ float mtocv(uint8_t pitch)
     return abs(15.0 - (pitch * voltsPerNote));
 }
 
-void AudioCallback(AudioHandle::InputBuffer  in,
-                   AudioHandle::OutputBuffer out,
-                   size_t                    size)
-{
-    float fade;
-    patch.ProcessAllControls();
-
-    for(int i = 0; i < MAX_VOICES; i++) {
-        oscillators[i].oscillator.SetPW(patch.GetAdcValue(dpt::CV_1));
-        oscillators[i].oscillator.SetWaveshape(patch.GetAdcValue(dpt::CV_2));
-        oscillators[i].zosc.SetShape(patch.GetAdcValue(dpt::CV_1));
-        oscillators[i].zosc.SetFormantFreq(patch.GetAdcValue(dpt::CV_2) * 1000.);
-        oscillators[i].zosc.SetMode(patch.GetAdcValue(dpt::CV_3));
-        oscillators[i].envelope.SetTime(2, abs(patch.GetAdcValue(dpt::CV_2)));
-        oscillators[i].vibratooo.SetAmp(patch.GetAdcValue(dpt::CV_6) * 10.f);
-        oscillators[i].vibratooo.SetFreq(patch.GetAdcValue(dpt::CV_7) * 30.f);
-        fade = patch.GetAdcValue(dpt::CV_8);
-        oscillators[i].SetFade(fade);
-    }
-
-    // rendering these
-    oscillators[4].Process();
-    oscillators[5].Process();
-    oscillators[6].Process();
-    oscillators[7].Process();
-
-    for(size_t i = 0; i < size; i++)
+void TrigVoice(int v, int note, int velocity) {
+#if USE_VOICE_BANK
+    bank.TrigMidi(v, note, velocity);
+    bank.TrigMidi(v + NOTE_VOICES, note, velocity);
+#else
+    oscillators[v].TrigMidi(note, velocity);
+    oscillators[v + NOTE_VOICES].TrigMidi(note, velocity);
+#endif
+}
+
+bool VoiceRunning(int v) {
+#if USE_VOICE_BANK
+    return bank.IsRunning(v);
+#else
+    return oscillators[v].envelope.IsRunning();
+#endif
+}
+
+// renders samples [start, end) of the block, 0+1 left and 2+3 right
+void RenderVoices(AudioHandle::OutputBuffer out, size_t start, size_t end) {
+#if USE_VOICE_BANK
+    float lanes[SaucyVoiceBank::kLanes];
+    for(size_t i = start; i < end; i++)
+    {
+        bank.Process(lanes);
+        out[0][i] = (lanes[0] + lanes[1]) * 0.5f;
+        out[1][i] = (lanes[2] + lanes[3]) * 0.5f;
+    }
+#else
+    size_t n = end - start;
+    if(n == 0)
+        return;
+
+    for(size_t i = start; i < end; i++)
     {
-            out[0][i] = (oscillators[0].Process() + oscillators[1].Process()) * 0.5;
-            out[1][i] = (oscillators[2].Process() + oscillators[3].Process()) * 0.5;
+        out[0][i] = 0.f;
+        out[1][i] = 0.f;
     }
+
+    // only sounding voices
+    for(size_t k = 0; k < voices.NumActive(); k++)
+    {
+        int v = voices.Active(k);
+
+        // DAC7554 voice, only its last value is used
+        oscillators[v + NOTE_VOICES].ProcessBlock(voice_buf, n);
+
+        oscillators[v].ProcessBlock(voice_buf, n);
+        float *dst = out[v / 2] + start;
+        for(size_t i = 0; i < n; i++)
+            dst[i] += voice_buf[i] * 0.5f;
+    }
+#endif
 }
 
-void dac7554handler(void *data) {
+// note events queued by the main loop, applied in the audio callback
+void HandleNote(MidiEvent event) {
+    if(event.type == MidiMessageType::NoteOn) {
+        auto e = event.AsNoteOn();
+        int  v = voices.NoteOn(e.channel, e.note, e.velocity);
+        if(v >= 0)
+            TrigVoice(v, e.note, e.velocity);
+    }
+    else if(event.type == MidiMessageType::NoteOff) {
+        auto e = event.AsNoteOff();
+        voices.NoteOff(e.channel, e.note);
+    }
+}
+
+// Expander CVs, the DAC7554 voices' last samples. They only change once
+// per block, so they go out once per block too, in one SPI transaction.
+void WriteExpander() {
+#if USE_VOICE_BANK
+    patch.WriteCvOutExp(
+        bank.Last(4),
+        bank.Last(5),
+        bank.Last(6),
+        bank.Last(7),
+        false);
+#else
     patch.WriteCvOutExp(
         oscillators[4].last,
         oscillators[5].last,
         oscillators[6].last,
         oscillators[7].last,
         false);
+#endif
+}
+
+void AudioCallback(AudioHandle::InputBuffer  in,
+                   AudioHandle::OutputBuffer out,
+                   size_t                    size)
+{
+#if USE_VOICE_BANK
+    // the bank only has the saw and the envelope, the other CVs do nothing
+    if(patch.ControlChanged(dpt::CV_1))
+        bank.SetPW(patch.GetAdcValue(dpt::CV_1));
+    if(patch.ControlChanged(dpt::CV_2)) {
+        float v = patch.GetAdcValue(dpt::CV_2);
+        bank.SetWaveshape(v);
+        bank.SetDecay(abs(v));
+    }
+#else
+    // only push the settings whose CVs actually moved
+    if(patch.ControlChanged(dpt::CV_1)) {
+        float v = patch.GetAdcValue(dpt::CV_1);
+        for(int i = 0; i < MAX_VOICES; i++) {
+            oscillators[i].oscillator.SetPW(v);
+            oscillators[i].zosc.SetShape(v);
+        }
+    }
+    if(patch.ControlChanged(dpt::CV_2)) {
+        float v = patch.GetAdcValue(dpt::CV_2);
+        for(int i = 0; i < MAX_VOICES; i++) {
+            oscillators[i].oscillator.SetWaveshape(v);
+            oscillators[i].zosc.SetFormantFreq(v * 1000.);
+            oscillators[i].envelope.SetTime(2, abs(v));
+        }
+    }
+    if(patch.ControlChanged(dpt::CV_3)) {
+        float v = patch.GetAdcValue(dpt::CV_3);
+        for(int i = 0; i < MAX_VOICES; i++)
+            oscillators[i].zosc.SetMode(v);
+    }
+    if(patch.ControlChanged(dpt::CV_6)) {
+        float v = patch.GetAdcValue(dpt::CV_6) * 10.f;
+        for(int i = 0; i < MAX_VOICES; i++)
+            oscillators[i].vibratooo.SetAmp(v);
+    }
+    if(patch.ControlChanged(dpt::CV_7)) {
+        float v = patch.GetAdcValue(dpt::CV_7) * 30.f;
+        for(int i = 0; i < MAX_VOICES; i++)
+            oscillators[i].vibratooo.SetFreq(v);
+    }
+    if(patch.ControlChanged(dpt::CV_8)) {
+        float fade = patch.GetAdcValue(dpt::CV_8);
+        for(int i = 0; i < MAX_VOICES; i++)
+            oscillators[i].SetFade(fade);
+    }
+#endif
+
+    // render up to each note event, then apply it on its sample
+    size_t    pos = 0, offset;
+    MidiEvent event;
+    while(patch.NextMidiEvent(&event, &offset)) {
+        RenderVoices(out, pos, offset);
+        pos = offset;
+        HandleNote(event);
+    }
+    RenderVoices(out, pos, size);
+
+    // released voices go back to the pool once their envelope is done
+    for(int v = 0; v < NOTE_VOICES; v++) {
+        if(voices.GetVoice(v).state == VoiceAllocator<NOTE_VOICES>::State::RELEASED
+           && !VoiceRunning(v))
+            voices.Free(v);
+    }
+
+    WriteExpander();
 }
 
 int main(void)
@@ -89,23 +219,44 @@ int main(void)
     float samplerate = 48000;
     patch.Init();
     patch.SetAudioSampleRate(samplerate);
-    patch.SetAudioBlockSize(1); // must be 1 to match main callback
+    patch.SetAudioBlockSize(BLOCK_SIZE); // voices render whole blocks
+    patch.SetControlBank(true); // all 12 CV/ADC filters in one pass
+    patch.SetControlRate(1000.f); // controls at 1kHz, not once per sample
+    patch.SetControlChangeDetection(true); // for ControlChanged()
 
+#if USE_VOICE_BANK
+    bank.Init(samplerate * 2);
+#else
     for(int i = 0; i < 8; i++) {
          oscillators[i].Init(samplerate * 2, i);
     }
+#endif
 
     patch.StartAudio(AudioCallback);
-    patch.InitTimer(dac7554handler, nullptr);
 
-    patch.midi.StartReceive();
+    // TRS and USB input merged, parsed and timestamped as the bytes arrive.
+    // Note echoes go out of the TRS queue in batches, never block.
+    patch.StartMidiRouter();
+
+#if PRINT_LOAD
+    patch.StartLog(false);
+    uint32_t last_print = System::GetNow();
+#endif
 
     while(1)
     {
-        patch.midi.Listen();
+        patch.ProcessMidi();
+
+#if PRINT_LOAD
+        if(System::GetNow() - last_print >= 1000) {
+            last_print = System::GetNow();
+            patch.PrintLoad();
+        }
+#endif
 
-        while(patch.midi.HasEvents()) {
-            auto event = patch.midi.PopEvent();
+        TimedMidiEvent timed;
+        while(patch.PopMidiEvent(&timed)) {
+            auto event = timed.event;
 
             // Basic MIDI -> CV, and forwards note on/off to MIDI
             if(event.type  == MidiMessageType::NoteOn) {
@@ -114,23 +265,21 @@ int main(void)
                 patch.MIDISendNoteOn(e.channel, e.note, e.velocity);
                 patch.WriteCvOut(CV_OUT_1, mtocv(e.note), false);
                 
-                if(e.channel == 0) {
-                    oscillators[currVoice].TrigMidi(e.note, e.velocity);
-                    oscillators[currVoice+4].TrigMidi(e.note, e.velocity);
-                    if(++currVoice == 4) currVoice = 0;
-                }
+                if(e.channel == 0)
+                    patch.QueueMidiEvent(event, timed.time);
             }
             else if(event.type  == MidiMessageType::NoteOff) {
                 auto e = event.AsNoteOff();
                 dsy_gpio_write(&patch.gate_out_1, 0);
                 patch.MIDISendNoteOff(e.channel, e.note, e.velocity);
+                patch.QueueMidiEvent(event, timed.time);
             }
             else if(event.type == MidiMessageType::ControlChange) {
                 auto e = event.AsControlChange();
                 patch.WriteCvOut(CV_OUT_2, ((float)e.value / 127.) * 5.f, false);
             }
         } 
-        patch.Delay(10);
+        patch.Delay(1);
     }
 }
 
@@ -142,7 +291,7 @@ extern "C" void TIM5_IRQHandler(void) {
     //patch.WriteCvOut(1, oscillators[4].Process() * 5.f, false);
     //patch.WriteCvOut(0, oscillators[5].Process() * 5.f, false);
     
-    if(!patch.dac_exp.lock) {
+    if(!patch.dac_exp.IsBusy()) {
         patch.dac_exp.WriteDac7554();
     }
 }
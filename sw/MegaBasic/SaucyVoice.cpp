@@ -57,6 +57,18 @@ float SaucyVoice::Process()
     return last;
 }
 
+void SaucyVoice::ProcessBlock(float *out, size_t n)
+{
+    // f only changes in TrigMidi, so once per block is plenty
+    zosc.SetFreq(f);
+    oscillator.SetFreq(f);
+    for(size_t i = 0; i < n; i++)
+        out[i] = oscillator.Process() * envelope.Process();
+
+    if(n > 0)
+        last = out[n - 1];
+}
+
 void SaucyVoice::Trig()
 {
     envelope.Trigger();
@@ -25,6 +25,11 @@ class SaucyVoice {
 
         float Process();
 
+        /** Renders n samples into out, frequency is only set once per block.
+         *  last holds the final sample for the DAC7554 outputs.
+         */
+        void ProcessBlock(float *out, size_t n);
+
         void Trig();
 
         void TrigMidi(int note, int velocity); 
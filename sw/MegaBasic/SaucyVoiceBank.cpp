@@ -0,0 +1,108 @@
+/*
+ * SaucyVoice, 8 at a time
+ *
+ * 2022 - Joseph Misra
+ */
+
+#include "../../lib/daisy_dpt.h"
+#include "SaucyVoiceBank.h"
+
+using namespace daisy;
+using namespace dpt;
+
+void SaucyVoiceBank::Init(float samplerate)
+{
+    samplerate_ = samplerate;
+
+    for(size_t i = 0; i < kLanes; i++) {
+        phase_[i]   = 0.f;
+        inc_[i]     = 60.f / samplerate;
+        inv_inc_[i] = samplerate / 60.f;
+        env_[i]     = 0.f;
+        amp_[i]     = 1.f;
+        last_[i]    = 0.f;
+        stage_[i]   = IDLE;
+    }
+
+    // same defaults as SaucyVoice::Init
+    SetPW(0.f);
+    SetWaveshape(0.f);
+    SetAttack(0.01);
+    SetDecay(0.64);
+}
+
+void SaucyVoiceBank::SetPW(float pw)
+{
+    // keep both slopes at least a couple of samples long at the top of the range
+    rise_     = dpt::fclamp((pw + 1.f) * 0.5f, 0.02f, 0.98f);
+    inv_rise_ = 1.f / rise_;
+    inv_fall_ = 1.f / (1.f - rise_);
+}
+
+void SaucyVoiceBank::SetWaveshape(float shape)
+{
+    shape_ = dpt::fclamp(shape, 0.f, 1.f);
+}
+
+void SaucyVoiceBank::SetAttack(float seconds)
+{
+    attack_inc_ = 1.f / (dpt::fmax(seconds, 0.001f) * samplerate_);
+}
+
+void SaucyVoiceBank::SetDecay(float seconds)
+{
+    // -60dB over the decay time
+    decay_coef_ = expf(-6.9078f / (dpt::fmax(seconds, 0.001f) * samplerate_));
+}
+
+void SaucyVoiceBank::TrigMidi(size_t lane, int note, int velocity)
+{
+    // mtof, 440Hz at note 69
+    inc_[lane]     = 440.f * dpt::fexp2((note - 69) / 12.f) / samplerate_;
+    inv_inc_[lane] = 1.f / inc_[lane];
+    amp_[lane]     = velocity / 127.f;
+    stage_[lane]   = ATTACK;
+}
+
+void SaucyVoiceBank::Process(float *out)
+{
+    for(size_t i = 0; i < kLanes; i++) {
+        float phase = phase_[i] + inc_[i];
+        phase -= phase >= 1.f ? 1.f : 0.f;
+        phase_[i] = phase;
+
+        // saw with a polyBLEP at the wrap
+        float t   = phase * inv_inc_[i];
+        float u   = (phase - 1.f) * inv_inc_[i];
+        float saw = 2.f * phase - 1.f;
+        saw -= phase < inc_[i] ? t + t - t * t - 1.f
+               : phase > 1.f - inc_[i] ? u * u + u + u + 1.f
+               : 0.f;
+
+        float slope = phase < rise_ ? phase * inv_rise_ : (1.f - phase) * inv_fall_;
+        float osc   = saw + shape_ * (2.f * slope - 1.f - saw);
+
+        // AD envelope, attack is linear, decay exponential
+        float env   = env_[i];
+        int   stage = stage_[i];
+        if(stage == ATTACK) {
+            env += attack_inc_;
+            if(env >= 1.f) {
+                env   = 1.f;
+                stage = DECAY;
+            }
+        }
+        else if(stage == DECAY) {
+            env *= decay_coef_;
+            if(env < 0.0001f) {
+                env   = 0.f;
+                stage = IDLE;
+            }
+        }
+        env_[i]   = env;
+        stage_[i] = stage;
+
+        last_[i] = osc * env * amp_[i];
+        out[i]   = last_[i];
+    }
+}
@@ -0,0 +1,59 @@
+#include "../../lib/daisy_dpt.h"
+
+using namespace daisy;
+using namespace dpt;
+
+/** 8 SaucyVoices rendered together
+ *
+ *  Only the parts of SaucyVoice that reach the output are kept: the
+ *  variable saw times the AD envelope. Phases, increments and envelope
+ *  states for all voices sit next to each other, and Process() renders
+ *  every lane in one loop with no per-voice objects or calls.
+ *  Idle lanes keep running with the envelope at 0, so there is no
+ *  branching on which voices are playing.
+ *  Needs no DaisySP, so the host benchmark can build it on its own.
+ */
+class SaucyVoiceBank {
+    public:
+        static constexpr size_t kLanes = 8;
+
+        void Init(float samplerate);
+
+        /** -1 to 1, the rising part of the slope, like VariableSawOscillator */
+        void SetPW(float pw);
+
+        /** 0 = saw, 1 = variable slope */
+        void SetWaveshape(float shape);
+
+        void SetAttack(float seconds);
+        void SetDecay(float seconds);
+
+        void TrigMidi(size_t lane, int note, int velocity);
+
+        bool IsRunning(size_t lane) { return stage_[lane] != IDLE; }
+
+        /** Renders one sample of every lane into out[kLanes] */
+        void Process(float *out);
+
+        /** Lane's latest output */
+        float Last(size_t lane) { return last_[lane]; }
+
+    private:
+        enum { IDLE, ATTACK, DECAY };
+
+        float samplerate_;
+
+        /** Shared by all lanes */
+        float rise_, inv_rise_, inv_fall_;
+        float shape_;
+        float attack_inc_, decay_coef_;
+
+        /** One entry per lane */
+        float phase_[kLanes];
+        float inc_[kLanes];
+        float inv_inc_[kLanes]; /**< 1 / inc_, for the polyBLEP */
+        float env_[kLanes];
+        float amp_[kLanes];
+        float last_[kLanes];
+        int   stage_[kLanes];
+};
@@ -8,6 +8,7 @@ using namespace dpt;
 
 DPT patch;
 ReverbSc    reverb;
+CurveMapper time_map, damp_map;
 
 void AudioCallback(AudioHandle::InputBuffer  in,
                    AudioHandle::OutputBuffer out,
@@ -17,9 +18,9 @@ void AudioCallback(AudioHandle::InputBuffer  in,
 
     /** Update Params with the four knobs */
     float time_knob = patch.controls[CV_1].Value();
-    float time      = fmap(time_knob, 0.3f, 0.99f, Mapping::LINEAR);
+    float time      = time_map.Process(time_knob);
     float damp_knob = patch.controls[CV_2].Value();
-    float damp      = fmap(damp_knob, 1000.f, 19000.f, Mapping::LOG);
+    float damp      = damp_map.Process(damp_knob);
     float in_level = patch.controls[CV_3].Value();
     float send_level = patch.controls[CV_4].Value();
 
@@ -47,6 +48,8 @@ int main(void)
     patch.Init();
 
     reverb.Init(samplerate);
+    time_map.Init(0.3f, 0.99f, MappingFmap::LINEAR);
+    damp_map.Init(1000.f, 19000.f, MappingFmap::LOG);
     patch.StartAudio(AudioCallback);
 
     while(1) {}
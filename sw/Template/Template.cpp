@@ -76,30 +76,30 @@ int main(void)
 {
     patch.Init();
 
-    // Set up callback for TIM5
-
     patch.StartAudio(AudioCallback);
-    patch.InitTimer(dac7554callback, nullptr);
 
-    // patch.midi.StartReceieve()
+    // Expander CV task at the samplerate, more tasks can share the timer,
+    // e.g. patch.AddTask(led_callback, nullptr, 60.f, TaskPriority::LOW);
+    patch.AddTask(dac7554callback, nullptr, patch.AudioSampleRate());
+
+    // patch.StartMidiInterrupt();
 
     while(1)
     {
         /*
             MIDI processing here
 
-            patch.midi.Listen()
-            first then you can call
-
-            patch.midi.HasEvents()
-            and
-            auto event = patch.midi.PopEvent();
+            TimedMidiEvent timed;
+            while(patch.PopMidiEvent(&timed))
+            {
+                auto event = timed.event;
 
-            and sort that out from there
+                and sort that out from there
 
-            if(event.type == MidiMessageType::NoteOn) {
-                ...
-            };
+                if(event.type == MidiMessageType::NoteOn) {
+                    ...
+                };
+            }
         */
     }
 }
\ No newline at end of file
@@ -135,7 +135,7 @@ int main(void)
         (warble[1]->Process() + 0.5) * 2048,
         (warble[2]->Process() + 0.5) * 2048,
         (warble[3]->Process() + 0.5) * 2048);
-    if(!patch.dac_exp.lock) {
+    if(!patch.dac_exp.IsBusy()) {
         patch.dac_exp.WriteDac7554();
     }
     */